@@ -0,0 +1,306 @@
+// Combo (chord) engine shared by the firmwares and host benchmarks.
+//
+// A combo is a set of matrix positions, stored as a bitmask (bit i = packed
+// matrix position i), and the action it produces while held. Pressing all
+// of its keys within term ms of the first one fires the combo instead of the
+// keys themselves.
+//
+// Only keys that belong to some combo are ever held back. A press of any
+// other key resolves a pending combo on the spot and goes through without
+// delay. A per-key index (position -> combos containing it) seeds the
+// candidate list on the first press; every further press only filters that
+// list, so the cost per event depends on how many combos share a key, not on
+// how many combos exist.
+//
+// Resolution of the held-back keys:
+//   - the candidates narrow down to one combo that is complete -> fire it
+//   - a key outside all remaining candidates is pressed, a held-back key is
+//     released, or term runs out -> fire the candidate that matches the
+//     held-back keys exactly, otherwise let them through as normal keys
+//     (keys already released are reported once, as a tap)
+// A fired combo ends when the first of its keys is released; its other keys
+// stay swallowed until they are released too.
+//
+// The engine is level based to match the firmwares' report builders: feed
+// it the pressed matrix every scan with combo_update() and build the report
+// from combo_output(). combo_press()/combo_release() take single events.
+//
+// Exactly one translation unit must define COMBO_IMPLEMENTATION before
+// including this header. Combo tables are read directly (RAM on AVR).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Positions a mask can hold
+#define COMBO_MAX_POSITIONS 64
+
+// Combos per table, candidate list size
+#ifndef COMBO_MAX_COMBOS
+#    define COMBO_MAX_COMBOS 16
+#endif
+
+// Total keys over all combos (per-key index entries)
+#ifndef COMBO_INDEX_SIZE
+#    define COMBO_INDEX_SIZE (COMBO_MAX_COMBOS * 4)
+#endif
+
+// Combos held at the same time, at most 8
+#ifndef COMBO_MAX_ACTIVE
+#    define COMBO_MAX_ACTIVE 4
+#endif
+
+// Default time to complete a combo, ms
+#ifndef COMBO_TERM
+#    define COMBO_TERM 50
+#endif
+
+typedef uint64_t combo_mask_t;
+
+typedef struct {
+    combo_mask_t keys;   // matrix positions, bit i = position i
+    uint16_t     action; // keycode or command reported while the combo is held
+} combo_t;
+
+typedef struct {
+    const combo_t *combos;
+    uint8_t        count;
+    uint16_t       term;
+    combo_mask_t   members; // union of all combo keys
+
+    // Per-key index: combos containing position p are
+    // index[index_start[p]] .. index[index_start[p + 1] - 1]
+    uint16_t index_start[COMBO_MAX_POSITIONS + 1];
+    uint8_t  index[COMBO_INDEX_SIZE];
+
+    combo_mask_t pressed;       // matrix seen by the last combo_update()
+    combo_mask_t buffered;      // keys held back until resolved
+    combo_mask_t buffered_up;   // held-back keys that were already released
+    uint16_t     buffer_start;  // time of the first held-back press
+    uint8_t      candidates[COMBO_MAX_COMBOS];
+    uint8_t      candidate_count;
+
+    combo_mask_t suppressed;    // keys of fired combos, not reported
+    combo_mask_t taps;          // resolved keys already released, reported once
+    uint8_t      active[COMBO_MAX_ACTIVE];
+    uint8_t      active_count;
+    uint8_t      active_fresh;  // bit per active slot: not reported yet
+    uint8_t      active_ending; // bit per active slot: released, drop after reporting
+} combo_state_t;
+
+// Build the per-key index, false if the table does not fit the limits above
+bool combo_init(combo_state_t *s, const combo_t *combos, uint8_t count, uint16_t term);
+
+// Feed the pressed matrix of one scan: releases, then presses, then term
+void combo_update(combo_state_t *s, combo_mask_t pressed, uint16_t now);
+
+void combo_press(combo_state_t *s, uint8_t pos, uint16_t now);
+void combo_release(combo_state_t *s, uint8_t pos, uint16_t now);
+void combo_task(combo_state_t *s, uint16_t now);
+
+// Keys to report out of pressed, and the actions of the combos being held
+// (up to COMBO_MAX_ACTIVE). Taps and released combos are reported once.
+combo_mask_t combo_output(combo_state_t *s, combo_mask_t pressed, uint16_t *actions, uint8_t *action_count);
+
+#ifdef COMBO_IMPLEMENTATION
+
+bool combo_init(combo_state_t *s, const combo_t *combos, uint8_t count, uint16_t term) {
+    memset(s, 0, sizeof(*s));
+    s->combos = combos;
+    s->term   = term;
+    if (count > COMBO_MAX_COMBOS) {
+        return false;
+    }
+
+    // Counting sort of (position, combo) pairs into the index
+    uint16_t total = 0;
+    for (uint8_t pos = 0; pos < COMBO_MAX_POSITIONS; pos++) {
+        s->index_start[pos] = total;
+        combo_mask_t bit = (combo_mask_t)1 << pos;
+        for (uint8_t id = 0; id < count; id++) {
+            if (combos[id].keys & bit) {
+                if (total == COMBO_INDEX_SIZE) {
+                    return false;
+                }
+                s->index[total++] = id;
+            }
+        }
+        if (s->index_start[pos] != total) {
+            s->members |= bit;
+        }
+    }
+    s->index_start[COMBO_MAX_POSITIONS] = total;
+    s->count = count;
+    return true;
+}
+
+static void combo_clear_buffer(combo_state_t *s) {
+    s->buffered        = 0;
+    s->buffered_up     = 0;
+    s->candidate_count = 0;
+}
+
+static void combo_fire(combo_state_t *s, uint8_t id) {
+    if (s->active_count == COMBO_MAX_ACTIVE) {
+        // No slot left: the keys go through as they are
+        s->taps |= s->buffered_up;
+        combo_clear_buffer(s);
+        return;
+    }
+    uint8_t slot = s->active_count++;
+    s->active[slot] = id;
+    s->active_fresh |= 1 << slot;
+    if (s->buffered_up) {
+        s->active_ending |= 1 << slot;
+    }
+    s->suppressed |= s->buffered & ~s->buffered_up;
+    combo_clear_buffer(s);
+}
+
+// Fire the candidate matching the held-back keys exactly, else let them through
+static void combo_resolve(combo_state_t *s) {
+    for (uint8_t i = 0; i < s->candidate_count; i++) {
+        if (s->combos[s->candidates[i]].keys == s->buffered) {
+            combo_fire(s, s->candidates[i]);
+            return;
+        }
+    }
+    s->taps |= s->buffered_up;
+    combo_clear_buffer(s);
+}
+
+// Fire now if the only way left to go is the complete combo
+static void combo_check_complete(combo_state_t *s) {
+    int16_t complete = -1;
+    for (uint8_t i = 0; i < s->candidate_count; i++) {
+        if (s->combos[s->candidates[i]].keys == s->buffered) {
+            complete = s->candidates[i];
+        } else {
+            return; // a larger candidate may still complete
+        }
+    }
+    if (complete >= 0) {
+        combo_fire(s, (uint8_t)complete);
+    }
+}
+
+void combo_press(combo_state_t *s, uint8_t pos, uint16_t now) {
+    combo_mask_t bit = (combo_mask_t)1 << pos;
+    if (!(s->members & bit)) {
+        if (s->buffered) combo_resolve(s);
+        return;
+    }
+
+    if (s->buffered) {
+        // Keep the candidates containing this key; the list is only
+        // overwritten once something is kept
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < s->candidate_count; i++) {
+            uint8_t id = s->candidates[i];
+            if (s->combos[id].keys & bit) {
+                s->candidates[kept++] = id;
+            }
+        }
+        if (kept) {
+            s->candidate_count = kept;
+            s->buffered |= bit;
+            combo_check_complete(s);
+            return;
+        }
+        combo_resolve(s);
+    }
+
+    uint16_t first = s->index_start[pos];
+    uint16_t last  = s->index_start[pos + 1];
+    s->candidate_count = (uint8_t)(last - first);
+    memcpy(s->candidates, &s->index[first], s->candidate_count);
+    s->buffered     = bit;
+    s->buffer_start = now;
+    combo_check_complete(s);
+}
+
+void combo_release(combo_state_t *s, uint8_t pos, uint16_t now) {
+    combo_mask_t bit = (combo_mask_t)1 << pos;
+    (void)now;
+    if (s->buffered & bit) {
+        s->buffered_up |= bit;
+        combo_resolve(s);
+        return;
+    }
+    if (!(s->suppressed & bit)) {
+        return;
+    }
+    s->suppressed &= ~bit;
+
+    // The first key released ends its combo; one already reported goes now
+    uint8_t kept = 0;
+    uint8_t fresh = 0, ending = 0;
+    for (uint8_t slot = 0; slot < s->active_count; slot++) {
+        uint8_t mask = 1 << slot;
+        bool    mine = s->combos[s->active[slot]].keys & bit;
+        if (mine && !(s->active_fresh & mask)) {
+            continue;
+        }
+        s->active[kept] = s->active[slot];
+        if (s->active_fresh & mask) fresh |= 1 << kept;
+        if (mine || (s->active_ending & mask)) ending |= 1 << kept;
+        kept++;
+    }
+    s->active_count  = kept;
+    s->active_fresh  = fresh;
+    s->active_ending = ending;
+}
+
+void combo_task(combo_state_t *s, uint16_t now) {
+    if (s->buffered && (uint16_t)(now - s->buffer_start) >= s->term) {
+        combo_resolve(s);
+    }
+}
+
+void combo_update(combo_state_t *s, combo_mask_t pressed, uint16_t now) {
+    combo_task(s, now);
+    combo_mask_t changed = pressed ^ s->pressed;
+    s->pressed           = pressed;
+    if (!changed) {
+        return;
+    }
+
+    combo_mask_t released = changed & ~pressed;
+    for (uint8_t pos = 0; released; pos++, released >>= 1) {
+        if (released & 1) combo_release(s, pos, now);
+    }
+    combo_mask_t down = changed & pressed;
+    for (uint8_t pos = 0; down; pos++, down >>= 1) {
+        if (down & 1) combo_press(s, pos, now);
+    }
+}
+
+combo_mask_t combo_output(combo_state_t *s, combo_mask_t pressed, uint16_t *actions, uint8_t *action_count) {
+    combo_mask_t keys = (pressed & ~(s->buffered | s->suppressed)) | s->taps;
+    s->taps           = 0;
+
+    uint8_t kept = 0;
+    for (uint8_t slot = 0; slot < s->active_count; slot++) {
+        actions[slot] = s->combos[s->active[slot]].action;
+        if (!(s->active_ending & (1 << slot))) {
+            s->active[kept++] = s->active[slot];
+        }
+    }
+    *action_count    = s->active_count;
+    s->active_count  = kept;
+    s->active_fresh  = 0;
+    s->active_ending = 0;
+    return keys;
+}
+
+#endif // COMBO_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
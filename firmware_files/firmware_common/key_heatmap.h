@@ -0,0 +1,354 @@
+// Key press heatmap shared by the firmwares: one press counter per key and
+// layer, the raw HID wire format to read them, and a flash log the RP2040
+// builds keep them in across power cycles.
+//
+// Counters are 16 bit, saturating, packed in one array indexed
+// layer * HEATMAP_KEYS + key, with a dirty bit each. heatmap_press() is the
+// only thing on the event path: an add, a compare and an OR. A saturated
+// counter stays at 65535 and stops being written.
+//
+// Raw HID (32 byte packets, like firmware_common/telemetry.h):
+//   request [0] HEATMAP_REPORT_ID, [1] command, [2..3] first counter (LE)
+//   answer  [0] HEATMAP_REPORT_ID, [1] command, [2..3] first counter,
+//           [4] counters in this answer, [5] layers, [6] keys per layer,
+//           [7] 0, [8..31] counters (LE)
+// HEATMAP_CMD_READ answers with the counters from first on, HEATMAP_CMD_CLEAR
+// zeroes them all first.
+//
+// Flash log: HEATMAP_LOG_SECTORS erase sectors used as a ring of pages. A
+// page holds a run of counters (absolute values) with a sequence number and
+// a checksum; replaying the pages in sequence order gives the counters back.
+// heatmap_log_task() does at most one flash operation per call:
+//   - program one page with the next dirty run of counters: the page program
+//     stall (HEATMAP_STALL_BUDGET_MS at most), fine between two scans
+//   - erase one sector: tens of ms up to HEATMAP_ERASE_MAX_MS, more than
+//     any scan can wait, so only when the caller says nothing can be late
+//     (may_erase)
+// A full sector moves on to the next and starts it with a snapshot of all
+// counters, after which the sectors behind hold nothing the log needs.
+// Erases only ever prepare sectors ahead: given may_erase the log erases
+// every old sector it can, up to HEATMAP_LOG_SECTORS - 1, and spends them
+// one by one in between. With none left it stops writing and the counters
+// wait in RAM. Power lost mid-page leaves a page that fails its checksum
+// and is skipped.
+//
+// The includer defines HEATMAP_LAYERS and HEATMAP_KEYS; without them only
+// the wire format is declared (host tools, raw HID dispatch). Exactly one
+// translation unit that uses the log must define HEATMAP_IMPLEMENTATION
+// before including this header.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HEATMAP_REPORT_SIZE 32
+#define HEATMAP_REPORT_ID 0x48 // 'H'
+#define HEATMAP_HEADER_SIZE 8
+#define HEATMAP_COUNTERS_PER_REPORT ((HEATMAP_REPORT_SIZE - HEATMAP_HEADER_SIZE) / 2)
+
+#define HEATMAP_CMD_READ 0x00
+#define HEATMAP_CMD_CLEAR 0x01
+
+static inline uint16_t heatmap_get16(const uint8_t *src) {
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static inline void heatmap_put16(uint8_t *dst, uint16_t value) {
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+#if defined(HEATMAP_LAYERS) && defined(HEATMAP_KEYS)
+
+#define HEATMAP_COUNTERS (HEATMAP_LAYERS * HEATMAP_KEYS)
+#define HEATMAP_MAX_COUNT 0xFFFF
+
+// Flash geometry (RP2040: W25Q16JV behind XIP)
+#ifndef HEATMAP_LOG_PAGE_SIZE
+#    define HEATMAP_LOG_PAGE_SIZE 256
+#endif
+#ifndef HEATMAP_LOG_SECTOR_SIZE
+#    define HEATMAP_LOG_SECTOR_SIZE 4096
+#endif
+#ifndef HEATMAP_LOG_SECTORS
+#    define HEATMAP_LOG_SECTORS 64
+#endif
+
+// Longest flash operation allowed between two scans: a page program, 3 ms
+// worst case in the W25Q16JV datasheet (0.4 ms typical)
+#ifndef HEATMAP_STALL_BUDGET_MS
+#    define HEATMAP_STALL_BUDGET_MS 3
+#endif
+
+// Longest sector erase in the same datasheet (45 ms typical)
+#ifndef HEATMAP_ERASE_MAX_MS
+#    define HEATMAP_ERASE_MAX_MS 400
+#endif
+
+#define HEATMAP_LOG_MAGIC 0x4D48 // "HM"
+#define HEATMAP_LOG_HEADER 8
+#define HEATMAP_LOG_PER_PAGE ((HEATMAP_LOG_PAGE_SIZE - HEATMAP_LOG_HEADER) / 2)
+#define HEATMAP_LOG_PAGES (HEATMAP_LOG_SECTOR_SIZE / HEATMAP_LOG_PAGE_SIZE)
+
+typedef struct {
+    uint16_t count[HEATMAP_COUNTERS];
+    uint8_t  dirty[(HEATMAP_COUNTERS + 7) / 8]; // changed since written to the log
+} heatmap_t;
+
+static inline void heatmap_press(heatmap_t *hm, uint8_t layer, uint8_t key) {
+    uint16_t i = (uint16_t)layer * HEATMAP_KEYS + key;
+    if (i < HEATMAP_COUNTERS && hm->count[i] != HEATMAP_MAX_COUNT) {
+        hm->count[i]++;
+        hm->dirty[i >> 3] |= (uint8_t)(1 << (i & 7));
+    }
+}
+
+static inline void heatmap_clear(heatmap_t *hm) {
+    memset(hm->count, 0, sizeof(hm->count));
+    memset(hm->dirty, 0xFF, sizeof(hm->dirty));
+}
+
+// Answer to a raw HID request, report has HEATMAP_REPORT_SIZE bytes
+static inline void heatmap_answer(heatmap_t *hm, const uint8_t *request, uint8_t *report) {
+    uint16_t first = heatmap_get16(&request[2]);
+    if (request[1] == HEATMAP_CMD_CLEAR) heatmap_clear(hm);
+
+    memset(report, 0, HEATMAP_REPORT_SIZE);
+    uint8_t n = 0;
+    while (n < HEATMAP_COUNTERS_PER_REPORT && first + n < HEATMAP_COUNTERS) {
+        heatmap_put16(&report[HEATMAP_HEADER_SIZE + 2 * n], hm->count[first + n]);
+        n++;
+    }
+    report[0] = HEATMAP_REPORT_ID;
+    report[1] = request[1];
+    heatmap_put16(&report[2], first);
+    report[4] = n;
+    report[5] = HEATMAP_LAYERS;
+    report[6] = HEATMAP_KEYS;
+}
+
+// Flash access of the board. The region is HEATMAP_LOG_SECTORS sectors,
+// readable at base; offsets are from its start.
+typedef struct {
+    const uint8_t *base;
+    void (*program)(uint32_t offset, const uint8_t *page); // one page
+    void (*erase)(uint32_t offset);                        // one sector
+} heatmap_flash_t;
+
+typedef struct {
+    uint8_t  sector;      // sector being appended to
+    uint8_t  page;        // next page in it, HEATMAP_LOG_PAGES when full
+    uint16_t sequence;    // of the next page
+    uint16_t cursor;      // counter to look for dirty ones from
+    uint16_t snapshot;    // next counter of the snapshot being written, HEATMAP_COUNTERS when done
+    uint8_t  erased;      // sectors after this one erased and ready
+} heatmap_log_t;
+
+typedef enum {
+    HEATMAP_LOG_IDLE,       // nothing to do
+    HEATMAP_LOG_PROGRAMMED, // one page written
+    HEATMAP_LOG_ERASED,     // one sector erased
+    HEATMAP_LOG_BLOCKED,    // no erased sector left, waiting for may_erase; counters stay in RAM
+} heatmap_log_result_t;
+
+// Counters from the log; also finds where appending continues
+void heatmap_log_load(heatmap_log_t *log, const heatmap_flash_t *flash, heatmap_t *hm);
+// At most one flash operation, see above
+heatmap_log_result_t heatmap_log_task(heatmap_log_t *log, const heatmap_flash_t *flash, heatmap_t *hm, bool may_erase);
+// Counters still waiting to be written
+uint16_t heatmap_dirty_count(const heatmap_t *hm);
+
+#ifdef HEATMAP_IMPLEMENTATION
+
+#    ifdef __cplusplus
+static_assert(HEATMAP_COUNTERS <= HEATMAP_LOG_PER_PAGE * (HEATMAP_LOG_PAGES - 1), "heatmap snapshot does not fit a log sector");
+static_assert(HEATMAP_LOG_SECTORS >= 2 && HEATMAP_LOG_SECTORS <= 255, "heatmap log needs 2 to 255 sectors");
+#    else
+_Static_assert(HEATMAP_COUNTERS <= HEATMAP_LOG_PER_PAGE * (HEATMAP_LOG_PAGES - 1), "heatmap snapshot does not fit a log sector");
+_Static_assert(HEATMAP_LOG_SECTORS >= 2 && HEATMAP_LOG_SECTORS <= 255, "heatmap log needs 2 to 255 sectors");
+#    endif
+
+static const uint8_t *heatmap_log_page(const heatmap_flash_t *flash, uint8_t sector, uint8_t page) {
+    return flash->base + (uint32_t)sector * HEATMAP_LOG_SECTOR_SIZE + (uint32_t)page * HEATMAP_LOG_PAGE_SIZE;
+}
+
+static uint8_t heatmap_log_checksum(const uint8_t *page) {
+    uint8_t sum = 0;
+    for (uint16_t i = 0; i < HEATMAP_LOG_HEADER + 2 * page[6]; i++) {
+        if (i != 7) sum += page[i];
+    }
+    return sum;
+}
+
+static bool heatmap_log_valid(const uint8_t *page) {
+    return heatmap_get16(&page[0]) == HEATMAP_LOG_MAGIC && page[6] > 0 && page[6] <= HEATMAP_LOG_PER_PAGE &&
+           heatmap_get16(&page[4]) + page[6] <= HEATMAP_COUNTERS && heatmap_log_checksum(page) == page[7];
+}
+
+static bool heatmap_log_blank(const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (data[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+uint16_t heatmap_dirty_count(const heatmap_t *hm) {
+    uint16_t n = 0;
+    for (uint16_t i = 0; i < sizeof(hm->dirty); i++) {
+        for (uint8_t bits = hm->dirty[i]; bits; bits &= bits - 1) n++;
+    }
+    return n;
+}
+
+void heatmap_log_load(heatmap_log_t *log, const heatmap_flash_t *flash, heatmap_t *hm) {
+    memset(hm, 0, sizeof(*hm));
+
+    // Sectors in the order they were written: by the sequence of their first page
+    uint8_t  order[HEATMAP_LOG_SECTORS];
+    uint16_t first_seq[HEATMAP_LOG_SECTORS];
+    uint8_t  used = 0;
+    for (uint8_t s = 0; s < HEATMAP_LOG_SECTORS; s++) {
+        const uint8_t *page = heatmap_log_page(flash, s, 0);
+        if (!heatmap_log_valid(page)) continue;
+        uint8_t at = used++;
+        while (at > 0 && (int16_t)(heatmap_get16(&page[2]) - first_seq[at - 1]) < 0) {
+            order[at]     = order[at - 1];
+            first_seq[at] = first_seq[at - 1];
+            at--;
+        }
+        order[at]     = s;
+        first_seq[at] = heatmap_get16(&page[2]);
+    }
+
+    log->sector   = used ? order[used - 1] : 0;
+    log->page     = 0;
+    log->sequence = 0;
+    log->cursor   = 0;
+    log->snapshot = HEATMAP_COUNTERS;
+
+    // The sector before the newest holds a whole snapshot, so older ones add nothing
+    uint16_t snapshot_end = 0;
+    for (uint8_t o = used > 2 ? used - 2 : 0; o < used; o++) {
+        for (uint8_t p = 0; p < HEATMAP_LOG_PAGES; p++) {
+            const uint8_t *page = heatmap_log_page(flash, order[o], p);
+            if (heatmap_log_blank(page, HEATMAP_LOG_PAGE_SIZE)) break;
+            if (o == used - 1) log->page = p + 1;
+            if (!heatmap_log_valid(page)) continue; // torn by a power cut
+
+            uint16_t first = heatmap_get16(&page[4]);
+            for (uint8_t i = 0; i < page[6]; i++) {
+                hm->count[first + i] = heatmap_get16(&page[HEATMAP_LOG_HEADER + 2 * i]);
+            }
+            log->sequence = heatmap_get16(&page[2]) + 1;
+            if (o == used - 1 && first == snapshot_end && p == snapshot_end / HEATMAP_LOG_PER_PAGE) {
+                snapshot_end += page[6];
+            }
+        }
+    }
+
+    // The sector behind may only be erased once this one holds everything
+    if (used > 1 && snapshot_end < HEATMAP_COUNTERS) {
+        log->snapshot = 0;
+    }
+    log->erased = 0;
+    while (log->erased < HEATMAP_LOG_SECTORS - 1) {
+        uint8_t next = (uint8_t)((log->sector + 1 + log->erased) % HEATMAP_LOG_SECTORS);
+        if (!heatmap_log_blank(heatmap_log_page(flash, next, 0), HEATMAP_LOG_SECTOR_SIZE)) break;
+        log->erased++;
+    }
+}
+
+// Sectors past the erased ones are old, except the one behind this sector
+// until this one holds a whole snapshot
+static bool heatmap_log_can_erase(const heatmap_log_t *log) {
+    return log->erased < HEATMAP_LOG_SECTORS - (log->snapshot < HEATMAP_COUNTERS ? 2 : 1);
+}
+
+static heatmap_log_result_t heatmap_log_erase(heatmap_log_t *log, const heatmap_flash_t *flash) {
+    uint8_t sector = (uint8_t)((log->sector + 1 + log->erased) % HEATMAP_LOG_SECTORS);
+    flash->erase((uint32_t)sector * HEATMAP_LOG_SECTOR_SIZE);
+    log->erased++;
+    return HEATMAP_LOG_ERASED;
+}
+
+// First dirty counter at or after from, wrapping; HEATMAP_COUNTERS if none
+static uint16_t heatmap_next_dirty(const heatmap_t *hm, uint16_t from) {
+    for (uint16_t n = 0; n < HEATMAP_COUNTERS; n++) {
+        uint16_t i = (uint16_t)((from + n) % HEATMAP_COUNTERS);
+        if (hm->dirty[i >> 3] == 0) {
+            n += 7 - (i & 7); // rest of an empty byte
+            continue;
+        }
+        if (hm->dirty[i >> 3] & (1 << (i & 7))) return i;
+    }
+    return HEATMAP_COUNTERS;
+}
+
+heatmap_log_result_t heatmap_log_task(heatmap_log_t *log, const heatmap_flash_t *flash, heatmap_t *hm, bool may_erase) {
+    // Skip pages a power cut left half written
+    while (log->page < HEATMAP_LOG_PAGES && !heatmap_log_blank(heatmap_log_page(flash, log->sector, log->page), HEATMAP_LOG_PAGE_SIZE)) {
+        log->page++;
+    }
+
+    if (log->page == HEATMAP_LOG_PAGES) {
+        if (log->erased == 0) {
+            if (!may_erase || !heatmap_log_can_erase(log)) return HEATMAP_LOG_BLOCKED;
+            return heatmap_log_erase(log, flash);
+        }
+        // Move on; the new sector starts with all counters
+        log->sector   = (uint8_t)((log->sector + 1) % HEATMAP_LOG_SECTORS);
+        log->page     = 0;
+        log->snapshot = 0;
+        log->erased--;
+    }
+
+    uint16_t first;
+    if (log->snapshot < HEATMAP_COUNTERS) {
+        first = log->snapshot;
+    } else {
+        first = heatmap_next_dirty(hm, log->cursor);
+        if (first == HEATMAP_COUNTERS) {
+            // Nothing to write: a good time to get sectors ready
+            if (may_erase && heatmap_log_can_erase(log)) return heatmap_log_erase(log, flash);
+            return HEATMAP_LOG_IDLE;
+        }
+    }
+    uint8_t n = HEATMAP_COUNTERS - first < HEATMAP_LOG_PER_PAGE ? (uint8_t)(HEATMAP_COUNTERS - first) : HEATMAP_LOG_PER_PAGE;
+
+    uint8_t page[HEATMAP_LOG_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    heatmap_put16(&page[0], HEATMAP_LOG_MAGIC);
+    heatmap_put16(&page[2], log->sequence);
+    heatmap_put16(&page[4], first);
+    page[6] = n;
+    for (uint8_t i = 0; i < n; i++) {
+        uint16_t c = first + i;
+        heatmap_put16(&page[HEATMAP_LOG_HEADER + 2 * i], hm->count[c]);
+        hm->dirty[c >> 3] &= (uint8_t)~(1 << (c & 7));
+    }
+    page[7] = heatmap_log_checksum(page);
+
+    flash->program((uint32_t)log->sector * HEATMAP_LOG_SECTOR_SIZE + (uint32_t)log->page * HEATMAP_LOG_PAGE_SIZE, page);
+    log->page++;
+    log->sequence++;
+    if (log->snapshot < HEATMAP_COUNTERS) {
+        log->snapshot += n;
+    } else {
+        log->cursor = (uint16_t)((first + n) % HEATMAP_COUNTERS);
+    }
+    return HEATMAP_LOG_PROGRAMMED;
+}
+
+#endif // HEATMAP_IMPLEMENTATION
+
+#endif // HEATMAP_LAYERS && HEATMAP_KEYS
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,130 @@
+// Text to keyboard reports, for typing strings (macros, snippets) at one
+// report per USB frame instead of a tap per loop pass.
+//
+// The compiler walks the string and yields the shortest report sequence
+// that types it on a host with a US layout, one report per call:
+//   - each report presses exactly one new key, and releases the key before
+//     it in the same report
+//   - the modifiers a character needs change in the report that presses
+//     it; the host applies modifier changes before key presses, so they
+//     never leak onto the key before
+//   - a key typed twice in a row gets a report with the key released in
+//     between, the only extra report
+//   - the last report releases everything
+// "Hello" is S+h, e, l, -, l, o, - (7 reports); a tap per character sends
+// 10 and needs a loop pass for each.
+//
+// Nothing is buffered: send_string_next() produces the next report when the
+// caller has room for it, so the producer never waits on USB. Characters
+// without a key on a US layout (anything outside printable ASCII, tab and
+// newline) are skipped.
+//
+// Exactly one translation unit must define SEND_STRING_IMPLEMENTATION
+// before including this header.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Modifier bits of a report (HID boot keyboard byte 0)
+#define SEND_STRING_MOD_SHIFT 0x02
+
+typedef struct {
+    uint8_t modifiers; // HID modifier bits
+    uint8_t key;       // keyboard page usage, 0 for none
+} send_string_report_t;
+
+typedef struct {
+    const char *text;      // NUL terminated, must stay valid while typing
+    uint16_t    pos;       // next character
+    uint8_t     key;       // key held in the last report
+    uint8_t     modifiers; // modifiers held in the last report
+    bool        active;
+} send_string_t;
+
+// Keyboard page usage typing c, 0 if none; *modifiers gets what it needs held
+uint8_t send_string_usage(char c, uint8_t *modifiers);
+
+void send_string_start(send_string_t *s, const char *text);
+
+// The next report; false once the final release has been produced
+bool send_string_next(send_string_t *s, send_string_report_t *report);
+
+#ifdef SEND_STRING_IMPLEMENTATION
+
+// Printable ASCII from ' ': usage, bit 7 set when shifted
+static const uint8_t send_string_ascii[95] = {
+    0x2C,        0x1E | 0x80, 0x34 | 0x80, 0x20 | 0x80, 0x21 | 0x80, 0x22 | 0x80, 0x24 | 0x80, 0x34,        // space ! " # $ % & '
+    0x26 | 0x80, 0x27 | 0x80, 0x25 | 0x80, 0x2E | 0x80, 0x36,        0x2D,        0x37,        0x38,        // ( ) * + , - . /
+    0x27,        0x1E,        0x1F,        0x20,        0x21,        0x22,        0x23,        0x24,        // 0-7
+    0x25,        0x26,        0x33 | 0x80, 0x33,        0x36 | 0x80, 0x2E,        0x37 | 0x80, 0x38 | 0x80, // 8 9 : ; < = > ?
+    0x1F | 0x80,                                                                                            // @
+    0x04 | 0x80, 0x05 | 0x80, 0x06 | 0x80, 0x07 | 0x80, 0x08 | 0x80, 0x09 | 0x80, 0x0A | 0x80,              // A-G
+    0x0B | 0x80, 0x0C | 0x80, 0x0D | 0x80, 0x0E | 0x80, 0x0F | 0x80, 0x10 | 0x80, 0x11 | 0x80,              // H-N
+    0x12 | 0x80, 0x13 | 0x80, 0x14 | 0x80, 0x15 | 0x80, 0x16 | 0x80, 0x17 | 0x80, 0x18 | 0x80,              // O-U
+    0x19 | 0x80, 0x1A | 0x80, 0x1B | 0x80, 0x1C | 0x80, 0x1D | 0x80,                                        // V-Z
+    0x2F,        0x31,        0x30,        0x23 | 0x80, 0x2D | 0x80, 0x35,                                  // [ \ ] ^ _ `
+    0x04,        0x05,        0x06,        0x07,        0x08,        0x09,        0x0A,                     // a-g
+    0x0B,        0x0C,        0x0D,        0x0E,        0x0F,        0x10,        0x11,                     // h-n
+    0x12,        0x13,        0x14,        0x15,        0x16,        0x17,        0x18,                     // o-u
+    0x19,        0x1A,        0x1B,        0x1C,        0x1D,                                               // v-z
+    0x2F | 0x80, 0x31 | 0x80, 0x30 | 0x80, 0x35 | 0x80,                                                     // { | } ~
+};
+
+uint8_t send_string_usage(char c, uint8_t *modifiers) {
+    *modifiers = 0;
+    if (c == '\n') return 0x28; // Enter
+    if (c == '\t') return 0x2B;
+    if (c < ' ' || c > '~') return 0;
+    uint8_t entry = send_string_ascii[c - ' '];
+    if (entry & 0x80) *modifiers = SEND_STRING_MOD_SHIFT;
+    return entry & 0x7F;
+}
+
+void send_string_start(send_string_t *s, const char *text) {
+    s->text      = text;
+    s->pos       = 0;
+    s->key       = 0;
+    s->modifiers = 0;
+    s->active    = true;
+}
+
+bool send_string_next(send_string_t *s, send_string_report_t *report) {
+    if (!s->active) return false;
+
+    uint8_t key = 0, modifiers = 0;
+    while (s->text[s->pos] && (key = send_string_usage(s->text[s->pos], &modifiers)) == 0) {
+        s->pos++;
+    }
+
+    if (key == 0) {
+        // End of the text: release what is held, then stop
+        if (s->key == 0 && s->modifiers == 0) {
+            s->active = false;
+            return false;
+        }
+        modifiers = 0;
+    } else if (key == s->key) {
+        // Same key again: release it first, already with the new modifiers
+        key = 0;
+    } else {
+        s->pos++;
+    }
+
+    report->modifiers = modifiers;
+    report->key       = key;
+    s->key            = key;
+    s->modifiers      = modifiers;
+    return true;
+}
+
+#endif // SEND_STRING_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,189 @@
+// Hot-path stage profiler shared by the QMK build, the handwritten firmware
+// and host simulations.
+//
+// Define STAGE_PROFILE_ENABLE to turn it on; without it every macro below
+// expands to nothing, so instrumented code costs nothing. Exactly one
+// translation unit must define STAGE_PROFILE_IMPLEMENTATION before including
+// this header to provide the storage.
+//
+// Time source, picked at compile time:
+//   host (STAGE_PROFILE_HOST) - std::chrono::steady_clock, ns
+//   AVR                        - micros(), us
+//   Cortex-M (RP2040)          - SysTick current value, CPU cycles
+//
+// Each stage keeps count, min/avg/max and a log2 histogram: bucket b holds
+// durations in [2^(b-1), 2^b) ticks, bucket 0 holds zero.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    // QMK matrix_scan_custom() and the debounce after it
+    PROFILE_SCAN_ROWS,
+    PROFILE_SCAN_COLS,
+    PROFILE_ENCODER,
+    PROFILE_GHOSTING,
+    PROFILE_DEBOUNCE,
+    // Handwritten loop()
+    PROFILE_SCAN,
+    PROFILE_I2C,
+    PROFILE_PROCESS,
+    PROFILE_REPORT,
+    PROFILE_STAGE_COUNT
+} profile_stage_t;
+
+#define PROFILE_HIST_BUCKETS 16
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t hist[PROFILE_HIST_BUCKETS];
+} profile_stats_t;
+
+#ifdef STAGE_PROFILE_ENABLE
+
+#    if defined(STAGE_PROFILE_HOST)
+#        define STAGE_PROFILE_UNIT "ns"
+uint32_t stage_profile_host_now(void);
+static inline uint32_t stage_profile_now(void) {
+    return stage_profile_host_now();
+}
+static inline uint32_t stage_profile_elapsed(uint32_t start, uint32_t end) {
+    return end - start;
+}
+static inline void stage_profile_clock_init(void) {}
+
+#    elif defined(__AVR__)
+#        define STAGE_PROFILE_UNIT "us"
+unsigned long micros(void);
+static inline uint32_t stage_profile_now(void) {
+    return micros();
+}
+static inline uint32_t stage_profile_elapsed(uint32_t start, uint32_t end) {
+    return end - start;
+}
+static inline void stage_profile_clock_init(void) {}
+
+#    elif defined(__arm__)
+#        define STAGE_PROFILE_UNIT "cycles"
+// SysTick is a 24-bit down counter clocked from the CPU. It is started
+// free-running unless the OS already owns it, in which case its reload
+// value is used as the wrap modulus.
+#        define PROFILE_SYST_CSR (*(volatile uint32_t *)0xE000E010)
+#        define PROFILE_SYST_RVR (*(volatile uint32_t *)0xE000E014)
+#        define PROFILE_SYST_CVR (*(volatile uint32_t *)0xE000E018)
+extern uint32_t stage_profile_systick_span;
+static inline uint32_t stage_profile_now(void) {
+    return PROFILE_SYST_CVR;
+}
+static inline uint32_t stage_profile_elapsed(uint32_t start, uint32_t end) {
+    return start >= end ? start - end : start + stage_profile_systick_span - end;
+}
+static inline void stage_profile_clock_init(void) {
+    if (!(PROFILE_SYST_CSR & 1)) {
+        PROFILE_SYST_RVR = 0xFFFFFF;
+        PROFILE_SYST_CVR = 0;
+        PROFILE_SYST_CSR = 0x5; // enable, processor clock, no interrupt
+    }
+    stage_profile_systick_span = PROFILE_SYST_RVR + 1;
+}
+
+#    else
+#        error "stage_profile: no time source for this target"
+#    endif
+
+extern profile_stats_t stage_profile[PROFILE_STAGE_COUNT];
+extern uint32_t        stage_profile_marks[PROFILE_STAGE_COUNT];
+
+static inline uint8_t stage_profile_bucket(uint32_t ticks) {
+    uint8_t bucket = 0;
+    while (ticks && bucket < PROFILE_HIST_BUCKETS - 1) {
+        ticks >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static inline void stage_profile_record(profile_stage_t stage, uint32_t ticks) {
+    profile_stats_t *s = &stage_profile[stage];
+    if (s->count == 0 || ticks < s->min) s->min = ticks;
+    if (ticks > s->max) s->max = ticks;
+    s->count++;
+    s->total += ticks;
+    s->hist[stage_profile_bucket(ticks)]++;
+}
+
+void        stage_profile_init(void);
+void        stage_profile_reset(void);
+const char *stage_profile_name(profile_stage_t stage);
+// Format one stage as a console line, returns false if it has no samples
+bool stage_profile_format(profile_stage_t stage, char *buf, uint16_t len);
+
+// Time a block inside one function
+#    define PROFILE_BEGIN(stage) uint32_t profile_start_##stage = stage_profile_now()
+#    define PROFILE_END(stage) stage_profile_record((stage), stage_profile_elapsed(profile_start_##stage, stage_profile_now()))
+// Time a stage that starts and ends in different functions
+#    define PROFILE_MARK(stage) (stage_profile_marks[(stage)] = stage_profile_now())
+#    define PROFILE_MARK_END(stage) stage_profile_record((stage), stage_profile_elapsed(stage_profile_marks[(stage)], stage_profile_now()))
+
+#else
+
+#    define PROFILE_BEGIN(stage)
+#    define PROFILE_END(stage)
+#    define PROFILE_MARK(stage)
+#    define PROFILE_MARK_END(stage)
+
+#endif // STAGE_PROFILE_ENABLE
+
+#if defined(STAGE_PROFILE_ENABLE) && defined(STAGE_PROFILE_IMPLEMENTATION)
+
+#    include <stdio.h>
+#    include <string.h>
+
+profile_stats_t stage_profile[PROFILE_STAGE_COUNT];
+uint32_t        stage_profile_marks[PROFILE_STAGE_COUNT];
+#    if defined(__arm__) && !defined(STAGE_PROFILE_HOST)
+uint32_t stage_profile_systick_span = 0x1000000;
+#    endif
+
+static const char *const stage_profile_names[PROFILE_STAGE_COUNT] = {
+    "scan_rows", "scan_cols", "encoder", "ghosting", "debounce", "scan", "i2c", "process", "report",
+};
+
+void stage_profile_init(void) {
+    stage_profile_clock_init();
+    stage_profile_reset();
+}
+
+void stage_profile_reset(void) {
+    memset(stage_profile, 0, sizeof(stage_profile));
+}
+
+const char *stage_profile_name(profile_stage_t stage) {
+    return stage < PROFILE_STAGE_COUNT ? stage_profile_names[stage] : "?";
+}
+
+bool stage_profile_format(profile_stage_t stage, char *buf, uint16_t len) {
+    const profile_stats_t *s = &stage_profile[stage];
+    if (s->count == 0) return false;
+
+    int n = snprintf(buf, len, "%-9s n=%lu min=%lu avg=%lu max=%lu %s |", stage_profile_name(stage), (unsigned long)s->count, (unsigned long)s->min, (unsigned long)(s->total / s->count), (unsigned long)s->max, STAGE_PROFILE_UNIT);
+    for (uint8_t b = 0; b < PROFILE_HIST_BUCKETS && n > 0 && n < len; b++) {
+        n += snprintf(buf + n, len - n, " %lu", (unsigned long)s->hist[b]);
+    }
+    return true;
+}
+
+#endif // STAGE_PROFILE_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
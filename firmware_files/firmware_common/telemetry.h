@@ -0,0 +1,65 @@
+// Matrix event telemetry over raw HID: wire format shared by the firmware
+// and the host analyzer (firmware_host/tools/telemetry_analyze.cpp).
+//
+// Every telemetry report is one 32 byte raw HID packet:
+//   [0]     TELEMETRY_REPORT_ID
+//   [1]     sequence number, +1 per report
+//   [2]     number of records in this report (0..TELEMETRY_RECORDS_PER_REPORT)
+//   [3]     records dropped since the previous report (saturates at 255)
+//   [4..31] records, TELEMETRY_RECORD_SIZE bytes each
+//
+// A record is: timestamp in microseconds (32 bit, little endian, wraps
+// after ~71 minutes), matrix row, matrix column and flags. Most records are
+// matrix edges; a TELEMETRY_HID_REPORT record marks a changed keyboard
+// report handed to USB, with the row and column of the key whose
+// processing sent it.
+//
+// The host starts and stops the stream by sending a raw HID packet with
+// [0] = TELEMETRY_REPORT_ID and [1] = TELEMETRY_CMD_START / TELEMETRY_CMD_STOP.
+// TELEMETRY_CMD_START_TRACE also streams the unfiltered scan edges, for
+// recording replayable traces (firmware_host/tools/trace_tool).
+
+#pragma once
+
+#include <stdint.h>
+
+#define TELEMETRY_REPORT_SIZE 32
+#define TELEMETRY_REPORT_ID 0x54 // 'T'
+#define TELEMETRY_HEADER_SIZE 4
+#define TELEMETRY_RECORD_SIZE 7
+#define TELEMETRY_RECORDS_PER_REPORT ((TELEMETRY_REPORT_SIZE - TELEMETRY_HEADER_SIZE) / TELEMETRY_RECORD_SIZE)
+
+#define TELEMETRY_CMD_STOP 0x00
+#define TELEMETRY_CMD_START 0x01
+#define TELEMETRY_CMD_START_TRACE 0x02
+
+// Record flags
+#define TELEMETRY_PRESSED 0x01   // key went down (else up)
+#define TELEMETRY_DEBOUNCED 0x02 // edge after debounce (else raw scan edge)
+#define TELEMETRY_LEFT_HALF 0x04 // key belongs to the left half
+#define TELEMETRY_UNFILTERED 0x08 // raw edge before the encoder and ghosting fixes
+#define TELEMETRY_HID_REPORT 0x10 // keyboard report sent for this key's event (PRESSED: its press)
+
+typedef struct {
+    uint32_t time_us;
+    uint8_t  row;
+    uint8_t  col;
+    uint8_t  flags;
+} telemetry_record_t;
+
+static inline void telemetry_pack(uint8_t *dst, const telemetry_record_t *rec) {
+    dst[0] = rec->time_us;
+    dst[1] = rec->time_us >> 8;
+    dst[2] = rec->time_us >> 16;
+    dst[3] = rec->time_us >> 24;
+    dst[4] = rec->row;
+    dst[5] = rec->col;
+    dst[6] = rec->flags;
+}
+
+static inline void telemetry_unpack(telemetry_record_t *rec, const uint8_t *src) {
+    rec->time_us = (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+    rec->row     = src[4];
+    rec->col     = src[5];
+    rec->flags   = src[6];
+}
@@ -0,0 +1,241 @@
+/*
+  Keyboard reports queued by the loop, committed at USB start-of-frame
+
+  Writing a report whenever the loop runs lands it at a random point of
+  the poll interval, and a report written while the endpoint still holds
+  an untaken one replaces it: a tap between two polls never reaches the
+  host. Here the loop pushes every report change into a short queue, and
+  the start-of-frame handler hands the endpoint one report per frame, just
+  before the host's poll in that frame.
+
+  Reports that pile up between two frames are coalesced, but only where
+  the host can't tell: a run of reports each able to replace the one before
+  goes out as its last. push() adds a report to the run of the report
+  before when, from the report before the run to the new one,
+    - no key changes twice (a tap, or a release and press again), and
+    - the merge doesn't reorder what the host would type: hid-input
+      reports modifier changes first, then releases, then presses in
+      slot order, so a run that presses a key can't take a later
+      modifier change or another press.
+  Anything else queues behind. A full queue refuses the report, so the
+  core asks the board for room before a change (hidCanTake()) and, when
+  the queue can't take all of it, keeps the change for its next pass
+  instead of waiting; nothing is dropped.
+
+  Each slot holds the sequence number its run starts at, and take() only
+  merges a run that starts at its tail. The start of frame can take the
+  report before while push() is still deciding; the new report then
+  continues a run the host has partly seen, and it goes out unmerged
+  instead of being merged against a report the host never got.
+
+  Reports are the core's six usages, modifiers as 0xE0-0xE7 usages.
+  push() belongs to the main loop, take() to the start-of-frame handler;
+  each field has one writer, so neither side locks (see split_link.h for
+  the barrier).
+
+  HidUsageQueue does the same for the consumer and system control reports
+  on the same endpoint, without coalescing: each is a single usage, and a
+  tap's press and release both have to reach the host.
+
+  HidRawQueue carries vendor reports (keymap_live.h) whole and in order,
+  both ways: requests from the USB stack's callback to the loop, answers
+  from the loop to the start-of-frame handler.
+
+  Must stay C++11 (see keyboard_core.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Reports waiting for a frame, a power of two
+#define HID_QUEUE_SIZE 8
+
+static_assert((HID_QUEUE_SIZE & (HID_QUEUE_SIZE - 1)) == 0, "HID_QUEUE_SIZE must be a power of two");
+
+// Host stress tests define their own, to also hand the CPU to the other
+// thread where the two sides meet
+#ifndef HID_QUEUE_BARRIER
+#if defined(__AVR__)
+#define HID_QUEUE_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define HID_QUEUE_BARRIER() __sync_synchronize()
+#endif
+#endif
+
+struct HidReportQueue {
+  uint8_t reports[HID_QUEUE_SIZE][6];
+  uint8_t runs[HID_QUEUE_SIZE];  // sequence number the slot's run starts at
+  volatile uint8_t head;         // next slot, push()
+  volatile uint8_t tail;         // next report to go out, take()
+  uint8_t last[6];               // last report pushed, push()
+  uint8_t base[6];               // report before the run last belongs to, push()
+  uint8_t run;                   // sequence number that run starts at, push()
+
+  void reset() {
+    memset(reports, 0, sizeof(reports));
+    memset(runs, 0, sizeof(runs));
+    head = 0;
+    tail = 0;
+    memset(last, 0, sizeof(last));
+    memset(base, 0, sizeof(base));
+    run = 0;
+  }
+
+  uint8_t depth() const { return (uint8_t)(head - tail); }
+
+  // Main loop: queue a report; false when the queue is full
+  bool push(const uint8_t *keys) {
+    if (memcmp(keys, last, 6) == 0) {
+      return true;
+    }
+    uint8_t h = head;
+    uint8_t queued = (uint8_t)(h - tail);
+    if (queued == HID_QUEUE_SIZE) {
+      return false;
+    }
+    HID_QUEUE_BARRIER();  // the slot is free before it is written
+
+    // Once the report before has gone out, nothing is left to replace. It
+    // can still go out from here on; take() then sees a run it can't merge.
+    if (queued == 0 || !canReplace(base, last, keys)) {
+      memcpy(base, last, 6);
+      run = h;
+    }
+    memcpy(reports[h % HID_QUEUE_SIZE], keys, 6);
+    runs[h % HID_QUEUE_SIZE] = run;
+    memcpy(last, keys, 6);
+    HID_QUEUE_BARRIER();
+    head = h + 1;
+    return true;
+  }
+
+  // Start of frame: the report for the endpoint, false when none is waiting
+  bool take(uint8_t *keys) {
+    const uint8_t first = tail;
+    uint8_t h = head;
+    if (first == h) {
+      return false;
+    }
+    HID_QUEUE_BARRIER();  // slots up to head are read after head
+
+    // The host has the report before first: only a run starting there merges
+    uint8_t t = first;
+    while ((uint8_t)(t + 1) != h && runs[(uint8_t)(t + 1) % HID_QUEUE_SIZE] == first) {
+      t++;
+    }
+    memcpy(keys, reports[t % HID_QUEUE_SIZE], 6);
+    HID_QUEUE_BARRIER();
+    tail = t + 1;
+    return true;
+  }
+
+  static bool isModifier(uint8_t usage) { return usage >= 0xE0 && usage <= 0xE7; }
+
+  static bool holds(const uint8_t *keys, uint8_t usage) { return memchr(keys, usage, 6) != 0; }
+
+  // Can going a -> c in one report stand for a -> b -> c?
+  static bool canReplace(const uint8_t *a, const uint8_t *b, const uint8_t *c) {
+    bool firstPresses = false;   // a -> b presses a key
+    bool secondOrders = false;   // b -> c presses a key or changes a modifier
+    const uint8_t *reports[3] = {a, b, c};
+    for (uint8_t r = 0; r < 3; r++) {
+      for (uint8_t i = 0; i < 6; i++) {
+        uint8_t usage = reports[r][i];
+        if (usage == 0) {
+          continue;
+        }
+        bool inA = holds(a, usage), inB = holds(b, usage), inC = holds(c, usage);
+        if (inA != inB && inB != inC) {
+          return false;
+        }
+        if (!isModifier(usage) && !inA && inB) {
+          firstPresses = true;
+        }
+        if (inB != inC && (isModifier(usage) || inC)) {
+          secondOrders = true;
+        }
+      }
+    }
+    return !(firstPresses && secondOrders);
+  }
+};
+
+// Consumer and system control reports waiting for a frame: report ID and
+// usage, in order, never merged
+struct HidUsageQueue {
+  uint8_t ids[HID_QUEUE_SIZE];
+  uint16_t usages[HID_QUEUE_SIZE];
+  volatile uint8_t head;  // push()
+  volatile uint8_t tail;  // take()
+
+  void reset() {
+    head = 0;
+    tail = 0;
+  }
+
+  uint8_t depth() const { return (uint8_t)(head - tail); }
+
+  // Main loop: false when the queue is full
+  bool push(uint8_t id, uint16_t usage) {
+    uint8_t h = head;
+    if ((uint8_t)(h - tail) == HID_QUEUE_SIZE) {
+      return false;
+    }
+    ids[h % HID_QUEUE_SIZE] = id;
+    usages[h % HID_QUEUE_SIZE] = usage;
+    HID_QUEUE_BARRIER();
+    head = h + 1;
+    return true;
+  }
+
+  // Start of frame: false when none is waiting
+  bool take(uint8_t &id, uint16_t &usage) {
+    uint8_t t = tail;
+    if (t == head) {
+      return false;
+    }
+    id = ids[t % HID_QUEUE_SIZE];
+    usage = usages[t % HID_QUEUE_SIZE];
+    HID_QUEUE_BARRIER();
+    tail = t + 1;
+    return true;
+  }
+};
+
+// Vendor reports of Size bytes, in order, never merged
+template <uint8_t Size> struct HidRawQueue {
+  uint8_t reports[HID_QUEUE_SIZE][Size];
+  volatile uint8_t head;  // push()
+  volatile uint8_t tail;  // take()
+
+  void reset() {
+    head = 0;
+    tail = 0;
+  }
+
+  // False when the queue is full
+  bool push(const uint8_t *report) {
+    uint8_t h = head;
+    if ((uint8_t)(h - tail) == HID_QUEUE_SIZE) {
+      return false;
+    }
+    memcpy(reports[h % HID_QUEUE_SIZE], report, Size);
+    HID_QUEUE_BARRIER();
+    head = h + 1;
+    return true;
+  }
+
+  // False when none is waiting
+  bool take(uint8_t *report) {
+    uint8_t t = tail;
+    if (t == head) {
+      return false;
+    }
+    memcpy(report, reports[t % HID_QUEUE_SIZE], Size);
+    HID_QUEUE_BARRIER();
+    tail = t + 1;
+    return true;
+  }
+};
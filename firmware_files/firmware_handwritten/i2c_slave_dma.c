@@ -0,0 +1,102 @@
+/*
+  DMA-fed I2C slave for the left half of the RP2040 Zero build
+
+  See i2c_slave_dma.h for the overview.
+
+  Licensed under the MIT License
+*/
+
+#if defined(ARDUINO_ARCH_RP2040)
+
+#include "i2c_slave_dma.h"
+
+#include <stdbool.h>
+
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+
+// GPIO4/5 are I2C0; the left half never starts Wire, so it is ours
+static i2c_inst_t *const slaveI2c = i2c0;
+static int slaveDmaChannel = -1;
+static void (*slaveOnRequest)(void);
+
+// DATA_CMD words: the byte in bits 0-7, CMD/STOP/RESTART clear. 16-bit DMA
+// writes are replicated into the upper half of the register, which is
+// reserved, so a byte write (replicated into CMD) can't be used.
+static uint16_t txWords[I2C_SLAVE_DMA_MAX];
+
+// This read has been answered; another RD_REQ before STOP means the master
+// reads past the end
+static bool answered = false;
+
+static void i2cSlaveIrq(void) {
+  i2c_hw_t *hw = i2c_get_hw(slaveI2c);
+  uint32_t status = hw->intr_stat;
+
+  if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+    // Master NACKed early, the controller flushed the FIFO: stop feeding it
+    dma_channel_abort(slaveDmaChannel);
+    (void)hw->clr_tx_abrt;
+  }
+  if (status & I2C_IC_INTR_STAT_R_STOP_DET_BITS) {
+    (void)hw->clr_stop_det;
+    answered = false;
+  }
+  if (status & I2C_IC_INTR_STAT_R_RD_REQ_BITS) {
+    if (!answered) {
+      answered = true;
+      slaveOnRequest();
+    } else {
+      hw->data_cmd = 0xFF;
+    }
+    (void)hw->clr_rd_req;
+  }
+}
+
+void i2cSlaveDmaInit(uint8_t sdaPin, uint8_t sclPin, uint8_t address, void (*onRequest)(void)) {
+  slaveOnRequest = onRequest;
+
+  i2c_init(slaveI2c, 400 * 1000);
+  i2c_set_slave_mode(slaveI2c, true, address);
+  gpio_set_function(sdaPin, GPIO_FUNC_I2C);
+  gpio_set_function(sclPin, GPIO_FUNC_I2C);
+  gpio_pull_up(sdaPin);
+  gpio_pull_up(sclPin);
+
+  // One DATA_CMD word per byte, paced by the TX FIFO (refilled at half empty)
+  i2c_hw_t *hw = i2c_get_hw(slaveI2c);
+  slaveDmaChannel = dma_claim_unused_channel(true);
+  dma_channel_config dc = dma_channel_get_default_config(slaveDmaChannel);
+  channel_config_set_transfer_data_size(&dc, DMA_SIZE_16);
+  channel_config_set_read_increment(&dc, true);
+  channel_config_set_write_increment(&dc, false);
+  channel_config_set_dreq(&dc, i2c_get_dreq(slaveI2c, true));
+  dma_channel_configure(slaveDmaChannel, &dc, &hw->data_cmd, txWords, 0, false);
+  hw->dma_tdlr = 8;
+  hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS;
+
+  hw->intr_mask = I2C_IC_INTR_MASK_M_RD_REQ_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS | I2C_IC_INTR_MASK_M_STOP_DET_BITS;
+  irq_set_exclusive_handler(I2C0_IRQ, i2cSlaveIrq);
+  irq_set_enabled(I2C0_IRQ, true);
+}
+
+void i2cSlaveDmaSend(const uint8_t *data, uint8_t len) {
+  if (len > I2C_SLAVE_DMA_MAX) {
+    len = I2C_SLAVE_DMA_MAX;
+  }
+
+  // A previous answer the master cut short
+  if (dma_channel_is_busy(slaveDmaChannel)) {
+    dma_channel_abort(slaveDmaChannel);
+  }
+
+  // Fixed length, so the time spent here doesn't depend on the keys
+  for (uint8_t i = 0; i < len; i++) {
+    txWords[i] = data[i];
+  }
+  dma_channel_transfer_from_buffer_now(slaveDmaChannel, txWords, len);
+}
+
+#endif // ARDUINO_ARCH_RP2040
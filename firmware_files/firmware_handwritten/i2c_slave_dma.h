@@ -0,0 +1,33 @@
+/*
+  DMA-fed I2C slave for the left half of the RP2040 Zero build
+
+  The right half reads the left half's key state as I2C master. With the
+  Wire library the answer is written into the TX FIFO byte by byte from the
+  request callback while the master's clock is stretched. Here the request
+  interrupt only copies the answer the scan loop already built (see
+  split_link.h) into a word buffer and starts a DMA channel paced by the
+  I2C TX DREQ, so the stretch is a fixed, short time whatever the loop is
+  doing. A master reading past the end gets 0xFF; one that stops early
+  makes the controller flush the FIFO and the transfer is aborted.
+
+  Licensed under the MIT License
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Longest answer, matches SPLIT_ANSWER_MAX
+#define I2C_SLAVE_DMA_MAX 32
+
+// Slave on I2C0; onRequest runs in the interrupt and must call i2cSlaveDmaSend()
+void i2cSlaveDmaInit(uint8_t sdaPin, uint8_t sclPin, uint8_t address, void (*onRequest)(void));
+void i2cSlaveDmaSend(const uint8_t *data, uint8_t len);
+
+#ifdef __cplusplus
+}
+#endif
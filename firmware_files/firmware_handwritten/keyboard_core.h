@@ -0,0 +1,1171 @@
+/*
+  Shared scan/report core for the handwritten split keyboard firmware
+
+  Both sketches (Arduino Nano and RP2040 Zero) and the host simulator
+  instantiate KeyboardCore with a board traits type. Everything board
+  specific lives in the traits:
+
+    typedef PinList<...> RowPins;              // driven LOW one at a time
+    typedef PinList<...> ColPins;              // read with pull-ups
+    static const uint8_t sidePin;              // HIGH for right side
+    static const uint8_t i2cAddress;           // left side I2C slave address
+    template <uint8_t Pin> static void writePin(bool high);
+    template <uint8_t Pin> static bool readPin();
+    static uint32_t readColumns();             // bit i set when column i reads LOW
+    static void pinOutput(uint8_t pin);
+    static void pinInputPullup(uint8_t pin);
+    static void settle();                      // row settle time before reading
+    static void sideSettle();                  // side select pull-up settle time
+    static uint32_t millis();
+    static void init();                        // first thing in setup()
+    static void begin(bool rightSide, void (*onRequest)());  // I2C, HID, Serial; never waits
+    static uint8_t requestOtherHalf(uint8_t *data, uint8_t len);
+    static void sendToMaster(const uint8_t *data, uint8_t len);  // copies before returning
+    static bool hostReady();                   // USB configured by the host (right side)
+    static bool hidSingleReport();             // each change as one hidSend() instead of releaseAll()+press()
+    static void hidReleaseAll();
+    static void hidPress(uint8_t keycode);
+    static void hidSend(const uint8_t *keys);  // one report holding these six keys
+    static uint8_t hidRoom();                  // reports hidSend() takes now without waiting
+    static bool hidCanTake(uint8_t keyboard, uint8_t usages);  // that many keyboard and consumer/system reports go out, none refused
+    static void hidConsumer(uint16_t usage);   // consumer control report, 0 when released
+    static void hidSystem(uint8_t usage);      // system control report (0x81-0x83), 0 when released
+    static void keyEvent(uint8_t position, bool pressed, uint32_t timeMs);  // merged stream, right side
+    static void statusChanged(uint8_t state, uint8_t layer);
+    static void logLine(const char *line);
+    static void task();                        // once per loop, after scanning
+    static void idle();                        // while waiting for the next scan
+
+  With HEATMAP_ENABLE the right half counts presses per key and layer
+  (firmware_common/key_heatmap.h) and logs them to flash in the wait for
+  the next scan, one operation at a time: page programs when they can't
+  make that scan late, sector erases only in a gap in the typing (see
+  heatmapTask()); boards then also provide
+
+    static const uint8_t *heatmapFlash();      // log region, readable
+    static void heatmapProgram(uint32_t offset, const uint8_t *page);
+    static void heatmapErase(uint32_t offset);
+    static bool hostSuspended();               // the host suspended the USB bus
+
+  With KEYMAP_LIVE_ENABLE the right half resolves keycodes, macros and
+  settings from a keymap image the host can replace over raw HID
+  (keymap_live.h), swapped in at the start of a loop pass; boards then
+  also provide
+
+    static bool rawHidReceive(uint8_t *report);  // next vendor report from the host, false if none
+    static void rawHidSend(const uint8_t *report);   // queue a vendor report for the host
+
+  Pins are template arguments, so the row loop unrolls and every pin access
+  folds to the board's port access instead of a runtime table lookup.
+  Boards without a faster way to read all columns at once can implement
+  readColumns() as PinOps<Board, ColPins>::readLow().
+
+  setup() waits for nothing: scanning and the split link run from the first
+  loop, USB enumeration and the serial port come up on their own, and the
+  report goes out once hostReady() says the host can take it.
+
+  Must stay C++11: the Nano core builds with -std=gnu++11.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../firmware_common/stage_profile.h"
+
+// Timestamped key events from the left half, merged in order on the right
+#include "split_link.h"
+
+// Timing
+#define SCAN_INTERVAL 10      // ms between key scans
+#define DEBOUNCE_TIME 20      // ms for debounce
+
+// Special keys and commands
+#define CMD_LAYER_CHANGE 0xF0
+#define CMD_MACRO_RECORD 0xF1
+#define CMD_MACRO_PLAY   0xF2
+#define CMD_PROGRAM_MODE 0xF3
+
+// Media and system keys without a keyboard page usage, in the reserved
+// 0xA5-0xAE range where QMK keeps its own. They and KEY_MUTE,
+// KEY_VOLUME_UP, KEY_VOLUME_DOWN go out in the consumer and system control
+// reports instead of the six key slots.
+#define SYS_POWER        0xA5
+#define SYS_SLEEP        0xA6
+#define SYS_WAKE         0xA7
+#define MEDIA_NEXT       0xAB
+#define MEDIA_PREV       0xAC
+#define MEDIA_STOP       0xAD
+#define MEDIA_PLAY_PAUSE 0xAE
+
+// Macro keys: MACRO(n) types macro n of the keymap (typeString())
+#define MACRO_0     0xF8
+#define MACRO_COUNT 8
+#define MACRO(n)    (MACRO_0 + (n))
+
+// Keyboard states and their transition table
+#include "state_table.h"
+
+// Combo engine; the keymap tables below hold the combos as matrix bitmasks
+#include "../firmware_common/combo.h"
+
+// Strings typed as one report per USB frame (typeString())
+#include "../firmware_common/send_string.h"
+
+// Keymap, per-layer command masks, ghost topology and combos, generated from
+// keyboard.json and keymap.json by firmware_host/tools/keymap_compiler.
+// The default keymap has no combos; define KEYMAP_TABLES_H as
+// "keymaps/combos/keymap_tables.h" to build with the combos keymap.
+#ifdef KEYMAP_TABLES_H
+#include KEYMAP_TABLES_H
+#else
+#include "keymap_tables.h"
+#endif
+
+// Layers stored sparse, resolved through the layer stack
+#include "keymap_layers.h"
+
+// Keymap image replaced over raw HID, see KEYMAP_LIVE_ENABLE above
+#ifdef KEYMAP_LIVE_ENABLE
+#include "keymap_live.h"
+#endif
+
+// Press counters per key and layer, see HEATMAP_ENABLE above
+#ifdef HEATMAP_ENABLE
+#include <stdio.h>
+#define HEATMAP_LAYERS KEYMAP_LAYERS
+#define HEATMAP_KEYS   KEYMAP_POSITIONS
+#include "../firmware_common/key_heatmap.h"
+
+#ifndef HEATMAP_FLUSH_MS
+#define HEATMAP_FLUSH_MS 60000        // ms between writing the changed counters to flash
+#endif
+#ifndef HEATMAP_IDLE_MS
+#define HEATMAP_IDLE_MS 5000          // ms without a key event before a sector erase
+#endif
+#ifndef HEATMAP_ERASE_AHEAD
+#define HEATMAP_ERASE_AHEAD 4         // sectors kept erased for the flushes to come
+#endif
+static_assert(HEATMAP_IDLE_MS > HEATMAP_ERASE_MAX_MS, "an erase must fit in the gap that allows it");
+#endif
+
+// Layer definitions
+#define LAYER_DEFAULT 0
+#define LAYER_FN      1
+#define LAYER_NUMPAD  2
+#define MAX_LAYERS    KEYMAP_LAYERS
+
+// Compile-time pin list
+template <uint8_t... Pins> struct PinList;
+
+template <> struct PinList<> {
+  static const uint8_t size = 0;
+};
+
+template <uint8_t First, uint8_t... Rest> struct PinList<First, Rest...> {
+  static const uint8_t size = 1 + sizeof...(Rest);
+  static const uint8_t first = First;
+  typedef PinList<Rest...> Tail;
+};
+
+// Operations over every pin of a PinList, expanded at compile time
+template <typename Board, typename Pins, uint8_t Index = 0> struct PinOps {
+  typedef PinOps<Board, typename Pins::Tail, Index + 1> Next;
+
+  static void setOutputHigh() {
+    Board::pinOutput(Pins::first);
+    Board::template writePin<Pins::first>(true);
+    Next::setOutputHigh();
+  }
+
+  static void setInputPullup() {
+    Board::pinInputPullup(Pins::first);
+    Next::setInputPullup();
+  }
+
+  // Bit Index set when the pin reads LOW (key pressed, pull-up inverted)
+  static uint32_t readLow() {
+    return (Board::template readPin<Pins::first>() ? 0 : (1ul << Index)) | Next::readLow();
+  }
+
+  // Same, gathered from a snapshot of all GPIO input levels
+  static uint32_t gatherLow(uint32_t levels) {
+    return (((~levels) >> Pins::first) & 1ul) << Index | Next::gatherLow(levels);
+  }
+
+  // True when the pins are consecutive GPIOs starting at Start
+  static constexpr bool contiguousFrom(uint8_t start) {
+    return Pins::first == start + Index && Next::contiguousFrom(start);
+  }
+};
+
+template <typename Board, uint8_t Index> struct PinOps<Board, PinList<>, Index> {
+  static void setOutputHigh() {}
+  static void setInputPullup() {}
+  static uint32_t readLow() { return 0; }
+  static uint32_t gatherLow(uint32_t) { return 0; }
+  static constexpr bool contiguousFrom(uint8_t) { return true; }
+};
+
+template <typename Board> class KeyboardCore {
+ public:
+  static const uint8_t rowCount = Board::RowPins::size;
+  static const uint8_t colCount = Board::ColPins::size;
+  static const uint8_t totalKeys = rowCount * colCount;
+
+  static_assert(totalKeys * 2 == KEYMAP_POSITIONS, "board matrix does not match keymap_tables.h");
+  static_assert(colCount <= 32, "columns are read into a 32 bit mask");
+
+  // I2C answer of the left half: events, then the bitmap (split_link.h)
+  static const uint8_t linkBitmapBytes = totalKeys / 8 + 1;
+  static const uint8_t linkPacketSize = SPLIT_PACKET_SIZE(linkBitmapBytes);
+  static_assert(linkPacketSize <= SPLIT_ANSWER_MAX, "I2C answer must fit the answer buffers and the Wire buffer");
+  static_assert(totalKeys <= 0x7F, "key positions share a byte with SPLIT_PRESSED");
+
+  // Key state tracking: the last scan and the keys that differ from their
+  // debounced state, a column bit per key of each row
+  uint32_t scannedRow[rowCount];
+  uint32_t unsettledRow[rowCount];
+  bool debouncedKeyState[totalKeys];
+  uint32_t lastDebounceTime[totalKeys];
+
+  // Received key states from the other half
+  bool otherHalfKeyState[totalKeys];
+
+  // Both halves packed, bit i = keymap position i (other half from totalKeys),
+  // updated from the merged event stream
+  uint64_t pressedMask;
+
+  // Left side: debounced changes and the answers carrying them
+  SplitEventQueue linkQueue;
+  // Right side: left half clock estimate, own changes waiting to be merged,
+  // queue index of the next left half event
+  SplitClock linkClock;
+  SplitPending localEvents;
+  uint8_t linkNextEvent;
+  bool linkSynced;
+
+  // Combined key states for HID report
+  uint8_t combinedKeyReport[6];
+  uint8_t prevKeyReport[6];
+  // Consumer and system control usages held, 0 for none
+  uint16_t consumerUsage;
+  uint16_t prevConsumerUsage;
+  uint8_t systemUsage;
+  uint8_t prevSystemUsage;
+
+  // Active layers, bit n = layer n; LAYER_DEFAULT is always at the bottom
+  uint32_t layerStack;
+  // Current active layer: the highest one in layerStack
+  uint8_t currentLayer;
+  // Active layers above LAYER_DEFAULT from the top down, for keycode lookups
+  uint8_t layerOrder[KEYMAP_LAYERS];
+  uint8_t layerDepth;
+  // Positions of each command key and of the media keys through the layer
+  // stack, recomputed when it changes
+  uint64_t layerCommandMask[4];
+  uint64_t layerMediaMask;
+
+  // Configuration
+  bool isRightSide;
+  unsigned long lastScanTime;
+  uint32_t uptimeMs;
+
+  // State machine variables
+  KeyboardState currentState;
+  KeyboardState nextState;
+  uint8_t pressedKeyCount;
+  uint8_t programSrcKey;
+  bool recordingMacro;
+
+#if KEYMAP_COMBOS
+  combo_state_t combos;
+  // Keys pressed but not yet in the report, oldest first, so keys a combo
+  // held back reach the host in the order they were pressed
+  uint8_t comboOrder[8];
+  uint8_t comboOrderCount;
+  uint64_t comboShown;
+#endif
+  // Actions of the combos being held, reported after the keys
+  uint16_t comboActions[COMBO_MAX_ACTIVE];
+  uint8_t comboActionCount;
+
+  // String being typed; the key report waits until it is done
+  send_string_t typing;
+
+#ifdef KEYMAP_LIVE_ENABLE
+  // Keymap in use
+  LiveKeymap live;
+#endif
+
+#ifdef HEATMAP_ENABLE
+  heatmap_t heatmap;
+  heatmap_log_t heatmapLog;
+  heatmap_flash_t heatmapFlash;
+  uint32_t heatmapFlushMs;   // last time the log caught up
+  uint32_t heatmapKeyMs;     // last key event
+  bool heatmapFlushing;
+  uint8_t heatmapDumpLine;   // next console line of a dump, 0xFF when none
+#endif
+
+  KeyboardCore() { reset(); }
+
+  void reset() {
+    memset(scannedRow, 0, sizeof(scannedRow));
+    memset(unsettledRow, 0, sizeof(unsettledRow));
+    memset(debouncedKeyState, 0, sizeof(debouncedKeyState));
+    memset(lastDebounceTime, 0, sizeof(lastDebounceTime));
+    memset(otherHalfKeyState, 0, sizeof(otherHalfKeyState));
+    pressedMask = 0;
+    linkQueue.reset();
+    linkClock.reset();
+    localEvents.count = 0;
+    linkNextEvent = 0;
+    linkSynced = false;
+    comboActionCount = 0;
+    typing.active = false;
+#ifdef KEYMAP_LIVE_ENABLE
+    live.reset();
+#endif
+#if KEYMAP_COMBOS
+    combo_init(&combos, keymapCombos, KEYMAP_COMBOS, COMBO_TERM);
+    comboOrderCount = 0;
+    comboShown = 0;
+#endif
+    memset(combinedKeyReport, 0, sizeof(combinedKeyReport));
+    memset(prevKeyReport, 0, sizeof(prevKeyReport));
+    consumerUsage = 0;
+    prevConsumerUsage = 0;
+    systemUsage = 0;
+    prevSystemUsage = 0;
+    layerStack = 1ul << LAYER_DEFAULT;
+    layersChanged();
+    isRightSide = false;
+    lastScanTime = 0;
+    uptimeMs = 0;
+    currentState = STATE_NORMAL;
+    nextState = STATE_NORMAL;
+    pressedKeyCount = 0;
+    programSrcKey = 0;
+    recordingMacro = false;
+    statusState = STATE_NORMAL;
+    statusLayer = LAYER_DEFAULT;
+#ifdef HEATMAP_ENABLE
+    memset(&heatmap, 0, sizeof(heatmap));
+    memset(&heatmapLog, 0, sizeof(heatmapLog));
+    heatmapFlushMs = 0;
+    heatmapKeyMs = 0;
+    heatmapFlushing = false;
+    heatmapDumpLine = 0xFF;
+#endif
+  }
+
+  void setup(void (*onRequest)()) {
+    Board::init();
+
+    // Initialize pins
+    PinOps<Board, typename Board::RowPins>::setOutputHigh();
+    PinOps<Board, typename Board::ColPins>::setInputPullup();
+
+    // Determine side (left or right)
+    Board::pinInputPullup(Board::sidePin);
+    Board::sideSettle();
+    isRightSide = Board::template readPin<Board::sidePin>();
+
+    Board::begin(isRightSide, onRequest);
+#ifdef KEYMAP_LIVE_ENABLE
+    if (isRightSide) {
+#if KEYMAP_MACROS
+      live.load(keymapMacroText, sizeof(keymapMacroText), COMBO_TERM);
+#else
+      live.load(nullptr, 0, COMBO_TERM);
+#endif
+      liveKeymapChanged();
+    }
+#endif
+#ifdef HEATMAP_ENABLE
+    if (isRightSide) {
+      heatmapFlash.base = Board::heatmapFlash();
+      heatmapFlash.program = Board::heatmapProgram;
+      heatmapFlash.erase = Board::heatmapErase;
+      heatmap_log_load(&heatmapLog, &heatmapFlash, &heatmap);
+    }
+#endif
+#ifdef STAGE_PROFILE_ENABLE
+    stage_profile_init();
+#endif
+    lastScanTime = Board::millis();
+  }
+
+  void loop() {
+    updateTimers();
+    if (!isRightSide) {
+      linkQueue.scanStarted();
+    }
+#ifdef KEYMAP_LIVE_ENABLE
+    if (isRightSide) {
+      liveKeymapApply();
+    }
+#endif
+    PROFILE_BEGIN(PROFILE_SCAN);
+    scanKeys();
+    PROFILE_END(PROFILE_SCAN);
+
+    Board::task();
+
+    if (isRightSide) {
+      // Right side: get key states from left side, process all keys, send to computer
+      PROFILE_BEGIN(PROFILE_I2C);
+      receiveKeyStates();
+      PROFILE_END(PROFILE_I2C);
+
+      PROFILE_BEGIN(PROFILE_PROCESS);
+      processKeys();
+      updateLEDs();
+      runStateMachine();
+      PROFILE_END(PROFILE_PROCESS);
+
+      // Send key report to USB
+      PROFILE_BEGIN(PROFILE_REPORT);
+      sendKeyReport();
+      typeTask();
+      PROFILE_END(PROFILE_REPORT);
+#ifdef KEYMAP_LIVE_ENABLE
+      liveKeymapTask();
+#endif
+    } else {
+      // Left side: the answer for the next I2C request, ready before it comes
+      PROFILE_BEGIN(PROFILE_I2C);
+      publishKeyStates();
+      PROFILE_END(PROFILE_I2C);
+    }
+
+    reportProfile();
+#ifdef HEATMAP_ENABLE
+    heatmapDump();
+#endif
+
+    // Ensure scanning interval
+    while (Board::millis() - lastScanTime < SCAN_INTERVAL) {
+      if (isRightSide) {
+        typeTask();
+#ifdef KEYMAP_LIVE_ENABLE
+        liveKeymapTask();
+#endif
+      }
+#ifdef HEATMAP_ENABLE
+      // Flash work only with a whole stall budget left before the next scan
+      if (isRightSide && SCAN_INTERVAL - (Board::millis() - lastScanTime) > HEATMAP_STALL_BUDGET_MS) {
+        heatmapTask();
+      }
+#endif
+      Board::idle();
+    }
+    lastScanTime = Board::millis();
+  }
+
+  void updateTimers() {
+    uptimeMs = Board::millis();
+  }
+
+#ifdef HEATMAP_ENABLE
+  // One step of writing the counters to flash. A flush starts every
+  // HEATMAP_FLUSH_MS, and at once when the host suspends the bus, and
+  // writes a page per call until nothing is dirty.
+  // A sector erase stalls for up to HEATMAP_ERASE_MAX_MS with interrupts
+  // off, past any stall budget, so erases wait for a gap: the host awake,
+  // no key held and none moved for HEATMAP_IDLE_MS. A key pressed during
+  // one is seen when it ends, at most HEATMAP_ERASE_MAX_MS late. Never
+  // while suspended, where a resume has to be answered within 10 ms. A gap
+  // erases up to HEATMAP_ERASE_AHEAD sectors and flushes as well; typing
+  // with no gap until the flushes use those up leaves the counters in RAM
+  // until the next gap.
+  void heatmapTask() {
+    uint32_t now = Board::millis();
+    bool suspended = Board::hostSuspended();
+    bool gap = !suspended && pressedMask == 0 && now - heatmapKeyMs >= HEATMAP_IDLE_MS &&
+               heatmapLog.erased < HEATMAP_ERASE_AHEAD;
+    if (!heatmapFlushing && (now - heatmapFlushMs >= HEATMAP_FLUSH_MS || suspended)) {
+      heatmapFlushing = true;
+    }
+    if (!heatmapFlushing && !gap) {
+      return;
+    }
+    heatmap_log_result_t result = heatmap_log_task(&heatmapLog, &heatmapFlash, &heatmap, gap);
+    if (result == HEATMAP_LOG_IDLE || result == HEATMAP_LOG_BLOCKED) {
+      heatmapFlushing = false;
+      heatmapFlushMs = now;
+    }
+  }
+
+  // Print the counters on the console, one line per loop pass
+  void heatmapDumpStart() { heatmapDumpLine = 0; }
+
+  void heatmapDump() {
+    if (heatmapDumpLine >= KEYMAP_LAYERS * rowCount * 2) {
+      return;
+    }
+    // A line per matrix row of each half and layer, in matrix position order
+    uint8_t layer = heatmapDumpLine / (rowCount * 2);
+    uint8_t first = (heatmapDumpLine % (rowCount * 2)) * colCount;
+    char line[96];
+    int len = snprintf(line, sizeof(line), "heatmap L%u %2u:", (unsigned)layer, (unsigned)first);
+    for (uint8_t c = 0; c < colCount && len < (int)sizeof(line); c++) {
+      len += snprintf(line + len, sizeof(line) - len, " %5u", (unsigned)heatmap.count[layer * KEYMAP_POSITIONS + first + c]);
+    }
+    Board::logLine(line);
+    heatmapDumpLine++;
+  }
+#endif
+
+#ifdef KEYMAP_LIVE_ENABLE
+  // Requests from the host, answered in the order they came
+  void liveKeymapTask() {
+    uint8_t request[KEYMAP_LIVE_REPORT_SIZE];
+    uint8_t answer[KEYMAP_LIVE_REPORT_SIZE];
+    while (Board::rawHidReceive(request)) {
+      if (live.receive(request, answer)) {
+        Board::rawHidSend(answer);
+      }
+    }
+  }
+
+  // Scan boundary: a committed image becomes the keymap for this whole
+  // pass. A macro being typed reads its text from the active image, so the
+  // swap waits until it is done.
+  void liveKeymapApply() {
+    uint8_t answer[KEYMAP_LIVE_REPORT_SIZE];
+    if (!typing.active && live.apply(answer)) {
+      liveKeymapChanged();
+      Board::rawHidSend(answer);
+    }
+  }
+
+  void liveKeymapChanged() {
+    layersChanged();
+#if KEYMAP_COMBOS
+    combos.term = live.setting(KEYMAP_LIVE_SET_COMBO_TERM);
+#endif
+  }
+#endif
+
+  // Type a string (send_string.h); text must stay valid until it is done.
+  // The keys held meanwhile go out once it is.
+  void typeString(const char *text) { send_string_start(&typing, text); }
+
+  // Hand the board as many reports of the string as it can take without
+  // waiting, from the loop and while waiting for the next scan, so a board
+  // that commits a report per USB frame never runs dry
+  void typeTask() {
+    if (!typing.active || !Board::hostReady()) {
+      return;
+    }
+    for (uint8_t room = Board::hidRoom(); room > 0; room--) {
+      send_string_report_t report;
+      if (!send_string_next(&typing, &report)) {
+        // Everything released: the held keys are a change again
+        memset(prevKeyReport, 0, sizeof(prevKeyReport));
+        return;
+      }
+      uint8_t keys[6] = {0};
+      uint8_t n = 0;
+      for (uint8_t bit = 0; bit < 8 && n < 5; bit++) {
+        if (report.modifiers & (1 << bit)) {
+          keys[n++] = (uint8_t)(KEY_LEFT_CTRL + bit);
+        }
+      }
+      keys[n] = report.key;
+      Board::hidSend(keys);
+    }
+  }
+
+  void reportProfile() {
+#ifdef STAGE_PROFILE_ENABLE
+    // Dump and restart the stage timings every few seconds
+    static uint32_t lastReport = 0;
+    if (uptimeMs - lastReport < STAGE_PROFILE_REPORT_MS) {
+      return;
+    }
+    lastReport = uptimeMs;
+
+    char line[160];
+    for (uint8_t stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+      if (stage_profile_format((profile_stage_t)stage, line, sizeof(line))) {
+        Board::logLine(line);
+      }
+    }
+    stage_profile_reset();
+#endif
+  }
+
+  void scanKeys() {
+    scanMatrix();
+  }
+
+  // Read and debounce this half's matrix
+  void scanMatrix() {
+    RowScan<typename Board::RowPins, 0>::run(*this);
+  }
+
+  // Debounce one scanned row, columns holds a bit per pressed key. Only keys
+  // that moved this scan or are still waiting out their debounce time are
+  // visited; a row at rest costs a compare.
+  template <uint8_t Row> void storeRow(uint32_t columns) {
+    const uint32_t changed = columns ^ scannedRow[Row];
+    uint32_t pending = changed | unsettledRow[Row];
+    if (!pending) return;
+    scannedRow[Row] = columns;
+
+    uint32_t unsettled = 0;
+    for (uint8_t col = 0; pending; col++, pending >>= 1) {
+      if (!(pending & 1)) continue;
+      const uint8_t keyIndex = Row * colCount + col;
+      bool keyState = (columns >> col) & 1;
+
+      // Debounce
+      if ((changed >> col) & 1) {
+        lastDebounceTime[keyIndex] = uptimeMs;
+      }
+
+      if (debouncedKeyState[keyIndex] != keyState) {
+        if ((uptimeMs - lastDebounceTime[keyIndex]) > DEBOUNCE_TIME) {
+          // If the debounce time has passed, update the stable state
+          debouncedKeyState[keyIndex] = keyState;
+          keyChanged(keyIndex, keyState);
+        } else {
+          unsettled |= 1ul << col;
+        }
+      }
+    }
+    unsettledRow[Row] = unsettled;
+  }
+
+  // Queue a debounced change of this half, stamped with this scan's time
+  void keyChanged(uint8_t keyIndex, bool pressed) {
+    uint8_t key = keyIndex | (pressed ? SPLIT_PRESSED : 0);
+    if (!isRightSide) {
+      linkQueue.push(key, (uint16_t)uptimeMs);
+    } else if (!localEvents.push(key, uptimeMs)) {
+      // The other half has been silent for a whole queue; don't wait for it
+      applyEvent(localEvents.keys[0], 0, localEvents.times[0]);
+      localEvents.pop();
+      localEvents.push(key, uptimeMs);
+    }
+  }
+
+  void processKeys() {
+    // Combo keys are held back from the report until their combo resolves
+    uint64_t keys = pressedMask;
+#if KEYMAP_COMBOS
+    combo_task(&combos, (uint16_t)uptimeMs);
+    keys = combo_output(&combos, pressedMask, comboActions, &comboActionCount);
+#endif
+
+    // Clear current key report
+    clearKeyReport();
+
+    // Only process and send keys in normal state
+    if (currentState == STATE_NORMAL || currentState == STATE_MACRO_RECORD) {
+#if KEYMAP_COMBOS
+      reportInPressOrder(keys);
+#endif
+      updateKeyReport(keys);
+    }
+#if KEYMAP_COMBOS
+    comboShown = keys;
+#endif
+  }
+
+#if KEYMAP_COMBOS
+  // Keys a resolved combo lets out and the key that resolved it appear in
+  // the same pass; send them one report each, in press order, ahead of the
+  // pass's own report. Command and combo action keys wait for that report.
+  void reportInPressOrder(uint64_t keys) {
+    uint64_t shown = keys & comboShown;
+    uint64_t added = keys & ~comboShown;
+    const uint64_t *masks = commandMasks();
+    uint64_t commands = masks[0] | masks[1] | masks[2] | masks[3];
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < comboOrderCount; i++) {
+      uint64_t bit = 1ull << comboOrder[i];
+      if ((added & bit) && (added & ~bit) && !(bit & commands)) {
+        added &= ~bit;
+        shown |= bit;
+        uint8_t count = comboActionCount;
+        comboActionCount = 0;
+        updateKeyReport(shown & ~commands);
+        comboActionCount = count;
+        sendKeyReport();
+        clearKeyReport();
+      } else if ((pressedMask & bit) && !(keys & bit)) {
+        // Still held back
+        comboOrder[kept++] = comboOrder[i];
+      }
+    }
+    comboOrderCount = kept;
+  }
+#endif
+
+  // One event of the merged stream: key positions of the other half start at base
+  void applyEvent(uint8_t key, uint8_t base, uint32_t time) {
+    uint8_t position = base + (key & ~SPLIT_PRESSED);
+    bool pressed = key & SPLIT_PRESSED;
+    if (base) {
+      otherHalfKeyState[position - base] = pressed;
+    }
+#ifdef HEATMAP_ENABLE
+    if (pressed) {
+      heatmap_press(&heatmap, layerAt(position), position);
+    }
+    heatmapKeyMs = time;
+#endif
+    if (pressed) {
+      pressedMask |= 1ull << position;
+    } else {
+      pressedMask &= ~(1ull << position);
+    }
+#if KEYMAP_MACROS || defined(KEYMAP_LIVE_ENABLE)
+    if (pressed) {
+      uint8_t keycode = keycodeAt(position);
+      if (keycode >= MACRO_0 && !typing.active) {
+        typeString(macroText(keycode - MACRO_0));
+      }
+    }
+#endif
+#if KEYMAP_COMBOS
+    combo_task(&combos, (uint16_t)time);
+    if (pressed) {
+      combo_press(&combos, position, (uint16_t)time);
+      if (comboOrderCount < sizeof(comboOrder)) {
+        comboOrder[comboOrderCount++] = position;
+      }
+    } else {
+      combo_release(&combos, position, (uint16_t)time);
+    }
+#endif
+    Board::keyEvent(position, pressed, time);
+  }
+
+  // Release this half's queued events up to horizon, behind the other half's
+  // that are older
+  void mergeLocal(uint32_t horizon) {
+    while (localEvents.count && (int32_t)(horizon - localEvents.times[0]) >= 0) {
+      applyEvent(localEvents.keys[0], 0, localEvents.times[0]);
+      localEvents.pop();
+    }
+  }
+
+  // One step of the transition table (state_table.h)
+  void runStateMachine() {
+    if (currentState >= STATE_COUNT) {
+      // Unknown state, go back to normal
+      currentState = STATE_NORMAL;
+      return;
+    }
+
+    pressedKeyCount = popcount64(pressedMask);
+    uint8_t commands = heldCommands();
+    uint8_t keys = stateKeysClass(pressedKeyCount);
+
+    for (uint8_t row = stateTransitionIndex[currentState]; row < stateTransitionIndex[currentState + 1]; row++) {
+      const StateTransition &t = stateTransitions[row];
+      if ((commands & t.commands) != t.commands || (commands & t.without) || !(keys & t.count)) {
+        continue;
+      }
+      runStateAction(t.action);
+      if (t.to == STATE_NEXT) {
+        currentState = nextState;
+      } else {
+        currentState = (KeyboardState)t.to;
+      }
+      nextState = (KeyboardState)t.next;
+      break;
+    }
+
+    if (currentState == STATE_MACRO_RECORD && !recordingMacro) {
+      recordingMacro = true;
+      // In a real implementation, we would initialize macro recording
+    }
+  }
+
+  void runStateAction(uint8_t action) {
+    switch (action) {
+      case STATE_ACTION_SAVE_SOURCE:
+        // Save the source key: the only key held
+        programSrcKey = keycodeAt(lowestBit64(pressedMask));
+        break;
+      case STATE_ACTION_REMAP:
+        // In a real implementation, we would save the key remapping
+        break;
+      case STATE_ACTION_SAVE_MACRO:
+        recordingMacro = false;
+        // In a real implementation, we would save the recorded macro
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Command keys held on either half or as a combo, bit (command - CMD_LAYER_CHANGE)
+  uint8_t heldCommands() const {
+    const uint64_t *masks = commandMasks();
+    uint8_t commands = 0;
+    for (uint8_t c = 0; c < 4; c++) {
+      if (pressedMask & masks[c]) commands |= 1 << c;
+    }
+    for (uint8_t i = 0; i < comboActionCount; i++) {
+      if (comboActions[i] >= CMD_LAYER_CHANGE && comboActions[i] <= CMD_PROGRAM_MODE) {
+        commands |= STATE_CMD(comboActions[i]);
+      }
+    }
+    return commands;
+  }
+
+  static uint8_t popcount64(uint64_t mask) {
+    uint8_t count = 0;
+    for (; mask; count++) {
+      mask &= mask - 1;
+    }
+    return count;
+  }
+
+  static uint8_t lowestBit64(uint64_t mask) {
+    uint8_t bit = 0;
+    while (mask && !(mask & 1)) {
+      mask >>= 1;
+      bit++;
+    }
+    return bit;
+  }
+
+  void clearKeyReport() {
+    for (uint8_t i = 0; i < 6; i++) {
+      combinedKeyReport[i] = 0;
+    }
+    consumerUsage = 0;
+    systemUsage = 0;
+  }
+
+  void updateKeyReport(uint64_t keys) {
+    uint8_t reportIndex = 0;
+
+    // Media and system keys first: they have reports of their own and
+    // never take one of the six slots
+    uint64_t media = keys & mediaMask();
+    keys &= ~media;
+    for (uint8_t i = 0; media; i++, media >>= 1) {
+      if (media & 1) {
+        addKeyToReport(keycodeAt(i), reportIndex);
+      }
+    }
+
+    // First this side's keys, then the other half's, then held combos
+    for (uint8_t i = 0; keys && reportIndex < 6; i++, keys >>= 1) {
+      if (keys & 1) {
+        addKeyToReport(keycodeAt(i), reportIndex);
+      }
+    }
+    for (uint8_t i = 0; i < comboActionCount && reportIndex < 6; i++) {
+      addKeyToReport((uint8_t)comboActions[i], reportIndex);
+    }
+  }
+
+  void addKeyToReport(uint8_t keycode, uint8_t &reportIndex) {
+    // Check for special commands
+    if (keycode >= CMD_LAYER_CHANGE) {
+      // Handle special commands
+      if (keycode == CMD_LAYER_CHANGE) {
+        // Toggle layer
+        layerToggle(LAYER_FN);
+      }
+      // Don't add command keys to the report
+    } else if (uint16_t consumer = consumerUsageOf(keycode)) {
+      // One usage per report: the first one held
+      if (consumerUsage == 0) {
+        consumerUsage = consumer;
+      }
+    } else if (uint8_t system = systemUsageOf(keycode)) {
+      if (systemUsage == 0) {
+        systemUsage = system;
+      }
+    } else if (keycode != KEY_RESERVED) {
+      // Regular key, add to report
+      combinedKeyReport[reportIndex++] = keycode;
+    }
+  }
+
+  void sendKeyReport() {
+    // Reports before enumeration would be dropped; the keys held by then go
+    // out as the first report after it
+    if (!Board::hostReady()) {
+      return;
+    }
+
+    // Only send if changed, and not into a string being typed
+    bool keysChanged = !typing.active && memcmp(combinedKeyReport, prevKeyReport, 6) != 0;
+    uint8_t keyReports = 0;
+    if (keysChanged) {
+      keyReports = 1;
+      for (uint8_t i = 0; i < 6 && !Board::hidSingleReport(); i++) {
+        keyReports += combinedKeyReport[i] != 0;
+      }
+    }
+    uint8_t usageReports = (consumerUsage != prevConsumerUsage) + (systemUsage != prevSystemUsage);
+
+    // A board that can't take the whole change now gets it on a later pass,
+    // as the keys held by then: nothing waits here and nothing is refused
+    if ((keyReports || usageReports) && !Board::hidCanTake(keyReports, usageReports)) {
+      return;
+    }
+
+    if (keysChanged) {
+      if (Board::hidSingleReport()) {
+        // The whole change in one report: held keys stay down at the host
+        Board::hidSend(combinedKeyReport);
+      } else {
+        // Release all keys first
+        Board::hidReleaseAll();
+
+        // Press the current keys
+        for (uint8_t i = 0; i < 6; i++) {
+          if (combinedKeyReport[i] != 0) {
+            Board::hidPress(combinedKeyReport[i]);
+          }
+        }
+      }
+
+      // Save current report
+      memcpy(prevKeyReport, combinedKeyReport, 6);
+    }
+
+    if (consumerUsage != prevConsumerUsage) {
+      Board::hidConsumer(consumerUsage);
+      prevConsumerUsage = consumerUsage;
+    }
+    if (systemUsage != prevSystemUsage) {
+      Board::hidSystem(systemUsage);
+      prevSystemUsage = systemUsage;
+    }
+  }
+
+  // Consumer page usage of a media key, 0 for any other key
+  static uint16_t consumerUsageOf(uint8_t keycode) {
+    switch (keycode) {
+      case KEY_MUTE:         return 0xE2;
+      case KEY_VOLUME_UP:    return 0xE9;
+      case KEY_VOLUME_DOWN:  return 0xEA;
+      case MEDIA_NEXT:       return 0xB5;
+      case MEDIA_PREV:       return 0xB6;
+      case MEDIA_STOP:       return 0xB7;
+      case MEDIA_PLAY_PAUSE: return 0xCD;
+      default:               return 0;
+    }
+  }
+
+  // Generic desktop usage of a system key (power down, sleep, wake up), 0 for any other key
+  static uint8_t systemUsageOf(uint8_t keycode) {
+    return keycode >= SYS_POWER && keycode <= SYS_WAKE ? 0x81 + (keycode - SYS_POWER) : 0;
+  }
+
+  void receiveKeyStates() {
+    // Request events and key states from left side
+    uint8_t packet[linkPacketSize] = {0};
+    uint8_t received = Board::requestOtherHalf(packet, sizeof(packet));
+    uint32_t now = Board::millis();
+    if (received < sizeof(packet)) {
+      // No answer: nothing to wait for
+      mergeLocal(now);
+      return;
+    }
+
+    uint16_t slaveNow = packet[1] | (uint16_t)packet[2] << 8;
+    linkClock.sample(slaveNow, (uint16_t)now);
+
+    // Events this side already has come again when the left half hasn't
+    // scanned since the last request; an index behind or too far ahead
+    // means events were lost or the left half restarted
+    uint8_t count = packet[0] & SPLIT_COUNT_MASK;
+    uint8_t first = packet[5];
+    uint8_t skip = (uint8_t)(linkNextEvent - first);
+    bool gap = !linkSynced || skip > count;
+    if (gap) {
+      skip = 0;
+    }
+    linkNextEvent = first + count;
+    linkSynced = true;
+
+    // The left half has sent everything it saw up to now, up to the scan
+    // before the one in progress, or up to its last event when more are queued
+    uint32_t horizon = now;
+    if (packet[0] & SPLIT_SCANNING) {
+      horizon = linkClock.toMaster(packet[3] | (uint16_t)packet[4] << 8, now);
+    }
+    const uint8_t *event = packet + SPLIT_HEADER_SIZE;
+    for (uint8_t i = 0; i < count; i++, event += 3) {
+      uint32_t time = linkClock.toMaster(event[1] | (uint16_t)event[2] << 8, now);
+      if (i >= skip) {
+        mergeLocal(time);
+        if ((event[0] & ~SPLIT_PRESSED) < totalKeys) {
+          applyEvent(event[0], totalKeys, time);
+        }
+      }
+      if (packet[0] & SPLIT_MORE) {
+        horizon = time;
+      }
+    }
+    mergeLocal(horizon);
+
+    if (gap || (packet[0] & SPLIT_OVERFLOW)) {
+      // Events were lost: catch up with the bitmap
+      const uint8_t *bitmap = packet + SPLIT_PACKET_SIZE(0);
+      for (uint8_t i = 0; i < totalKeys; i++) {
+        bool pressed = bitmap[i / 8] & (1 << (i % 8));
+        if (pressed != otherHalfKeyState[i]) {
+          applyEvent(i | (pressed ? SPLIT_PRESSED : 0), totalKeys, now);
+        }
+      }
+    }
+  }
+
+  // Left side, after each scan: the next I2C answer, events and the bitmap
+  // they leave behind, published for the request interrupt
+  void publishKeyStates() {
+    uint8_t *packet = linkQueue.prepare((uint16_t)uptimeMs);
+    if (!packet) {
+      return;
+    }
+    uint8_t *bitmap = packet + SPLIT_PACKET_SIZE(0);
+    memset(bitmap, 0, linkBitmapBytes);
+    for (uint8_t i = 0; i < totalKeys; i++) {
+      if (debouncedKeyState[i]) {
+        bitmap[i / 8] |= (1 << (i % 8));
+      }
+    }
+    linkQueue.publish();
+  }
+
+  // I2C request handler of the left side (interrupt context): hands out the
+  // answer the loop published, in constant time
+  void sendKeyStates() {
+    const uint8_t *packet = linkQueue.beginSend((uint16_t)Board::millis());
+    Board::sendToMaster(packet, linkPacketSize);
+    linkQueue.endSend();
+  }
+
+  void updateLEDs() {
+    // LED management for different states
+    if (currentState != statusState || currentLayer != statusLayer) {
+      Board::statusChanged(currentState, currentLayer);
+      statusState = currentState;
+      statusLayer = currentLayer;
+    }
+  }
+
+  // Only layer active over LAYER_DEFAULT
+  void selectLayer(uint8_t layer) {
+    layerStack = 1ul << LAYER_DEFAULT | 1ul << layer;
+    layersChanged();
+  }
+
+  void layerToggle(uint8_t layer) {
+    layerStack ^= 1ul << layer;
+    layerStack |= 1ul << LAYER_DEFAULT;
+    layersChanged();
+  }
+
+  // The stack's order and masks, after it or the keymap changed
+  void layersChanged() {
+    currentLayer = LAYER_DEFAULT;
+    layerDepth = 0;
+    for (uint8_t layer = KEYMAP_LAYERS - 1; layer > LAYER_DEFAULT; layer--) {
+      if ((layerStack >> layer) & 1) {
+        if (layerDepth == 0) {
+          currentLayer = layer;
+        }
+        layerOrder[layerDepth++] = layer;
+      }
+    }
+    memset(layerCommandMask, 0, sizeof(layerCommandMask));
+    layerMediaMask = 0;
+    for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+      uint8_t keycode = keycodeAt(i);
+      if (keycode >= CMD_LAYER_CHANGE && keycode <= CMD_PROGRAM_MODE) {
+        layerCommandMask[keycode - CMD_LAYER_CHANGE] |= 1ull << i;
+      } else if (consumerUsageOf(keycode) || systemUsageOf(keycode)) {
+        layerMediaMask |= 1ull << i;
+      }
+    }
+  }
+
+  bool layerHolds(uint8_t layer, uint8_t position) const {
+#ifdef KEYMAP_LIVE_ENABLE
+    return live.keycode(layer, position) != KEY_TRANSPARENT;
+#else
+    return keymapHolds(layer, position);
+#endif
+  }
+
+  // Layer whose keycode position takes: the highest active one holding it
+  uint8_t layerAt(uint8_t position) const {
+    for (uint8_t i = 0; i < layerDepth; i++) {
+      if (layerHolds(layerOrder[i], position)) {
+        return layerOrder[i];
+      }
+    }
+    return LAYER_DEFAULT;
+  }
+
+  uint8_t keycodeAt(uint8_t position) const {
+#ifdef KEYMAP_LIVE_ENABLE
+    uint8_t keycode = live.keycode(layerAt(position), position);
+    return keycode == KEY_TRANSPARENT ? (uint8_t)KEY_RESERVED : keycode;
+#else
+    return keymapKeycode(layerAt(position), position);
+#endif
+  }
+
+  // Positions of each command key through the layer stack
+  const uint64_t *commandMasks() const { return layerCommandMask; }
+
+  uint64_t mediaMask() const { return layerMediaMask; }
+
+#if KEYMAP_MACROS || defined(KEYMAP_LIVE_ENABLE)
+  // Text of macro n, empty when the keymap has no such macro
+  const char *macroText(uint8_t n) const {
+#ifdef KEYMAP_LIVE_ENABLE
+    return live.macro(n);
+#else
+    const char *text = keymapMacroText;
+    const char *end = keymapMacroText + sizeof(keymapMacroText) - 1;
+    for (; n > 0 && text < end; n--) {
+      text += strlen(text) + 1;
+    }
+    return text < end ? text : end;
+#endif
+  }
+#endif
+
+ private:
+  KeyboardState statusState;
+  uint8_t statusLayer;
+
+  // Drive each row LOW in turn and debounce its columns, unrolled per row
+  template <typename Pins, uint8_t Row> struct RowScan {
+    static void run(KeyboardCore &core) {
+      // Set the current row LOW for scanning
+      Board::template writePin<Pins::first>(false);
+      Board::settle(); // Give the row time to settle
+      uint32_t columns = Board::readColumns();
+      // Set the row back to HIGH
+      Board::template writePin<Pins::first>(true);
+
+      core.template storeRow<Row>(columns);
+      RowScan<typename Pins::Tail, Row + 1>::run(core);
+    }
+  };
+
+  template <uint8_t Row> struct RowScan<PinList<>, Row> {
+    static void run(KeyboardCore &) {}
+  };
+};
@@ -0,0 +1,99 @@
+/*
+  Sparse layered keymap: layer 0 whole, upper layers as a presence bitmap
+  and only the keycodes they set
+
+  Upper layers mostly leave keys to the layers below (KC_TRNS in
+  keymap.json), so keymap_compiler emits
+
+    keymapKeycodes    layer 0 by matrix position, then the keycodes of
+                      each upper layer in matrix position order
+    keymapPresence    per upper layer, KEYMAP_BLOCKS bytes: bit i of byte
+                      b set when matrix position 8b + i has a keycode on
+                      the layer, clear where it is transparent
+    keymapLayerStart  per upper layer, where its keycodes start
+
+  An upper layer costs its keycodes plus KEYMAP_BLOCKS + 2 bytes, so one
+  that is all transparent is 8 bytes instead of KEYMAP_POSITIONS.
+
+  A key resolves through the active layers from the top down with one bit
+  test per layer; only the layer that holds it counts the set bits before
+  the position to find its keycode, and layer 0 is a plain index.
+  Everything stays in PROGMEM, nothing is copied to RAM.
+
+  The helpers take one layer's rows so host benches can run them on
+  keymaps of other sizes; the keymap_tables.h wrappers need it included
+  first. Must stay C++11 (see keyboard_core.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Live keymap images (keymap_live.h) mark a transparent position with
+// this; the HID usage is ErrorRollOver, never a key of a keymap
+#define KEY_TRANSPARENT 0x01
+
+#define KEYMAP_BLOCKS_OF(positions) (((positions) + 7) / 8)
+
+static inline uint8_t keymapBitCount(uint8_t byte) {
+  byte = byte - ((byte >> 1) & 0x55);
+  byte = (byte & 0x33) + ((byte >> 2) & 0x33);
+  return (byte + (byte >> 4)) & 0x0F;
+}
+
+// True when the upper layer with these presence bytes holds position
+static inline bool keymapLayerHolds(const uint8_t *presence, uint8_t position) {
+  return (pgm_read_byte(presence + (position >> 3)) >> (position & 7)) & 1;
+}
+
+// Keycode of position on an upper layer that holds it; keycodes are the
+// layer's own
+static inline uint8_t keymapLayerKeycode(const uint8_t *presence, const uint8_t *keycodes, uint8_t position) {
+  uint8_t block = position >> 3;
+  uint8_t i = keymapBitCount(pgm_read_byte(presence + block) & (uint8_t)((1u << (position & 7)) - 1));
+  for (uint8_t b = 0; b < block; b++) {
+    i += keymapBitCount(pgm_read_byte(presence + b));
+  }
+  return pgm_read_byte(keycodes + i);
+}
+
+#ifdef KEYMAP_POSITIONS
+
+static_assert(KEYMAP_LAYERS <= 32, "layer stacks are 32 bit masks");
+static_assert(KEYMAP_BLOCKS == KEYMAP_BLOCKS_OF(KEYMAP_POSITIONS), "keymap_tables.h is out of date");
+
+static inline bool keymapHolds(uint8_t layer, uint8_t position) {
+#if KEYMAP_LAYERS > 1
+  return layer == 0 || keymapLayerHolds(keymapPresence[layer - 1], position);
+#else
+  return true;
+#endif
+}
+
+// Keycode of position on layer, KEY_TRANSPARENT where the layer leaves it
+// to the layers below
+static inline uint8_t keymapKeycode(uint8_t layer, uint8_t position) {
+  if (layer == 0) {
+    return pgm_read_byte(&keymapKeycodes[position]);
+  }
+#if KEYMAP_LAYERS > 1
+  if (keymapHolds(layer, position)) {
+    return keymapLayerKeycode(keymapPresence[layer - 1], keymapKeycodes + pgm_read_word(&keymapLayerStart[layer - 1]),
+                              position);
+  }
+#endif
+  return KEY_TRANSPARENT;
+}
+
+// Keycode of position through a layer stack, bit n = layer n active;
+// layer 0 is always under it
+static inline uint8_t keymapLookup(uint32_t stack, uint8_t position) {
+  for (uint8_t layer = KEYMAP_LAYERS - 1; layer > 0; layer--) {
+    if (((stack >> layer) & 1) && keymapHolds(layer, position)) {
+      return keymapKeycode(layer, position);
+    }
+  }
+  return keymapKeycode(0, position);
+}
+
+#endif // KEYMAP_POSITIONS
@@ -0,0 +1,305 @@
+/*
+  Live keymap: keycodes, macros and settings of the right half replaced
+  over raw HID, without reflashing
+
+  Only the right half resolves keycodes (the left one sends key events),
+  so only it holds the keymap. It keeps it as an image in RAM, laid out
+  exactly as it travels:
+
+    keycodes  [KEYMAP_LAYERS][KEYMAP_POSITIONS], one byte each,
+              KEY_TRANSPARENT where a layer leaves the key to the ones
+              below (keymap_layers.h)
+    macros    KEYMAP_LIVE_MACRO_BYTES: NUL terminated strings, macro n is
+              the n-th, typed by MACRO_0 + n (send_string.h); the last
+              byte is always NUL
+    settings  KEYMAP_LIVE_SETTINGS_BYTES, little endian:
+              0  combo term, ms (combo.h)
+
+  Two images: the active one, and a staging one an upload writes. A
+  committed upload is swapped in at the start of a loop pass, before the
+  scan, so a pass never sees half a keymap; nothing else changes the
+  active image.
+
+  Protocol: vendor reports of KEYMAP_LIVE_REPORT_SIZE bytes, byte 0 the
+  command, echoed in byte 0 of the answer with a status in byte 1.
+
+    INFO    -> layers, positions, macro bytes (16), settings bytes, image
+               size (16), active image CRC-32 (32), images applied since
+               boot, 1 while a commit waits for the scan boundary
+    READ    offset (16), length -> offset (16), length, data
+    WRITE   offset (16), length, CRC-8 of data, data: no answer when it
+            is taken; a chunk at offset 0 starts a new upload, every
+            other chunk has to continue where the last one ended. Errors
+            answer with the offset expected next, the host resends from
+            there.
+    COMMIT  image size (16), CRC-32 of the image (32): checked against
+            the staged image, then answered once it is active
+
+  Chunks go out back to back without waiting for answers; an upload of
+  the whole image is a report per chunk plus the commit. All of it runs
+  in the loop: the USB stack only queues requests, the loop takes them
+  while it waits for the next scan (receive()), and answers are queued
+  for the start-of-frame handler.
+
+  The image lives in RAM: a power cycle goes back to the compiled
+  keymap_tables.h.
+
+  The wire format part is plain C++ for the host tools; the image needs
+  keymap_tables.h and keymap_layers.h included first. Must stay C++11 (see keyboard_core.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// One report each way, the vendor report on a full speed endpoint with its report ID
+#define KEYMAP_LIVE_REPORT_ID 4
+#define KEYMAP_LIVE_REPORT_SIZE 63
+#define KEYMAP_LIVE_CHUNK_HEADER 5
+#define KEYMAP_LIVE_CHUNK_MAX (KEYMAP_LIVE_REPORT_SIZE - KEYMAP_LIVE_CHUNK_HEADER)
+
+#ifndef KEYMAP_LIVE_MACRO_BYTES
+#define KEYMAP_LIVE_MACRO_BYTES 256
+#endif
+#define KEYMAP_LIVE_SETTINGS_BYTES 8
+
+// Settings, offsets in the settings block
+#define KEYMAP_LIVE_SET_COMBO_TERM 0
+
+// Commands
+#define KEYMAP_LIVE_CMD_INFO   0x01
+#define KEYMAP_LIVE_CMD_READ   0x02
+#define KEYMAP_LIVE_CMD_WRITE  0x03
+#define KEYMAP_LIVE_CMD_COMMIT 0x04
+
+// Answer status
+#define KEYMAP_LIVE_OK          0
+#define KEYMAP_LIVE_ERR_OFFSET  1  // chunk not where the last one ended
+#define KEYMAP_LIVE_ERR_CHUNK   2  // chunk CRC-8 wrong
+#define KEYMAP_LIVE_ERR_SIZE    3  // outside the image, or the image incomplete
+#define KEYMAP_LIVE_ERR_CRC     4  // image CRC-32 wrong
+#define KEYMAP_LIVE_ERR_MACROS  5  // macro block not NUL terminated
+#define KEYMAP_LIVE_ERR_BUSY    6  // a commit waits for the scan boundary
+#define KEYMAP_LIVE_ERR_COMMAND 7
+
+static inline uint16_t keymapLiveGet16(const uint8_t *p) { return p[0] | (uint16_t)p[1] << 8; }
+
+static inline void keymapLivePut16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline uint32_t keymapLiveGet32(const uint8_t *p) {
+  return keymapLiveGet16(p) | (uint32_t)keymapLiveGet16(p + 2) << 16;
+}
+
+static inline void keymapLivePut32(uint8_t *p, uint32_t v) {
+  keymapLivePut16(p, (uint16_t)v);
+  keymapLivePut16(p + 2, (uint16_t)(v >> 16));
+}
+
+// CRC-32 (IEEE, as zlib), bitwise: the image is checked once per commit
+static inline uint32_t keymapLiveCrc32(const uint8_t *data, uint16_t len) {
+  uint32_t crc = 0xFFFFFFFFul;
+  for (uint16_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320ul & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// CRC-8, polynomial 0x07, per chunk
+static inline uint8_t keymapLiveCrc8(const uint8_t *data, uint8_t len) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (uint8_t)((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0));
+    }
+  }
+  return crc;
+}
+
+// Host side: the WRITE request for the chunk of image at offset; its length
+static inline uint8_t keymapLiveWriteRequest(uint8_t *report, const uint8_t *image, uint16_t size, uint16_t offset) {
+  uint8_t len = size - offset < KEYMAP_LIVE_CHUNK_MAX ? (uint8_t)(size - offset) : KEYMAP_LIVE_CHUNK_MAX;
+  memset(report, 0, KEYMAP_LIVE_REPORT_SIZE);
+  report[0] = KEYMAP_LIVE_CMD_WRITE;
+  keymapLivePut16(report + 1, offset);
+  report[3] = len;
+  report[4] = keymapLiveCrc8(image + offset, len);
+  memcpy(report + KEYMAP_LIVE_CHUNK_HEADER, image + offset, len);
+  return len;
+}
+
+static inline void keymapLiveCommitRequest(uint8_t *report, const uint8_t *image, uint16_t size) {
+  memset(report, 0, KEYMAP_LIVE_REPORT_SIZE);
+  report[0] = KEYMAP_LIVE_CMD_COMMIT;
+  keymapLivePut16(report + 1, size);
+  keymapLivePut32(report + 3, keymapLiveCrc32(image, size));
+}
+
+#ifdef KEYMAP_POSITIONS
+
+#define KEYMAP_LIVE_KEYCODES   0
+#define KEYMAP_LIVE_MACROS     (KEYMAP_LAYERS * KEYMAP_POSITIONS)
+#define KEYMAP_LIVE_SETTINGS   (KEYMAP_LIVE_MACROS + KEYMAP_LIVE_MACRO_BYTES)
+#define KEYMAP_LIVE_IMAGE_SIZE (KEYMAP_LIVE_SETTINGS + KEYMAP_LIVE_SETTINGS_BYTES)
+
+static_assert(KEYMAP_LIVE_IMAGE_SIZE <= 0xFFFF, "image offsets are 16 bit");
+
+struct LiveKeymap {
+  uint8_t images[2][KEYMAP_LIVE_IMAGE_SIZE];
+  uint8_t active;       // image in use, the other one is staging
+  uint16_t received;    // bytes of the staging image written so far
+  bool pending;         // staging image committed, swapped in at the next scan boundary
+  uint8_t generation;   // images applied since boot
+  uint32_t crc;         // of the active image
+  uint32_t stagedCrc;   // of the committed one
+
+  void reset() {
+    memset(images, 0, sizeof(images));
+    active = 0;
+    received = 0;
+    pending = false;
+    generation = 0;
+    crc = 0;
+    stagedCrc = 0;
+  }
+
+  // The compiled keymap (keymap_layers.h) as the active image
+  void load(const char *macros, uint16_t macroBytes, uint16_t comboTerm) {
+    uint8_t *image = images[active];
+    for (uint16_t i = 0; i < KEYMAP_LAYERS * KEYMAP_POSITIONS; i++) {
+      image[KEYMAP_LIVE_KEYCODES + i] = keymapKeycode(i / KEYMAP_POSITIONS, i % KEYMAP_POSITIONS);
+    }
+    memset(image + KEYMAP_LIVE_MACROS, 0, KEYMAP_LIVE_MACRO_BYTES + KEYMAP_LIVE_SETTINGS_BYTES);
+    if (macroBytes > KEYMAP_LIVE_MACRO_BYTES - 1) {
+      macroBytes = KEYMAP_LIVE_MACRO_BYTES - 1;
+    }
+    if (macros) {
+      memcpy(image + KEYMAP_LIVE_MACROS, macros, macroBytes);
+    }
+    keymapLivePut16(image + KEYMAP_LIVE_SETTINGS + KEYMAP_LIVE_SET_COMBO_TERM, comboTerm);
+    crc = keymapLiveCrc32(image, KEYMAP_LIVE_IMAGE_SIZE);
+  }
+
+  const uint8_t *image() const { return images[active]; }
+
+  uint8_t keycode(uint8_t layer, uint8_t position) const {
+    return images[active][KEYMAP_LIVE_KEYCODES + layer * KEYMAP_POSITIONS + position];
+  }
+
+  // Text of macro n, empty past the last one
+  const char *macro(uint8_t n) const {
+    const char *text = (const char *)images[active] + KEYMAP_LIVE_MACROS;
+    const char *end = text + KEYMAP_LIVE_MACRO_BYTES - 1;
+    for (; n > 0 && text < end; n--) {
+      text += strlen(text) + 1;
+    }
+    return text < end ? text : end;
+  }
+
+  uint16_t setting(uint8_t offset) const { return keymapLiveGet16(images[active] + KEYMAP_LIVE_SETTINGS + offset); }
+
+  // One request from the host; true when answer holds a report to send back
+  bool receive(const uint8_t *request, uint8_t *answer) {
+    memset(answer, 0, KEYMAP_LIVE_REPORT_SIZE);
+    answer[0] = request[0];
+    uint8_t *staging = images[active ^ 1];
+    switch (request[0]) {
+      case KEYMAP_LIVE_CMD_INFO:
+        answer[2] = KEYMAP_LAYERS;
+        answer[3] = KEYMAP_POSITIONS;
+        keymapLivePut16(answer + 4, KEYMAP_LIVE_MACRO_BYTES);
+        answer[6] = KEYMAP_LIVE_SETTINGS_BYTES;
+        keymapLivePut16(answer + 7, KEYMAP_LIVE_IMAGE_SIZE);
+        keymapLivePut32(answer + 9, crc);
+        answer[13] = generation;
+        answer[14] = pending;
+        return true;
+
+      case KEYMAP_LIVE_CMD_READ: {
+        uint16_t offset = keymapLiveGet16(request + 1);
+        uint8_t len = request[3] < KEYMAP_LIVE_CHUNK_MAX ? request[3] : KEYMAP_LIVE_CHUNK_MAX;
+        if (offset > KEYMAP_LIVE_IMAGE_SIZE) {
+          answer[1] = KEYMAP_LIVE_ERR_SIZE;
+          return true;
+        }
+        if (len > KEYMAP_LIVE_IMAGE_SIZE - offset) {
+          len = (uint8_t)(KEYMAP_LIVE_IMAGE_SIZE - offset);
+        }
+        keymapLivePut16(answer + 2, offset);
+        answer[4] = len;
+        memcpy(answer + KEYMAP_LIVE_CHUNK_HEADER, images[active] + offset, len);
+        return true;
+      }
+
+      case KEYMAP_LIVE_CMD_WRITE: {
+        uint16_t offset = keymapLiveGet16(request + 1);
+        uint8_t len = request[3];
+        if (pending) {
+          answer[1] = KEYMAP_LIVE_ERR_BUSY;
+        } else if (offset != 0 && offset != received) {
+          answer[1] = KEYMAP_LIVE_ERR_OFFSET;
+        } else if (len == 0 || len > KEYMAP_LIVE_CHUNK_MAX || len > KEYMAP_LIVE_IMAGE_SIZE - offset) {
+          answer[1] = KEYMAP_LIVE_ERR_SIZE;
+        } else if (keymapLiveCrc8(request + KEYMAP_LIVE_CHUNK_HEADER, len) != request[4]) {
+          answer[1] = KEYMAP_LIVE_ERR_CHUNK;
+          received = offset;
+        } else {
+          memcpy(staging + offset, request + KEYMAP_LIVE_CHUNK_HEADER, len);
+          received = offset + len;
+          return false;
+        }
+        keymapLivePut16(answer + 2, received);
+        return true;
+      }
+
+      case KEYMAP_LIVE_CMD_COMMIT:
+        if (pending) {
+          answer[1] = KEYMAP_LIVE_ERR_BUSY;
+        } else if (keymapLiveGet16(request + 1) != KEYMAP_LIVE_IMAGE_SIZE || received != KEYMAP_LIVE_IMAGE_SIZE) {
+          answer[1] = KEYMAP_LIVE_ERR_SIZE;
+        } else if ((stagedCrc = keymapLiveCrc32(staging, KEYMAP_LIVE_IMAGE_SIZE)) != keymapLiveGet32(request + 3)) {
+          answer[1] = KEYMAP_LIVE_ERR_CRC;
+        } else if (staging[KEYMAP_LIVE_SETTINGS - 1] != 0) {
+          answer[1] = KEYMAP_LIVE_ERR_MACROS;
+        } else {
+          // Answered by apply()
+          pending = true;
+          return false;
+        }
+        // The staging image stays: after an incomplete upload the host goes
+        // on from the last WRITE error's offset
+        return true;
+
+      default:
+        answer[1] = KEYMAP_LIVE_ERR_COMMAND;
+        return true;
+    }
+  }
+
+  // Scan boundary: swap in a committed image; true when it did, with the
+  // commit's answer
+  bool apply(uint8_t *answer) {
+    if (!pending) {
+      return false;
+    }
+    active ^= 1;
+    crc = stagedCrc;
+    generation++;
+    pending = false;
+    received = 0;
+    memset(answer, 0, KEYMAP_LIVE_REPORT_SIZE);
+    answer[0] = KEYMAP_LIVE_CMD_COMMIT;
+    answer[1] = KEYMAP_LIVE_OK;
+    answer[2] = generation;
+    return true;
+  }
+};
+
+#endif // KEYMAP_POSITIONS
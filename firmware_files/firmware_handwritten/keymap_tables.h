@@ -0,0 +1,113 @@
+// Generated by firmware_host/tools/keymap_compiler from firmware_handwritten/keyboard.json and firmware_handwritten/keymap.json (LAYOUT_split_4x6).
+// Do not edit, regenerate with:
+//   keymap_compiler --target handwritten firmware_handwritten/keyboard.json firmware_handwritten/keymap.json -o firmware_handwritten/keymap_tables.h
+// Note: layer 2 cannot be reached from layer 0.
+
+#pragma once
+
+#define KEYMAP_LAYERS 3
+#define KEYMAP_MATRIX_ROWS 8
+#define KEYMAP_MATRIX_COLS 6
+#define KEYMAP_POSITIONS 48
+#define KEYMAP_LAYOUT_KEYS 48
+#define KEYMAP_COLUMN_WIRES 12
+#define KEYMAP_COMBOS 0
+#define KEYMAP_MACROS 0
+
+// Matrix position (row * KEYMAP_MATRIX_COLS + col) -> LAYOUT_split_4x6 index, 0xFF if unused
+const uint8_t keymapLayoutIndex[KEYMAP_POSITIONS] PROGMEM = {
+  0, 1, 2, 3, 4, 5,
+  6, 7, 8, 9, 10, 11,
+  12, 13, 14, 15, 16, 17,
+  18, 19, 20, 21, 22, 23,
+  24, 25, 26, 27, 28, 29,
+  30, 31, 32, 33, 34, 35,
+  36, 37, 38, 39, 40, 41,
+  42, 43, 44, 45, 46, 47,
+};
+
+#define KEYMAP_BLOCKS 6
+#define KEYMAP_KEYCODES 125
+
+// Keycodes per layer, sparse: 125 of 144 positions set, 141 bytes of flash
+// (144 as a full table)
+// Upper layers: bit i of presence byte b is set when matrix position 8b + i
+// is set on the layer, clear where the layer is transparent
+const uint8_t keymapPresence[KEYMAP_LAYERS - 1][KEYMAP_BLOCKS] PROGMEM = {
+  {0xff, 0xff, 0x03, 0xff, 0xf7, 0x03}, // Layer 1
+  {0xff, 0xff, 0x03, 0xff, 0xff, 0xff}, // Layer 2
+};
+// Upper layers: index of the layer's first keycode in keymapKeycodes
+const uint16_t keymapLayerStart[KEYMAP_LAYERS - 1] PROGMEM = {
+  48, 83,
+};
+
+// Layer 0 by matrix position, then the keycodes each upper layer sets in
+// matrix position order (/*___*/ where it is transparent)
+const uint8_t keymapKeycodes[KEYMAP_KEYCODES] PROGMEM = {
+  // Layer 0
+  // Matrix rows 0-3
+  KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y,
+  KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H,
+  KEY_Z, KEY_X, KEY_C, KEY_V, KEY_B, KEY_N,
+  KEY_ESC, KEY_TAB, KEY_LEFT_CTRL, KEY_LEFT_SHIFT, KEY_BACKSPACE, KEY_LEFT_ALT,
+
+  // Matrix rows 4-7
+  KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P, KEY_BACKSLASH,
+  KEY_J, KEY_K, KEY_L, KEY_SEMICOLON, KEY_QUOTE, KEY_ENTER,
+  KEY_M, KEY_COMMA, KEY_PERIOD, KEY_SLASH, KEY_RIGHT_SHIFT, KEY_RIGHT_ALT,
+  CMD_LAYER_CHANGE, KEY_SPACE, KEY_LEFT_ARROW, KEY_DOWN_ARROW, KEY_UP_ARROW, KEY_RIGHT_ARROW,
+
+  // Layer 1
+  // Matrix rows 0-3
+  KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6,
+  KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6,
+  KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
+  /*___*/ /*___*/ /*___*/ /*___*/ /*___*/ /*___*/
+
+  // Matrix rows 4-7
+  KEY_7, KEY_8, KEY_9, KEY_0, KEY_MINUS, KEY_EQUAL,
+  KEY_HOME, KEY_PAGE_DOWN, KEY_PAGE_UP, KEY_END, KEY_DELETE, /*___*/
+  CMD_MACRO_RECORD, KEY_VOLUME_DOWN, KEY_VOLUME_UP, KEY_MUTE, KEY_PRINT_SCREEN, CMD_PROGRAM_MODE,
+  /*___*/ /*___*/ /*___*/ /*___*/ /*___*/ /*___*/
+
+  // Layer 2
+  // Matrix rows 0-3
+  KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
+  KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
+  KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
+  /*___*/ /*___*/ /*___*/ /*___*/ /*___*/ /*___*/
+
+  // Matrix rows 4-7
+  KEY_NUM_LOCK, KEY_KP_SLASH, KEY_KP_ASTERISK, KEY_KP_MINUS, KEY_RESERVED, KEY_RESERVED,
+  KEY_KP_7, KEY_KP_8, KEY_KP_9, KEY_KP_PLUS, KEY_RESERVED, KEY_RESERVED,
+  KEY_KP_4, KEY_KP_5, KEY_KP_6, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
+  KEY_KP_1, KEY_KP_2, KEY_KP_3, KEY_KP_ENTER, KEY_KP_0, KEY_KP_DOT,
+};
+
+// Ghost topology: keys sharing a row wire and a column wire. Three pressed
+// corners of a rectangle over these wires make the fourth one ghost.
+constexpr uint64_t keymapRowWireMask[KEYMAP_MATRIX_ROWS] = {
+  0x000000000000003full,
+  0x0000000000000fc0ull,
+  0x000000000003f000ull,
+  0x0000000000fc0000ull,
+  0x000000003f000000ull,
+  0x0000000fc0000000ull,
+  0x000003f000000000ull,
+  0x0000fc0000000000ull,
+};
+constexpr uint64_t keymapColumnWireMask[KEYMAP_COLUMN_WIRES] = {
+  0x0000000000041041ull,
+  0x0000000000082082ull,
+  0x0000000000104104ull,
+  0x0000000000208208ull,
+  0x0000000000410410ull,
+  0x0000000000820820ull,
+  0x0000041041000000ull,
+  0x0000082082000000ull,
+  0x0000104104000000ull,
+  0x0000208208000000ull,
+  0x0000410410000000ull,
+  0x0000820820000000ull,
+};
@@ -1,23 +1,48 @@
 /*
   Split Keyboard Firmware for RP2040 Zero board
-  
+
   This firmware allows communication between two halves of a split keyboard.
   Left side scans keys and sends the state to the right side via I2C.
   Right side combines both halves' states and sends to the computer via USB.
-  
+
   Copyright AKASH O' MATICS (FEB 2025)
-  
-  Licensed under the MIT License 
+
+  Licensed under the MIT License
 */
 
 #include <Wire.h>
+#include <hardware/flash.h>
 #include "Adafruit_TinyUSB.h"
 #include "HID-Project.h"
+#include "ws2812_pio.h"
+#include "i2c_slave_dma.h"
+#include "hid_report_queue.h"
+
+// Per-stage loop timing, printed over Serial every STAGE_PROFILE_REPORT_MS
+// #define STAGE_PROFILE_ENABLE
+#define STAGE_PROFILE_REPORT_MS 5000
+#define STAGE_PROFILE_IMPLEMENTATION
+#include "../firmware_common/stage_profile.h"
+
+// Combos from keymap.json (firmware_common/combo.h)
+#define COMBO_IMPLEMENTATION
+#include "../firmware_common/combo.h"
 
-// Pin definitions
-#define ROW_COUNT 4
-#define COL_COUNT 6
-#define TOTAL_KEYS (ROW_COUNT * COL_COUNT)
+// Strings typed by KeyboardCore::typeString()
+#define SEND_STRING_IMPLEMENTATION
+#include "../firmware_common/send_string.h"
+
+// Press counters per key and layer, logged to flash; "h" on Serial prints them
+#define HEATMAP_ENABLE
+#define HEATMAP_IMPLEMENTATION
+extern "C" uint8_t _FS_start;  // arduino-pico linker script: filesystem, then EEPROM, up to the end of flash
+
+// Keymap, macros and settings replaced over raw HID (keymap_live.h),
+// synced by keymap_compiler --sync
+#define KEYMAP_LIVE_ENABLE
+
+// Scan, debounce, report and state machine shared with the Nano build
+#include "keyboard_core.h"
 
 // Configuration pins
 #define SIDE_SELECT_PIN 28  // GPIO28 for side detection: HIGH for right side, LOW for left side
@@ -27,613 +52,243 @@
 #define I2C_SCL_PIN 5       // GPIO5 for SCL
 #define LEFT_SIDE_ADDR 0x23
 
-// Timing
-#define SCAN_INTERVAL 10      // ms between key scans
-#define DEBOUNCE_TIME 20      // ms for debounce
-
-// Special keys and commands
-#define CMD_LAYER_CHANGE 0xF0
-#define CMD_MACRO_RECORD 0xF1
-#define CMD_MACRO_PLAY   0xF2
-#define CMD_PROGRAM_MODE 0xF3
-
-// Keyboard states
-typedef enum {
-  STATE_NORMAL,
-  STATE_LAYER_SWITCH,
-  STATE_PROGRAMMING,
-  STATE_PROGRAMMING_SRC,
-  STATE_PROGRAMMING_DST,
-  STATE_MACRO_RECORD_TRIGGER,
-  STATE_MACRO_RECORD,
-  STATE_MACRO_PLAY,
-  STATE_WAITING,
-  STATE_PRINTING
-} KeyboardState;
-
-// Layer definitions
-#define LAYER_DEFAULT 0
-#define LAYER_FN      1
-#define LAYER_NUMPAD  2
-#define MAX_LAYERS    3
-
 // RGB LED pins (for status indication)
 #define RGB_LED_PIN 16  // GPIO16 for NeoPixel LED on RP2040 Zero
 
-// Key matrices - Updated for RP2040 Zero GPIO pins
-const uint8_t rowPins[ROW_COUNT] = {6, 7, 8, 9};
-const uint8_t colPins[COL_COUNT] = {10, 11, 12, 13, 14, 15};
-
-// Key state tracking
-bool currentKeyState[TOTAL_KEYS] = {0};
-bool previousKeyState[TOTAL_KEYS] = {0};
-bool debouncedKeyState[TOTAL_KEYS] = {0};
-uint32_t lastDebounceTime[TOTAL_KEYS] = {0};
-
-// Received key states from the other half
-bool otherHalfKeyState[TOTAL_KEYS] = {0};
-
-// Combined key states for HID report
-uint8_t combinedKeyReport[6] = {0};
-uint8_t prevKeyReport[6] = {0};
-
-// Current active layer
-uint8_t currentLayer = LAYER_DEFAULT;
-
-// Configuration
-bool isRightSide = false;
-unsigned long lastScanTime = 0;
-uint32_t uptimeMs = 0;
-
-// State machine variables
-KeyboardState currentState = STATE_NORMAL;
-KeyboardState nextState = STATE_NORMAL;
-uint8_t pressedKeyCount = 0;
-uint8_t programSrcKey = 0;
-bool recordingMacro = false;
-
-// USB HID
-Adafruit_USBD_HID usb_hid;
-
-// Keymap definitions (each layer has ROW_COUNT * COL_COUNT * 2 keys - for both halves)
-const uint8_t keymap[MAX_LAYERS][ROW_COUNT * COL_COUNT * 2] PROGMEM = {
-  // Default layer
-  {
-    // Left half
-    KEY_Q, KEY_W, KEY_E, KEY_R, KEY_T, KEY_Y,
-    KEY_A, KEY_S, KEY_D, KEY_F, KEY_G, KEY_H,
-    KEY_Z, KEY_X, KEY_C, KEY_V, KEY_B, KEY_N,
-    KEY_ESC, KEY_TAB, KEY_LEFT_CTRL, KEY_LEFT_SHIFT, KEY_BACKSPACE, KEY_LEFT_ALT,
-    
-    // Right half
-    KEY_Y, KEY_U, KEY_I, KEY_O, KEY_P, KEY_BACKSLASH,
-    KEY_J, KEY_K, KEY_L, KEY_SEMICOLON, KEY_QUOTE, KEY_ENTER,
-    KEY_M, KEY_COMMA, KEY_PERIOD, KEY_SLASH, KEY_RIGHT_SHIFT, KEY_RIGHT_ALT,
-    CMD_LAYER_CHANGE, KEY_SPACE, KEY_LEFT_ARROW, KEY_DOWN_ARROW, KEY_UP_ARROW, KEY_RIGHT_ARROW
-  },
-  
-  // Function layer
-  {
-    // Left half
-    KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6,
-    KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6,
-    KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
-    KEY_ESC, KEY_TAB, KEY_LEFT_CTRL, KEY_LEFT_SHIFT, KEY_BACKSPACE, KEY_LEFT_ALT,
-    
-    // Right half
-    KEY_7, KEY_8, KEY_9, KEY_0, KEY_MINUS, KEY_EQUAL,
-    KEY_HOME, KEY_PAGE_DOWN, KEY_PAGE_UP, KEY_END, KEY_DELETE, KEY_ENTER,
-    CMD_MACRO_RECORD, KEY_VOLUME_DOWN, KEY_VOLUME_UP, KEY_MUTE, KEY_PRINT_SCREEN, CMD_PROGRAM_MODE,
-    CMD_LAYER_CHANGE, KEY_SPACE, KEY_LEFT_ARROW, KEY_DOWN_ARROW, KEY_UP_ARROW, KEY_RIGHT_ARROW
-  },
-  
-  // Numpad layer
-  {
-    // Left half
-    KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
-    KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
-    KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
-    KEY_ESC, KEY_TAB, KEY_LEFT_CTRL, KEY_LEFT_SHIFT, KEY_BACKSPACE, KEY_LEFT_ALT,
-    
-    // Right half
-    KEY_NUM_LOCK, KEY_KP_SLASH, KEY_KP_ASTERISK, KEY_KP_MINUS, KEY_RESERVED, KEY_RESERVED,
-    KEY_KP_7, KEY_KP_8, KEY_KP_9, KEY_KP_PLUS, KEY_RESERVED, KEY_RESERVED,
-    KEY_KP_4, KEY_KP_5, KEY_KP_6, KEY_RESERVED, KEY_RESERVED, KEY_RESERVED,
-    KEY_KP_1, KEY_KP_2, KEY_KP_3, KEY_KP_ENTER, KEY_KP_0, KEY_KP_DOT
-  }
+// USB HID: keyboard, consumer control and system control reports on one
+// interface. Media keys get a report of their own instead of a key slot.
+// The vendor report carries the live keymap protocol both ways.
+enum { RID_KEYBOARD = 1, RID_CONSUMER, RID_SYSTEM, RID_RAW };
+static_assert(RID_RAW == KEYMAP_LIVE_REPORT_ID, "host tools address the vendor report by KEYMAP_LIVE_REPORT_ID");
+
+static const uint8_t hidReportDescriptor[] = {
+  TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(RID_KEYBOARD)),
+  TUD_HID_REPORT_DESC_CONSUMER(HID_REPORT_ID(RID_CONSUMER)),
+  TUD_HID_REPORT_DESC_SYSTEM_CONTROL(HID_REPORT_ID(RID_SYSTEM)),
+  TUD_HID_REPORT_DESC_GENERIC_INOUT(KEYMAP_LIVE_REPORT_SIZE, HID_REPORT_ID(RID_RAW)),
 };
 
-// Function prototypes
-void scanKeys();
-void processKeys();
-void updateLEDs();
-void handleStateNormal();
-void handleStateProgramming();
-void handleStateMacroRecordTrigger();
-void handleStateMacroRecord();
-void sendKeyReport();
-void receiveKeyStates();
-void sendKeyStates();
-uint8_t getKeyFromPosition(uint8_t row, uint8_t col);
-void clearKeyReport();
-void updateKeyReport();
-void updateTimers();
-bool programKeyPressed();
-bool macroRecordKeyPressed();
-void setRgbColor(uint8_t r, uint8_t g, uint8_t b);
-
-// Setup for I2C handler
-void i2cRequestEvent() {
-  sendKeyStates();
-}
-
-void setup() {
-  // Initialize USB
-  usb_hid.setPollInterval(2);
-  usb_hid.setReportDescriptor(HID_KEYBOARD_REPORT_DESC, sizeof(HID_KEYBOARD_REPORT_DESC));
-  usb_hid.begin();
-
-  // Initialize pins
-  for (uint8_t i = 0; i < ROW_COUNT; i++) {
-    pinMode(rowPins[i], OUTPUT);
-    digitalWrite(rowPins[i], HIGH);
-  }
-  
-  for (uint8_t i = 0; i < COL_COUNT; i++) {
-    pinMode(colPins[i], INPUT_PULLUP);
-  }
-  
-  // RGB LED setup for status indication
-  pinMode(RGB_LED_PIN, OUTPUT);
-  
-  // Determine side (left or right)
-  pinMode(SIDE_SELECT_PIN, INPUT_PULLUP);
-  delay(10);  // Short delay to let the pin settle
-  isRightSide = digitalRead(SIDE_SELECT_PIN);
-  
-  // Wait for USB to be mounted
-  while (!TinyUSBDevice.mounted()) {
-    delay(1);
-  }
-  
-  // Configure I2C with appropriate pins for RP2040
-  Wire.setSDA(I2C_SDA_PIN);
-  Wire.setSCL(I2C_SCL_PIN);
-  
-  if (isRightSide) {
-    // Right side acts as I2C master
-    Wire.begin();
-    
-    // Initialize keyboard (only on right side)
-    Keyboard.begin();
-  } else {
-    // Left side acts as I2C slave
-    Wire.begin(LEFT_SIDE_ADDR);
-    Wire.onRequest(i2cRequestEvent);
-  }
-  
-  Serial.begin(115200);
-  while (!Serial && millis() < 3000) {
-    delay(1);  // Wait up to 3 seconds for serial port to connect
-  }
-  
-  Serial.println(isRightSide ? "Initialized as RIGHT side" : "Initialized as LEFT side");
-  
-  // Set initial LED color based on side
-  if (isRightSide) {
-    setRgbColor(0, 0, 64);  // Blue for right side
-  } else {
-    setRgbColor(64, 0, 0);  // Red for left side
-  }
-  
-  lastScanTime = millis();
-}
-
-void loop() {
-  updateTimers();
-  scanKeys();
-  
-  if (isRightSide) {
-    // Right side: get key states from left side, process all keys, send to computer
-    receiveKeyStates();
-    processKeys();
-    updateLEDs();
-    
-    // Process keyboard states
-    switch (currentState) {
-      case STATE_NORMAL:
-        handleStateNormal();
-        break;
-      case STATE_WAITING:
-        if (pressedKeyCount == 0) {
-          currentState = nextState;
-          nextState = STATE_NORMAL;
-        }
-        break;
-      case STATE_PROGRAMMING_SRC:
-      case STATE_PROGRAMMING_DST:
-        handleStateProgramming();
-        break;
-      case STATE_MACRO_RECORD_TRIGGER:
-        handleStateMacroRecordTrigger();
-        break;
-      case STATE_MACRO_RECORD:
-        handleStateMacroRecord();
-        break;
-      case STATE_MACRO_PLAY:
-        // Handled by key processing
-        break;
-      default:
-        // Unknown state, go back to normal
-        currentState = STATE_NORMAL;
-        break;
-    }
-    
-    // Send key report to USB
-    sendKeyReport();
-  } else {
-    // Left side: nothing else to do, key states will be sent when requested
-  }
-  
-  // Ensure scanning interval
-  while (millis() - lastScanTime < SCAN_INTERVAL) {
-    // Wait
-    delay(1);  // Small delay to prevent CPU spinning
-  }
-  lastScanTime = millis();
-}
+Adafruit_USBD_HID usb_hid;
 
-void updateTimers() {
-  uptimeMs = millis();
+// Reports wait here for the next USB frame (hid_report_queue.h)
+static HidReportQueue hidQueue;
+static HidUsageQueue hidUsageQueue;
+static HidRawQueue<KEYMAP_LIVE_REPORT_SIZE> rawRequests;  // from the host, taken by the loop
+static HidRawQueue<KEYMAP_LIVE_REPORT_SIZE> rawAnswers;   // from the loop, sent at start of frame
+static uint8_t hidKeys[6];  // report built by hidReleaseAll()/hidPress()/hidSend()
+
+// The core asks hidCanTake() before each change, so these find room
+static void queueHidReport() { hidQueue.push(hidKeys); }
+
+static void queueHidUsage(uint8_t id, uint16_t usage) { hidUsageQueue.push(id, usage); }
+
+// Vendor report from the host (SET_REPORT, TinyUSB task): queued for the
+// loop. A full queue drops it; the next chunk then misses its offset and
+// the host resends from there.
+static void hidSetReport(uint8_t reportId, hid_report_type_t type, uint8_t const *buffer, uint16_t size) {
+  (void)type;
+  if (reportId == 0 && size > 0 && buffer[0] == RID_RAW) {
+    // Report ID still in front (interrupt OUT path)
+    reportId = buffer[0];
+    buffer++;
+    size--;
+  }
+  if (reportId != RID_RAW || size < KEYMAP_LIVE_REPORT_SIZE) {
+    return;
+  }
+  rawRequests.push(buffer);
 }
 
-void scanKeys() {
-  for (uint8_t row = 0; row < ROW_COUNT; row++) {
-    // Set the current row LOW for scanning
-    digitalWrite(rowPins[row], LOW);
-    delayMicroseconds(10); // Give the row time to settle
-    
-    for (uint8_t col = 0; col < COL_COUNT; col++) {
-      uint8_t keyIndex = row * COL_COUNT + col;
-      bool keyState = !digitalRead(colPins[col]); // Inverted because pullup
-      
-      // Store the current key state
-      currentKeyState[keyIndex] = keyState;
-      
-      // Debounce
-      if (currentKeyState[keyIndex] != previousKeyState[keyIndex]) {
-        lastDebounceTime[keyIndex] = uptimeMs;
-      }
-      
-      if ((uptimeMs - lastDebounceTime[keyIndex]) > DEBOUNCE_TIME) {
-        // If the debounce time has passed, update the stable state
-        if (debouncedKeyState[keyIndex] != currentKeyState[keyIndex]) {
-          debouncedKeyState[keyIndex] = currentKeyState[keyIndex];
-        }
+// Start of frame, from the TinyUSB task: one queued report per frame, on
+// the endpoint before the host's poll in that frame (poll interval 1 ms).
+// Key reports go first, consumer and system reports in frames they leave,
+// vendor reports after those.
+extern "C" void tud_sof_cb(uint32_t frame_count) {
+  (void)frame_count;
+  if (!usb_hid.ready()) {
+    return;
+  }
+  uint8_t keys[6];
+  if (!hidQueue.take(keys)) {
+    uint8_t id;
+    uint16_t usage;
+    if (!hidUsageQueue.take(id, usage)) {
+      uint8_t answer[KEYMAP_LIVE_REPORT_SIZE];
+      if (rawAnswers.take(answer)) {
+        usb_hid.sendReport(RID_RAW, answer, sizeof(answer));
       }
-      
-      previousKeyState[keyIndex] = currentKeyState[keyIndex];
+      return;
     }
-    
-    // Set the row back to HIGH
-    digitalWrite(rowPins[row], HIGH);
-  }
-  
-  // Count pressed keys
-  pressedKeyCount = 0;
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (debouncedKeyState[i]) {
-      pressedKeyCount++;
+    if (id == RID_CONSUMER) {
+      usb_hid.sendReport16(RID_CONSUMER, usage);
+    } else {
+      // The system control field counts from 1 = power down (0x81)
+      uint8_t value = usage ? usage - 0x80 : 0;
+      usb_hid.sendReport(RID_SYSTEM, &value, 1);
     }
-    if (otherHalfKeyState[i]) {
-      pressedKeyCount++;
+    return;
+  }
+  uint8_t modifiers = 0;
+  uint8_t codes[6] = {0};
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < 6; i++) {
+    if (HidReportQueue::isModifier(keys[i])) {
+      modifiers |= 1 << (keys[i] - 0xE0);
+    } else if (keys[i] != 0) {
+      codes[n++] = keys[i];
     }
   }
+  usb_hid.keyboardReport(RID_KEYBOARD, modifiers, codes);
 }
 
-void processKeys() {
-  // Clear current key report
-  clearKeyReport();
-  
-  // Only process and send keys in normal state
-  if (currentState == STATE_NORMAL || currentState == STATE_MACRO_RECORD) {
-    updateKeyReport();
-  }
-}
+// Side, for the greeting sent once a terminal opens the serial port
+static bool bootRightSide;
+static bool serialGreeted;
 
-void clearKeyReport() {
-  for (uint8_t i = 0; i < 6; i++) {
-    combinedKeyReport[i] = 0;
-  }
-}
+void setRgbColor(uint8_t r, uint8_t g, uint8_t b);
 
-void updateKeyReport() {
-  uint8_t reportIndex = 0;
-  
-  // First process this side's keys
-  for (uint8_t i = 0; i < TOTAL_KEYS && reportIndex < 6; i++) {
-    if (debouncedKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i]);
-      
-      // Check for special commands
-      if (keycode >= CMD_LAYER_CHANGE) {
-        // Handle special commands
-        if (keycode == CMD_LAYER_CHANGE) {
-          // Toggle layer
-          if (currentLayer == LAYER_DEFAULT) {
-            currentLayer = LAYER_FN;
-          } else {
-            currentLayer = LAYER_DEFAULT;
-          }
-        }
-        // Don't add command keys to the report
-      } else if (keycode != KEY_RESERVED) {
-        // Regular key, add to report
-        combinedKeyReport[reportIndex++] = keycode;
-      }
+// Board traits for KeyboardCore (see keyboard_core.h)
+struct Rp2040Board {
+  // Key matrices - RP2040 Zero GPIO pins
+  typedef PinList<6, 7, 8, 9> RowPins;
+  typedef PinList<10, 11, 12, 13, 14, 15> ColPins;
+
+  static const uint8_t sidePin = SIDE_SELECT_PIN;
+  static const uint8_t i2cAddress = LEFT_SIDE_ADDR;
+
+  // SIO set/clear and input registers, one store or load per access
+  template <uint8_t Pin> static void writePin(bool high) { gpio_put(Pin, high); }
+  template <uint8_t Pin> static bool readPin() { return gpio_get(Pin); }
+
+  static uint32_t readColumns() {
+    // All columns from a single GPIO_IN read; consecutive pins reduce to a shift and mask
+    typedef PinOps<Rp2040Board, ColPins> Cols;
+    uint32_t levels = gpio_get_all();
+    if (Cols::contiguousFrom(ColPins::first)) {
+      return (~levels >> ColPins::first) & ((1ul << ColPins::size) - 1);
     }
-  }
-  
-  // Then process the other half's keys
-  uint8_t otherHalfOffset = TOTAL_KEYS; // Index offset for the other half in keymap
-  for (uint8_t i = 0; i < TOTAL_KEYS && reportIndex < 6; i++) {
-    if (otherHalfKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i + otherHalfOffset]);
-      
-      // Check for special commands
-      if (keycode >= CMD_LAYER_CHANGE) {
-        // Handle special commands
-        if (keycode == CMD_LAYER_CHANGE) {
-          // Toggle layer
-          if (currentLayer == LAYER_DEFAULT) {
-            currentLayer = LAYER_FN;
-          } else {
-            currentLayer = LAYER_DEFAULT;
-          }
-        }
-        // Don't add command keys to the report
-      } else if (keycode != KEY_RESERVED) {
-        // Regular key, add to report
-        combinedKeyReport[reportIndex++] = keycode;
-      }
+    return Cols::gatherLow(levels);
+  }
+
+  static void pinOutput(uint8_t pin) { pinMode(pin, OUTPUT); }
+  static void pinInputPullup(uint8_t pin) { pinMode(pin, INPUT_PULLUP); }
+  static void settle() { delayMicroseconds(10); }
+  static void sideSettle() { delayMicroseconds(100); }  // Internal pull-up charges the pin in a few us
+  static uint32_t millis() { return ::millis(); }
+
+  static void init() {
+    // Initialize USB; the host enumerates it while the keyboard already scans
+    hidQueue.reset();
+    hidUsageQueue.reset();
+    rawRequests.reset();
+    rawAnswers.reset();
+    usb_hid.setPollInterval(1);
+    usb_hid.setReportDescriptor(hidReportDescriptor, sizeof(hidReportDescriptor));
+    usb_hid.setReportCallback(NULL, hidSetReport);
+    usb_hid.begin();
+    tud_sof_cb_enable(true);
+
+    // RGB LED setup for status indication (PIO + DMA, never blocks the loop)
+    ws2812Init(RGB_LED_PIN);
+  }
+
+  static void begin(bool rightSide, void (*onRequest)()) {
+    if (rightSide) {
+      // Right side acts as I2C master
+      Wire.setSDA(I2C_SDA_PIN);
+      Wire.setSCL(I2C_SCL_PIN);
+      Wire.begin();
+
+      // Initialize keyboard (only on right side)
+      Keyboard.begin();
+    } else {
+      // Left side acts as I2C slave, answers fed to the FIFO by DMA
+      i2cSlaveDmaInit(I2C_SDA_PIN, I2C_SCL_PIN, LEFT_SIDE_ADDR, onRequest);
     }
-  }
-}
 
-void sendKeyReport() {
-  bool reportChanged = false;
-  
-  // Check if report is different from previous one
-  for (uint8_t i = 0; i < 6; i++) {
-    if (combinedKeyReport[i] != prevKeyReport[i]) {
-      reportChanged = true;
-      break;
-    }
-  }
-  
-  // Only send if changed
-  if (reportChanged) {
-    // Release all keys first
-    Keyboard.releaseAll();
-    
-    // Press the current keys
-    for (uint8_t i = 0; i < 6; i++) {
-      if (combinedKeyReport[i] != 0) {
-        Keyboard.press(combinedKeyReport[i]);
-      }
+    // Output before a terminal opens the port is dropped, task() greets it
+    Serial.begin(115200);
+    bootRightSide = rightSide;
+
+    // Set initial LED color based on side
+    if (rightSide) {
+      setRgbColor(0, 0, 64);  // Blue for right side
+    } else {
+      setRgbColor(64, 0, 0);  // Red for left side
     }
-    
-    // Save current report
-    memcpy(prevKeyReport, combinedKeyReport, 6);
   }
-}
 
-void receiveKeyStates() {
-  // Request data from left side
-  Wire.requestFrom(LEFT_SIDE_ADDR, TOTAL_KEYS / 8 + 1);
-  
-  // Clear existing states first
-  memset(otherHalfKeyState, 0, TOTAL_KEYS);
-  
-  uint8_t packedData[TOTAL_KEYS / 8 + 1];
-  uint8_t bytesRead = 0;
-  
-  while (Wire.available() && bytesRead < sizeof(packedData)) {
-    packedData[bytesRead++] = Wire.read();
-  }
-  
-  // Unpack key states
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    otherHalfKeyState[i] = (packedData[i / 8] & (1 << (i % 8))) ? true : false;
-  }
-}
+  static uint8_t requestOtherHalf(uint8_t *data, uint8_t len) {
+    Wire.requestFrom(LEFT_SIDE_ADDR, len);
 
-void sendKeyStates() {
-  // Pack key states into bytes to minimize I2C transfer
-  uint8_t packedData[TOTAL_KEYS / 8 + 1] = {0};
-  
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (debouncedKeyState[i]) {
-      packedData[i / 8] |= (1 << (i % 8));
+    uint8_t bytesRead = 0;
+    while (Wire.available() && bytesRead < len) {
+      data[bytesRead++] = Wire.read();
     }
+    return bytesRead;
   }
-  
-  Wire.write(packedData, sizeof(packedData));
-}
 
-void handleStateNormal() {
-  // Check for special key combinations
-  bool programKeyPressed = false;
-  bool macroRecordKeyPressed = false;
-  
-  // Check this side's keys
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (debouncedKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i]);
-      if (keycode == CMD_PROGRAM_MODE) {
-        programKeyPressed = true;
-      } else if (keycode == CMD_MACRO_RECORD) {
-        macroRecordKeyPressed = true;
-      }
-    }
-  }
-  
-  // Check other half's keys
-  uint8_t otherHalfOffset = TOTAL_KEYS;
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (otherHalfKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i + otherHalfOffset]);
-      if (keycode == CMD_PROGRAM_MODE) {
-        programKeyPressed = true;
-      } else if (keycode == CMD_MACRO_RECORD) {
-        macroRecordKeyPressed = true;
-      }
-    }
-  }
-  
-  // Enter special states based on key combinations
-  if (programKeyPressed && macroRecordKeyPressed) {
-    currentState = STATE_WAITING;
-    nextState = STATE_MACRO_RECORD_TRIGGER;
-  } else if (programKeyPressed) {
-    currentState = STATE_WAITING;
-    nextState = STATE_PROGRAMMING_SRC;
+  static void sendToMaster(const uint8_t *data, uint8_t len) { i2cSlaveDmaSend(data, len); }
+
+  static bool hostReady() { return TinyUSBDevice.mounted(); }
+  // Each change as one report: releaseAll() plus a report per held key
+  // would take up to seven queue slots, one frame each, and a change held
+  // for room loses the taps behind it (firmware_host/bench/hid_queue_bench)
+  static bool hidSingleReport() { return true; }
+
+  static void hidReleaseAll() {
+    memset(hidKeys, 0, sizeof(hidKeys));
+    queueHidReport();
   }
-}
 
-void handleStateProgramming() {
-  // Simplified programming mode for demonstration
-  // In a real implementation, this would allow remapping keys
-  
-  if (pressedKeyCount == 1) {
-    // Find which key is pressed
-    uint8_t pressedKey = 0xFF; // Invalid value
-    
-    // Check this side's keys
-    for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-      if (debouncedKeyState[i]) {
-        uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i]);
-        pressedKey = keycode;
-        break;
-      }
-    }
-    
-    // Check other half's keys
-    uint8_t otherHalfOffset = TOTAL_KEYS;
-    for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-      if (otherHalfKeyState[i]) {
-        uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i + otherHalfOffset]);
-        pressedKey = keycode;
+  static void hidPress(uint8_t keycode) {
+    for (uint8_t i = 0; i < 6; i++) {
+      if (hidKeys[i] == 0) {
+        hidKeys[i] = keycode;
         break;
       }
     }
-    
-    if (currentState == STATE_PROGRAMMING_SRC) {
-      // Save the source key
-      programSrcKey = pressedKey;
-      currentState = STATE_WAITING;
-      nextState = STATE_PROGRAMMING_DST;
-    } else if (currentState == STATE_PROGRAMMING_DST) {
-      // In a real implementation, we would save the key remapping
-      // For this demo, we'll just go back to programming mode
-      currentState = STATE_WAITING;
-      nextState = STATE_PROGRAMMING_SRC;
-    }
-  } else if (pressedKeyCount >= 2) {
-    // Check for exit combo (PROGRAM + FN keys)
-    if (programKeyPressed()) {
-      currentState = STATE_WAITING;
-      nextState = STATE_NORMAL;
-    }
+    queueHidReport();
   }
-}
 
-bool programKeyPressed() {
-  // Check if program key is pressed on either half
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (debouncedKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i]);
-      if (keycode == CMD_PROGRAM_MODE) return true;
-    }
-  }
-  
-  uint8_t otherHalfOffset = TOTAL_KEYS;
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (otherHalfKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i + otherHalfOffset]);
-      if (keycode == CMD_PROGRAM_MODE) return true;
-    }
+  static void hidSend(const uint8_t *keys) {
+    memcpy(hidKeys, keys, sizeof(hidKeys));
+    queueHidReport();
   }
-  
-  return false;
-}
 
-void handleStateMacroRecordTrigger() {
-  // Simplified for demonstration
-  // In a real implementation, this would record a key combination as a macro trigger
-  
-  if (pressedKeyCount > 0) {
-    // Record triggered
-    currentState = STATE_WAITING;
-    nextState = STATE_MACRO_RECORD;
-  }
-}
+  static uint8_t hidRoom() { return HID_QUEUE_SIZE - hidQueue.depth(); }
 
-void handleStateMacroRecord() {
-  if (!recordingMacro) {
-    recordingMacro = true;
-    // In a real implementation, we would initialize macro recording
+  // Full only while the host stops taking reports; the core keeps the
+  // change until a frame has freed enough slots
+  static bool hidCanTake(uint8_t keyboard, uint8_t usages) {
+    return keyboard <= HID_QUEUE_SIZE - hidQueue.depth() && usages <= HID_QUEUE_SIZE - hidUsageQueue.depth();
   }
-  
-  // Check for exit combo (MACRO_RECORD + PROGRAM keys)
-  if (macroRecordKeyPressed() && programKeyPressed()) {
-    recordingMacro = false;
-    // In a real implementation, we would save the recorded macro
-    currentState = STATE_WAITING;
-    nextState = STATE_NORMAL;
-  }
-}
 
-bool macroRecordKeyPressed() {
-  // Check if macro record key is pressed on either half
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (debouncedKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i]);
-      if (keycode == CMD_MACRO_RECORD) return true;
-    }
-  }
-  
-  uint8_t otherHalfOffset = TOTAL_KEYS;
-  for (uint8_t i = 0; i < TOTAL_KEYS; i++) {
-    if (otherHalfKeyState[i]) {
-      uint8_t keycode = pgm_read_byte(&keymap[currentLayer][i + otherHalfOffset]);
-      if (keycode == CMD_MACRO_RECORD) return true;
-    }
-  }
-  
-  return false;
-}
+  static void hidConsumer(uint16_t usage) { queueHidUsage(RID_CONSUMER, usage); }
+  static void hidSystem(uint8_t usage) { queueHidUsage(RID_SYSTEM, usage); }
+  static void keyEvent(uint8_t, bool, uint32_t) {}
+
+  static bool rawHidReceive(uint8_t *report) { return rawRequests.take(report); }
+
+  // Answers are few and the host waits for each; one that finds the queue
+  // full is dropped and the host's request times out
+  static void rawHidSend(const uint8_t *report) { rawAnswers.push(report); }
 
-void updateLEDs() {
-  // LED management for different states
-  static KeyboardState previousState = STATE_NORMAL;
-  static uint8_t previousLayer = LAYER_DEFAULT;
-  
-  if (currentState != previousState || currentLayer != previousLayer) {
+  static void statusChanged(uint8_t state, uint8_t layer) {
     Serial.print("State: ");
-    Serial.print(currentState);
+    Serial.print(state);
     Serial.print(", Layer: ");
-    Serial.println(currentLayer);
-    
+    Serial.println(layer);
+
     // Update RGB LED based on state and layer
-    switch (currentState) {
+    switch (state) {
       case STATE_NORMAL:
         // Layer colors in normal state
-        if (currentLayer == LAYER_DEFAULT) {
+        if (layer == LAYER_DEFAULT) {
           setRgbColor(0, 64, 0);  // Green for default layer
-        } else if (currentLayer == LAYER_FN) {
+        } else if (layer == LAYER_FN) {
           setRgbColor(64, 64, 0);  // Yellow for function layer
-        } else if (currentLayer == LAYER_NUMPAD) {
+        } else if (layer == LAYER_NUMPAD) {
           setRgbColor(64, 0, 64);  // Purple for numpad layer
         }
         break;
@@ -648,31 +303,94 @@ void updateLEDs() {
         setRgbColor(64, 64, 64);  // White for other states
         break;
     }
-    
-    previousState = currentState;
-    previousLayer = currentLayer;
+  }
+
+  static void logLine(const char *line) { Serial.println(line); }
+
+  static void task() {
+    // Push a pending LED colour once the previous frame has latched
+    ws2812Task();
+
+    if (!serialGreeted && Serial) {
+      serialGreeted = true;
+      Serial.println(bootRightSide ? "Initialized as RIGHT side" : "Initialized as LEFT side");
+    }
+  }
+
+  static void idle() {
+    delay(1);  // Small delay to prevent CPU spinning
+  }
+
+  // Heatmap log in the sectors just below the filesystem/EEPROM area at the
+  // end of flash: 256 KB of the 2 MB, well clear of the sketch. XIP is off while the flash is
+  // programmed, so nothing may run from flash: interrupts off around it.
+  static const uint8_t *heatmapFlash() {
+    return &_FS_start - HEATMAP_LOG_SECTORS * HEATMAP_LOG_SECTOR_SIZE;
+  }
+
+  static void heatmapProgram(uint32_t offset, const uint8_t *page) {
+    uint32_t at = (uint32_t)(heatmapFlash() - (const uint8_t *)XIP_BASE) + offset;
+    noInterrupts();
+    flash_range_program(at, page, HEATMAP_LOG_PAGE_SIZE);
+    interrupts();
+  }
+
+  static void heatmapErase(uint32_t offset) {
+    uint32_t at = (uint32_t)(heatmapFlash() - (const uint8_t *)XIP_BASE) + offset;
+    noInterrupts();
+    flash_range_erase(at, HEATMAP_LOG_SECTOR_SIZE);
+    interrupts();
+  }
+
+  // Host asleep: the core flushes then, but never erases (a resume would
+  // find interrupts off)
+  static bool hostSuspended() { return TinyUSBDevice.mounted() && TinyUSBDevice.suspended(); }
+};
+
+KeyboardCore<Rp2040Board> keyboard;
+
+// Setup for I2C handler
+void i2cRequestEvent() {
+  keyboard.sendKeyStates();
+}
+
+void setup() {
+  keyboard.setup(i2cRequestEvent);
+}
+
+// Serial console commands, one per line:
+//   h           print the heatmap
+//   type <text> type text on the host (typeString(), a report per USB frame)
+static char serialLine[512];
+static uint16_t serialLength;
+static char typingText[sizeof(serialLine)];
+
+static void serialCommand() {
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (serialLength < sizeof(serialLine) - 1) {
+        serialLine[serialLength++] = c;
+      }
+      continue;
+    }
+    serialLine[serialLength] = 0;
+    if (strcmp(serialLine, "h") == 0) {
+      keyboard.heatmapDumpStart();
+    } else if (strncmp(serialLine, "type ", 5) == 0 && !keyboard.typing.active) {
+      strcpy(typingText, serialLine + 5);
+      keyboard.typeString(typingText);
+    }
+    serialLength = 0;
   }
 }
 
+void loop() {
+  keyboard.loop();
+  serialCommand();
+}
+
 void setRgbColor(uint8_t r, uint8_t g, uint8_t b) {
-  
-  // For now, just log the color to serial
-  Serial.print("LED Color: R=");
-  // WILL TRY HUE PIXEL COLORING
-
-  Serial.print(r);
-
-  Serial.print(", G=");
-  // WILL TRY HUE PIXEL COLORING
-
-  Serial.print(g);
-
-  Serial.print(", B=");
-  // WILL TRY HUE PIXEL COLORING
-  Serial.println(b);
-  
-  // TODO: Implement actual LED control using NeoPixel or similar
-  // NeoPixel code would look something like:
-  // pixels.setPixelColor(0, pixels.Color(r, g, b));
-  // pixels.show();
-}
\ No newline at end of file
+  // Queued for the PIO/DMA driver, transmitted from loop() only if it changed
+  ws2812SetColor(r, g, b);
+}
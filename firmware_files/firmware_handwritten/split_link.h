@@ -0,0 +1,264 @@
+/*
+  Left-to-right split link: timestamped key events and clock sync
+
+  The left half queues every debounced press and release with its own
+  millis() and hands them over in the I2C answer. The master converts the
+  stamps to its clock and merges them with its own half's events, so both
+  halves come out as one stream in the order the keys changed, instead of
+  in the order the polls happened to see them.
+
+  I2C answer, SPLIT_PACKET_SIZE(bitmap) bytes, at most 32 (Wire buffer):
+
+    [0]     event count (bits 0-3), SPLIT_SCANNING (bit 5), SPLIT_MORE (bit 6),
+            SPLIT_OVERFLOW (bit 7)
+    [1..2]  slave millis() when the answer went out, low 16 bits, LE
+    [3..4]  slave millis() of the scan that built it: no event is missing
+            up to there
+    [5]     queue index of the first event
+    [6..]   SPLIT_EVENTS_PER_PACKET events of 3 bytes:
+              key position | SPLIT_PRESSED, stamp (slave ms, 16 bits LE)
+    [...]   debounced bitmap, bit i = key i
+
+  Without flags the slave is up to date as of the send time: anything it
+  hasn't sent yet will be stamped by a later scan. SPLIT_MORE: events were
+  left in the queue, the master must not take the slave as up to date past
+  the last event. SPLIT_SCANNING: the request came between a scan and the
+  answer it builds, the slave is only up to date as of [3..4].
+  SPLIT_OVERFLOW: the queue ran full and events were lost, the master
+  resyncs from the bitmap.
+
+  The answer is built by the main loop after each scan, never in the
+  request interrupt: the loop fills the buffer of a pair the interrupt is
+  not handing out and publishes it with a one byte index store, so the
+  interrupt only stamps the send time and copies a finished answer out,
+  and never sees the key state half updated. Events leave the queue once
+  an answer carrying them went out; until the next scan publishes again, a
+  second request gets the same events, which the master skips by their
+  queue index.
+
+  Clock sync needs nothing extra on the wire: every answer carries the slave
+  time, and the master's time on receiving it minus that is an offset
+  sample. Bus and ISR delays only ever make a sample larger, so the
+  smallest of the last SPLIT_SYNC_WINDOW samples is the estimate; the
+  window is short enough to follow RC oscillator drift. Stamps are 16 bit
+  and wrap every 65 s, far longer than anything waits in a queue.
+
+  Must stay C++11 (see keyboard_core.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Events per I2C answer; a full scan of changes fits in two polls
+#define SPLIT_EVENTS_PER_PACKET 4
+// Queue length on each side, a power of two
+#define SPLIT_QUEUE_SIZE 16
+// Offset samples the clock estimate is taken over
+#define SPLIT_SYNC_WINDOW 8
+
+#define SPLIT_PRESSED  0x80
+#define SPLIT_SCANNING 0x20
+#define SPLIT_MORE     0x40
+#define SPLIT_OVERFLOW 0x80
+#define SPLIT_COUNT_MASK 0x0F
+
+#define SPLIT_HEADER_SIZE 6
+#define SPLIT_PACKET_SIZE(bitmapBytes) (SPLIT_HEADER_SIZE + 3 * SPLIT_EVENTS_PER_PACKET + (bitmapBytes))
+
+static_assert((SPLIT_QUEUE_SIZE & (SPLIT_QUEUE_SIZE - 1)) == 0, "SPLIT_QUEUE_SIZE must be a power of two");
+static_assert(SPLIT_EVENTS_PER_PACKET <= SPLIT_COUNT_MASK, "event count field is 4 bits");
+
+struct SplitEvent {
+  uint8_t key;    // position | SPLIT_PRESSED
+  uint16_t time;  // ms on the clock of the half that saw it
+};
+
+// Ordering between the main loop and the request interrupt. On the MCUs the
+// interrupt runs on the same core, so only the compiler must not move
+// stores across it; host stress tests run the two sides as threads.
+#if defined(__AVR__)
+#define SPLIT_BARRIER() __asm__ __volatile__("" ::: "memory")
+#else
+#define SPLIT_BARRIER() __sync_synchronize()
+#endif
+
+#define SPLIT_ANSWER_MAX 32
+#define SPLIT_NOT_SENDING 0xFF
+
+// Left half: events and the answers carrying them. push(), prepare() and
+// publish() belong to the main loop, beginSend()/endSend() to the request
+// interrupt; each field has one writer.
+struct SplitEventQueue {
+  SplitEvent events[SPLIT_QUEUE_SIZE];
+  uint8_t head;             // index of the next event, push()
+  uint8_t gen;              // answers published
+  uint8_t overflowGen;      // first answer built after an event was lost
+  bool overflowed;
+  volatile bool scanning;   // between scanStarted() and publish()
+
+  uint8_t answers[2][SPLIT_ANSWER_MAX];
+  uint8_t answerGen[2];
+  volatile uint8_t published;  // answer the interrupt hands out, publish()
+  volatile uint8_t sending;    // answer being copied out, beginSend()
+  volatile uint8_t sentGen;    // last answer handed out, beginSend()
+  volatile uint8_t sent;       // events before this index went out, beginSend()
+
+  void reset() {
+    head = 0;
+    gen = 0;
+    overflowGen = 0;
+    overflowed = false;
+    scanning = false;
+    memset(answers, 0, sizeof(answers));
+    answerGen[0] = answerGen[1] = 0;
+    published = 0;
+    sending = SPLIT_NOT_SENDING;
+    sentGen = 0;
+    sent = 0;
+  }
+
+  // Before the scan whose changes go into the next answer
+  void scanStarted() {
+    scanning = true;
+    SPLIT_BARRIER();
+  }
+
+  void push(uint8_t key, uint16_t time) {
+    uint8_t h = head;
+    if ((uint8_t)(h - sent) == SPLIT_QUEUE_SIZE) {
+      overflowed = true;
+      overflowGen = gen + 1;
+      return;
+    }
+    events[h % SPLIT_QUEUE_SIZE].key = key;
+    events[h % SPLIT_QUEUE_SIZE].time = time;
+    head = h + 1;
+  }
+
+  // Header and events of the next answer, in the buffer the interrupt is
+  // not handing out; the caller appends the bitmap and publishes. Null
+  // while the interrupt is still copying that buffer (next scan then).
+  uint8_t *prepare(uint16_t scanTime) {
+    uint8_t next = published ^ 1;
+    if (sending == next) {
+      return 0;
+    }
+    if (overflowed && (int8_t)(sentGen - overflowGen) >= 0) {
+      overflowed = false;  // an answer saying so went out
+    }
+
+    uint8_t *packet = answers[next];
+    uint8_t t = sent;
+    uint8_t count = 0;
+    uint8_t *out = packet + SPLIT_HEADER_SIZE;
+    for (uint8_t i = t; i != head && count < SPLIT_EVENTS_PER_PACKET; i++, count++) {
+      const SplitEvent &e = events[i % SPLIT_QUEUE_SIZE];
+      out[0] = e.key;
+      out[1] = (uint8_t)e.time;
+      out[2] = (uint8_t)(e.time >> 8);
+      out += 3;
+    }
+
+    packet[0] = count;
+    if ((uint8_t)(t + count) != head) packet[0] |= SPLIT_MORE;
+    if (overflowed) packet[0] |= SPLIT_OVERFLOW;
+    packet[3] = (uint8_t)scanTime;
+    packet[4] = (uint8_t)(scanTime >> 8);
+    packet[5] = t;
+    return packet;
+  }
+
+  void publish() {
+    uint8_t next = published ^ 1;
+    answerGen[next] = ++gen;
+    SPLIT_BARRIER();
+    published = next;
+    SPLIT_BARRIER();
+    scanning = false;
+  }
+
+  // Interrupt: the latest answer with its send time. Constant time on the
+  // MCUs; the retry only matters when the loop runs on another thread.
+  const uint8_t *beginSend(uint16_t now) {
+    uint8_t i;
+    do {
+      i = published;
+      sending = i;
+      SPLIT_BARRIER();
+    } while (published != i);
+
+    uint8_t *packet = answers[i];
+    packet[0] = (packet[0] & ~SPLIT_SCANNING) | (scanning ? SPLIT_SCANNING : 0);
+    packet[1] = (uint8_t)now;
+    packet[2] = (uint8_t)(now >> 8);
+    sentGen = answerGen[i];
+    sent = packet[5] + (packet[0] & SPLIT_COUNT_MASK);
+    return packet;
+  }
+
+  // Interrupt: the answer has been copied to the bus driver
+  void endSend() {
+    SPLIT_BARRIER();
+    sending = SPLIT_NOT_SENDING;
+  }
+};
+
+// Master: slave clock offset from the time stamps of the answers
+struct SplitClock {
+  uint16_t samples[SPLIT_SYNC_WINDOW];
+  uint8_t count;
+  uint8_t next;
+  uint16_t offset;  // master ms - slave ms
+
+  void reset() {
+    count = 0;
+    next = 0;
+    offset = 0;
+  }
+
+  void sample(uint16_t slaveNow, uint16_t masterNow) {
+    uint16_t s = masterNow - slaveNow;
+    samples[next] = s;
+    next = (next + 1) % SPLIT_SYNC_WINDOW;
+    if (count < SPLIT_SYNC_WINDOW) count++;
+
+    // Smallest sample, compared relative to the newest so wrap doesn't matter
+    offset = s;
+    for (uint8_t i = 0; i < count; i++) {
+      if ((int16_t)(samples[i] - s) < (int16_t)(offset - s)) {
+        offset = samples[i];
+      }
+    }
+  }
+
+  // Slave stamp on the master's 32 bit clock; never later than masterNow
+  uint32_t toMaster(uint16_t slaveTime, uint32_t masterNow) const {
+    uint16_t age = (uint16_t)masterNow - (uint16_t)(slaveTime + offset);
+    return (int16_t)age < 0 ? masterNow : masterNow - age;
+  }
+};
+
+// Master: this half's events waiting for the other half to catch up, oldest first
+struct SplitPending {
+  uint8_t keys[SPLIT_QUEUE_SIZE];
+  uint32_t times[SPLIT_QUEUE_SIZE];
+  uint8_t count;
+
+  bool push(uint8_t key, uint32_t time) {
+    if (count == SPLIT_QUEUE_SIZE) return false;
+    keys[count] = key;
+    times[count] = time;
+    count++;
+    return true;
+  }
+
+  void pop() {
+    count--;
+    for (uint8_t i = 0; i < count; i++) {
+      keys[i] = keys[i + 1];
+      times[i] = times[i + 1];
+    }
+  }
+};
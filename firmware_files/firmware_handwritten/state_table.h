@@ -0,0 +1,135 @@
+/*
+  Transition table of the handwritten firmware's state machine
+
+  States and transitions follow the Stateflow chart built by
+  firmware_simulink/stateflow_chart_creator.m; firmware_host/bench/
+  state_machine_bench checks that both list the same states and the same
+  state-to-state edges. Every loop KeyboardCore tries the rows of the
+  current state in order and takes the first one whose guard holds.
+
+  A guard only looks at two words computed once per loop: which command
+  keys are held (bit per CMD_*, from the per-layer command masks of
+  keymap_tables.h and the held combos) and how many keys are held, as one
+  of three classes. So a row is two AND/compare pairs and a bit test.
+
+  Going through STATE_WAITING is how the chart waits for all keys to be let
+  go: a row to STATE_WAITING stores next, and WAITING's own row moves on to
+  it. Where the chart exits programming straight to NORMAL on PROGRAM+FN,
+  the firmware goes through WAITING so the held PROGRAM key doesn't start
+  programming again; the edge is the same.
+
+  Must stay C++11 (see keyboard_core.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Keyboard states, the states of the chart
+typedef enum {
+  STATE_NORMAL,
+  STATE_PROGRAMMING_SRC,
+  STATE_PROGRAMMING_DST,
+  STATE_MACRO_RECORD_TRIGGER,
+  STATE_MACRO_RECORD,
+  STATE_MACRO_PLAY,
+  STATE_WAITING,
+  STATE_COUNT
+} KeyboardState;
+
+// Command key held, for StateTransition::commands
+#define STATE_CMD(command) (1 << ((command) - CMD_LAYER_CHANGE))
+
+// Classes of the number of keys held, for StateTransition::count
+#define STATE_KEYS_NONE    0x01
+#define STATE_KEYS_ONE     0x02
+#define STATE_KEYS_SEVERAL 0x04
+#define STATE_KEYS_SOME    (STATE_KEYS_ONE | STATE_KEYS_SEVERAL)
+#define STATE_KEYS_ANY     (STATE_KEYS_NONE | STATE_KEYS_SOME)
+
+// Transition target of STATE_WAITING: the stored next state
+#define STATE_NEXT 0xFF
+
+// Actions taken with a transition
+typedef enum {
+  STATE_ACTION_NONE,
+  STATE_ACTION_SAVE_SOURCE,   // remember the keycode of the key held
+  STATE_ACTION_REMAP,         // remap source -> held key (not implemented yet)
+  STATE_ACTION_SAVE_MACRO,    // stop recording, keep the macro
+} StateAction;
+
+struct StateTransition {
+  uint8_t from;
+  uint8_t commands;  // STATE_CMD() bits that must all be held
+  uint8_t without;   // STATE_CMD() bits that must not be held
+  uint8_t count;     // STATE_KEYS_* classes allowed
+  uint8_t to;        // new state, or STATE_NEXT
+  uint8_t next;      // next state stored when going to STATE_WAITING
+  uint8_t action;    // StateAction
+};
+
+// Rows grouped by state, in the chart's execution order within a state
+constexpr StateTransition stateTransitions[] = {
+  // NORMAL: PROGRAM+MACRO starts recording a macro, PROGRAM alone programming
+  {STATE_NORMAL, STATE_CMD(CMD_PROGRAM_MODE) | STATE_CMD(CMD_MACRO_RECORD), 0, STATE_KEYS_ANY,
+   STATE_WAITING, STATE_MACRO_RECORD_TRIGGER, STATE_ACTION_NONE},
+  {STATE_NORMAL, STATE_CMD(CMD_PROGRAM_MODE), STATE_CMD(CMD_MACRO_RECORD), STATE_KEYS_ANY,
+   STATE_WAITING, STATE_PROGRAMMING_SRC, STATE_ACTION_NONE},
+
+  // PROGRAMMING_SRC: one key picks the source, PROGRAM with another key
+  // leaves (the chart asks for PROGRAM+FN)
+  {STATE_PROGRAMMING_SRC, 0, 0, STATE_KEYS_ONE,
+   STATE_WAITING, STATE_PROGRAMMING_DST, STATE_ACTION_SAVE_SOURCE},
+  {STATE_PROGRAMMING_SRC, STATE_CMD(CMD_PROGRAM_MODE), 0, STATE_KEYS_SEVERAL,
+   STATE_WAITING, STATE_NORMAL, STATE_ACTION_NONE},
+
+  // PROGRAMMING_DST: one key picks the destination, PROGRAM with another key leaves
+  {STATE_PROGRAMMING_DST, 0, 0, STATE_KEYS_ONE,
+   STATE_WAITING, STATE_PROGRAMMING_SRC, STATE_ACTION_REMAP},
+  {STATE_PROGRAMMING_DST, STATE_CMD(CMD_PROGRAM_MODE), 0, STATE_KEYS_SEVERAL,
+   STATE_WAITING, STATE_NORMAL, STATE_ACTION_NONE},
+
+  // MACRO_RECORD_TRIGGER: any keys become the trigger. The chart's
+  // PROGRAM+MACRO exit comes second, as there, so it never wins.
+  {STATE_MACRO_RECORD_TRIGGER, 0, 0, STATE_KEYS_SOME,
+   STATE_WAITING, STATE_MACRO_RECORD, STATE_ACTION_NONE},
+  {STATE_MACRO_RECORD_TRIGGER, STATE_CMD(CMD_PROGRAM_MODE) | STATE_CMD(CMD_MACRO_RECORD), 0, STATE_KEYS_ANY,
+   STATE_WAITING, STATE_NORMAL, STATE_ACTION_NONE},
+
+  // MACRO_RECORD: MACRO+PROGRAM stops and keeps the macro
+  {STATE_MACRO_RECORD, STATE_CMD(CMD_PROGRAM_MODE) | STATE_CMD(CMD_MACRO_RECORD), 0, STATE_KEYS_ANY,
+   STATE_WAITING, STATE_NORMAL, STATE_ACTION_SAVE_MACRO},
+
+  // MACRO_PLAY: left by key processing
+
+  // WAITING: once every key is up
+  {STATE_WAITING, 0, 0, STATE_KEYS_NONE,
+   STATE_NEXT, STATE_NORMAL, STATE_ACTION_NONE},
+};
+
+static const uint8_t stateTransitionCount = sizeof(stateTransitions) / sizeof(stateTransitions[0]);
+
+// First row of a state; the rows of state s are [first(s), first(s + 1))
+constexpr uint8_t stateFirstTransition(uint8_t state, uint8_t row = 0) {
+  return row == stateTransitionCount || stateTransitions[row].from >= state ? row
+                                                                           : stateFirstTransition(state, row + 1);
+}
+
+constexpr uint8_t stateTransitionIndex[STATE_COUNT + 1] = {
+  stateFirstTransition(0), stateFirstTransition(1), stateFirstTransition(2), stateFirstTransition(3),
+  stateFirstTransition(4), stateFirstTransition(5), stateFirstTransition(6), stateFirstTransition(7),
+};
+
+static_assert(STATE_COUNT == 7, "update stateTransitionIndex with the states");
+
+constexpr bool stateTableSorted(uint8_t row = 1) {
+  return row >= stateTransitionCount ||
+         (stateTransitions[row - 1].from <= stateTransitions[row].from && stateTableSorted(row + 1));
+}
+
+static_assert(stateTableSorted(), "stateTransitions must be grouped by state in enum order");
+
+// Class of a held key count, as a STATE_KEYS_* bit
+inline uint8_t stateKeysClass(uint8_t count) {
+  return count == 0 ? STATE_KEYS_NONE : count == 1 ? STATE_KEYS_ONE : STATE_KEYS_SEVERAL;
+}
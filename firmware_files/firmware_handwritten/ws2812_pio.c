@@ -0,0 +1,131 @@
+/*
+  Non-blocking WS2812 (NeoPixel) driver for the RP2040 Zero status LED
+
+  See ws2812_pio.h for the overview.
+
+  Licensed under the MIT License
+*/
+
+#if defined(ARDUINO_ARCH_RP2040)
+
+#include "ws2812_pio.h"
+
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/timer.h"
+
+// PIO program from the pico-examples ws2812.pio (T1 = 2, T2 = 5, T3 = 3),
+// pre-assembled so no pioasm step is needed in the Arduino build.
+//     .wrap_target
+//  0: out    x, 1            side 0 [2]
+//  1: jmp    !x, 3           side 1 [1]
+//  2: jmp    0               side 1 [4]
+//  3: nop                    side 0 [4]
+//     .wrap
+#define WS2812_T1 2
+#define WS2812_T2 5
+#define WS2812_T3 3
+#define WS2812_FREQ 800000
+
+static const uint16_t ws2812ProgramInstructions[] = {
+  0x6221,
+  0x1123,
+  0x1400,
+  0xa442,
+};
+
+static const struct pio_program ws2812Program = {
+  .instructions = ws2812ProgramInstructions,
+  .length = 4,
+  .origin = -1,
+};
+
+// Use PIO1 like the QMK build does, leaving PIO0 to the Arduino core
+static PIO ws2812Pio = pio1;
+static uint ws2812Sm = 0;
+static int ws2812DmaChannel = -1;
+
+// DMA source word; only written while the channel is idle
+static uint32_t txWord = 0;
+
+// Colour currently on the LED and colour waiting to be sent. The sentinel
+// can never be produced by ws2812EncodeGrb() (its low byte is always zero).
+#define WS2812_NO_COLOR 0xFFFFFFFFu
+static uint32_t sentWord = WS2812_NO_COLOR;
+static uint32_t pendingWord = WS2812_NO_COLOR;
+
+// Earliest time the next frame may start (end of the reset gap)
+static uint32_t readyAtUs = 0;
+
+void ws2812Init(uint8_t pin) {
+  uint offset = pio_add_program(ws2812Pio, &ws2812Program);
+  ws2812Sm = pio_claim_unused_sm(ws2812Pio, true);
+
+  pio_gpio_init(ws2812Pio, pin);
+  pio_sm_set_consistent_pindirs(ws2812Pio, ws2812Sm, pin, 1, true);
+
+  pio_sm_config c = pio_get_default_sm_config();
+  sm_config_set_wrap(&c, offset + 0, offset + 3);
+  sm_config_set_sideset(&c, 1, false, false);
+  sm_config_set_sideset_pins(&c, pin);
+  sm_config_set_out_shift(&c, false, true, WS2812_FRAME_BITS);
+  sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+
+  int cyclesPerBit = WS2812_T1 + WS2812_T2 + WS2812_T3;
+  float div = clock_get_hz(clk_sys) / (float)(WS2812_FREQ * cyclesPerBit);
+  sm_config_set_clkdiv(&c, div);
+
+  pio_sm_init(ws2812Pio, ws2812Sm, offset, &c);
+  pio_sm_set_enabled(ws2812Pio, ws2812Sm, true);
+
+  // One 32-bit word per LED, paced by the state machine's TX FIFO
+  ws2812DmaChannel = dma_claim_unused_channel(true);
+  dma_channel_config dc = dma_channel_get_default_config(ws2812DmaChannel);
+  channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+  channel_config_set_read_increment(&dc, true);
+  channel_config_set_write_increment(&dc, false);
+  channel_config_set_dreq(&dc, pio_get_dreq(ws2812Pio, ws2812Sm, true));
+  dma_channel_configure(ws2812DmaChannel, &dc, &ws2812Pio->txf[ws2812Sm], &txWord, 1, false);
+
+  readyAtUs = time_us_32();
+}
+
+void ws2812SetColor(uint8_t r, uint8_t g, uint8_t b) {
+  // Only remember the latest colour; ws2812Task() decides when to send it,
+  // so every update between two loop passes collapses into one frame
+  pendingWord = ws2812EncodeGrb(r, g, b);
+}
+
+bool ws2812Busy(void) {
+  if (ws2812DmaChannel < 0) {
+    return false;
+  }
+  return dma_channel_is_busy(ws2812DmaChannel) || (int32_t)(time_us_32() - readyAtUs) < 0;
+}
+
+void ws2812Task(void) {
+  if (pendingWord == WS2812_NO_COLOR || ws2812DmaChannel < 0) {
+    return;
+  }
+
+  // Nothing new to show
+  if (pendingWord == sentWord) {
+    pendingWord = WS2812_NO_COLOR;
+    return;
+  }
+
+  // Previous frame still shifting out or latching, try again next loop
+  if (ws2812Busy()) {
+    return;
+  }
+
+  txWord = pendingWord;
+  sentWord = pendingWord;
+  pendingWord = WS2812_NO_COLOR;
+
+  readyAtUs = time_us_32() + WS2812_FRAME_US + WS2812_RESET_US;
+  dma_channel_transfer_from_buffer_now(ws2812DmaChannel, &txWord, 1);
+}
+
+#endif // ARDUINO_ARCH_RP2040
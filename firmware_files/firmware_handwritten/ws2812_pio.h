@@ -0,0 +1,43 @@
+/*
+  Non-blocking WS2812 (NeoPixel) driver for the RP2040 Zero status LED
+
+  The LED bitstream is generated by a PIO state machine and fed by a DMA
+  channel, so the CPU never bit-bangs and interrupts stay enabled (I2C and
+  USB keep running while a frame is on the wire).
+
+  Colour updates are coalesced: ws2812SetColor() only records the wanted
+  colour, and ws2812Task() (called from loop()) starts a transfer when the
+  previous frame and its reset gap are done. Back-to-back updates collapse
+  into the last one, and an unchanged colour is never retransmitted.
+
+  Licensed under the MIT License
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bits per LED frame (GRB, 8 bits each) and line timing at 800 kHz
+#define WS2812_FRAME_BITS 24
+#define WS2812_FRAME_US   30   // 24 bits * 1.25 us
+#define WS2812_RESET_US   300  // Latch gap, covers the longer WS2812B-V5 reset
+
+// Pack an RGB colour into the word the PIO program shifts out: GRB order,
+// MSB first, left-justified because the state machine autopulls 24 bits.
+static inline uint32_t ws2812EncodeGrb(uint8_t r, uint8_t g, uint8_t b) {
+  return ((uint32_t)g << 24) | ((uint32_t)r << 16) | ((uint32_t)b << 8);
+}
+
+void ws2812Init(uint8_t pin);
+void ws2812SetColor(uint8_t r, uint8_t g, uint8_t b);
+void ws2812Task(void);
+bool ws2812Busy(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,199 @@
+// Boot time of the handwritten firmware (firmware_handwritten/keyboard_core.h)
+// on the simulated board: power-on to the first scan pass, to the first
+// debounced key and to the first HID report carrying it, for a key held on
+// each half from power-on.
+//
+// Both halves power up together. The right half is plugged into a host that
+// configures it after a while (or never: a charger); the left half only has
+// the TRRS cable and never sees USB. Serial terminals open at some point or
+// never. Boards:
+//   rp2040 before - begin() as it was: waits for the USB mount, then up to
+//                   3 s for a terminal, 10 ms side select settle
+//   nano before   - begin() as it was: delay(100)
+//   now           - begin() never waits; reports are held back until the
+//                   host has configured the device (same on both boards)
+// The before boards send reports whenever the core has one; the simulated
+// USB stack drops what is sent before the mount, like the real ones do.
+//
+// Exits non-zero when the current firmware fails to scan from the first
+// loop on either half, loses a key held across enumeration, or reports it
+// later than one scan interval after the host is ready.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/boot_bench.cpp -o /tmp/boot_bench
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "../sim/sim_board.h"
+
+#define GIVE_UP_MS 10000
+#define NEVER UINT32_MAX
+
+struct Timeline {
+  const char *name;
+  uint32_t usbMountMs;    // host configures the right half
+  uint32_t serialOpenMs;  // a terminal opens the serial port
+};
+
+static const Timeline timelines[] = {
+    {"host at 150 ms, no terminal", 150, NEVER},
+    {"host at 150 ms, terminal at 800 ms", 150, 800},
+    {"host at 1500 ms (KVM, BIOS)", 1500, NEVER},
+    {"no host (charger)", NEVER, NEVER},
+};
+
+static uint32_t serialOpenMs;
+
+// Virtual delay for the blocking begin()s; false once the sim gives up
+static bool simDelay(uint32_t ms) {
+  simState.nowMs += ms;
+  return simState.nowMs < GIVE_UP_MS;
+}
+
+struct LegacyRp2040Board : SimBoard {
+  static void sideSettle() { simDelay(10); }
+  static bool hostReady() { return true; }
+  static void begin(bool, void (*)()) {
+    while (!SimBoard::hostReady()) {
+      if (!simDelay(1)) return;  // never mounted: stuck here for good
+    }
+    while (simState.nowMs < serialOpenMs && simState.nowMs < 3000) {
+      simDelay(1);
+    }
+  }
+};
+
+struct LegacyNanoBoard : SimBoard {
+  static bool hostReady() { return true; }
+  static void begin(bool, void (*)()) { simDelay(100); }
+};
+
+struct BootTimes {
+  uint32_t loopMs[2];    // first scan pass, right and left
+  uint32_t keyMs[2];     // key held from power-on debounced on its half
+  uint32_t reportMs[2];  // first report with that key reaching the host
+  uint32_t dropped;      // reports the USB stack dropped
+};
+
+// First position of each half with a plain key on the default layer, not
+// part of a combo (plain keys sort below the modifiers and CMD_* codes)
+static uint8_t pickKey(uint8_t first, uint8_t count) {
+  uint64_t combos = 0;
+#if KEYMAP_COMBOS
+  for (uint8_t i = 0; i < KEYMAP_COMBOS; i++) combos |= keymapCombos[i].keys;
+#endif
+  for (uint8_t p = first; p < first + count; p++) {
+    uint8_t code = keymapKeycode(LAYER_DEFAULT, p);
+    if (code >= KEY_A && code < KEY_LEFT_CTRL && !(combos >> p & 1)) return p;
+  }
+  return first;
+}
+
+template <typename Board> struct BootSim {
+  typedef KeyboardCore<Board> Core;
+
+  struct Half {
+    Core core;
+    SimState state;
+    uint32_t readyMs;
+    void enter() { simState = state; }
+    void leave() { state = simState; }
+  };
+
+  static inline Half halves[2];  // right, left
+
+  // The left half answers in the middle of the right half's loop
+  static void onRequest() {
+    SimState master = simState;
+    halves[1].enter();
+    simState.nowMs = master.nowMs;
+    halves[1].core.sendKeyStates();
+    halves[1].leave();
+    simState = master;
+    memcpy(simState.otherHalf, halves[1].state.sentToMaster, sizeof(simState.otherHalf));
+  }
+
+  static BootTimes run(const Timeline &timeline) {
+    const uint8_t halfKeys = Core::totalKeys, cols = Board::ColPins::size;
+    uint8_t key[2] = {pickKey(0, halfKeys), pickKey(halfKeys, halfKeys)};
+    serialOpenMs = timeline.serialOpenMs;
+
+    BootTimes t;
+    for (int h = 0; h < 2; h++) {
+      t.loopMs[h] = t.keyMs[h] = t.reportMs[h] = NEVER;
+      Half &half = halves[h];
+      memset(&simState, 0, sizeof(simState));
+      simState.levels = ~0ull;
+      simState.rightSide = h == 0;
+      simState.usbMountMs = h == 0 ? timeline.usbMountMs : NEVER;
+      uint8_t local = key[h] - h * halfKeys;
+      simSetKey(local / cols, local % cols, true);
+      half.core.reset();
+      half.core.setup(nullptr);
+      half.readyMs = simState.nowMs < GIVE_UP_MS ? simState.nowMs : NEVER;
+      half.core.lastScanTime -= SCAN_INTERVAL;  // loop() runs straight after setup()
+      half.leave();
+    }
+    halves[0].state.onRequest = onRequest;
+
+    for (uint32_t now = 0; now < GIVE_UP_MS; now++) {
+      for (int h = 1; h >= 0; h--) {
+        Half &half = halves[h];
+        if (now < half.readyMs || now - half.core.lastScanTime < SCAN_INTERVAL) continue;
+        half.enter();
+        simState.nowMs = now;
+        simState.otherHalfSilent = now < halves[1].readyMs;
+        half.core.loop();
+        half.leave();
+        if (t.loopMs[h] == NEVER) t.loopMs[h] = now;
+        if (t.keyMs[h] == NEVER && half.core.debouncedKeyState[key[h] - h * halfKeys]) t.keyMs[h] = now;
+      }
+      for (int h = 0; h < 2; h++) {
+        uint8_t code = keymapKeycode(LAYER_DEFAULT, key[h]);
+        if (t.reportMs[h] == NEVER && memchr(halves[0].state.hidKeys, code, 6)) t.reportMs[h] = now;
+      }
+    }
+    t.dropped = halves[0].state.hidDropped;
+    return t;
+  }
+};
+
+static std::string ms(uint32_t v) { return v == NEVER ? "never" : std::to_string(v); }
+
+static void print(const char *board, const BootTimes &t) {
+  printf("  %-14s %7s %7s %8s %8s %8s %8s %8u\n", board, ms(t.loopMs[0]).c_str(), ms(t.loopMs[1]).c_str(),
+         ms(t.keyMs[0]).c_str(), ms(t.keyMs[1]).c_str(), ms(t.reportMs[0]).c_str(), ms(t.reportMs[1]).c_str(),
+         t.dropped);
+}
+
+int main() {
+  bool ok = true;
+  for (const Timeline &timeline : timelines) {
+    printf("%s\n", timeline.name);
+    printf("  %-14s %15s %17s %17s %8s\n", "", "first scan R/L", "key scanned R/L", "key reported R/L", "dropped");
+    print("rp2040 before", BootSim<LegacyRp2040Board>::run(timeline));
+    print("nano before", BootSim<LegacyNanoBoard>::run(timeline));
+    BootTimes now = BootSim<SimBoard>::run(timeline);
+    print("now", now);
+
+    // Both halves scan from power-on; the held keys go out once the host is ready
+    uint32_t keysReady = DEBOUNCE_TIME + 2 * SCAN_INTERVAL;
+    for (int h = 0; h < 2; h++) {
+      if (now.loopMs[h] != 0 || now.keyMs[h] > keysReady) {
+        printf("  FAILED: %s half does not scan from power-on\n", h ? "left" : "right");
+        ok = false;
+      }
+      uint32_t due = timeline.usbMountMs == NEVER ? NEVER : std::max(timeline.usbMountMs, keysReady) + SCAN_INTERVAL;
+      if (due != NEVER ? now.reportMs[h] > due : now.reportMs[h] != NEVER) {
+        printf("  FAILED: %s key reported at %s ms\n", h ? "left" : "right", ms(now.reportMs[h]).c_str());
+        ok = false;
+      }
+    }
+    printf("\n");
+  }
+  printf("%s\n", ok ? "boot ok" : "FAILED");
+  return ok ? 0 : 1;
+}
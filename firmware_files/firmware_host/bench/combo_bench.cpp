@@ -0,0 +1,463 @@
+// Combo engine (firmware_common/combo.h) on typing traces of the
+// handwritten firmware's 8x6 matrix (trace_tool gen on
+// firmware_handwritten/keyboard.json + keymap.json).
+//
+// Traces are debounced per key (5 ms) and fed to the engine once per 1 ms
+// tick, the way a firmware calls combo_update() every scan. Combo sets:
+//   keymap   - the combos in firmware_handwritten/keymaps/combos/keymap.json
+//              (the default keymap has none)
+//   dense    - 108 combos: every horizontal and vertical neighbour pair and
+//              every horizontal triple, so most keys belong to many combos
+//   dense without index - the same 108 combos matched by scanning the whole
+//              table on every press (what the per-key index avoids)
+//
+// Reported per set: engine cost per matrix event (the same loop with an
+// empty table subtracted; only ticks where the matrix changed are timed),
+// combos fired (on prose these are accidental), and the delay the engine
+// adds between a debounced press and the key (or its combo) being reported,
+// for keys in some combo and for all others.
+//
+// Then the handwritten core, built with the combos keymap, takes the same
+// debounced events and runs a pass every SCAN_INTERVAL ms: every key must
+// reach the host in the order it was pressed, including keys a combo held
+// back and the key that let them out. Any key out of order fails the bench.
+//
+//   combo_bench [--term N] trace...
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/combo_bench.cpp -o /tmp/combo_bench
+
+#define COMBO_MAX_COMBOS 128
+#define COMBO_INDEX_SIZE 512
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#define KEYMAP_TABLES_H "keymaps/combos/keymap_tables.h"
+#include "../sim/sim_board.h"
+#include "../sim/trace.h"
+
+#define DEBOUNCE_MS 5
+#define ROUNDS 200
+
+static const uint8_t kRows = 8;
+static const uint8_t kCols = 6;
+
+// Debounced matrix per 1 ms tick, packed like KeyboardCore::pressedMask
+static std::vector<uint64_t> debounceTrace(const Trace &trace, uint32_t &events) {
+  TraceCursor cursor(trace);
+  std::vector<uint64_t> ticks;
+  uint64_t raw = 0, cooked = 0;
+  uint32_t changedAt[64] = {0};
+  events = 0;
+  for (uint32_t ms = 0; !cursor.done() || raw != cooked; ms++) {
+    cursor.advance(ms * 1000);
+    uint64_t now = 0;
+    for (uint8_t row = 0; row < kRows; row++) {
+      now |= (uint64_t)(cursor.rows[row] & ((1 << kCols) - 1)) << (row * kCols);
+    }
+    uint64_t changed = now ^ raw;
+    for (uint8_t pos = 0; pos < 64; pos++) {
+      uint64_t bit = 1ull << pos;
+      if (changed & bit) {
+        changedAt[pos] = ms;
+      } else if (((now ^ cooked) & bit) && ms - changedAt[pos] >= DEBOUNCE_MS) {
+        cooked ^= bit;
+        events++;
+      }
+    }
+    raw = now;
+    ticks.push_back(cooked);
+  }
+  return ticks;
+}
+
+static std::vector<combo_t> denseCombos() {
+  std::vector<combo_t> combos;
+  auto bit = [](int row, int col) { return 1ull << (row * kCols + col); };
+  uint16_t action = KEY_F12;
+  for (int row = 0; row < kRows; row++) {
+    for (int col = 0; col + 1 < kCols; col++) {
+      combos.push_back(combo_t{bit(row, col) | bit(row, col + 1), action});
+    }
+    for (int col = 0; col + 2 < kCols; col++) {
+      combos.push_back(combo_t{bit(row, col) | bit(row, col + 1) | bit(row, col + 2), action});
+    }
+  }
+  for (int half = 0; half < 2; half++) {
+    for (int row = half * 4; row + 1 < half * 4 + 4; row++) {
+      for (int col = 0; col < kCols; col++) {
+        combos.push_back(combo_t{bit(row, col) | bit(row + 1, col), action});
+      }
+    }
+  }
+  return combos;
+}
+
+// Same resolution rules as combo.h, candidates found by scanning every combo
+struct LinearCombos {
+  const combo_t *combos;
+  uint8_t count;
+  uint16_t term;
+  uint64_t members = 0, pressed = 0, buffered = 0, up = 0, suppressed = 0;
+  uint16_t start = 0;
+  uint32_t fired = 0;
+
+  LinearCombos(const combo_t *c, uint8_t n, uint16_t t) : combos(c), count(n), term(t) {
+    for (uint8_t i = 0; i < n; i++) {
+      members |= c[i].keys;
+    }
+  }
+
+  int match(uint64_t keys, bool &larger) const {
+    int exact = -1;
+    larger = false;
+    for (uint8_t i = 0; i < count; i++) {
+      if ((combos[i].keys & keys) == keys) {
+        if (combos[i].keys == keys) {
+          exact = i;
+        } else {
+          larger = true;
+        }
+      }
+    }
+    return exact;
+  }
+
+  void resolve() {
+    bool larger;
+    if (match(buffered, larger) >= 0) {
+      fired++;
+      suppressed |= buffered & ~up;
+    }
+    buffered = up = 0;
+  }
+
+  void press(uint8_t pos, uint16_t now) {
+    uint64_t bit = 1ull << pos;
+    if (!(members & bit)) {
+      if (buffered) resolve();
+      return;
+    }
+    bool larger;
+    int exact = match(buffered | bit, larger);
+    if (buffered && exact < 0 && !larger) {
+      resolve();
+      exact = match(bit, larger);
+    }
+    if (!buffered) start = now;
+    buffered |= bit;
+    if (exact >= 0 && !larger) resolve();
+  }
+
+  void release(uint8_t pos) {
+    uint64_t bit = 1ull << pos;
+    if (buffered & bit) {
+      up |= bit;
+      resolve();
+    }
+    suppressed &= ~bit;
+  }
+
+  // Term and releases; the caller feeds the presses after this
+  void update(uint64_t mask, uint16_t now) {
+    if (buffered && (uint16_t)(now - start) >= term) resolve();
+    uint64_t released = pressed & ~mask;
+    pressed = mask;
+    for (uint8_t pos = 0; released; pos++, released >>= 1) {
+      if (released & 1) release(pos);
+    }
+  }
+};
+
+struct Tick {
+  uint16_t ms;
+  uint64_t mask;
+};
+
+// The ticks where the debounced matrix changed
+static std::vector<Tick> changeTicks(const std::vector<uint64_t> &ticks) {
+  std::vector<Tick> out;
+  uint64_t prev = 0;
+  for (uint32_t ms = 0; ms < ticks.size(); ms++) {
+    if (ticks[ms] != prev) {
+      out.push_back(Tick{(uint16_t)ms, ticks[ms]});
+    }
+    prev = ticks[ms];
+  }
+  return out;
+}
+
+struct Latency {
+  std::vector<uint32_t> member;
+  std::vector<uint32_t> other;
+};
+
+struct SetResult {
+  double nsPerTick = 0;
+  uint32_t fired = 0;
+  Latency latency;
+};
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+static combo_state_t engine;
+static volatile uint64_t sink; // keeps the linear rounds from being optimised out
+
+// One pass over every tick for latency and fire counts, then timed rounds
+static SetResult runEngine(const std::vector<uint64_t> &ticks, const std::vector<Tick> &changes,
+                           const combo_t *combos, uint8_t count, uint16_t term) {
+  SetResult r;
+  if (!combo_init(&engine, combos, count, term)) {
+    fprintf(stderr, "combo table does not fit COMBO_MAX_COMBOS/COMBO_INDEX_SIZE\n");
+    exit(1);
+  }
+  uint16_t actions[COMBO_MAX_ACTIVE];
+  uint8_t actionCount;
+  uint64_t waiting = 0;
+  uint32_t pressedAt[64] = {0};
+  uint64_t prev = 0;
+  for (uint32_t ms = 0; ms < ticks.size(); ms++) {
+    uint64_t mask = ticks[ms];
+    uint64_t down = mask & ~prev;
+    prev = mask;
+    for (uint8_t pos = 0; pos < 64; pos++) {
+      if ((down >> pos) & 1) {
+        pressedAt[pos] = ms;
+      }
+    }
+    waiting |= down;
+    combo_update(&engine, mask, (uint16_t)ms);
+    uint8_t fresh = engine.active_fresh;
+    combo_output(&engine, mask, actions, &actionCount);
+    r.fired += __builtin_popcount(fresh);
+
+    uint64_t resolved = waiting & ~engine.buffered;
+    for (uint8_t pos = 0; resolved; pos++, resolved >>= 1) {
+      if (resolved & 1) {
+        ((engine.members >> pos) & 1 ? r.latency.member : r.latency.other).push_back(ms - pressedAt[pos]);
+      }
+    }
+    waiting &= engine.buffered;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    combo_init(&engine, combos, count, term);
+    for (const Tick &t : changes) {
+      combo_update(&engine, t.mask, t.ms);
+      combo_output(&engine, t.mask, actions, &actionCount);
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  r.nsPerTick = ns / ((double)changes.size() * ROUNDS);
+  return r;
+}
+
+static SetResult runLinear(const std::vector<uint64_t> &ticks, const std::vector<Tick> &changes,
+                           const combo_t *combos, uint8_t count, uint16_t term) {
+  SetResult r;
+  {
+    LinearCombos lin(combos, count, term);
+    for (uint32_t ms = 0; ms < ticks.size(); ms++) {
+      uint64_t down = ticks[ms] & ~lin.pressed;
+      lin.update(ticks[ms], (uint16_t)ms);
+      for (uint8_t pos = 0; down; pos++, down >>= 1) {
+        if (down & 1) lin.press(pos, (uint16_t)ms);
+      }
+    }
+    r.fired = lin.fired;
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  for (int round = 0; round < ROUNDS; round++) {
+    LinearCombos lin(combos, count, term);
+    for (const Tick &t : changes) {
+      uint64_t down = t.mask & ~lin.pressed;
+      lin.update(t.mask, t.ms);
+      for (uint8_t pos = 0; down; pos++, down >>= 1) {
+        if (down & 1) lin.press(pos, t.ms);
+      }
+    }
+    sink = sink + lin.fired + lin.suppressed;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+  r.nsPerTick = ns / ((double)changes.size() * ROUNDS);
+  return r;
+}
+
+typedef KeyboardCore<SimBoard> Core;
+
+static Core core;
+
+// Press tick of the key each keycode last came from, UINT32_MAX once the
+// host has seen that press (a layer change can bring the keycode back while
+// the key is held), and the keys in the last report
+struct HostOrder {
+  uint32_t pressedAt[256];
+  uint8_t keys[6];
+  uint32_t lastPress;
+  uint32_t keysSeen;
+  uint32_t outOfOrder;
+};
+
+static HostOrder order;
+
+static void onHidReport() {
+  for (uint8_t i = 0; i < 6; i++) {
+    uint8_t keycode = simState.hidKeys[i];
+    if (keycode == 0 || memchr(order.keys, keycode, sizeof(order.keys)) || order.pressedAt[keycode] == UINT32_MAX) {
+      continue;
+    }
+    // A key pressed before one the host already has went out late
+    if (order.pressedAt[keycode] < order.lastPress) {
+      order.outOfOrder++;
+    }
+    order.lastPress = order.pressedAt[keycode];
+    order.pressedAt[keycode] = UINT32_MAX;
+    order.keysSeen++;
+  }
+  memcpy(order.keys, simState.hidKeys, sizeof(order.keys));
+}
+
+// The core on the debounced trace: events as they debounce, one pass per scan
+static void runCore(const std::vector<uint64_t> &ticks) {
+  memset(&simState, 0, sizeof(simState));
+  simState.hidSingleReport = true;
+  simState.onHidReport = onHidReport;
+  memset(&order, 0, sizeof(order));
+  memset(order.pressedAt, 0xFF, sizeof(order.pressedAt));
+  core.reset();
+  core.isRightSide = true;
+  uint64_t prev = 0;
+  for (uint32_t ms = 0; ms < ticks.size(); ms++) {
+    simState.nowMs = ms;
+    core.uptimeMs = ms;
+    uint64_t changed = ticks[ms] ^ prev;
+    prev = ticks[ms];
+    for (uint8_t pos = 0; changed; pos++, changed >>= 1) {
+      if (!(changed & 1)) {
+        continue;
+      }
+      bool pressed = (ticks[ms] >> pos) & 1;
+      uint8_t base = pos < Core::totalKeys ? 0 : Core::totalKeys;
+      if (pressed) {
+        order.pressedAt[core.keycodeAt(pos)] = ms;
+      }
+      core.applyEvent((uint8_t)((pos - base) | (pressed ? SPLIT_PRESSED : 0)), base, ms);
+    }
+    if (ms % SCAN_INTERVAL == 0) {
+      core.processKeys();
+      core.runStateMachine();
+      core.sendKeyReport();
+    }
+  }
+}
+
+// U (a combo key, held back) pressed at 100 ms and S at 135 ms: the host
+// must see U go down before S
+static std::vector<uint64_t> usTicks() {
+  uint8_t u = 0, s = 0;
+  for (uint8_t pos = 0; pos < KEYMAP_POSITIONS; pos++) {
+    if (core.keycodeAt(pos) == KEY_U) u = pos;
+    if (core.keycodeAt(pos) == KEY_S) s = pos;
+  }
+  std::vector<uint64_t> ticks(300, 0);
+  for (uint32_t ms = 100; ms < 200; ms++) ticks[ms] |= 1ull << u;
+  for (uint32_t ms = 135; ms < 220; ms++) ticks[ms] |= 1ull << s;
+  return ticks;
+}
+
+int main(int argc, char **argv) {
+  uint16_t term = COMBO_TERM;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--term") == 0 && i + 1 < argc) {
+      term = (uint16_t)atoi(argv[++i]);
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "usage: combo_bench [--term N] <trace>...\n");
+    return 1;
+  }
+
+  std::vector<combo_t> dense = denseCombos();
+  printf("combo term %u ms, %zu dense combos, %d keymap combos\n", term, dense.size(), KEYMAP_COMBOS);
+
+  core.reset();
+  runCore(usTicks());
+  printf("core with keymap combos, U then S: %u out of press order\n", order.outOfOrder);
+  if (order.keysSeen != 2 || order.outOfOrder) {
+    printf("FAIL: the host did not see U go down before S\n");
+    return 1;
+  }
+
+  for (const char *path : paths) {
+    Trace trace;
+    std::string err = trace.load(path);
+    if (!err.empty()) {
+      fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    if (trace.rows != kRows || trace.cols != kCols) {
+      fprintf(stderr, "%s: %ux%u trace, expected the handwritten %ux%u matrix\n", path, trace.rows, trace.cols,
+              kRows, kCols);
+      return 1;
+    }
+    uint32_t events;
+    std::vector<uint64_t> ticks = debounceTrace(trace, events);
+
+    std::vector<Tick> changes = changeTicks(ticks);
+
+    SetResult none = runEngine(ticks, changes, nullptr, 0, term);
+    SetResult keymapSet = runEngine(ticks, changes, keymapCombos, KEYMAP_COMBOS, term);
+    SetResult denseSet = runEngine(ticks, changes, dense.data(), (uint8_t)dense.size(), term);
+    SetResult linearNone = runLinear(ticks, changes, nullptr, 0, term);
+    SetResult linear = runLinear(ticks, changes, dense.data(), (uint8_t)dense.size(), term);
+    double perEvent = (double)changes.size() / events;
+
+    printf("%s: %u events over %zu ticks\n", path, events, ticks.size());
+    printf("  %-22s %9s %7s %28s %22s\n", "combo set", "ns/event", "fired", "combo keys p50/p99/max ms",
+           "other keys p99/max ms");
+    struct Row {
+      const char *name;
+      SetResult *r;
+    } rows[] = {{"keymap", &keymapSet}, {"dense", &denseSet}, {"dense without index", &linear}};
+    for (const Row &row : rows) {
+      Latency &l = row.r->latency;
+      const SetResult &base = row.r == &linear ? linearNone : none;
+      printf("  %-22s %9.1f %7u", row.name, (row.r->nsPerTick - base.nsPerTick) * perEvent, row.r->fired);
+      if (row.r == &linear) {
+        printf(" %28s %22s\n", "-", "-");
+        continue;
+      }
+      printf(" %14u/%u/%u (%5zu) %14u/%u (%5zu)\n", percentile(l.member, 0.5), percentile(l.member, 0.99),
+             l.member.empty() ? 0 : *std::max_element(l.member.begin(), l.member.end()), l.member.size(),
+             percentile(l.other, 0.99), l.other.empty() ? 0 : *std::max_element(l.other.begin(), l.other.end()),
+             l.other.size());
+    }
+    if (linear.fired != denseSet.fired) {
+      printf("MISMATCH: indexed and linear matching fired %u and %u combos\n", denseSet.fired, linear.fired);
+      return 1;
+    }
+
+    runCore(ticks);
+    printf("  core with keymap combos: %u key presses reported, %u out of press order\n", order.keysSeen,
+           order.outOfOrder);
+    if (order.outOfOrder) {
+      printf("FAIL: the host saw keys out of the order they were pressed\n");
+      return 1;
+    }
+  }
+  return 0;
+}
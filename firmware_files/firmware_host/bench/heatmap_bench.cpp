@@ -0,0 +1,368 @@
+// Key press heatmap (firmware_common/key_heatmap.h) in the handwritten
+// firmware: what counting costs per key event, and whether logging the
+// counters to flash ever makes a scan late.
+//
+// Cost: heatmap_press() alone over random keys and layers, and the core's
+// applyEvent() per event with it (press and release), on this machine.
+//
+// Stall: the right half's loop() on the simulated board in virtual time,
+// with the heatmap log in simFlash. Typing sessions (a key every 100-250
+// ms, held 60-120 ms) alternate with idle gaps of 1-30 minutes; in gaps
+// over SUSPEND_AFTER_MS the host goes to sleep and suspends the bus from
+// then on, until the first key of the next session wakes it (--awake: the
+// host never sleeps). Each flash operation advances the virtual clock by
+// its duration from the W25Q16JV datasheet, typical (page program 0.4 ms,
+// sector erase 45 ms) or with --worst the maximum (3 ms, 400 ms).
+// Reported: scans that started late and by how much, while the host was
+// awake and while it had the bus suspended; how long each switch press
+// took to come out of debouncing, for presses while typing and for the
+// first press after HEATMAP_IDLE_MS without one (the only ones an erase
+// can hold up, and miss when released before it ends); the flash
+// operations done; how long the log went without an erased sector with
+// counters waiting in RAM; and whether the counters reached flash by the
+// end, after one more gap.
+//
+// Then power cuts: the flash as it is at several points of the run is
+// loaded into a fresh core, whole and with its last page torn in half, and
+// has to give back every counter written so far and nothing newer.
+//
+// Exits non-zero when a press while typing comes out of debouncing later
+// than DEBOUNCE_TIME + SCAN_INTERVAL + HEATMAP_STALL_BUDGET_MS (quick
+// re-presses that debouncing merges are counted missed either way), the
+// first press of a gap later than that plus HEATMAP_ERASE_MAX_MS, a scan is late
+// while the bus is suspended, a sector is erased while it is, the counters
+// are not all in flash after the last gap, or a counter is lost or
+// reloaded wrong.
+//
+//   heatmap_bench [--worst] [--awake] [--hours N]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/heatmap_bench.cpp -o /tmp/heatmap_bench
+
+#define HEATMAP_ENABLE
+// A log the run wraps many times, so erases happen; the firmware's is
+// -DHEATMAP_LOG_SECTORS=64
+#ifndef HEATMAP_LOG_SECTORS
+#define HEATMAP_LOG_SECTORS 4
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../sim/sim_board.h"
+
+typedef KeyboardCore<SimBoard> Core;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+static volatile uint32_t sink;  // keeps the timed loops from being optimised out
+
+static void cost() {
+  const uint32_t rounds = 2000000;
+  std::mt19937 rng(1);
+  std::vector<uint8_t> layers(4096), keys(4096);
+  for (size_t i = 0; i < keys.size(); i++) {
+    layers[i] = rng() % KEYMAP_LAYERS;
+    keys[i] = rng() % KEYMAP_POSITIONS;
+  }
+
+  static heatmap_t hm;
+  memset(&hm, 0, sizeof(hm));
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    heatmap_press(&hm, layers[i & 4095], keys[i & 4095]);
+  }
+  double pressNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+  sink = hm.count[0];
+
+  // applyEvent() on this half's keys, layer 0 letters only so the state
+  // machine stays put
+  std::vector<uint8_t> plain;
+  for (uint8_t i = 0; i < Core::totalKeys; i++) {
+    uint8_t keycode = keymapKeycode(LAYER_DEFAULT, i);
+    if (keycode < CMD_LAYER_CHANGE && keycode != KEY_RESERVED) plain.push_back(i);
+  }
+  static Core core;
+  memset(&simState, 0, sizeof(simState));
+  simState.rightSide = true;
+  core.reset();
+  core.isRightSide = true;
+  t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds / 2; i++) {
+    uint8_t key = plain[keys[i & 4095] % plain.size()];
+    core.applyEvent((uint8_t)(key | SPLIT_PRESSED), 0, i);
+    core.applyEvent(key, 0, i);
+  }
+  double eventNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+  sink = core.heatmap.count[0];
+
+  printf("per key event: heatmap_press %.1f ns, applyEvent with it %.1f ns (%u counters, %u bytes RAM)\n", pressNs,
+         eventNs, (unsigned)HEATMAP_COUNTERS, (unsigned)sizeof(heatmap_t));
+}
+
+// Idle time before the host sleeps and suspends the bus
+#define SUSPEND_AFTER_MS 600000
+
+// Flash timing, microseconds
+static uint32_t programUs, eraseUs;
+static uint32_t pendingUs;
+static uint32_t programs, erases, erasesSuspended;
+
+static void flashOp(bool erase) {
+  if (erase) {
+    erases++;
+    erasesSuspended += simState.usbSuspended;
+  } else {
+    programs++;
+  }
+  pendingUs += erase ? eraseUs : programUs;
+  simState.nowMs += pendingUs / 1000;
+  pendingUs %= 1000;
+}
+
+// Loads flash into a fresh core; false if a counter differs from what the
+// log was given (written, from the counters of the live core) or went up
+static bool reload(const uint8_t *flash, const Core &live, bool torn) {
+  static uint8_t saved[sizeof(simFlash)];
+  memcpy(saved, simFlash, sizeof(simFlash));
+  memcpy(simFlash, flash, sizeof(simFlash));
+
+  static Core fresh;
+  SimState state = simState;
+  simState.nowMs = 0;
+  fresh.reset();
+  fresh.setup(nullptr);
+  simState = state;
+
+  bool ok = true;
+  for (uint16_t i = 0; i < HEATMAP_COUNTERS; i++) {
+    bool dirty = live.heatmap.dirty[i >> 3] & (1 << (i & 7));
+    if (fresh.heatmap.count[i] > live.heatmap.count[i] || (!torn && !dirty && fresh.heatmap.count[i] != live.heatmap.count[i])) {
+      ok = false;
+    }
+  }
+  memcpy(simFlash, saved, sizeof(simFlash));
+  return ok;
+}
+
+// Presses as debouncing let them through (a quick re-press of the same key
+// merges with the one before)
+static uint32_t debounced[KEYMAP_POSITIONS];
+
+// Switch press to debounced press, per kind of press
+struct PressLatency {
+  uint32_t presses = 0;
+  uint32_t maxMs = 0;
+  uint32_t missed = 0;  // released before debouncing saw it (or merged with the press before)
+};
+
+static PressLatency typingPresses, gapPresses;
+static int8_t watchedKey = -1;  // pressed, not debounced yet
+static uint32_t watchedSince;
+static bool watchedGap;
+
+static void countPress(uint8_t position, bool pressed, uint32_t) {
+  if (pressed) debounced[position]++;
+  if (pressed && position == watchedKey) {
+    PressLatency &l = watchedGap ? gapPresses : typingPresses;
+    l.presses++;
+    l.maxMs = std::max(l.maxMs, simState.nowMs - watchedSince);
+    watchedKey = -1;
+  }
+}
+
+struct Lateness {
+  uint32_t scans = 0;
+  uint32_t late = 0;
+  uint32_t maxMs = 0;
+};
+
+static void stall(bool worst, bool awake, uint32_t hours) {
+  programUs = worst ? 3000 : 400;
+  eraseUs = worst ? 400000 : 45000;
+
+  std::vector<uint8_t> plain;
+  for (uint8_t i = 0; i < Core::totalKeys; i++) {
+    uint8_t keycode = keymapKeycode(LAYER_DEFAULT, i);
+    if (keycode < CMD_LAYER_CHANGE && keycode != KEY_RESERVED) plain.push_back(i);
+  }
+
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = true;
+  simState.otherHalfSilent = true;
+  memset(simFlash, 0xFF, sizeof(simFlash));
+  simFlashOp = flashOp;
+
+  static Core core;
+  core.reset();
+  core.setup(nullptr);
+
+  std::mt19937 rng(7);
+  uint32_t typed = 0;
+  memset(debounced, 0, sizeof(debounced));
+  simState.onKeyEvent = countPress;
+  Lateness awakeScans, suspendedScans;
+  uint32_t suspends = 0, blockedMs = 0;
+  uint32_t endMs = hours * 3600000u;
+  uint32_t cuts = 0, cutOk = 0;
+  static uint8_t cutFlash[sizeof(simFlash)];
+
+  // Session schedule: type until sessionEnd, then idle until the next one,
+  // asleep from sleepAt
+  bool inSession = false;
+  uint32_t sessionEnd = 0, nextSession = 1000, sleepAt = UINT32_MAX;
+  uint32_t nextKey = 0, releaseAt = 0, lastSwitchMs = 0;
+  int8_t heldKey = -1;
+  typingPresses = gapPresses = PressLatency();
+  watchedKey = -1;
+  uint32_t nextCut = 600000;
+
+  uint32_t lastScan = core.lastScanTime;
+  while (simState.nowMs < endMs) {
+    uint32_t now = simState.nowMs;
+    if (!inSession && now >= nextSession) {
+      inSession = true;
+      sessionEnd = now + 60000 + rng() % 1140000;
+      nextKey = now;
+      simState.usbSuspended = false;
+    } else if (!inSession && now >= sleepAt) {
+      sleepAt = UINT32_MAX;
+      simState.usbSuspended = true;
+      suspends++;
+    }
+    if (heldKey >= 0 && now >= releaseAt) {
+      simSetKey(heldKey / Core::colCount, heldKey % Core::colCount, false);
+      if (watchedKey == heldKey) {
+        (watchedGap ? gapPresses : typingPresses).missed++;
+        watchedKey = -1;
+      }
+      heldKey = -1;
+      lastSwitchMs = now;
+    }
+    if (inSession && heldKey < 0 && now >= nextKey) {
+      if (now >= sessionEnd) {
+        inSession = false;
+        nextSession = now + 60000 + rng() % 1740000;
+        if (!awake && nextSession - now > SUSPEND_AFTER_MS) sleepAt = now + SUSPEND_AFTER_MS;
+      } else {
+        heldKey = plain[rng() % plain.size()];
+        simSetKey(heldKey / Core::colCount, heldKey % Core::colCount, true);
+        watchedKey = heldKey;
+        watchedSince = now;
+        watchedGap = now - lastSwitchMs >= HEATMAP_IDLE_MS;
+        lastSwitchMs = now;
+        typed++;
+        releaseAt = now + 60 + rng() % 61;
+        nextKey = now + 100 + rng() % 151;
+      }
+    }
+
+    bool suspended = simState.usbSuspended;
+    core.loop();
+
+    uint32_t interval = core.lastScanTime - lastScan;
+    lastScan = core.lastScanTime;
+    if (core.heatmapLog.erased == 0 && core.heatmapLog.page == HEATMAP_LOG_PAGES) blockedMs += interval;
+    Lateness &l = suspended ? suspendedScans : awakeScans;
+    l.scans++;
+    if (interval > SCAN_INTERVAL) {
+      l.late++;
+      if (interval - SCAN_INTERVAL > l.maxMs) l.maxMs = interval - SCAN_INTERVAL;
+    }
+
+    // Power cut: the flash as it is now, whole and with the last page torn
+    if (simState.nowMs >= nextCut) {
+      nextCut += 600000;
+      memcpy(cutFlash, simFlash, sizeof(simFlash));
+      cuts++;
+      cutOk += reload(cutFlash, core, false);
+      uint8_t page = core.heatmapLog.page;
+      if (page > 0 && page <= HEATMAP_LOG_PAGES) {
+        uint8_t *torn = cutFlash + core.heatmapLog.sector * HEATMAP_LOG_SECTOR_SIZE + (page - 1) * HEATMAP_LOG_PAGE_SIZE;
+        memset(torn + HEATMAP_LOG_PAGE_SIZE / 2, 0xFF, HEATMAP_LOG_PAGE_SIZE / 2);
+        cuts++;
+        cutOk += reload(cutFlash, core, true);
+      }
+    }
+  }
+
+  // Let the last press through debouncing, then one more gap: the counters
+  // reach flash without the host ever suspending the bus
+  simState.usbSuspended = false;
+  for (int i = 0; i < 10; i++) core.loop();
+  uint32_t gapEnd = simState.nowMs + HEATMAP_IDLE_MS + HEATMAP_FLUSH_MS;
+  while (simState.nowMs < gapEnd) core.loop();
+  uint16_t dirtyAfterGap = heatmap_dirty_count(&core.heatmap);
+  bool flushed = dirtyAfterGap == 0 && reload(simFlash, core, false);
+
+  // Every debounced press counted
+  uint32_t total = 0, lost = 0;
+  for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+    total += debounced[i];
+    if (core.heatmap.count[LAYER_DEFAULT * KEYMAP_POSITIONS + i] != debounced[i]) lost++;
+  }
+
+  printf("\n%s flash timing (program %.1f ms, erase %u ms), %u h simulated, scan every %u ms, stall budget %u ms\n",
+         worst ? "worst case" : "typical", programUs / 1000.0, eraseUs / 1000, hours, SCAN_INTERVAL,
+         HEATMAP_STALL_BUDGET_MS);
+  printf("host suspended the bus %u times%s\n", suspends, awake ? " (--awake)" : "");
+  printf("%-10s %10s %8s %12s\n", "", "scans", "late", "worst (ms)");
+  printf("%-10s %10u %8u %12u\n", "awake", awakeScans.scans, awakeScans.late, awakeScans.maxMs);
+  printf("%-10s %10u %8u %12u\n", "suspended", suspendedScans.scans, suspendedScans.late, suspendedScans.maxMs);
+  printf("%-10s %10s %8s %12s\n", "presses", "debounced", "missed", "worst (ms)");
+  printf("%-10s %10u %8u %12u\n", "typing", typingPresses.presses, typingPresses.missed, typingPresses.maxMs);
+  printf("%-10s %10u %8u %12u\n", "after gap", gapPresses.presses, gapPresses.missed, gapPresses.maxMs);
+  printf("presses %u typed, %u debounced, page programs %u, sector erases %u (%u while suspended)\n", typed, total,
+         programs, erases, erasesSuspended);
+  printf("log sectors %u, erased ahead at the end %u, time with none left %.1f min\n", HEATMAP_LOG_SECTORS,
+         core.heatmapLog.erased, blockedMs / 60000.0);
+  printf("counters still dirty after the last gap %u, flash %s\n", dirtyAfterGap, flushed ? "up to date" : "BEHIND");
+  printf("power cuts reloaded correctly: %u/%u\n", cutOk, cuts);
+
+  const uint32_t typingBudgetMs = DEBOUNCE_TIME + SCAN_INTERVAL + HEATMAP_STALL_BUDGET_MS;
+  check(typingPresses.maxMs <= typingBudgetMs, "a press while typing was held up");
+  check(gapPresses.maxMs <= typingBudgetMs + HEATMAP_ERASE_MAX_MS, "the first press of a gap waited for more than an erase");
+  check(suspendedScans.late == 0, "a scan was late while the host had the bus suspended");
+  check(erasesSuspended == 0, "a sector was erased while the host had the bus suspended");
+  check(flushed, "the counters were not in flash after the last gap");
+  check(lost == 0, "a press count differs from the debounced presses");
+  check(cutOk == cuts, "a power cut lost or invented counts");
+  simFlashOp = nullptr;
+}
+
+int main(int argc, char **argv) {
+  bool worst = false, awake = false;
+  uint32_t hours = 8;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--worst") == 0) {
+      worst = true;
+    } else if (strcmp(argv[i], "--awake") == 0) {
+      awake = true;
+    } else if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc) {
+      hours = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else {
+      fprintf(stderr, "usage: heatmap_bench [--worst] [--awake] [--hours N]\n");
+      return 1;
+    }
+  }
+  cost();
+  stall(worst, awake, hours);
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,398 @@
+// Switch-to-OS latency of the handwritten firmware's key reports, measured
+// at the Linux input layer (sim/uinput_hid.h).
+//
+// The right half's KeyboardCore runs on the simulated board in real time:
+// millis() is the monotonic clock and a typist presses and releases keys
+// of the right half (rollover and Shift included) between scans. Each key
+// report goes through a full-speed USB model, one report per 1 ms poll,
+// and a send waits until the host has taken the previous report, like
+// HID-Project's. It then goes to a uinput keyboard. The evdev
+// events come back with kernel timestamps. Both report paths of
+// sendKeyReport() run the same typing:
+//   releaseAll()+press() - one report releasing everything, then one per
+//                          held key (HID_SINGLE_REPORT 0, the Nano default)
+//   single report        - the whole change in one report (HID_SINGLE_REPORT 1,
+//                          always on the RP2040)
+// Per path: reports per change, key events the host saw for keys whose
+// switch didn't change (held keys released and pressed again), and
+// percentiles of
+//   switch->OS   switch change to the evdev event of that key
+//   firmware     switch change to the report holding it (scan interval,
+//                debounce, waiting for the previous report)
+//   usb          report to the poll that takes it
+//   os           uinput write to the evdev timestamp
+//   held gap     a held key released at the host until pressed again
+// Then QMK's report sequence for tapped keys (qmk_shim tap_code16(), e.g.
+// the encoder's PGDN/PGUP) through the same device.
+//
+// Needs write access to /dev/uinput (root or the input group); without it,
+// or with --loopback, the events are fed back in process and "os" is zero.
+// The virtual keyboard's event node is grabbed, so the typing never reaches
+// the desktop. Exits non-zero when a key change never reaches the host or
+// the single-report path shows a held key being released.
+//
+//   hid_latency_bench [--presses N] [--interval-us N] [--seed N] [--loopback]
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -Ifirmware_host/qmk_shim firmware_host/bench/hid_latency_bench.cpp
+//       firmware_host/sim/uinput_hid.cpp firmware_host/qmk_shim/qmk_shim.c -lstdc++ -o /tmp/hid_latency_bench
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <time.h>
+
+#include "../sim/sim_board.h"
+#include "../sim/uinput_hid.h"
+#include "quantum.h"
+
+// Local positions of the right half used by the typist: the letter rows and
+// Shift (keymap layer 0, no combos on this half)
+static const uint8_t typedPositions[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+static const uint8_t shiftPosition = 21;
+
+struct Change {
+  uint64_t atNs;  // from the start of the run
+  uint8_t position;
+  bool press;
+};
+
+// A report on its way to the host
+struct Delivered {
+  uint64_t queuedNs;
+  uint64_t deliveredNs;
+};
+
+struct Pending {
+  uint64_t atNs;         // when the switch changed
+  uint16_t code;         // evdev code of its key
+  bool press;
+  bool seen;
+};
+
+struct Run {
+  UinputKeyboard *keyboard;
+  uint64_t startNs;
+  uint64_t intervalNs;
+
+  std::vector<Change> schedule;
+  size_t nextChange;
+
+  // USB model: the report the host takes at the next poll
+  bool hasPending;
+  uint8_t pendingReport[8];
+  uint64_t pendingQueuedNs, pendingPollNs, lastPollNs;
+  std::deque<Delivered> inFlight;  // delivered reports whose SYN hasn't come back
+
+  std::vector<Pending> changes;
+  bool switchDown[256];         // by evdev code
+  uint64_t heldReleasedNs[256];  // held key released at the host, 0 when not
+  uint32_t reports, spurious, heldReleased;
+  std::vector<double> switchToOs, firmware, usb, os, heldGap;
+};
+
+static Run run;
+
+static void sleepUntil(uint64_t ns) {
+  for (;;) {
+    uint64_t now = monotonicNs();
+    if (now >= ns) return;
+    // Sleep most of it, spin the rest for a sharp poll edge
+    if (ns - now > 200000) {
+      struct timespec ts = {0, (long)(ns - now - 100000)};
+      nanosleep(&ts, nullptr);
+    }
+  }
+}
+
+static void percentileAdd(std::vector<double> &v, uint64_t ns) { v.push_back(ns / 1e6); }
+
+// Events that have come back from the OS
+static void drainEvents() {
+  EvdevEvent e;
+  while (run.keyboard->readEvent(e, 0)) {
+    Delivered d = run.inFlight.empty() ? Delivered{e.timeNs, e.timeNs} : run.inFlight.front();
+    if (e.type == EVDEV_EV_SYN) {
+      if (!run.inFlight.empty()) run.inFlight.pop_front();
+      continue;
+    }
+
+    // The oldest change of this key the report came after, else a held key
+    // bouncing at the host
+    Pending *match = nullptr;
+    for (Pending &p : run.changes) {
+      if (!p.seen && p.code == e.code && p.press == (e.value != 0) && p.atNs <= d.queuedNs) {
+        match = &p;
+        break;
+      }
+    }
+    if (!match) {
+      run.spurious++;
+      if (!e.value && run.switchDown[e.code]) {
+        run.heldReleased++;
+        run.heldReleasedNs[e.code] = e.timeNs;
+      } else if (e.value && run.heldReleasedNs[e.code]) {
+        percentileAdd(run.heldGap, e.timeNs - run.heldReleasedNs[e.code]);
+        run.heldReleasedNs[e.code] = 0;
+      }
+      continue;
+    }
+    match->seen = true;
+    percentileAdd(run.switchToOs, e.timeNs - match->atNs);
+    percentileAdd(run.firmware, d.queuedNs - match->atNs);
+    percentileAdd(run.usb, d.deliveredNs - d.queuedNs);
+    percentileAdd(run.os, e.timeNs - d.deliveredNs);
+  }
+}
+
+static void deliverPending() {
+  sleepUntil(run.pendingPollNs);
+  uint64_t now = monotonicNs();
+  // A report that changes nothing makes no events and no SYN_REPORT
+  if (run.keyboard->send(run.pendingReport) > 0) run.inFlight.push_back({run.pendingQueuedNs, now});
+  run.lastPollNs = run.pendingPollNs;
+  run.hasPending = false;
+}
+
+// The next poll on the 1 ms frame grid after now, one report per poll
+static uint64_t nextPoll(uint64_t now) {
+  if (!run.intervalNs) return now;
+  uint64_t rel = now - run.startNs;
+  uint64_t poll = run.startNs + (rel / run.intervalNs + 1) * run.intervalNs;
+  return std::max(poll, run.lastPollNs + run.intervalNs);
+}
+
+// HID-Project: the endpoint holds one report; a send waits for the host to
+// take the one before
+static void hostSend() {
+  if (run.hasPending) deliverPending();
+
+  // Boot report from the six usages, modifiers as bits
+  uint8_t report[8] = {0};
+  uint8_t slot = 2;
+  for (uint8_t i = 0; i < 6; i++) {
+    uint8_t usage = simState.hidKeys[i];
+    if (usage >= 0xE0 && usage <= 0xE7) {
+      report[0] |= 1 << (usage - 0xE0);
+    } else if (usage) {
+      report[slot++] = usage;
+    }
+  }
+  uint64_t now = monotonicNs();
+  memcpy(run.pendingReport, report, sizeof(report));
+  run.pendingQueuedNs = now;
+  run.pendingPollNs = nextPoll(now);
+  run.hasPending = true;
+  run.reports++;
+}
+
+static void applyChanges() {
+  uint64_t now = monotonicNs();
+  while (run.nextChange < run.schedule.size() && run.startNs + run.schedule[run.nextChange].atNs <= now) {
+    const Change &c = run.schedule[run.nextChange++];
+    simSetKey(c.position / 6, c.position % 6, c.press);
+    uint16_t code = hidUsageToEvdev(keymapKeycode(LAYER_DEFAULT, c.position));
+    run.switchDown[code] = c.press;
+    run.changes.push_back({now, code, c.press, false});
+  }
+}
+
+struct RealtimeBoard : SimBoard {
+  static uint32_t millis() { return (uint32_t)((monotonicNs() - run.startNs) / 1000000); }
+  static bool hostReady() { return true; }
+
+  static void hidReleaseAll() {
+    SimBoard::hidReleaseAll();
+    hostSend();
+  }
+  static void hidPress(uint8_t keycode) {
+    SimBoard::hidPress(keycode);
+    hostSend();
+  }
+  static void hidSend(const uint8_t *keys) {
+    SimBoard::hidSend(keys);
+    hostSend();
+  }
+
+  static void idle() {
+    applyChanges();
+    if (run.hasPending && monotonicNs() >= run.pendingPollNs) deliverPending();
+    drainEvents();
+    struct timespec ts = {0, 50000};
+    nanosleep(&ts, nullptr);
+  }
+};
+
+// Presses with random gaps and holds, so keys overlap now and then, and
+// Shift held across a letter every so often. A key comes back no sooner
+// than releaseGapMs after its release: the debounce would merge the two.
+static const uint64_t releaseGapMs = DEBOUNCE_TIME + 3 * SCAN_INTERVAL;
+
+static std::vector<Change> makeSchedule(uint32_t presses, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> key(0, sizeof(typedPositions) - 1), gap(70, 180), hold(50, 160), chance(0, 99);
+  std::vector<Change> out;
+  uint64_t t = 100;  // ms, after the first scans
+  std::vector<uint64_t> freeAt(KEYMAP_POSITIONS, 0);
+  for (uint32_t i = 0; i < presses; i++) {
+    uint8_t position = typedPositions[key(rng)];
+    bool shifted = chance(rng) < 15;
+    while (freeAt[position] > t || (shifted && freeAt[shiftPosition] > t - 30)) t += 10;
+    uint64_t up = t + hold(rng);
+    if (shifted) {
+      out.push_back({(t - 30) * 1000000, shiftPosition, true});
+      out.push_back({(up + 20) * 1000000, shiftPosition, false});
+      freeAt[shiftPosition] = up + 20 + releaseGapMs;
+    }
+    out.push_back({t * 1000000, position, true});
+    out.push_back({up * 1000000, position, false});
+    freeAt[position] = up + releaseGapMs;
+    t += gap(rng);
+  }
+  std::stable_sort(out.begin(), out.end(), [](const Change &a, const Change &b) { return a.atNs < b.atNs; });
+  return out;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+struct PathResult {
+  const char *name;
+  uint32_t changes, lost, reports, spurious, heldReleased;
+  std::vector<double> switchToOs, firmware, usb, os, heldGap;
+};
+
+static PathResult runPath(const char *name, bool singleReport, UinputKeyboard &keyboard,
+                          const std::vector<Change> &schedule, uint64_t intervalNs) {
+  run = Run();
+  run.keyboard = &keyboard;
+  run.intervalNs = intervalNs;
+  run.schedule = schedule;
+
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = true;
+  simState.otherHalfSilent = true;
+  simState.hidSingleReport = singleReport;
+
+  KeyboardCore<RealtimeBoard> core;
+  run.startNs = monotonicNs();
+  run.lastPollNs = run.startNs;
+  core.setup(nullptr);
+  uint64_t endNs = run.startNs + schedule.back().atNs + 200000000ull;
+  while (monotonicNs() < endNs) core.loop();
+  if (run.hasPending) deliverPending();
+  sleepUntil(monotonicNs() + 20000000);
+  drainEvents();
+
+  PathResult r = {name, (uint32_t)run.changes.size(), 0, run.reports, run.spurious, run.heldReleased,
+                  run.switchToOs, run.firmware, run.usb, run.os, run.heldGap};
+  for (const Pending &p : run.changes) r.lost += !p.seen;
+  return r;
+}
+
+static void printRow(const char *what, const PathResult &a, const PathResult &b,
+                     std::vector<double> PathResult::*field) {
+  printf("  %-12s", what);
+  for (const PathResult *r : {&a, &b}) {
+    const std::vector<double> &v = r->*field;
+    printf("   %6.2f %6.2f %6.2f", percentile(v, 0.5), percentile(v, 0.99), v.empty() ? 0.0 : percentile(v, 1.0));
+  }
+  printf("\n");
+}
+
+// QMK's register/unregister sequence for tapped keys through the same device
+static UinputKeyboard *qmkKeyboard;
+static uint32_t qmkReports;
+
+static void qmkReport(const uint8_t report[8]) {
+  qmkKeyboard->send(report);
+  qmkReports++;
+}
+
+static void tapQmk(UinputKeyboard &keyboard, const char *name, uint16_t keycode) {
+  qmkKeyboard = &keyboard;
+  qmkReports = 0;
+  qmk_shim_send_report = qmkReport;
+  tap_code16(keycode);
+  qmk_shim_send_report = nullptr;
+
+  uint32_t events = 0;
+  EvdevEvent e;
+  printf("  %-10s %u reports:", name, qmkReports);
+  while (keyboard.readEvent(e, 20000)) {
+    if (e.type == EVDEV_EV_SYN) {
+      printf(" |");
+    } else {
+      printf(" %u%s", e.code, e.value ? "v" : "^");
+      events++;
+    }
+  }
+  printf("  (%u key events)\n", events);
+}
+
+int main(int argc, char **argv) {
+  uint32_t presses = 100, seed = 1, intervalUs = 1000;
+  bool loopback = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--presses") && i + 1 < argc) {
+      presses = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--interval-us") && i + 1 < argc) {
+      intervalUs = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--loopback")) {
+      loopback = true;
+    } else {
+      fprintf(stderr, "usage: hid_latency_bench [--presses N] [--interval-us N] [--seed N] [--loopback]\n");
+      return 1;
+    }
+  }
+  if (!presses) presses = 1;
+
+  UinputKeyboard keyboard;
+  char error[160];
+  if (loopback) {
+    keyboard.openLoopback();
+  } else if (!keyboard.open("hid_latency_bench", error, sizeof(error))) {
+    printf("uinput unavailable (%s), events looped back in process\n", error);
+    keyboard.openLoopback();
+  }
+
+  std::vector<Change> schedule = makeSchedule(presses, seed);
+  printf("%s, %u presses (%zu switch changes), USB poll every %u us, scan every %d ms, debounce %d ms\n",
+         keyboard.loopback() ? "loopback" : "uinput", presses, schedule.size(), intervalUs, SCAN_INTERVAL,
+         DEBOUNCE_TIME);
+
+  PathResult legacy = runPath("releaseAll()+press()", false, keyboard, schedule, intervalUs * 1000ull);
+  PathResult single = runPath("single report", true, keyboard, schedule, intervalUs * 1000ull);
+
+  printf("\n  %-12s   %-22s   %-22s\n", "", legacy.name, single.name);
+  printf("  %-12s   %6s %6s %6s   %6s %6s %6s   (ms)\n", "", "p50", "p99", "max", "p50", "p99", "max");
+  printRow("switch->OS", legacy, single, &PathResult::switchToOs);
+  printRow("firmware", legacy, single, &PathResult::firmware);
+  printRow("usb", legacy, single, &PathResult::usb);
+  printRow("os", legacy, single, &PathResult::os);
+  printRow("held gap", legacy, single, &PathResult::heldGap);
+  for (const PathResult *r : {&legacy, &single}) {
+    printf("  %-22s %u reports (%.2f per change), %u key events for unchanged keys, %u held keys released at the host,"
+           " %u changes lost\n",
+           r->name, r->reports, (double)r->reports / r->changes, r->spurious, r->heldReleased, r->lost);
+  }
+
+  printf("\nqmk tap_code16() (evdev code, v down, ^ up, | SYN_REPORT):\n");
+  tapQmk(keyboard, "KC_PGDN", KC_PGDN);
+  tapQmk(keyboard, "LSFT(KC_1)", LSFT(KC_1));
+
+  bool ok = !legacy.lost && !single.lost && !single.heldReleased;
+  printf("\n%s\n", ok ? "all changes reached the host" : "FAILED");
+  return ok ? 0 : 1;
+}
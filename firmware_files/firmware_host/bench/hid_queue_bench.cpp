@@ -0,0 +1,466 @@
+// Keyboard report scheduling against a simulated USB host: how long a
+// report waits for the poll that takes it, and whether every tap and the
+// typed order survive (firmware_handwritten/hid_report_queue.h).
+//
+// A typist with fast taps, rolls and Shift drives the switches; the loop
+// samples them every --loop-us plus up to 10% of jitter, drifting against
+// the USB frames, and builds the core's six-usage report.
+// The host polls the interrupt endpoint once per poll interval at
+// --poll-offset-us into the frame. Schemes:
+//   write, 2 ms  - the report is written to the endpoint when the loop
+//                  has it, poll interval 2; a report not taken yet is
+//                  overwritten (the RP2040 build before the queue)
+//   sof, 1 ms    - HidReportQueue, one report moved to the endpoint at
+//                  each start of frame, poll interval 1 (the RP2040 build)
+//   eager, 1 ms  - for comparison: the same queue, but the loop also
+//                  puts a report on an idle endpoint as soon as it pushes
+//                  it (the loop would become a second consumer of the
+//                  queue), and the next one goes as soon as the host took
+//                  the last
+// Each runs the same stream once as single reports per change (the RP2040
+// build) and once as releaseAll()+press() sequences, for comparison. The loop hands the queue a change only
+// when it has room for all of its reports (KeyboardCore::sendKeyReport()
+// and hidCanTake()); otherwise the change waits for the next loop pass,
+// where the keys held by then replace it. Per scheme: report-to-poll wait
+// percentiles (a report replaced in the queue or in the loop counts until
+// the poll that took the one replacing it), reports sent, presses missing
+// at the host, and whether the host typed the same keys with the same
+// modifiers in the same order (replayed through hid-input's rules,
+// sim/uinput_hid.h).
+//
+// Concurrent: the same streams pushed by this thread as fast as the queue
+// takes them while a second thread calls take() in a tight loop, as the
+// start-of-frame interrupt can land anywhere in push(); --stress rounds,
+// new typing each round. Both threads yield at random at the queue's
+// barriers, so the interleavings also happen on a single core. What the
+// second thread took must type the same, and every merge must hold against
+// the report the host had before it (bad merges), not just the one push()
+// saw before the run.
+//
+// Exits non-zero when the queue refuses a report the loop handed it, when
+// single reports lose a press or change what was typed, or when a merge
+// is one the host can tell apart.
+//
+//   hid_queue_bench [--presses N] [--loop-us N] [--poll-offset-us N] [--seed N] [--stress N]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 -pthread firmware_host/bench/hid_queue_bench.cpp firmware_host/sim/uinput_hid.cpp
+//       -o /tmp/hid_queue_bench
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Sometimes hand the CPU to the other thread where push() and take() meet
+static bool chaos = false;
+
+static void preempt() {
+  if (!chaos) return;
+  thread_local std::minstd_rand rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  if ((rng() & 3) == 0) std::this_thread::yield();
+}
+
+#define HID_QUEUE_BARRIER() (__sync_synchronize(), preempt())
+
+#include "../../firmware_handwritten/hid_report_queue.h"
+#include "../sim/uinput_hid.h"
+
+#define FRAME_US 1000
+
+typedef uint8_t Keys[6];
+
+struct Report {
+  uint64_t atUs;
+  uint8_t keys[6];
+};
+
+enum Scheme { WRITE_2MS, SOF_1MS, EAGER_1MS };
+static const char *schemeNames[] = {"write, 2 ms", "sof, 1 ms", "eager, 1 ms"};
+
+// Switch changes of a typist: letters tapped from very short to long, rolls
+// where the next press comes before the last release, Shift now and then
+struct SwitchChange {
+  uint64_t atUs;
+  uint8_t usage;
+  bool press;
+};
+
+static std::vector<SwitchChange> makeTyping(uint32_t presses, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> letter(0x04, 0x1D), chance(0, 99);
+  std::uniform_int_distribution<int> shortHold(300, 3000), hold(20000, 90000), gap(200, 60000);
+  std::vector<SwitchChange> out;
+  std::vector<uint64_t> freeAt(256, 0);
+  uint64_t t = 1000;
+  for (uint32_t i = 0; i < presses; i++) {
+    uint8_t usage = (uint8_t)letter(rng);
+    while (freeAt[usage] > t) t += 100;
+    uint64_t up = t + (chance(rng) < 30 ? shortHold(rng) : hold(rng));
+    if (chance(rng) < 10 && freeAt[0xE1] <= t - 2000) {
+      out.push_back({t - 2000, 0xE1, true});
+      out.push_back({up + 1500, 0xE1, false});
+      freeAt[0xE1] = up + 3000;
+    }
+    out.push_back({t, usage, true});
+    out.push_back({up, usage, false});
+    freeAt[usage] = up + 500;
+    t += gap(rng);
+  }
+  std::stable_sort(out.begin(), out.end(), [](const SwitchChange &a, const SwitchChange &b) { return a.atUs < b.atUs; });
+  return out;
+}
+
+// The loop's view: switches sampled every loopUs, the report in usage order
+// (the core builds it in key position order, not press order). Legacy
+// sends releaseAll() and then one report per held key, all at once.
+static std::vector<Report> makeReports(const std::vector<SwitchChange> &typing, uint32_t loopUs, bool legacy,
+                                       uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> jitter(0, loopUs / 10);
+  std::vector<Report> out;
+  bool down[256] = {false};
+  Keys prev = {0};
+  size_t next = 0;
+  uint64_t end = typing.back().atUs + 10000;
+  for (uint64_t t = loopUs; t < end; t += loopUs + jitter(rng)) {
+    while (next < typing.size() && typing[next].atUs <= t) {
+      down[typing[next].usage] = typing[next].press;
+      next++;
+    }
+    Keys keys = {0};
+    uint8_t n = 0;
+    for (int u = 0; u < 256 && n < 6; u++) {
+      if (down[u]) keys[n++] = (uint8_t)u;
+    }
+    if (!memcmp(keys, prev, 6)) continue;
+    memcpy(prev, keys, 6);
+    if (legacy) {
+      Report r = {t, {0}};
+      out.push_back(r);
+      for (uint8_t i = 0; i < n; i++) {
+        r.keys[i] = keys[i];
+        out.push_back(r);
+      }
+    } else {
+      Report r = {t, {0}};
+      memcpy(r.keys, keys, 6);
+      out.push_back(r);
+    }
+  }
+  return out;
+}
+
+// What the host's input layer makes of a report sequence: presses per key
+// and the typed sequence (key, modifiers held)
+struct HostView {
+  uint32_t presses[256] = {0};
+  std::vector<uint32_t> typed;
+};
+
+static HostView replay(const std::vector<Report> &reports) {
+  HostView view;
+  uint8_t prev[8] = {0};
+  uint8_t modifiers = 0;
+  for (const Report &r : reports) {
+    uint8_t next[8] = {0};
+    uint8_t slot = 2;
+    for (uint8_t i = 0; i < 6; i++) {
+      uint8_t u = r.keys[i];
+      if (HidReportQueue::isModifier(u)) {
+        next[0] |= 1 << (u - 0xE0);
+      } else if (u) {
+        next[slot++] = u;
+      }
+    }
+    EvdevEvent events[8 + 12 + 1];
+    size_t n = hidReportToEvents(prev, next, events);
+    for (size_t i = 0; i < n; i++) {
+      const EvdevEvent &e = events[i];
+      if (e.type != EVDEV_EV_KEY) continue;
+      view.presses[e.code] += e.value == 1;
+      if (e.code == hidUsageToEvdev(0xE1) || e.code == hidUsageToEvdev(0xE5)) {
+        if (e.value) modifiers |= 2; else modifiers &= ~2;
+      } else if (e.value == 1) {
+        view.typed.push_back(e.code | (uint32_t)modifiers << 16);
+      }
+    }
+    memcpy(prev, next, sizeof(prev));
+  }
+  return view;
+}
+
+struct Result {
+  std::vector<double> waitMs;
+  std::vector<Report> delivered;
+  uint32_t maxDepth = 0;
+  uint32_t heldOver = 0;  // loop passes that kept their change for the next one
+  uint32_t refused = 0;   // reports push() refused: lost
+};
+
+// One scheme over a report stream. Time advances event by event: pushes,
+// starts of frame and polls.
+static Result simulate(Scheme scheme, const std::vector<Report> &reports, uint32_t pollOffsetUs, uint32_t loopUs) {
+  Result result;
+  uint32_t interval = scheme == WRITE_2MS ? 2 : 1;
+  HidReportQueue queue;
+  queue.reset();
+
+  // Endpoint buffer and which pushed report it holds
+  bool full = false;
+  Report endpoint;
+  size_t endpointIndex = 0;
+  size_t taken = 0;     // reports that have left the queue (or were overwritten)
+  size_t waited = 0;    // reports whose wait is recorded
+  std::vector<size_t> pushedIndex;  // queue slot order -> report index
+
+  auto fill = [&](uint64_t now) {
+    Keys keys;
+    uint8_t before = queue.tail;
+    if (full || !queue.take(keys)) return;
+    taken += (uint8_t)(queue.tail - before);
+    endpointIndex = pushedIndex[taken - 1];
+    endpoint.atUs = now;
+    memcpy(endpoint.keys, keys, 6);
+    full = true;
+  };
+
+  // The loop's report i at time now
+  auto pushReport = [&](size_t i, uint64_t now) {
+    if (scheme == WRITE_2MS) {
+      endpoint = reports[i];
+      endpointIndex = i;
+      full = true;
+      return;
+    }
+    bool repeat = !memcmp(reports[i].keys, queue.last, 6);  // push() leaves those out
+    if (!queue.push(reports[i].keys)) {
+      result.refused++;
+      return;
+    }
+    if (!repeat) pushedIndex.push_back(i);
+    result.maxDepth = std::max<uint32_t>(result.maxDepth, queue.depth());
+    if (scheme == EAGER_1MS) fill(now);
+  };
+
+  // The change starting at report i: its reports share the loop pass's time.
+  // All of them go, or the change waits for the next pass.
+  auto changeEnd = [&](size_t i) {
+    size_t end = i + 1;
+    while (end < reports.size() && reports[end].atUs == reports[i].atUs) end++;
+    return end;
+  };
+  auto pushChange = [&](size_t i, uint64_t now) {
+    size_t end = changeEnd(i);
+    if (scheme != WRITE_2MS && end - i > (size_t)(HID_QUEUE_SIZE - queue.depth())) return false;
+    for (; i < end; i++) pushReport(i, now);
+    return true;
+  };
+  const size_t none = SIZE_MAX;
+  size_t pending = none;  // change the loop still holds
+  uint64_t retryUs = 0;   // its next pass
+  auto loopPushes = [&](size_t &next, uint64_t until) {
+    for (;;) {
+      uint64_t changeUs = next < reports.size() ? reports[next].atUs : UINT64_MAX;
+      if (pending != none && retryUs < until && retryUs < changeUs) {
+        if (pushChange(pending, retryUs)) {
+          pending = none;
+        } else {
+          result.heldOver++;
+          retryUs += loopUs;
+        }
+      } else if (changeUs < until) {
+        // A newer change replaces the one held
+        pending = none;
+        if (!pushChange(next, changeUs)) {
+          pending = next;
+          retryUs = changeUs + loopUs;
+          result.heldOver++;
+        }
+        next = changeEnd(next);
+      } else {
+        return;
+      }
+    }
+  };
+
+  size_t next = 0;
+  uint64_t frame = 0;
+  while (next < reports.size() || full || queue.depth() || pending != none) {
+    uint64_t sof = frame * FRAME_US;
+    uint64_t poll = sof + pollOffsetUs;
+
+    loopPushes(next, sof);
+    if (scheme == SOF_1MS) {
+      fill(sof);
+    } else {
+      // Written between the start of frame and the poll still makes this poll
+      loopPushes(next, poll);
+    }
+
+    if (frame % interval == 0 && full) {
+      Report r = endpoint;
+      r.atUs = poll;
+      result.delivered.push_back(r);
+      for (; waited <= endpointIndex; waited++) result.waitMs.push_back((poll - reports[waited].atUs) / 1000.0);
+      full = false;
+      if (scheme == EAGER_1MS) fill(poll);
+    }
+    frame++;
+  }
+  return result;
+}
+
+// Pushes the stream from this thread while another takes; what was taken,
+// in order, and for each the number of reports the queue had let go by then
+static std::vector<Report> takeConcurrently(const std::vector<Report> &reports, std::vector<size_t> &ends) {
+  HidReportQueue queue;
+  queue.reset();
+  std::vector<Report> delivered;
+  delivered.reserve(reports.size());
+  ends.clear();
+  std::atomic<bool> pushed(false);
+  chaos = true;
+  std::thread host([&] {
+    Report r = {0, {0}};
+    size_t taken = 0;
+    for (;;) {
+      bool last = pushed.load();
+      uint8_t before = queue.tail;
+      if (queue.take(r.keys)) {
+        taken += (uint8_t)(queue.tail - before);
+        delivered.push_back(r);
+        ends.push_back(taken);
+      } else if (last) {
+        return;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  for (const Report &r : reports) {
+    while (!queue.push(r.keys)) {
+      std::this_thread::yield();
+    }
+  }
+  pushed = true;
+  host.join();
+  chaos = false;
+  return delivered;
+}
+
+// Merges the host can tell from the reports it skipped: each report left
+// out must be replaceable, together with the ones before it in the merge,
+// from the report the host had before, as push() requires of a run
+static uint32_t badMerges(const std::vector<Report> &reports, const std::vector<size_t> &ends) {
+  std::vector<const uint8_t *> pushed;  // what push() queued: repeats left out
+  const uint8_t *last = nullptr;
+  static const Keys none = {0};
+  for (const Report &r : reports) {
+    if (memcmp(r.keys, last ? last : none, 6) != 0) pushed.push_back(last = r.keys);
+  }
+  uint32_t bad = 0;
+  const uint8_t *seen = none;
+  size_t first = 0;
+  for (size_t end : ends) {
+    for (size_t i = first + 1; i < end; i++) {
+      if (!HidReportQueue::canReplace(seen, pushed[i - 1], pushed[i])) {
+        bad++;
+        break;
+      }
+    }
+    seen = pushed[end - 1];
+    first = end;
+  }
+  return bad;
+}
+
+static double percentile(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char **argv) {
+  uint32_t presses = 20000, loopUs = 1000, pollOffsetUs = 300, seed = 1, rounds = 20;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--presses") && i + 1 < argc) {
+      presses = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--loop-us") && i + 1 < argc) {
+      loopUs = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--poll-offset-us") && i + 1 < argc) {
+      pollOffsetUs = (uint32_t)strtoul(argv[++i], nullptr, 0) % FRAME_US;
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--stress") && i + 1 < argc) {
+      rounds = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      fprintf(stderr,
+              "usage: hid_queue_bench [--presses N] [--loop-us N] [--poll-offset-us N] [--seed N] [--stress N]\n");
+      return 1;
+    }
+  }
+  if (!presses) presses = 1;
+  if (!loopUs) loopUs = 1;
+
+  std::vector<SwitchChange> typing = makeTyping(presses, seed);
+  printf("%u presses, loop every %u us, host polls %u us into the frame\n", presses, loopUs, pollOffsetUs);
+
+  bool ok = true;
+  for (bool legacy : {false, true}) {
+    std::vector<Report> reports = makeReports(typing, loopUs, legacy, seed);
+    HostView want = replay(reports);
+    printf("\n%s: %zu reports from the loop\n", legacy ? "releaseAll()+press()" : "single report per change",
+           reports.size());
+    printf("  %-12s %7s %7s %7s  %8s  %5s  %8s  %s\n", "", "p50", "p99", "max", "reports", "depth", "missing",
+           "typed");
+    for (Scheme scheme : {WRITE_2MS, SOF_1MS, EAGER_1MS}) {
+      Result r = simulate(scheme, reports, pollOffsetUs, loopUs);
+      HostView got = replay(r.delivered);
+      uint32_t missing = 0;
+      for (int code = 0; code < 256; code++) {
+        if (got.presses[code] < want.presses[code]) missing += want.presses[code] - got.presses[code];
+      }
+      bool sameText = got.typed == want.typed;
+      printf("  %-12s %7.2f %7.2f %7.2f  %8zu  %5u  %8u  %s\n", schemeNames[scheme], percentile(r.waitMs, 0.5),
+             percentile(r.waitMs, 0.99), percentile(r.waitMs, 1.0), r.delivered.size(), r.maxDepth, missing,
+             sameText ? "same" : "DIFFERENT");
+      if (r.heldOver) printf("  %-12s %u loop passes held their change for the next pass\n", "", r.heldOver);
+      if (r.refused) printf("  %-12s %u reports refused by a full queue and LOST\n", "", r.refused);
+      if (r.refused || (scheme != WRITE_2MS && !legacy && (missing || !sameText))) ok = false;
+    }
+  }
+  printf("  (wait in ms from the loop's report to the poll that took it)\n");
+
+  printf("\nconcurrent take(), %u rounds\n", rounds);
+  printf("  %-24s %9s %9s %10s %8s  %s\n", "", "reports", "taken", "bad merges", "missing", "typed");
+  for (bool legacy : {false, true}) {
+    uint64_t pushed = 0, taken = 0, missing = 0, bad = 0;
+    uint32_t different = 0;
+    std::vector<size_t> ends;
+    for (uint32_t round = 0; round < rounds; round++) {
+      std::vector<Report> reports = makeReports(makeTyping(presses, seed + round), loopUs, legacy, seed + round);
+      HostView want = replay(reports);
+      std::vector<Report> delivered = takeConcurrently(reports, ends);
+      bad += badMerges(reports, ends);
+      HostView got = replay(delivered);
+      for (int code = 0; code < 256; code++) {
+        if (got.presses[code] < want.presses[code]) missing += want.presses[code] - got.presses[code];
+      }
+      different += got.typed != want.typed;
+      pushed += reports.size();
+      taken += delivered.size();
+    }
+    printf("  %-24s %9llu %9llu %10llu %8llu  %s\n", legacy ? "releaseAll()+press()" : "single report per change",
+           (unsigned long long)pushed, (unsigned long long)taken, (unsigned long long)bad,
+           (unsigned long long)missing, different ? "DIFFERENT" : "same");
+    if (bad || missing || different) ok = false;
+  }
+
+  printf("\n%s\n", ok ? "no press lost, typed text unchanged" : "FAILED");
+  return ok ? 0 : 1;
+}
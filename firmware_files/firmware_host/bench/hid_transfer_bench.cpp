@@ -0,0 +1,279 @@
+// USB transfers per action for media and system keys, against the key
+// report they used to share.
+//
+// Handwritten firmware: the right half's KeyboardCore on the simulated
+// board, driven at the merged event stream (no scanning), through both
+// report paths of sendKeyReport(). Media keys are routed by the core's
+// mediaMask(), derived through the layer stack, to the consumer control
+// report; before, they took one of
+// the six key slots like any other key. The "before" columns replay the
+// same key states through that old routing: one boot keyboard report per
+// change, or releaseAll() plus one report per held key.
+//
+// QMK: encoder.c built unmodified against qmk_shim, one detent or click per
+// action; with EXTRAKEY_ENABLE the volume and play keycodes go out as
+// consumer reports of their own.
+//
+// Bytes per transfer are the report with its ID on the composite
+// descriptor (keyboard 9, consumer 3, system 2) and 8 for the old boot
+// keyboard report. "lost" is the most held keys missing from every report
+// at once: a seventh key, or a media key the six slots had no room for.
+// Exits non-zero when a media key lands in the key report, a held key goes
+// unreported, or a volume step is not exactly one consumer press and
+// release.
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -Ifirmware_host/qmk_shim firmware_host/bench/hid_transfer_bench.cpp
+//       firmware_qmk/encoder.c firmware_qmk/mouse_motion.c firmware_host/qmk_shim/qmk_shim.c -lstdc++ -o /tmp/hid_transfer_bench
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../sim/sim_board.h"
+#include "quantum.h"
+
+extern "C" void fix_encoder_action(matrix_row_t current_matrix[]);
+
+#define STEP_MS (DEBOUNCE_TIME + SCAN_INTERVAL)
+
+#define BYTES_KEYBOARD 9
+#define BYTES_CONSUMER 3
+#define BYTES_SYSTEM 2
+#define BYTES_BOOT 8
+
+typedef KeyboardCore<SimBoard> Core;
+
+static int failures = 0;
+
+static void check(bool ok, const char *action, const char *what) {
+  if (!ok) {
+    printf("FAIL %s: %s\n", action, what);
+    failures++;
+  }
+}
+
+// One step of an action: a key position pressed (+) or released (-)
+struct Step {
+  uint8_t position;
+  bool pressed;
+};
+
+struct Action {
+  const char *name;
+  std::vector<Step> steps;
+};
+
+struct Count {
+  uint32_t transfers = 0;
+  uint32_t bytes = 0;
+};
+
+// The key report as updateKeyReport() built it before media keys had a
+// report of their own: held keys in position order, six at most
+static void legacyReport(const Core &core, uint8_t *report) {
+  memset(report, 0, 6);
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < KEYMAP_POSITIONS && n < 6; i++) {
+    uint8_t keycode = core.keycodeAt(i);
+    if ((core.pressedMask >> i & 1) && keycode < CMD_LAYER_CHANGE && keycode != KEY_RESERVED) {
+      report[n++] = keycode;
+    }
+  }
+}
+
+static uint8_t usedSlots(const uint8_t *keys) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < 6; i++) n += keys[i] != 0;
+  return n;
+}
+
+// Held keys that are in none of the reports
+static uint8_t unreported(const Core &core, const uint8_t *keys, uint16_t consumer, uint8_t system) {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+    uint8_t keycode = core.keycodeAt(i);
+    if (!(core.pressedMask >> i & 1) || keycode >= CMD_LAYER_CHANGE || keycode == KEY_RESERVED) continue;
+    bool reported = memchr(keys, keycode, 6) != nullptr || (consumer && Core::consumerUsageOf(keycode) == consumer) ||
+                    (system && Core::systemUsageOf(keycode) == system);
+    n += !reported;
+  }
+  return n;
+}
+
+struct Result {
+  Count now, before;
+  uint32_t keyboard = 0, consumer = 0, system = 0;
+  uint8_t lost = 0, lostBefore = 0;  // most held keys missing from the reports at once
+  bool mediaInKeys = false;
+};
+
+static Result runHandwritten(const Action &action, bool singleReport) {
+  static Core core;
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = true;
+  simState.hidSingleReport = singleReport;
+  core.reset();
+  core.isRightSide = true;
+  core.selectLayer(LAYER_FN);
+
+  Result r;
+  uint8_t before[6] = {0};
+  for (const Step &step : action.steps) {
+    simState.nowMs += STEP_MS;
+    core.updateTimers();
+    uint8_t base = step.position < Core::totalKeys ? 0 : Core::totalKeys;
+    core.applyEvent((uint8_t)((step.position - base) | (step.pressed ? SPLIT_PRESSED : 0)), base, simState.nowMs);
+
+    uint32_t keyboard = simState.hidReports, consumer = simState.consumerReports, system = simState.systemReports;
+    core.processKeys();
+    core.sendKeyReport();
+    keyboard = simState.hidReports - keyboard;
+    consumer = simState.consumerReports - consumer;
+    system = simState.systemReports - system;
+    r.keyboard += keyboard;
+    r.consumer += consumer;
+    r.system += system;
+    r.now.transfers += keyboard + consumer + system;
+    r.now.bytes += keyboard * BYTES_KEYBOARD + consumer * BYTES_CONSUMER + system * BYTES_SYSTEM;
+
+    for (uint8_t i = 0; i < 6; i++) {
+      if (Core::consumerUsageOf(simState.hidKeys[i]) || Core::systemUsageOf(simState.hidKeys[i])) {
+        r.mediaInKeys = true;
+      }
+    }
+    uint8_t lost = unreported(core, simState.hidKeys, simState.consumerUsage, simState.systemUsage);
+    if (lost > r.lost) r.lost = lost;
+
+    uint8_t report[6];
+    legacyReport(core, report);
+    if (memcmp(report, before, 6) != 0) {
+      uint32_t transfers = singleReport ? 1 : 1 + usedSlots(report);
+      r.before.transfers += transfers;
+      r.before.bytes += transfers * BYTES_BOOT;
+      memcpy(before, report, 6);
+    }
+    lost = unreported(core, report, 0, 0);
+    if (lost > r.lostBefore) r.lostBefore = lost;
+  }
+  return r;
+}
+
+// Layer 1 positions (keymap_tables.h)
+#define POS_VOLD 37
+#define POS_VOLU 38
+#define POS_MUTE 39
+
+static std::vector<Step> tap(uint8_t position) { return {{position, true}, {position, false}}; }
+
+static std::vector<Step> operator+(std::vector<Step> a, const std::vector<Step> &b) {
+  a.insert(a.end(), b.begin(), b.end());
+  return a;
+}
+
+static void handwritten() {
+  // Six keys of this half (layer 1: 1-6) and the media keys of the other
+  std::vector<Step> sixDown, sixUp, typing;
+  for (uint8_t i = 0; i < 6; i++) {
+    sixDown.push_back({i, true});
+    sixUp.push_back({(uint8_t)(5 - i), false});
+    typing = typing + tap(i);
+  }
+  const Action actions[] = {
+      {"volume step", tap(POS_VOLU)},
+      {"5 volume steps", tap(POS_VOLU) + tap(POS_VOLU) + tap(POS_VOLU) + tap(POS_VOLU) + tap(POS_VOLU)},
+      {"mute", tap(POS_MUTE)},
+      {"type 6 keys", typing},
+      {"type 6 keys, volume held", std::vector<Step>{{POS_VOLD, true}} + typing + std::vector<Step>{{POS_VOLD, false}}},
+      {"6 keys held + volume", sixDown + tap(POS_VOLU) + sixUp},
+  };
+
+  printf("handwritten core: transfers (bytes) per action, before = media keys in the key report\n");
+  printf("%-26s %-14s %16s %16s %9s %9s %9s %12s\n", "action", "path", "before", "now", "keyboard", "consumer", "system",
+         "lost b/now");
+  for (const Action &action : actions) {
+    for (int single = 0; single < 2; single++) {
+      Result r = runHandwritten(action, single);
+      char before[32], now[32], lost[16];
+      snprintf(before, sizeof(before), "%u (%u)", r.before.transfers, r.before.bytes);
+      snprintf(now, sizeof(now), "%u (%u)", r.now.transfers, r.now.bytes);
+      snprintf(lost, sizeof(lost), "%u/%u", r.lostBefore, r.lost);
+      printf("%-26s %-14s %16s %16s %9u %9u %9u %12s\n", action.name, single ? "single" : "releaseAll", before, now,
+             r.keyboard, r.consumer, r.system, lost);
+      check(!r.mediaInKeys, action.name, "media key in the key report");
+      check(r.lost == 0, action.name, "a held key is missing from the reports");
+    }
+  }
+  Result step = runHandwritten(actions[0], true);
+  check(step.consumer == 2 && step.keyboard == 0, "volume step", "not one consumer press and release");
+}
+
+// QMK: fix_encoder_action() on the encoder row, counting tap_code16()'s reports
+#define ENC_ROW 3
+#define ENC_BUTTON_COL 0
+#define ENC_A_COL 2
+#define ENC_B_COL 4
+
+static uint32_t consumerReports, systemReports;
+
+static void countExtra(uint8_t reportId, uint16_t) {
+  if (reportId == REPORT_ID_CONSUMER) consumerReports++;
+  if (reportId == REPORT_ID_SYSTEM) systemReports++;
+}
+
+static void encoderRow(matrix_row_t row) {
+  matrix_row_t rows[MATRIX_ROWS] = {0};
+  rows[ENC_ROW] = row;
+  fix_encoder_action(rows);
+}
+
+static void qmk() {
+  struct QmkAction {
+    const char *name;
+    int layer;
+    bool click;
+  };
+  const QmkAction actions[] = {
+      {"detent, layer 6 (volume)", 6, false},
+      {"detent, layer 0 (PGDN)", 0, false},
+      {"detent, layer 3 (ctrl+tab)", 3, false},
+      {"click (play/pause)", 0, true},
+  };
+  qmk_shim_send_extra = countExtra;
+
+  printf("\nQMK encoder.c: transfers (bytes) per action\n");
+  printf("%-26s %16s %9s %9s %9s\n", "action", "transfers", "keyboard", "consumer", "system");
+  for (const QmkAction &action : actions) {
+    qmk_shim_reset();
+    qmk_shim_state.layer_state = 1u | 1u << action.layer;
+    consumerReports = systemReports = 0;
+    if (action.click) {
+      encoderRow(1 << ENC_BUTTON_COL);
+      encoderRow(0);
+    } else {
+      encoderRow(1 << ENC_A_COL | 1 << ENC_B_COL);
+      encoderRow(1 << ENC_A_COL);
+    }
+    uint32_t keyboard = qmk_shim_state.keyboard_reports;
+    uint32_t transfers = keyboard + consumerReports + systemReports;
+    uint32_t bytes = keyboard * BYTES_KEYBOARD + consumerReports * BYTES_CONSUMER + systemReports * BYTES_SYSTEM;
+    char total[32];
+    snprintf(total, sizeof(total), "%u (%u)", transfers, bytes);
+    printf("%-26s %16s %9u %9u %9u\n", action.name, total, keyboard, consumerReports, systemReports);
+    if (action.layer == 6 || action.click) {
+      check(keyboard == 0 && consumerReports == 2, action.name, "not one consumer press and release");
+    }
+  }
+  qmk_shim_send_extra = nullptr;
+}
+
+int main() {
+  handwritten();
+  qmk();
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
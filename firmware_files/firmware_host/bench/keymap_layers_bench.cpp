@@ -0,0 +1,257 @@
+// Sparse keymap layers (firmware_handwritten/keymap_layers.h): what the
+// presence bitmaps save in flash and what resolving a key through the
+// layer stack costs, against a full keycode table per layer with a
+// transparency marker.
+//
+// Size: the compiled keymap as keymap_tables.h has it, against the full
+// table with the per-layer special-key masks it used to carry, then synthetic
+// keymaps on this board's matrix with 3 to 32 layers, each upper layer
+// setting a share of the positions; flash for both formats, as a share of
+// the Nano's 32 KB. Also the core's RAM for layer state: the layer stack
+// and the command and media masks through it, against the masks per layer
+// the core used to keep (constant data, so copied to RAM on AVR).
+//
+// Cost: per lookup, random positions, with 1 layer active (only the
+// default), 2, 4 and all of them, for both formats built from the same
+// synthetic keymap, on this machine. The core's keycodeAt() and
+// layersChanged() on the compiled keymap.
+//
+// Exits non-zero when a sparse lookup differs from the table's, or the
+// core resolves a key other than keymapLookup() does.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/keymap_layers_bench.cpp -o /tmp/keymap_layers_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../sim/sim_board.h"
+
+typedef KeyboardCore<SimBoard> Core;
+
+#define NANO_FLASH_BYTES 32768
+// Masks per layer the core used: the four command masks and the media mask
+#define OLD_MASK_BYTES_PER_LAYER (5 * sizeof(uint64_t))
+// Masks per layer keymap_tables.h carried: those and the any-command,
+// modifier and empty masks
+#define OLD_FLASH_MASK_BYTES_PER_LAYER (8 * sizeof(uint64_t))
+
+static int failures = 0;
+
+static void check(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAIL %s\n", what);
+    failures++;
+  }
+}
+
+static volatile uint32_t sink;  // keeps the timed loops from being optimised out
+
+// One keymap in both formats
+struct Layers {
+  uint8_t layers;
+  std::vector<uint8_t> table;     // [layer][position], KEY_TRANSPARENT where unset
+  std::vector<uint8_t> presence;  // [layer - 1][block]
+  std::vector<uint16_t> start;    // [layer - 1]
+  std::vector<uint8_t> keycodes;  // layer 0, then what the upper layers set
+
+  // Upper layers set a position with probability fill
+  Layers(uint8_t layers, double fill, std::mt19937 &rng) : layers(layers) {
+    const uint8_t blocks = KEYMAP_BLOCKS_OF(KEYMAP_POSITIONS);
+    std::uniform_real_distribution<double> share(0, 1);
+    table.assign(layers * KEYMAP_POSITIONS, KEY_TRANSPARENT);
+    presence.assign((layers - 1) * blocks, 0);
+    for (uint8_t layer = 0; layer < layers; layer++) {
+      if (layer > 0) start.push_back((uint16_t)keycodes.size());
+      for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+        if (layer > 0 && share(rng) >= fill) continue;
+        uint8_t keycode = KEY_A + rng() % (KEY_LEFT_CTRL - KEY_A);
+        table[layer * KEYMAP_POSITIONS + i] = keycode;
+        keycodes.push_back(keycode);
+        if (layer > 0) presence[(layer - 1) * blocks + i / 8] |= 1 << (i % 8);
+      }
+    }
+  }
+
+  size_t tableBytes() const { return table.size(); }
+
+  size_t sparseBytes() const { return keycodes.size() + presence.size() + start.size() * sizeof(uint16_t); }
+
+  // Both walk the active layers above the default from the top down, as the
+  // core's layerAt() does
+  uint8_t tableLookup(const uint8_t *order, uint8_t depth, uint8_t position) const {
+    for (uint8_t i = 0; i < depth; i++) {
+      uint8_t keycode = table[order[i] * KEYMAP_POSITIONS + position];
+      if (keycode != KEY_TRANSPARENT) return keycode;
+    }
+    return table[position];
+  }
+
+  uint8_t sparseLookup(const uint8_t *order, uint8_t depth, uint8_t position) const {
+    const uint8_t blocks = KEYMAP_BLOCKS_OF(KEYMAP_POSITIONS);
+    for (uint8_t i = 0; i < depth; i++) {
+      const uint8_t *layerPresence = &presence[(order[i] - 1) * blocks];
+      if (keymapLayerHolds(layerPresence, position)) {
+        return keymapLayerKeycode(layerPresence, &keycodes[start[order[i] - 1]], position);
+      }
+    }
+    return keycodes[position];
+  }
+};
+
+// Active layers above the default from the top down: the top depth ones
+static uint8_t stackOrder(const Layers &l, uint8_t active, uint8_t *order) {
+  uint8_t depth = 0;
+  for (uint8_t layer = l.layers - 1; layer > 0 && depth + 1 < active; layer--) {
+    order[depth++] = layer;
+  }
+  return depth;
+}
+
+static void sizes() {
+  const size_t table = KEYMAP_LAYERS * KEYMAP_POSITIONS;
+  size_t sparse = KEYMAP_KEYCODES;
+#if KEYMAP_LAYERS > 1
+  sparse += sizeof(keymapPresence) + sizeof(keymapLayerStart);
+#endif
+  printf("compiled keymap: %d layers, %d positions, %d keycodes set\n", KEYMAP_LAYERS, KEYMAP_POSITIONS,
+         KEYMAP_KEYCODES);
+  const size_t masks = KEYMAP_LAYERS * OLD_FLASH_MASK_BYTES_PER_LAYER;
+  printf("  flash: table %zu bytes + masks %zu = %zu before, sparse %zu bytes now (masks through the stack, in RAM)\n\n",
+         table, masks, table + masks, sparse);
+
+  printf("synthetic keymaps, %d positions\n", KEYMAP_POSITIONS);
+  printf("%7s %6s %12s %8s %13s %8s\n", "layers", "fill", "table bytes", "% flash", "sparse bytes", "% flash");
+  std::mt19937 rng(1);
+  const uint8_t layerCounts[] = {3, 8, 16, 32};
+  const double fills[] = {0.1, 0.25, 0.5, 1.0};
+  for (uint8_t layers : layerCounts) {
+    for (double fill : fills) {
+      Layers l(layers, fill, rng);
+      printf("%7u %5.0f%% %12zu %7.2f%% %13zu %7.2f%%\n", layers, fill * 100, l.tableBytes(),
+             100.0 * l.tableBytes() / NANO_FLASH_BYTES, l.sparseBytes(), 100.0 * l.sparseBytes() / NANO_FLASH_BYTES);
+    }
+  }
+
+  const size_t layerState = sizeof(Core::layerStack) + sizeof(Core::currentLayer) + sizeof(Core::layerDepth) +
+                            sizeof(Core::layerCommandMask) + sizeof(Core::layerMediaMask);
+  printf("\ncore RAM for layers: %zu bytes + 1 per layer (stack order); masks per layer were %zu per layer\n",
+         layerState, OLD_MASK_BYTES_PER_LAYER);
+  printf("%7s %12s %12s\n", "layers", "now bytes", "before bytes");
+  for (uint8_t layers : layerCounts) {
+    printf("%7u %12zu %12zu\n", layers, layerState + layers, 1 + layers * OLD_MASK_BYTES_PER_LAYER);
+  }
+  printf("\n");
+}
+
+// Sparse and table lookups agree for every stack depth and position
+static void verify(const Layers &l) {
+  uint8_t order[32];
+  for (uint8_t active = 1; active <= l.layers; active++) {
+    uint8_t depth = stackOrder(l, active, order);
+    for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+      if (l.sparseLookup(order, depth, i) != l.tableLookup(order, depth, i)) {
+        check(false, "a sparse lookup differs from the table");
+        return;
+      }
+    }
+  }
+}
+
+static void lookupCost() {
+  const uint32_t rounds = 4000000;
+  std::mt19937 rng(2);
+  std::vector<uint8_t> positions(4096);
+  for (uint8_t &p : positions) p = rng() % KEYMAP_POSITIONS;
+
+  printf("lookup cost, %u lookups, 25%% of each upper layer set\n", rounds);
+  printf("%7s %7s %14s %15s\n", "layers", "active", "table ns", "sparse ns");
+  const uint8_t layerCounts[] = {3, 8, 16, 32};
+  for (uint8_t layers : layerCounts) {
+    Layers l(layers, 0.25, rng);
+    verify(l);
+    const uint8_t actives[] = {1, 2, 4, layers};
+    for (size_t a = 0; a < sizeof(actives); a++) {
+      uint8_t active = actives[a];
+      if (active > layers || (a > 0 && active == actives[a - 1])) continue;
+      uint8_t order[32];
+      uint8_t depth = stackOrder(l, active, order);
+      uint32_t sum = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < rounds; i++) {
+        sum += l.tableLookup(order, depth, positions[i & 4095]);
+      }
+      auto t1 = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < rounds; i++) {
+        sum += l.sparseLookup(order, depth, positions[i & 4095]);
+      }
+      auto t2 = std::chrono::steady_clock::now();
+      sink = sum;
+      printf("%7u %7u %14.2f %15.2f\n", layers, active,
+             std::chrono::duration<double, std::nano>(t1 - t0).count() / rounds,
+             std::chrono::duration<double, std::nano>(t2 - t1).count() / rounds);
+    }
+  }
+  printf("\n");
+}
+
+static Core core;
+
+// The core on the compiled keymap: keycodeAt() per key for each selected
+// layer, and layersChanged() per stack change
+static void coreCost() {
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  core.reset();
+  core.setup(nullptr);
+
+  for (uint32_t stack = 1; stack < (1ul << KEYMAP_LAYERS); stack += 2) {
+    core.layerStack = stack;
+    core.layersChanged();
+    for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+      uint8_t keycode = keymapLookup(stack, i);
+      if (keycode == KEY_TRANSPARENT) keycode = KEY_RESERVED;
+      if (core.keycodeAt(i) != keycode) {
+        check(false, "the core resolves a key other than keymapLookup()");
+        return;
+      }
+    }
+  }
+
+  const uint32_t rounds = 4000000, changes = 200000;
+  printf("core on the compiled keymap\n");
+  printf("%7s %16s\n", "layer", "keycodeAt() ns");
+  for (uint8_t layer = 0; layer < KEYMAP_LAYERS; layer++) {
+    core.selectLayer(layer);
+    uint32_t sum = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; i++) {
+      sum += core.keycodeAt(i % KEYMAP_POSITIONS);
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+    sink = sum;
+    printf("%7u %16.2f\n", layer, ns);
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < changes; i++) {
+    core.layerToggle(LAYER_FN);
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / changes;
+  sink = core.currentLayer;
+  printf("layersChanged(): %.2f us per stack change\n", us);
+}
+
+int main() {
+  sizes();
+  lookupCost();
+  coreCost();
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
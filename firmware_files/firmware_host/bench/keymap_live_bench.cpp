@@ -0,0 +1,416 @@
+// Live keymap updates over raw HID (firmware_handwritten/keymap_live.h):
+// how long a full keymap upload takes, and whether it ever makes a scan
+// late.
+//
+// The right half's KeyboardCore runs on the simulated board in virtual
+// time with KEYMAP_LIVE_ENABLE. Every millisecond of idle() is a USB
+// frame: the host model sends its next vendor report (one OUT report per
+// frame, as on a full speed interrupt endpoint) and takes one answer. The
+// host works like keymap_compiler --sync: chunks back to back, the commit,
+// then it reads the answers and resends from the offset of a WRITE error.
+// Keys are typed throughout (a key every 30-80 ms, held 20-60 ms).
+//
+// Scenarios:
+//   upload      - a changed image (a key swapped, a macro key, another
+//                 combo term): time from the first chunk to the commit's
+//                 answer, which comes once the image is active
+//   read back   - the whole active image with READ, compared
+//   bad chunk   - one chunk's data damaged after its CRC-8: resent
+//   lost chunk  - one chunk never arrives: resent from the offset
+//   bad commit  - wrong CRC-32 in the commit: the old image stays
+//   macro       - the new macro key types the uploaded text; a commit
+//                 while it types waits for it to finish
+// Per scenario: reports sent, attempts, ms, the longest gap between two
+// scans. Also the cost of receive() per chunk and of swapping an image in
+// (apply() plus the mask recompute) on this machine.
+//
+// Exits non-zero when a scenario ends wrong or a scan is late.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/keymap_live_bench.cpp -o /tmp/keymap_live_bench
+
+#define KEYMAP_LIVE_ENABLE
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "../sim/sim_board.h"
+
+typedef std::array<uint8_t, KEYMAP_LIVE_REPORT_SIZE> Report;
+
+static int failures = 0;
+
+static void check(bool ok, const char *scenario, const char *what) {
+  if (!ok) {
+    printf("FAIL %s: %s\n", scenario, what);
+    failures++;
+  }
+}
+
+// Host side: reports waiting for a frame, answers as they came
+struct Host {
+  std::deque<Report> outbox;
+  std::deque<Report> answers;
+  uint32_t sent;
+  int dropChunk;  // WRITE at this offset is lost once, -1 for none
+
+  void reset() {
+    outbox.clear();
+    answers.clear();
+    sent = 0;
+    dropChunk = -1;
+  }
+
+  void send(const uint8_t *report) {
+    Report r;
+    memcpy(r.data(), report, r.size());
+    outbox.push_back(r);
+  }
+
+  void frame() {
+    if (!outbox.empty()) {
+      Report &r = outbox.front();
+      bool lost = r[0] == KEYMAP_LIVE_CMD_WRITE && keymapLiveGet16(&r[1]) == dropChunk;
+      if (lost) {
+        dropChunk = -1;
+      } else if (!simRawRequests.push(r.data())) {
+        printf("request queue full\n");
+      }
+      outbox.pop_front();
+      sent++;
+    }
+    Report a;
+    if (simRawAnswers.take(a.data())) {
+      answers.push_back(a);
+    }
+  }
+};
+
+static Host host;
+
+struct LiveBoard : SimBoard {
+  static void idle() {
+    simState.nowMs++;
+    host.frame();
+  }
+};
+
+typedef KeyboardCore<LiveBoard> Core;
+
+static Core core;
+
+// Keys typed meanwhile: this half's plain keys on the default layer
+static std::vector<uint8_t> plain;
+static std::mt19937 rng(3);
+static int heldKey = -1;
+static uint32_t nextKey, releaseAt;
+static bool typingKeys;
+
+static void typeKeys() {
+  uint32_t now = simState.nowMs;
+  if (heldKey >= 0 && now >= releaseAt) {
+    simSetKey(heldKey / Core::colCount, heldKey % Core::colCount, false);
+    heldKey = -1;
+  }
+  if (typingKeys && heldKey < 0 && now >= nextKey) {
+    heldKey = plain[rng() % plain.size()];
+    simSetKey(heldKey / Core::colCount, heldKey % Core::colCount, true);
+    releaseAt = now + 20 + rng() % 41;
+    nextKey = now + 30 + rng() % 51;
+  }
+}
+
+static uint32_t lastScan, maxScanGapMs;
+
+// One loop pass with keys typed, keeping the longest gap between two scans
+static void scan() {
+  typeKeys();
+  core.loop();
+  uint32_t gap = core.lastScanTime - lastScan;
+  if (gap > maxScanGapMs) maxScanGapMs = gap;
+  lastScan = core.lastScanTime;
+}
+
+static void release() {
+  typingKeys = false;
+  if (heldKey >= 0) {
+    simSetKey(heldKey / Core::colCount, heldKey % Core::colCount, false);
+    heldKey = -1;
+  }
+  for (int i = 0; i < 5; i++) scan();
+}
+
+static void boot() {
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = true;
+  simState.otherHalfSilent = true;
+  simState.hidRoom = HID_QUEUE_SIZE;
+  simRawRequests.reset();
+  simRawAnswers.reset();
+  host.reset();
+  core.reset();
+  core.setup(nullptr);
+  for (int i = 0; i < 10; i++) core.loop();
+  lastScan = core.lastScanTime;
+}
+
+struct Result {
+  uint32_t reports = 0;
+  uint32_t attempts = 0;
+  uint32_t ms = 0;
+  uint32_t maxScanGapMs = 0;
+  uint8_t status = 0xFF;  // of the last commit answer
+};
+
+// keymap_compiler --sync's upload: chunks and commit, resent from a WRITE
+// error's offset, up to 5 times. crcDelta damages the commit's CRC,
+// badChunk the data of the chunk at that offset (first attempt only).
+static Result upload(const std::vector<uint8_t> &image, uint32_t crcDelta = 0, int badChunk = -1) {
+  Result r;
+  maxScanGapMs = 0;
+  typingKeys = true;
+  uint32_t start = simState.nowMs, sentBefore = host.sent;
+  uint16_t from = 0, size = (uint16_t)image.size();
+  uint8_t report[KEYMAP_LIVE_REPORT_SIZE];
+  bool done = false;
+  while (!done && r.attempts < 5) {
+    r.attempts++;
+    for (uint16_t offset = from; offset < size;) {
+      uint8_t len = keymapLiveWriteRequest(report, image.data(), size, offset);
+      if (offset == badChunk && r.attempts == 1) report[KEYMAP_LIVE_CHUNK_HEADER] ^= 0x01;
+      host.send(report);
+      offset += len;
+    }
+    keymapLiveCommitRequest(report, image.data(), size);
+    keymapLivePut32(report + 3, keymapLiveGet32(report + 3) + crcDelta);
+    host.send(report);
+
+    from = 0;
+    bool answered = false;
+    for (uint32_t deadline = simState.nowMs + 1000; !answered && simState.nowMs < deadline;) {
+      scan();
+      while (!host.answers.empty() && !answered) {
+        Report a = host.answers.front();
+        host.answers.pop_front();
+        if (a[0] == KEYMAP_LIVE_CMD_WRITE) {
+          from = keymapLiveGet16(&a[2]);
+        } else if (a[0] == KEYMAP_LIVE_CMD_COMMIT) {
+          answered = true;
+          r.status = a[1];
+          done = a[1] == KEYMAP_LIVE_OK || crcDelta != 0;
+        }
+      }
+    }
+  }
+  r.ms = simState.nowMs - start;
+  r.reports = host.sent - sentBefore;
+  release();
+  r.maxScanGapMs = maxScanGapMs;
+  return r;
+}
+
+// The whole active image with READ requests
+static Result readBack(std::vector<uint8_t> &out) {
+  Result r;
+  maxScanGapMs = 0;
+  typingKeys = true;
+  uint32_t start = simState.nowMs, sentBefore = host.sent;
+  out.assign(KEYMAP_LIVE_IMAGE_SIZE, 0);
+  uint8_t report[KEYMAP_LIVE_REPORT_SIZE];
+  uint16_t chunks = 0;
+  for (uint16_t offset = 0; offset < KEYMAP_LIVE_IMAGE_SIZE; offset += KEYMAP_LIVE_CHUNK_MAX, chunks++) {
+    memset(report, 0, sizeof(report));
+    report[0] = KEYMAP_LIVE_CMD_READ;
+    keymapLivePut16(report + 1, offset);
+    report[3] = KEYMAP_LIVE_CHUNK_MAX;
+    host.send(report);
+  }
+  r.attempts = 1;
+  for (uint32_t deadline = simState.nowMs + 1000; chunks > 0 && simState.nowMs < deadline;) {
+    scan();
+    while (!host.answers.empty()) {
+      Report a = host.answers.front();
+      host.answers.pop_front();
+      if (a[0] == KEYMAP_LIVE_CMD_READ && a[1] == KEYMAP_LIVE_OK) {
+        memcpy(&out[keymapLiveGet16(&a[2])], &a[KEYMAP_LIVE_CHUNK_HEADER], a[4]);
+        chunks--;
+      }
+    }
+  }
+  r.status = chunks == 0 ? KEYMAP_LIVE_OK : KEYMAP_LIVE_ERR_SIZE;
+  r.ms = simState.nowMs - start;
+  r.reports = host.sent - sentBefore;
+  release();
+  r.maxScanGapMs = maxScanGapMs;
+  return r;
+}
+
+static void print(const char *scenario, const Result &r) {
+  printf("%-12s %8u %9u %6u %12u\n", scenario, r.reports, r.attempts, r.ms, r.maxScanGapMs);
+  check(r.maxScanGapMs <= SCAN_INTERVAL, scenario, "a scan was late");
+}
+
+// Presses position and lets it through debouncing; holds it when hold
+static void tap(uint8_t position, bool hold = false) {
+  simSetKey(position / Core::colCount, position % Core::colCount, true);
+  for (int i = 0; i < 5; i++) scan();
+  if (!hold) {
+    simSetKey(position / Core::colCount, position % Core::colCount, false);
+    for (int i = 0; i < 5; i++) scan();
+  }
+}
+
+static bool reported(uint8_t keycode) {
+  for (uint8_t i = 0; i < 6; i++) {
+    if (simState.hidKeys[i] == keycode) return true;
+  }
+  return false;
+}
+
+static volatile uint32_t sink;  // keeps the timed loops from being optimised out
+
+static void cost(const std::vector<uint8_t> &image) {
+  const uint32_t rounds = 200000;
+  static LiveKeymap live;
+  live.reset();
+  uint8_t requests[8][KEYMAP_LIVE_REPORT_SIZE], answer[KEYMAP_LIVE_REPORT_SIZE];
+  uint8_t chunks = 0;
+  for (uint16_t offset = 0; offset < image.size(); chunks++) {
+    offset += keymapLiveWriteRequest(requests[chunks], image.data(), (uint16_t)image.size(), offset);
+  }
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    sink += live.receive(requests[i % chunks], answer);
+  }
+  double receiveNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+
+  uint8_t commit[KEYMAP_LIVE_REPORT_SIZE];
+  keymapLiveCommitRequest(commit, image.data(), (uint16_t)image.size());
+  t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds / 100; i++) {
+    live.receive(commit, answer);
+    sink += live.pending;
+    live.pending = false;
+  }
+  double commitUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() /
+                    (rounds / 100);
+
+  t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds / 100; i++) {
+    core.live.pending = true;
+    core.liveKeymapApply();
+    sink += core.layerMediaMask != 0;
+  }
+  double applyUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() /
+                   (rounds / 100);
+  simRawAnswers.reset();
+  printf("receive() %.1f ns per chunk, commit check (CRC-32 of %u bytes) %.1f us, swap with mask recompute %.1f us\n\n",
+         receiveNs, (unsigned)KEYMAP_LIVE_IMAGE_SIZE, commitUs, applyUs);
+}
+
+int main() {
+  boot();
+  for (uint8_t i = 0; i < Core::totalKeys; i++) {
+    uint8_t keycode = keymapKeycode(LAYER_DEFAULT, i);
+    if (keycode >= KEY_A && keycode <= KEY_Z) plain.push_back(i);
+  }
+
+  // The changed image: a letter swapped for another, a macro key, a combo term
+  std::vector<uint8_t> original(core.live.image(), core.live.image() + KEYMAP_LIVE_IMAGE_SIZE);
+  std::vector<uint8_t> image = original;
+  uint8_t swapped = plain[0], macroKey = plain[1];
+  plain.erase(plain.begin(), plain.begin() + 2);
+  uint8_t newKeycode = image[swapped] == KEY_Z ? KEY_X : KEY_Z;
+  image[KEYMAP_LIVE_KEYCODES + swapped] = newKeycode;
+  image[KEYMAP_LIVE_KEYCODES + macroKey] = MACRO(0);
+  const char macro[] = "live macro\n";
+  memcpy(&image[KEYMAP_LIVE_MACROS], macro, sizeof(macro));
+  keymapLivePut16(&image[KEYMAP_LIVE_SETTINGS + KEYMAP_LIVE_SET_COMBO_TERM], 40);
+
+  cost(image);
+
+  printf("image %u bytes: %u keycodes, %u macro bytes, %u settings bytes, %u bytes per chunk\n",
+         (unsigned)KEYMAP_LIVE_IMAGE_SIZE, KEYMAP_LAYERS * KEYMAP_POSITIONS, (unsigned)KEYMAP_LIVE_MACRO_BYTES,
+         (unsigned)KEYMAP_LIVE_SETTINGS_BYTES, (unsigned)KEYMAP_LIVE_CHUNK_MAX);
+  printf("%-12s %8s %9s %6s %12s\n", "scenario", "reports", "attempts", "ms", "scan gap ms");
+
+  boot();
+  Result r = upload(image);
+  print("upload", r);
+  check(r.status == KEYMAP_LIVE_OK && r.attempts == 1, "upload", "not taken first time");
+  check(core.live.crc == keymapLiveCrc32(image.data(), (uint16_t)image.size()), "upload", "active image differs");
+  check(memcmp(core.live.image(), image.data(), image.size()) == 0, "upload", "active image differs");
+  tap(swapped, true);
+  check(reported(newKeycode), "upload", "the swapped key reports its old keycode");
+  release();
+#if KEYMAP_COMBOS
+  check(core.combos.term == 40, "upload", "combo term not applied");
+#endif
+
+  std::vector<uint8_t> readImage;
+  r = readBack(readImage);
+  print("read back", r);
+  check(r.status == KEYMAP_LIVE_OK && readImage == image, "read back", "differs from the upload");
+
+  boot();
+  r = upload(image, 0, 2 * KEYMAP_LIVE_CHUNK_MAX);
+  print("bad chunk", r);
+  check(r.status == KEYMAP_LIVE_OK && r.attempts == 2, "bad chunk", "not resent");
+  check(memcmp(core.live.image(), image.data(), image.size()) == 0, "bad chunk", "active image differs");
+
+  boot();
+  host.dropChunk = 3 * KEYMAP_LIVE_CHUNK_MAX;
+  r = upload(image);
+  print("lost chunk", r);
+  check(r.status == KEYMAP_LIVE_OK && r.attempts == 2, "lost chunk", "not resent");
+  check(memcmp(core.live.image(), image.data(), image.size()) == 0, "lost chunk", "active image differs");
+
+  boot();
+  uint32_t crcBefore = core.live.crc;
+  r = upload(image, 1);
+  print("bad commit", r);
+  check(r.status == KEYMAP_LIVE_ERR_CRC, "bad commit", "taken");
+  check(core.live.crc == crcBefore && core.live.generation == 0 && core.live.keycode(0, swapped) == original[swapped],
+        "bad commit", "old image replaced");
+
+  // The macro key starts typing the uploaded text; a commit meanwhile
+  // waits until the text is typed
+  boot();
+  upload(image);
+  maxScanGapMs = 0;
+  uint32_t start = simState.nowMs;
+  simState.hidRoom = 0;
+  tap(macroKey);
+  check(core.typing.active && strcmp(core.typing.text, macro) == 0, "macro", "key does not type the macro");
+  uint8_t report[KEYMAP_LIVE_REPORT_SIZE];
+  for (uint16_t offset = 0; offset < original.size();) {
+    offset += keymapLiveWriteRequest(report, original.data(), (uint16_t)original.size(), offset);
+    host.send(report);
+  }
+  keymapLiveCommitRequest(report, original.data(), (uint16_t)original.size());
+  host.send(report);
+  for (int i = 0; i < 10; i++) scan();
+  check(core.live.pending && core.live.generation == 1, "macro", "image swapped while the macro typed");
+  simState.hidRoom = HID_QUEUE_SIZE;
+  for (int i = 0; i < 3; i++) scan();
+  check(!core.typing.active && core.live.generation == 2 && core.live.crc == crcBefore, "macro",
+        "image not swapped once the macro was typed");
+  r.reports = host.sent;
+  r.attempts = 1;
+  r.ms = simState.nowMs - start;
+  r.maxScanGapMs = maxScanGapMs;
+  print("macro", r);
+
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,324 @@
+// Settle time and sneak paths of the QMK build's duplex matrix: the
+// unmodified scan (firmware_qmk/matrix.c, encoder.c, ghosting.c) run over
+// the electrical model in firmware_host/sim/duplex_analog.h.
+//
+// Every chord of up to --max-keys switches of LAYOUT_split_3x5_3 (plus the
+// encoder's three contacts on row 3) is held through two back-to-back
+// scans; the second one is analysed read by read:
+//   settle  - time from selecting the step's row or column pin until the
+//             read net last crossed an input threshold; a read that is not
+//             yet at the level it settles to is unsettled at the compiled
+//             MATRIX_IO_DELAY
+//   sneaks  - positions read as pressed that aren't held, because the low
+//             spreads through three or more diodes: "low" below VIL,
+//             "undefined" between VIL and VIH (the pin may read either way,
+//             here it reads low unless --vswitch says where it flips), and
+//             whether fix_ghosting() removes the ghost
+// Per scan step: the worst settle time over single keys and over all
+// chords, and from that the smallest safe MATRIX_IO_DELAY. Rebuild with
+// -DMATRIX_IO_DELAY=N to check a shorter delay; exits non-zero when any
+// read is unsettled or a held key isn't read.
+//
+//   matrix_settle_bench [--max-keys N] [--rpullup OHM] [--cline F] [--cdiode F] [--vf V] [--vswitch V]
+//                       [--keyboard keyboard.json] [--trace r,c+r,c...]
+//
+// --trace prints the net voltages through one scan with that chord held as
+// CSV (microseconds, then one column per net) instead.
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -Ifirmware_host/qmk_shim firmware_host/bench/matrix_settle_bench.cpp firmware_qmk/matrix.c
+//       firmware_qmk/encoder.c firmware_qmk/ghosting.c firmware_qmk/mouse_motion.c firmware_qmk/telemetry.c
+//       firmware_host/qmk_shim/qmk_shim.c firmware_host/qmk_shim/matrix_common.c -lstdc++ -lm -o /tmp/matrix_settle_bench
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../sim/duplex_analog.h"
+#include "../tools/json.h"
+
+#define ENC_ROW 3
+
+struct Position {
+  uint8_t row, col;
+};
+
+typedef std::vector<Position> Chord;
+
+static std::string name(const Chord &chord) {
+  std::string s;
+  for (const Position &p : chord) {
+    if (!s.empty()) s += "+";
+    s += "[" + std::to_string(p.row) + "," + std::to_string(p.col) + "]";
+  }
+  return s;
+}
+
+// Switches on the board: the layout's keys and the encoder's button and
+// quadrature contacts (firmware_qmk/encoder.c)
+static std::vector<Position> loadSwitches(const std::string &path) {
+  std::vector<Position> switches;
+  Json kb = Json::parseFile(path);
+  for (const Json &key : kb.at("layouts").at("LAYOUT_split_3x5_3").at("layout").items()) {
+    const Json &m = key.at("matrix");
+    switches.push_back({(uint8_t)m[0].asInt(), (uint8_t)m[1].asInt()});
+  }
+  for (uint8_t col : {0, 2, 4}) switches.push_back({ENC_ROW, col});
+  return switches;
+}
+
+struct Sneak {
+  Chord chord;
+  Position ghost;
+  double volts;
+  bool undefined;
+  bool fixed;  // fix_ghosting() removed it
+};
+
+struct StepStats {
+  double singleUs = 0;  // worst over single keys
+  double worstUs = 0;   // worst over all chords
+  Chord worstChord;
+};
+
+struct Analysis {
+  DuplexAnalog model;
+  StepStats steps[DuplexAnalog::maxNets];
+  std::vector<Sneak> sneaks;
+  uint32_t chords = 0, sneakChords = 0;
+  uint32_t reads = 0, unsettled = 0, missed = 0;
+  double ioDelayUs = 0;  // select to read, what matrix.c was built with
+  std::string firstFailure;
+
+  // Two scans with the chord held, the second one logged
+  void scan(const Chord &chord, matrix_row_t out[]) {
+    qmk_shim_reset();
+    model.reset();
+    for (const Position &p : chord) qmk_shim_set_switch(p.row, p.col, true);
+    matrix_init();
+    matrix_row_t current[MATRIX_ROWS] = {0};
+    matrix_scan_custom(current);
+    model.reads.clear();
+    model.samples.clear();
+    memset(out, 0, sizeof(matrix_row_t) * MATRIX_ROWS);
+    matrix_scan_custom(out);
+  }
+
+  void run(const Chord &chord) {
+    matrix_row_t out[MATRIX_ROWS];
+    scan(chord, out);
+    chords++;
+    bool sneaked = false;
+    for (const DuplexRead &r : model.reads) {
+      if (r.driven < 0) continue;
+      reads++;
+      ioDelayUs = std::max(ioDelayUs, r.timeUs - r.setupUs);
+      // Position this read decides: row pin driven -> odd column, column pin driven -> even column
+      int readNet = model.netOf(r.pin);
+      Position pos;
+      if (r.driven < MATRIX_ROWS) {
+        pos = {(uint8_t)r.driven, (uint8_t)(2 * (readNet - MATRIX_ROWS) + 1)};
+      } else {
+        pos = {(uint8_t)readNet, (uint8_t)(2 * (r.driven - MATRIX_ROWS))};
+      }
+      bool held = qmk_shim_state.switches[pos.row] >> pos.col & 1;
+
+      if (r.finalLevel == LEVEL_UNDEFINED || (r.finalLevel == LEVEL_LOW && !held)) {
+        matrix_row_t keep = pos.row == ENC_ROW ? 0 : out[pos.row];
+        sneaks.push_back({chord, pos, r.finalVolts, r.finalLevel == LEVEL_UNDEFINED, !(keep >> pos.col & 1)});
+        sneaked = true;
+        if (held) fail(missed, chord, "held key reads undefined", pos);
+        continue;
+      }
+      if (held && r.finalLevel != LEVEL_LOW) {
+        fail(missed, chord, "held key not read", pos);
+        continue;
+      }
+      if (r.level != r.finalLevel) {
+        fail(unsettled, chord, "unsettled read", pos);
+        continue;
+      }
+      double settle = std::max(0.0, r.settledUs - r.setupUs);
+      StepStats &s = steps[r.driven];
+      if (chord.size() == 1) s.singleUs = std::max(s.singleUs, settle);
+      if (settle > s.worstUs) {
+        s.worstUs = settle;
+        s.worstChord = chord;
+      }
+    }
+    sneakChords += sneaked;
+  }
+
+  void fail(uint32_t &counter, const Chord &chord, const char *what, Position pos) {
+    if (counter++ == 0 && firstFailure.empty()) {
+      firstFailure = std::string(what) + " at [" + std::to_string(pos.row) + "," + std::to_string(pos.col) +
+                     "] with " + name(chord) + " held";
+    }
+  }
+};
+
+static Chord parseChord(const char *text) {
+  Chord chord;
+  std::string s(text);
+  size_t start = 0;
+  while (start < s.size()) {
+    size_t end = s.find('+', start);
+    if (end == std::string::npos) end = s.size();
+    unsigned row, col;
+    if (sscanf(s.substr(start, end - start).c_str(), "%u,%u", &row, &col) != 2 || row >= MATRIX_ROWS ||
+        col >= MATRIX_COLS) {
+      fprintf(stderr, "bad position in --trace: %s\n", s.substr(start, end - start).c_str());
+      exit(1);
+    }
+    chord.push_back({(uint8_t)row, (uint8_t)col});
+    start = end + 1;
+  }
+  return chord;
+}
+
+static void printTrace(Analysis &a, const Chord &chord) {
+  matrix_row_t out[MATRIX_ROWS];
+  a.model.traceVoltages = true;
+  a.scan(chord, out);
+  printf("us");
+  for (int i = 0; i < a.model.nets; i++) printf(",GP%u", a.model.netPin[i]);
+  printf("\n");
+  double t0 = a.model.samples.empty() ? 0 : a.model.samples.front().timeUs;
+  for (const DuplexAnalog::Sample &s : a.model.samples) {
+    printf("%.3f", s.timeUs - t0);
+    for (int i = 0; i < a.model.nets; i++) printf(",%.4f", s.volts[i]);
+    printf("\n");
+  }
+}
+
+static void stepName(const DuplexAnalog &model, int net, char *buf, size_t len) {
+  if (net < MATRIX_ROWS) {
+    snprintf(buf, len, "row %d (GP%u)", net, model.netPin[net]);
+  } else {
+    int pair = net - MATRIX_ROWS;
+    snprintf(buf, len, "cols %d/%d (GP%u)", 2 * pair, 2 * pair + 1, model.netPin[net]);
+  }
+}
+
+int main(int argc, char **argv) {
+  static Analysis a;  // large, keep it off the stack
+  int maxKeys = 3;
+  std::string keyboard = "firmware_qmk/keyboard.json";
+  a.model.params.vSwitch = a.model.params.vih;  // undefined reads as pressed: the ghosts the firmware must handle
+  const char *trace = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "usage: see the top of matrix_settle_bench.cpp\n");
+      return 1;
+    }
+    if (!strcmp(argv[i], "--max-keys")) {
+      maxKeys = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--rpullup")) {
+      a.model.params.rPullup = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--cline")) {
+      a.model.params.cLine = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--cdiode")) {
+      a.model.params.cDiode = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--vf")) {
+      a.model.params.vForward = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--vswitch")) {
+      a.model.params.vSwitch = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--keyboard")) {
+      keyboard = argv[++i];
+    } else if (!strcmp(argv[i], "--trace")) {
+      trace = argv[++i];
+    } else {
+      fprintf(stderr, "usage: see the top of matrix_settle_bench.cpp\n");
+      return 1;
+    }
+  }
+
+  duplexAnalogAttach(&a.model);
+  if (trace) {
+    printTrace(a, parseChord(trace));
+    return 0;
+  }
+
+  std::vector<Position> switches;
+  try {
+    switches = loadSwitches(keyboard);
+  } catch (const JsonError &e) {
+    fprintf(stderr, "%s: %s\n", keyboard.c_str(), e.what());
+    return 1;
+  }
+
+  const DuplexParams &p = a.model.params;
+  printf("duplex matrix, %zu switches: pull-up %.0f kOhm, line %.0f pF, diode %.2f V / %.0f pF, VIL %.1f V, VIH %.1f V,"
+         " undefined flips at %.2f V\n",
+         switches.size(), p.rPullup / 1e3, p.cLine * 1e12, p.vForward, p.cDiode * 1e12, p.vil, p.vih, p.vSwitch);
+
+  // Chords of 1..maxKeys switches, in lexicographic order
+  std::vector<int> pick;
+  size_t n = switches.size();
+  for (int k = 1; k <= maxKeys && k <= (int)n; k++) {
+    pick.assign(k, 0);
+    for (int i = 0; i < k; i++) pick[i] = i;
+    while (true) {
+      Chord chord;
+      for (int i : pick) chord.push_back(switches[i]);
+      a.run(chord);
+      int i = k - 1;
+      while (i >= 0 && pick[i] == (int)n - k + i) i--;
+      if (i < 0) break;
+      pick[i]++;
+      for (int j = i + 1; j < k; j++) pick[j] = pick[j - 1] + 1;
+    }
+  }
+
+  printf("MATRIX_IO_DELAY %.0f us, scans back to back\n\n", a.ioDelayUs);
+  printf("settle per scan step (select to last threshold crossing of a read pin):\n");
+  printf("  %-18s %9s %9s  %s\n", "step", "singles", "chords", "worst chord");
+  double worst = 0;
+  int worstStep = 0;
+  for (int net = 0; net < a.model.nets; net++) {
+    const StepStats &s = a.steps[net];
+    char step[48];
+    stepName(a.model, net, step, sizeof(step));
+    printf("  %-18s %7.2f us %6.2f us  %s\n", step, s.singleUs, s.worstUs, name(s.worstChord).c_str());
+    if (s.worstUs > worst) {
+      worst = s.worstUs;
+      worstStep = net;
+    }
+  }
+  char step[48];
+  stepName(a.model, worstStep, step, sizeof(step));
+  printf("smallest safe MATRIX_IO_DELAY: %.2f us (%s); %d us with 2x margin\n", worst, step,
+         (int)std::ceil(2 * worst));
+  printf("%u chords, %u reads: %u unsettled at %.0f us, %u held keys not read\n\n", a.chords, a.reads, a.unsettled,
+         a.ioDelayUs, a.missed);
+
+  uint32_t low = 0, undefined = 0, surviving = 0;
+  for (const Sneak &s : a.sneaks) {
+    (s.undefined ? undefined : low)++;
+    surviving += !s.fixed;
+  }
+  printf("sneak paths: %u chords, %zu ghost reads (%u low, %u undefined), %u not removed by fix_ghosting()\n",
+         a.sneakChords, a.sneaks.size(), low, undefined, surviving);
+  // The ones that reach the debounce first, then the lowest voltages
+  std::stable_sort(a.sneaks.begin(), a.sneaks.end(), [](const Sneak &x, const Sneak &y) {
+    return x.fixed != y.fixed ? !x.fixed : x.volts < y.volts;
+  });
+  int shown = 0;
+  for (const Sneak &s : a.sneaks) {
+    if (shown++ == 24) {
+      printf("  ...\n");
+      break;
+    }
+    printf("  %-28s ghost [%u,%u] at %.2f V %-9s %s\n", name(s.chord).c_str(), s.ghost.row, s.ghost.col, s.volts,
+           s.undefined ? "undefined" : "low", s.fixed ? "removed" : "reaches debounce");
+  }
+
+  bool ok = a.unsettled == 0 && a.missed == 0;
+  if (!ok) printf("\nfirst failure: %s\n", a.firstFailure.c_str());
+  printf("\n%s\n", ok ? "all reads settled" : "FAILED");
+  return ok ? 0 : 1;
+}
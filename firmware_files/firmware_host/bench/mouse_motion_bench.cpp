@@ -0,0 +1,356 @@
+// Mouse key motion engine (firmware_qmk/mouse_motion.c) on a simulated QMK
+// scan loop: passes every 100-300 us, a 4 ms stall every 250 ms (LED and
+// EEPROM work), MS_RGHT held for 1.5 s.
+//
+// Per curve: cursor displacement against time as a plot (and --csv for a
+// real one), distance after 100 ms - 1.5 s, report rate, how late reports
+// leave after their frame starts and the biggest single jump. Stock QMK
+// mousekey with its documented defaults (MOUSEKEY_DELAY 10, INTERVAL 20,
+// MOVE_DELTA 8, MAX_SPEED 10, TIME_TO_MAX 30) is shown for comparison.
+//
+// Checks, exit 1 on failure:
+//   - at most one report per frame, and one in every frame once the cursor
+//     moves a pixel per frame or more (stalls aside)
+//   - the distance does not depend on the loop: within one frame's motion
+//     of the same curve integrated in floating point
+//   - nothing is sent after the key is released
+//   - scroll mode: the cursor keys and encoder detents come out together
+//     on the frame grid, no report off it, no detent lost
+//
+//   mouse_motion_bench [--csv file]
+//
+// Build (from firmware_files/):
+//   gcc -O2 -c firmware_qmk/mouse_motion.c -o /tmp/mouse_motion.o
+//   g++ -O2 -std=c++17 -Ifirmware_qmk firmware_host/bench/mouse_motion_bench.cpp /tmp/mouse_motion.o -o /tmp/mouse_motion_bench
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "mouse_motion.h"
+}
+
+#define FRAME_US MOUSE_MOTION_FRAME_US
+#define HOLD_US 1500000
+#define PRESS_US 12345  // not on a frame boundary
+#define STALL_EVERY_US 250000
+#define STALL_US 4000
+
+struct Report {
+  uint32_t us;
+  mouse_motion_report_t r;
+};
+
+struct Run {
+  const char *name;
+  char symbol;
+  mouse_curve_t curve;
+  int tier;  // MS_ACL key held, -1 for none
+  std::vector<Report> reports;
+  std::vector<uint32_t> lateUs;  // report time after its frame started
+  int expected = 0;              // floating point integration of the curve
+};
+
+// Scan loop passes: 100-300 us apart, stalls now and then
+struct Loop {
+  uint32_t rng = 2463534242u;
+  uint32_t now = 0;
+  uint32_t nextStall = STALL_EVERY_US;
+
+  uint32_t next() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    now += 100 + rng % 201;
+    if (now >= nextStall) {
+      now += STALL_US;
+      nextStall += STALL_EVERY_US;
+    }
+    return now;
+  }
+};
+
+// Cursor speed of the engine's curves in px/s, in floating point
+static double curveSpeed(mouse_curve_t curve, int tier, double ms) {
+  static const double tiers[3] = MOUSE_MOTION_TIER_SPEEDS;
+  if (tier >= 0) return tiers[tier];
+  if (curve == MOUSE_CURVE_CONSTANT) return tiers[MOUSE_MOTION_DEFAULT_TIER];
+  double f = std::min(ms / MOUSE_MOTION_TIME_TO_MAX, 1.0);
+  if (curve == MOUSE_CURVE_QUADRATIC) f *= f;
+  return MOUSE_MOTION_START_SPEED + (MOUSE_MOTION_MAX_SPEED - MOUSE_MOTION_START_SPEED) * f;
+}
+
+static Run runEngine(const char *name, char symbol, mouse_curve_t curve, int tier) {
+  Run run{name, symbol, curve, tier, {}, {}};
+  mouse_motion_init();
+  mouse_motion_set_curve(curve);
+  Loop loop;
+  bool pressed = false, released = false;
+  uint32_t start = 0;
+  for (uint32_t now = loop.next(); now < PRESS_US + HOLD_US + 50000; now = loop.next()) {
+    if (!pressed && now >= PRESS_US) {
+      pressed = true;
+      start = now;
+      if (tier >= 0) mouse_motion_input((mouse_input_t)(MOUSE_INPUT_ACCEL0 + tier), true, now);
+      mouse_motion_input(MOUSE_INPUT_RIGHT, true, now);
+    }
+    if (pressed && !released && now >= PRESS_US + HOLD_US) {
+      released = true;
+      mouse_motion_input(MOUSE_INPUT_RIGHT, false, now);
+    }
+    mouse_motion_report_t r;
+    if (mouse_motion_task(now, &r)) {
+      run.reports.push_back(Report{now, r});
+      run.lateUs.push_back((now - start) % FRAME_US);
+    }
+  }
+  // Frames the key was seen held: the first at the press, one more per frame started before release
+  double px = 1;
+  for (uint32_t frame = 0; start + frame * FRAME_US < PRESS_US + HOLD_US + (FRAME_US - 1); frame++) {
+    uint32_t t = start + frame * FRAME_US;
+    if (t > PRESS_US + HOLD_US) break;
+    px += curveSpeed(curve, tier, frame * FRAME_US / 1000.0) * FRAME_US / 1e6;
+  }
+  run.expected = (int)px;
+  return run;
+}
+
+// QMK's mousekey.c in accelerated mode, defaults from its docs
+static Run runStock() {
+  Run run{"stock mousekey", 'S', MOUSE_CURVE_COUNT, -1, {}, {}};
+  const int delta = 8, maxSpeed = 10, timeToMax = 30, delayMs = 10, intervalMs = 20;
+  uint32_t repeat = 0;
+  uint32_t last = PRESS_US;
+  auto unit = [&]() {
+    int u = repeat == 0 ? delta : repeat >= (uint32_t)timeToMax ? delta * maxSpeed : delta * maxSpeed * (int)repeat / timeToMax;
+    return std::max(1, std::min(127, u));
+  };
+  run.reports.push_back(Report{PRESS_US, {0, (int8_t)unit(), 0, 0, 0}});
+  for (uint32_t t = PRESS_US; t < PRESS_US + HOLD_US; t += 1000) {
+    if (t - last >= (repeat ? intervalMs : delayMs) * 1000u) {
+      if (repeat < 255) repeat++;
+      run.reports.push_back(Report{t, {0, (int8_t)unit(), 0, 0, 0}});
+      last = t;
+    }
+  }
+  return run;
+}
+
+static int distanceAt(const Run &run, uint32_t us) {
+  int x = 0;
+  for (const Report &r : run.reports) {
+    if (r.us > us) break;
+    x += r.r.x;
+  }
+  return x;
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+// At most one report per frame; every frame has one once speed >= 1 px/frame
+static bool checkFrames(const Run &run, uint32_t start, uint32_t fastFrom, std::string &err) {
+  uint32_t lastFrame = UINT32_MAX;
+  for (size_t i = 0; i < run.reports.size(); i++) {
+    uint32_t frame = (run.reports[i].us - start) / FRAME_US;
+    if (frame == lastFrame) {
+      err = "two reports in frame " + std::to_string(frame);
+      return false;
+    }
+    if (i && run.reports[i].us >= fastFrom && run.reports[i].us < PRESS_US + HOLD_US && frame != lastFrame + 1) {
+      // A gap is only allowed across a stall
+      uint32_t prev = run.reports[i - 1].us;
+      bool stall = (prev / STALL_EVERY_US) != (run.reports[i].us / STALL_EVERY_US);
+      if (!stall) {
+        err = "no report in frames " + std::to_string(lastFrame + 1) + "-" + std::to_string(frame - 1);
+        return false;
+      }
+    }
+    lastFrame = frame;
+  }
+  return true;
+}
+
+static void plot(const std::vector<Run> &runs) {
+  const int width = 64, height = 16;
+  int top = 1;
+  for (const Run &run : runs) top = std::max(top, distanceAt(run, PRESS_US + HOLD_US));
+  std::vector<std::string> rows(height, std::string(width, ' '));
+  for (const Run &run : runs) {
+    for (int col = 0; col < width; col++) {
+      uint32_t us = PRESS_US + (uint32_t)((uint64_t)HOLD_US * (col + 1) / width);
+      int row = (int)((int64_t)distanceAt(run, us) * (height - 1) / top);
+      char &c = rows[height - 1 - row][col];
+      c = c == ' ' || c == run.symbol ? run.symbol : '*';
+    }
+  }
+  printf("cursor x against time (0-%d ms, 0-%d px; * where curves overlap)\n", HOLD_US / 1000, top);
+  for (int row = 0; row < height; row++) {
+    int px = (int)((int64_t)top * (height - 1 - row) / (height - 1));
+    printf("  %5d |%s\n", px, rows[row].c_str());
+  }
+  printf("        +%s\n         ", std::string(width, '-').c_str());
+  for (int col = 0; col < width; col += 16) printf("%-16d", (int)((uint64_t)HOLD_US * col / width / 1000));
+  printf("ms\n  ");
+  for (const Run &run : runs) printf(" %c %s ", run.symbol, run.name);
+  printf("\n\n");
+}
+
+static void writeCsv(const char *path, const std::vector<Run> &runs) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "cannot write %s\n", path);
+    return;
+  }
+  fprintf(f, "ms");
+  for (const Run &run : runs) fprintf(f, ",%s", run.name);
+  fprintf(f, "\n");
+  for (uint32_t ms = 0; ms <= HOLD_US / 1000; ms++) {
+    fprintf(f, "%u", ms);
+    for (const Run &run : runs) fprintf(f, ",%d", distanceAt(run, PRESS_US + ms * 1000));
+    fprintf(f, "\n");
+  }
+  fclose(f);
+  printf("wrote %s\n", path);
+}
+
+// Scroll mode: MS_DOWN held 500 ms while the encoder turns 5 detents each way and back
+static bool checkScroll() {
+  mouse_motion_init();
+  mouse_motion_set_scroll(true);
+  Loop loop;
+  std::vector<Report> reports;
+  uint32_t start = 0;
+  int knob = 0;
+  for (uint32_t now = loop.next(); now < PRESS_US + 600000; now = loop.next()) {
+    if (!start && now >= PRESS_US) {
+      start = now;
+      mouse_motion_input(MOUSE_INPUT_DOWN, true, now);
+    }
+    if (start && now >= PRESS_US + 500000) {
+      mouse_motion_input(MOUSE_INPUT_DOWN, false, now);
+    }
+    // A detent every 20 ms from 100 ms on, clockwise (down) then back
+    if (start && now >= PRESS_US + 100000 + 20000 * (uint32_t)std::abs(knob) && std::abs(knob) < 10) {
+      int8_t detent = std::abs(knob) < 5 ? -1 : 1;
+      mouse_motion_wheel(detent, 0);
+      knob += knob >= 0 ? 1 : -1;
+    }
+    mouse_motion_report_t r;
+    if (mouse_motion_task(now, &r)) reports.push_back(Report{now, r});
+  }
+
+  int wheel = 0, cursor = 0;
+  uint32_t lastFrame = UINT32_MAX;
+  bool onGrid = true;
+  for (const Report &r : reports) {
+    wheel += r.r.v;
+    cursor += std::abs(r.r.x) + std::abs(r.r.y);
+    uint32_t frame = (r.us - start) / FRAME_US;
+    onGrid &= frame != lastFrame;
+    lastFrame = frame;
+  }
+  // Keys alone, same loop
+  mouse_motion_init();
+  mouse_motion_set_scroll(true);
+  Loop keysOnly;
+  int keyWheel = 0;
+  bool down = false;
+  for (uint32_t now = keysOnly.next(); now < PRESS_US + 600000; now = keysOnly.next()) {
+    if (!down && now >= PRESS_US) {
+      down = true;
+      mouse_motion_input(MOUSE_INPUT_DOWN, true, now);
+    }
+    if (down && now >= PRESS_US + 500000) mouse_motion_input(MOUSE_INPUT_DOWN, false, now);
+    mouse_motion_report_t r;
+    if (mouse_motion_task(now, &r)) keyWheel += r.v;
+  }
+  // The knob went 5 down and 5 up: same total as the keys alone
+  bool ok = onGrid && cursor == 0 && wheel == keyWheel;
+  printf("scroll mode, MS_DOWN 500 ms + encoder 5 detents down and 5 up: %zu reports, wheel %d (keys alone %d), "
+         "cursor %d, %s\n",
+         reports.size(), wheel, keyWheel, cursor, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  const char *csv = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+      csv = argv[++i];
+    } else {
+      fprintf(stderr, "usage: mouse_motion_bench [--csv file]\n");
+      return 1;
+    }
+  }
+
+  std::vector<Run> runs;
+  runs.push_back(runEngine("linear", 'L', MOUSE_CURVE_LINEAR, -1));
+  runs.push_back(runEngine("quadratic", 'Q', MOUSE_CURVE_QUADRATIC, -1));
+  runs.push_back(runEngine("constant", 'C', MOUSE_CURVE_CONSTANT, -1));
+  runs.push_back(runEngine("ACL0", '0', MOUSE_CURVE_QUADRATIC, 0));
+  runs.push_back(runEngine("ACL2", '2', MOUSE_CURVE_QUADRATIC, 2));
+  runs.push_back(runStock());
+
+  plot(runs);
+  if (csv) writeCsv(csv, runs);
+
+  printf("  %-15s %27s %10s %9s %14s %9s\n", "curve", "x at 100/250/500/1000/1500ms", "float", "reports/s",
+         "late p50/max us", "max jump");
+  bool ok = true;
+  for (const Run &run : runs) {
+    bool stock = run.symbol == 'S';
+    int jump = 0;
+    uint32_t moving = 0;
+    for (const Report &r : run.reports) {
+      jump = std::max(jump, (int)std::abs(r.r.x));
+      moving += r.us < PRESS_US + HOLD_US;
+    }
+    char expected[16] = "-", late[24] = "-";
+    if (!stock) {
+      snprintf(expected, sizeof(expected), "%d", run.expected);
+      snprintf(late, sizeof(late), "%u/%u", percentile(run.lateUs, 0.5), percentile(run.lateUs, 1.0));
+    }
+    printf("  %-15s %5d/%4d/%5d/%5d/%5d %10s %9.0f %15s %9d\n", run.name, distanceAt(run, PRESS_US + 100000),
+           distanceAt(run, PRESS_US + 250000), distanceAt(run, PRESS_US + 500000), distanceAt(run, PRESS_US + 1000000),
+           distanceAt(run, PRESS_US + HOLD_US), expected, moving / (HOLD_US / 1e6), late, jump);
+    if (stock) continue;
+
+    // Fast enough for a pixel every frame: from where the float curve passes 1000 px/s
+    uint32_t fastFrom = UINT32_MAX;
+    for (uint32_t ms = 0; ms < HOLD_US / 1000; ms++) {
+      if (curveSpeed(run.curve, run.tier, ms) >= 1e6 / FRAME_US) {
+        fastFrom = PRESS_US + ms * 1000 + 2 * FRAME_US;
+        break;
+      }
+    }
+    std::string err;
+    if (!checkFrames(run, run.reports.empty() ? 0 : run.reports[0].us - run.lateUs[0], fastFrom, err)) {
+      printf("  %s: %s\n", run.name, err.c_str());
+      ok = false;
+    }
+    double frameMotion = curveSpeed(MOUSE_CURVE_LINEAR, -1, 1e9) * FRAME_US / 1e6;
+    int total = distanceAt(run, UINT32_MAX);
+    if (std::abs(total - run.expected) > frameMotion + 1) {
+      printf("  %s: moved %d px, the curve gives %d\n", run.name, total, run.expected);
+      ok = false;
+    }
+    if (!run.reports.empty() && run.reports.back().us > PRESS_US + HOLD_US + FRAME_US + STALL_US) {
+      printf("  %s: report %u us after release\n", run.name, run.reports.back().us - PRESS_US - HOLD_US);
+      ok = false;
+    }
+  }
+  printf("\n");
+
+  ok = checkScroll() && ok;
+  printf("%s\n", ok ? "report grid ok" : "FAILED");
+  return ok ? 0 : 1;
+}
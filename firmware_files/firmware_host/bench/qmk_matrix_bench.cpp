@@ -0,0 +1,193 @@
+// Scan hot path of the QMK build on the host: firmware_qmk/matrix.c,
+// encoder.c, ghosting.c and telemetry.c compiled unmodified against
+// firmware_host/qmk_shim, which simulates the duplex matrix's pins and
+// diodes and runs wait_us() on virtual time.
+//
+// Checked first, through matrix_scan_custom():
+//   singles - every matrix position held alone reads as exactly that key
+//   pairs   - every two positions held together read as exactly those two
+//             (a ghost needs three switches)
+//   encoder - quadrature steps on row 3 turn into PGDN/PGUP taps and the
+//             encoder row is cleared
+// Then random typing through matrix_scan() (custom scan + sym_defer_g
+// debounce): wall time per scan and per stage (stage_profile.h, the scan
+// stages include the simulated pins), pin reads per scan and the virtual
+// time matrix.c waits per scan, which bounds the scan rate on the board.
+// Exits non-zero when a check fails.
+//
+//   qmk_matrix_bench [--scans N] [--seed N]
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -DSTAGE_PROFILE_ENABLE -DSTAGE_PROFILE_HOST -Ifirmware_host/qmk_shim firmware_host/bench/qmk_matrix_bench.cpp
+//       firmware_qmk/matrix.c firmware_qmk/encoder.c firmware_qmk/ghosting.c firmware_qmk/mouse_motion.c
+//       firmware_qmk/telemetry.c firmware_host/qmk_shim/qmk_shim.c firmware_host/qmk_shim/matrix_common.c
+//       firmware_host/stage_profile_host.cpp -lstdc++ -o /tmp/qmk_matrix_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "quantum.h"
+
+#define STAGE_PROFILE_IMPLEMENTATION
+#include "../../firmware_common/stage_profile.h"
+
+#define ENC_ROW 3
+#define ENC_BUTTON_COL 0
+#define ENC_A_COL 2
+#define ENC_B_COL 4
+
+// The debounce stage is opened at the end of matrix_scan_custom()
+extern "C" void matrix_scan_user(void) {
+  PROFILE_MARK_END(PROFILE_DEBOUNCE);
+}
+
+static void releaseAll() {
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) qmk_shim_set_switch(row, col, false);
+  }
+}
+
+// What matrix_scan_custom() should return for the held switches
+static void expected(matrix_row_t out[]) {
+  memcpy(out, qmk_shim_state.switches, sizeof(qmk_shim_state.switches));
+  out[ENC_ROW] = 0;  // consumed by fix_encoder_action()
+}
+
+static bool scanMatches(const char *what, int &failures) {
+  matrix_row_t current[MATRIX_ROWS] = {0}, want[MATRIX_ROWS];
+  matrix_scan_custom(current);
+  expected(want);
+  if (!memcmp(current, want, sizeof(want))) return true;
+  if (failures++ < 5) {
+    printf("  %s: read", what);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) printf(" %03x", current[row]);
+    printf(", held");
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) printf(" %03x", want[row]);
+    printf("\n");
+  }
+  return false;
+}
+
+static int checkSingles() {
+  int failures = 0;
+  qmk_shim_reset();
+  matrix_init();
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      char what[32];
+      snprintf(what, sizeof(what), "[%u,%u]", row, col);
+      qmk_shim_set_switch(row, col, true);
+      scanMatches(what, failures);
+      qmk_shim_set_switch(row, col, false);
+      scanMatches("released", failures);
+    }
+  }
+  printf("singles: %d of %d positions wrong\n", failures, MATRIX_ROWS * MATRIX_COLS);
+  return failures;
+}
+
+static int checkPairs() {
+  int failures = 0, pairs = 0;
+  const int positions = MATRIX_ROWS * MATRIX_COLS;
+  qmk_shim_reset();
+  matrix_init();
+  for (int a = 0; a < positions; a++) {
+    for (int b = a + 1; b < positions; b++) {
+      char what[48];
+      snprintf(what, sizeof(what), "[%d,%d]+[%d,%d]", a / MATRIX_COLS, a % MATRIX_COLS, b / MATRIX_COLS,
+               b % MATRIX_COLS);
+      qmk_shim_set_switch(a / MATRIX_COLS, a % MATRIX_COLS, true);
+      qmk_shim_set_switch(b / MATRIX_COLS, b % MATRIX_COLS, true);
+      scanMatches(what, failures);
+      releaseAll();
+      pairs++;
+    }
+  }
+  printf("pairs: %d of %d wrong\n", failures, pairs);
+  return failures;
+}
+
+// Quadrature as fix_encoder_action() expects it: both contacts, then the
+// leading one alone, then neither
+static void encoderStep(bool clockwise) {
+  matrix_row_t current[MATRIX_ROWS] = {0};
+  uint8_t lead = clockwise ? ENC_A_COL : ENC_B_COL;
+  qmk_shim_set_switch(ENC_ROW, ENC_A_COL, true);
+  qmk_shim_set_switch(ENC_ROW, ENC_B_COL, true);
+  matrix_scan_custom(current);
+  qmk_shim_set_switch(ENC_ROW, ENC_A_COL + ENC_B_COL - lead, false);
+  matrix_scan_custom(current);
+  qmk_shim_set_switch(ENC_ROW, lead, false);
+  matrix_scan_custom(current);
+}
+
+static int checkEncoder() {
+  qmk_shim_reset();
+  matrix_init();
+  const int turns = 5;
+  for (int i = 0; i < turns; i++) encoderStep(true);
+  for (int i = 0; i < turns; i++) encoderStep(false);
+  int failures = qmk_shim_state.taps != 2 * turns;
+  for (uint32_t i = 0; i < qmk_shim_state.taps && i < QMK_SHIM_TAP_LOG; i++) {
+    failures += qmk_shim_state.tap_log[i] != (i < (uint32_t)turns ? KC_PGDN : KC_PGUP);
+  }
+  printf("encoder: %d clockwise + %d counter-clockwise steps, %u taps, %d wrong\n", turns, turns, qmk_shim_state.taps,
+         failures);
+  return failures;
+}
+
+static void benchScan(uint32_t scans, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> row(0, MATRIX_ROWS - 1), col(0, MATRIX_COLS - 1), chance(0, 99);
+  qmk_shim_reset();
+  matrix_init();
+  stage_profile_init();
+
+  uint32_t changes = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < scans; i++) {
+    // A switch changes every few scans, at most three held, encoder row left alone
+    if (chance(rng) < 20) {
+      int r = row(rng), c = col(rng);
+      bool held = qmk_shim_state.switches[r] >> c & 1;
+      int count = 0;
+      for (uint8_t k = 0; k < MATRIX_ROWS; k++) count += __builtin_popcount(qmk_shim_state.switches[k]);
+      if (r != ENC_ROW && (held || count < 3)) qmk_shim_set_switch(r, c, !held);
+    }
+    changes += matrix_scan();
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+
+  printf("\nmatrix_scan() on random typing: %u scans, %u debounced changes\n", scans, changes);
+  printf("  wall     %8.1f ns per scan (%.2f M scans/s)\n", ns / scans, scans / ns * 1e3);
+  printf("  pins     %8.1f reads per scan\n", (double)qmk_shim_state.pin_reads / scans);
+  printf("  waits    %8.1f us per scan in wait_us(): at most %.0f scans/s on the board\n",
+         (double)qmk_shim_state.waited_us / scans, 1e6 * scans / qmk_shim_state.waited_us);
+  printf("  stages:\n");
+  for (int stage = 0; stage <= PROFILE_DEBOUNCE; stage++) {
+    char line[160];
+    if (stage_profile_format((profile_stage_t)stage, line, sizeof(line))) printf("    %s\n", line);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t scans = 1000000, seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--scans") && i + 1 < argc) {
+      scans = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      fprintf(stderr, "usage: qmk_matrix_bench [--scans N] [--seed N]\n");
+      return 1;
+    }
+  }
+
+  int failures = checkSingles() + checkPairs() + checkEncoder();
+  benchScan(scans, seed);
+  printf("\n%s\n", failures ? "FAILED" : "matrix ok");
+  return failures ? 1 : 0;
+}
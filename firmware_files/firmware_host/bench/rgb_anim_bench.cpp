@@ -0,0 +1,117 @@
+// Per-frame cost of the QMK status LED animation engine (firmware_qmk/rgb_anim.c)
+//
+// Plays the startup sweep, a run of layer fades and a caps word pulse, and
+// compares it with the old approach of converting HSV and writing the LED on
+// every frame (flash_led() calling rgblight_sethsv()). The engine plays a
+// run of frames per wakeup (RGB_ANIM_STEP_FRAMES), so its cost is per
+// animation frame over the wakeups it took.
+//
+// Exits non-zero when the engine writes the LED or wakes up on more than
+// half of the frames.
+//
+// Build (from firmware_files/):
+//   gcc -O2 -c firmware_qmk/rgb_anim.c -o /tmp/rgb_anim.o
+//   g++ -O2 -std=c++17 -Ifirmware_qmk firmware_host/bench/rgb_anim_bench.cpp /tmp/rgb_anim.o -o /tmp/rgb_anim_bench
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+#include "rgb_anim.h"
+}
+
+static uint32_t ledWrites = 0;
+static volatile uint8_t ledSink = 0;
+
+extern "C" void rgb_anim_output(uint8_t r, uint8_t g, uint8_t b) {
+  ledWrites++;
+  ledSink = r ^ g ^ b;
+}
+
+// The per-frame conversion flash_led() used to pay for through rgblight_sethsv()
+static void naiveFrame(uint8_t hue, uint8_t sat, uint8_t val) {
+  if (sat == 0) {
+    rgb_anim_output(val, val, val);
+    return;
+  }
+  uint16_t h = hue, s = sat, v = val;
+  uint8_t region = h * 6 / 255;
+  uint8_t remainder = (h * 2 - region * 85) * 3;
+  uint8_t p = (v * (255 - s)) >> 8;
+  uint8_t q = (v * (255 - ((s * remainder) >> 8))) >> 8;
+  uint8_t t = (v * (255 - ((s * (255 - remainder)) >> 8))) >> 8;
+  switch (region) {
+    case 6:
+    case 0: rgb_anim_output(v, t, p); break;
+    case 1: rgb_anim_output(q, v, p); break;
+    case 2: rgb_anim_output(p, v, t); break;
+    case 3: rgb_anim_output(p, q, v); break;
+    case 4: rgb_anim_output(t, p, v); break;
+    default: rgb_anim_output(v, p, q); break;
+  }
+}
+
+static double nowNs() {
+  using namespace std::chrono;
+  return (double)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static const uint8_t layerHues[] = {128, 220, 180, 120, 220, 128};
+
+int main() {
+  const int rounds = 20000;
+
+  // Engine: a startup sweep, six layer fades and a caps word pulse per round.
+  // Rounds are timed whole, then once more setting up the effects without
+  // playing them; the difference is the frame stepping.
+  rgb_anim_init(128, 128, 32);
+  auto round = [](bool playFrames) {
+    auto play = [playFrames](uint32_t maxFrames) {
+      uint32_t until = rgb_anim_stats()->frames + maxFrames;
+      while (playFrames && rgb_anim_stats()->frames < until && rgb_anim_task()) {
+      }
+    };
+    rgb_anim_startup();
+    play(RGB_ANIM_MAX_FRAMES);
+    for (uint8_t hue : layerHues) {
+      rgb_anim_layer(hue);
+      play(RGB_ANIM_MAX_FRAMES);
+    }
+    rgb_anim_caps_word(true);
+    play(32);
+    rgb_anim_caps_word(false);
+    play(RGB_ANIM_MAX_FRAMES);
+  };
+  double t0 = nowNs();
+  for (int i = 0; i < rounds; i++) round(true);
+  double totalNs = nowNs() - t0;
+  uint64_t frames = rgb_anim_stats()->frames;
+  uint32_t engineWrites = rgb_anim_stats()->writes;
+  uint32_t engineSteps = rgb_anim_stats()->steps;
+  t0 = nowNs();
+  for (int i = 0; i < rounds; i++) round(false);
+  double setupNs = nowNs() - t0;
+  double engineNs = totalNs - setupNs;
+
+  // Old path: same number of frames, each one converted and written
+  ledWrites = 0;
+  t0 = nowNs();
+  for (uint64_t i = 0; i < frames; i++) {
+    naiveFrame((uint8_t)(250 - (i % 50) * 5), 230, 70);
+  }
+  double naiveNs = nowNs() - t0;
+
+  printf("frames           %llu\n", (unsigned long long)frames);
+  printf("engine wakeups   %u (%.1f%% of frames)\n", engineSteps, 100.0 * engineSteps / frames);
+  printf("engine writes    %u (%.1f%% of frames)\n", engineWrites, 100.0 * engineWrites / frames);
+  printf("engine ns/frame  %.2f\n", engineNs / frames);
+  printf("setup ns/effect  %.2f\n", setupNs / (rounds * (3.0 + sizeof(layerHues))));
+  printf("naive writes     %u\n", ledWrites);
+  printf("naive ns/frame   %.2f\n", naiveNs / frames);
+  if (engineWrites * 2 > frames || engineSteps * 2 > frames) {
+    printf("FAIL the engine writes or wakes up on more than half of the frames\n");
+    return 1;
+  }
+  return 0;
+}
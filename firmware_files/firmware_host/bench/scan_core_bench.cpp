@@ -0,0 +1,187 @@
+// Cost of one matrix scan + debounce of the handwritten firmware core, built
+// for the simulated board (firmware_host/sim/sim_board.h):
+//
+//   runtime pins  - the pre-template scan: loops over rowPins[]/colPins[]
+//                   arrays, every access looks the pin up at run time
+//   template      - KeyboardCore<SimBoard>, rows unrolled, one read per column
+//   template+gpio - KeyboardCore<SimGpioBoard>, all columns from one GPIO
+//                   read (what the RP2040 traits do)
+//
+// All variants see the same key sequence and must end up with the same
+// debounced state.
+//
+// The template rows used to lose to runtime pins (about 275 against 240
+// cycles): the columns were gathered into a mask and then unpacked again by
+// a per-column loop GCC does not unroll at -O2, paying both ways for every
+// key. storeRow() now works on the row masks and only visits keys that
+// moved or are still debouncing, so a row at rest costs a compare. On the keyboard itself, build with STAGE_PROFILE_ENABLE:
+// the "scan" stage reports cycles (RP2040) or microseconds (Nano) per scan.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/scan_core_bench.cpp -o /tmp/scan_core_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#include "../sim/sim_board.h"
+
+#define SCANS 2000000
+
+struct SimGpioBoard : SimBoard {
+  static uint32_t readColumns() {
+    return (uint32_t)(~simState.levels >> ColPins::first) & ((1u << ColPins::size) - 1);
+  }
+};
+
+// The scan loop as it was before the board traits, over runtime pin tables
+struct RuntimeScan {
+  static const uint8_t rowCount = 4;
+  static const uint8_t colCount = 6;
+  static const uint8_t totalKeys = rowCount * colCount;
+
+  uint8_t rowPins[rowCount] = {6, 7, 8, 9};
+  uint8_t colPins[colCount] = {10, 11, 12, 13, 14, 15};
+  int8_t rowOfPin[64];
+
+  bool currentKeyState[totalKeys] = {};
+  bool previousKeyState[totalKeys] = {};
+  bool debouncedKeyState[totalKeys] = {};
+  uint32_t lastDebounceTime[totalKeys] = {};
+  uint32_t uptimeMs = 0;
+
+  RuntimeScan() {
+    memset(rowOfPin, -1, sizeof(rowOfPin));
+    for (uint8_t row = 0; row < rowCount; row++) {
+      rowOfPin[rowPins[row]] = row;
+    }
+  }
+
+  void digitalWrite(uint8_t pin, bool high) { SimBoard::drive(pin, rowOfPin[pin], high); }
+  bool digitalRead(uint8_t pin) { return (simState.levels >> pin) & 1; }
+
+  __attribute__((noinline)) void scanKeys() {
+    for (uint8_t row = 0; row < rowCount; row++) {
+      digitalWrite(rowPins[row], false);
+
+      for (uint8_t col = 0; col < colCount; col++) {
+        uint8_t keyIndex = row * colCount + col;
+        bool keyState = !digitalRead(colPins[col]);
+
+        currentKeyState[keyIndex] = keyState;
+        if (currentKeyState[keyIndex] != previousKeyState[keyIndex]) {
+          lastDebounceTime[keyIndex] = uptimeMs;
+        }
+        if ((uptimeMs - lastDebounceTime[keyIndex]) > DEBOUNCE_TIME) {
+          if (debouncedKeyState[keyIndex] != currentKeyState[keyIndex]) {
+            debouncedKeyState[keyIndex] = currentKeyState[keyIndex];
+          }
+        }
+        previousKeyState[keyIndex] = currentKeyState[keyIndex];
+      }
+
+      digitalWrite(rowPins[row], true);
+    }
+  }
+};
+
+template <typename Board> struct CoreScan {
+  KeyboardCore<Board> core;
+  __attribute__((noinline)) void scanKeys() { core.scanMatrix(); }
+  const bool *debounced() const { return core.debouncedKeyState; }
+  void setTime(uint32_t ms) { core.uptimeMs = ms; }
+};
+
+struct RuntimeScanBench {
+  RuntimeScan scan;
+  void scanKeys() { scan.scanKeys(); }
+  const bool *debounced() const { return scan.debouncedKeyState; }
+  void setTime(uint32_t ms) { scan.uptimeMs = ms; }
+};
+
+// Harness cost only, subtracted from the other rows
+struct NullScanBench {
+  bool state[24] = {};
+  __attribute__((noinline)) void scanKeys() { __asm__ volatile("" ::: "memory"); }
+  const bool *debounced() const { return state; }
+  void setTime(uint32_t) {}
+};
+
+struct Result {
+  double nsPerScan;
+  double cyclesPerScan;
+  uint32_t checksum;
+};
+
+// Typing-like input: a key changes every few scans, time advances 1 ms per scan
+static void stepKeys(uint32_t i, uint32_t &rng) {
+  if (i % 4 == 0) {
+    rng = rng * 1664525u + 1013904223u;
+    uint8_t key = (rng >> 16) % 24;
+    simSetKey(key / 6, key % 6, (rng >> 8) & 1);
+  }
+}
+
+// Scans are timed in batches so the clock reads do not dominate
+#define BATCH 1000
+
+template <typename Bench> static Result run(Bench &bench) {
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  uint32_t rng = 12345;
+  uint32_t checksum = 0;
+
+  uint64_t totalNs = 0;
+  uint64_t totalCycles = 0;
+  for (uint32_t batch = 0; batch < SCANS / BATCH; batch++) {
+    auto t0 = std::chrono::steady_clock::now();
+#ifdef BENCH_HAVE_TSC
+    uint64_t c0 = __rdtsc();
+#endif
+    for (uint32_t i = batch * BATCH; i < (batch + 1) * BATCH; i++) {
+      stepKeys(i, rng);
+      bench.setTime(i);
+      bench.scanKeys();
+      checksum = checksum * 31 + bench.debounced()[i % 24];
+    }
+#ifdef BENCH_HAVE_TSC
+    totalCycles += __rdtsc() - c0;
+#endif
+    totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+  }
+  return Result{(double)totalNs / SCANS, (double)totalCycles / SCANS, checksum};
+}
+
+int main() {
+  NullScanBench null;
+  RuntimeScanBench runtime;
+  CoreScan<SimBoard> perPin;
+  CoreScan<SimGpioBoard> gpio;
+
+  Result base = run(null);
+  Result results[3] = {run(runtime), run(perPin), run(gpio)};
+  const char *names[3] = {"runtime pins", "template", "template+gpio"};
+
+  printf("scan + debounce of one 4x6 half, %d scans, harness cost subtracted\n", SCANS);
+  printf("  %-14s %9s %12s\n", "variant", "ns/scan", "cycles/scan");
+  for (int i = 0; i < 3; i++) {
+#ifdef BENCH_HAVE_TSC
+    printf("  %-14s %9.1f %12.1f\n", names[i], results[i].nsPerScan - base.nsPerScan,
+           results[i].cyclesPerScan - base.cyclesPerScan);
+#else
+    printf("  %-14s %9.1f %12s\n", names[i], results[i].nsPerScan - base.nsPerScan, "-");
+#endif
+  }
+
+  if (results[0].checksum != results[1].checksum || results[0].checksum != results[2].checksum) {
+    printf("MISMATCH: debounced state differs between variants\n");
+    return 1;
+  }
+  printf("debounced state identical across variants\n");
+  return 0;
+}
@@ -0,0 +1,318 @@
+// Typing strings from the handwritten firmware: characters per second of
+// the string compiler (firmware_common/send_string.h) streamed by
+// typeString(), against a tap per character.
+//
+// The right half's KeyboardCore runs on the simulated board in virtual
+// time. hidSend() pushes into HidReportQueue like the RP2040 build, and
+// every millisecond of idle() is a USB frame that commits one report to a
+// host model. The host applies each report the way hid-input does
+// (modifier changes, then releases, then presses in slot order) and types
+// a character for each key press, so a report sequence that only looks
+// right (a repeat merged away, Shift leaking onto a neighbour) shows up as
+// wrong text. Schemes:
+//   typeString   - the compiler's reports, produced by typeTask() as the
+//                  queue has room, from the loop and while it waits for the
+//                  next scan
+//   tap per loop - press (with its modifiers) in one loop pass, release in
+//                  the next, as a key macro driven by the scan loop would
+//   QMK          - send_string()'s report sequence, modelled: Shift
+//                  registered, key registered and unregistered, Shift
+//                  unregistered, each report waiting for the endpoint
+//                  (one per frame, TAP_CODE_DELAY 0); the scan loop is
+//                  blocked until the last one
+// Per scheme and text: reports, time from the call to the last report at
+// the host, characters per second, the longest gap between two scans, and
+// whether the host typed the text. Also the compiler's own cost per
+// character on this machine.
+//
+// Exits non-zero when a scheme types something else, or a scan is late
+// while typeString() streams.
+//
+//   send_string_bench [--corpus FILE]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/send_string_bench.cpp -o /tmp/send_string_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "../sim/sim_board.h"
+#include "../../firmware_handwritten/hid_report_queue.h"
+
+#define FRAME_MS 1
+
+static int failures = 0;
+
+static void check(bool ok, const char *scheme, const char *text, const char *what) {
+  if (!ok) {
+    printf("FAIL %s, %s: %s\n", scheme, text, what);
+    failures++;
+  }
+}
+
+// Host side: what hid-input makes of each report, as typed text
+struct Host {
+  uint8_t held[6];
+  std::string typed;
+  uint32_t reports;
+  uint32_t lastReportMs;
+  char chars[256][2];  // usage, Shift -> character
+
+  Host() {
+    memset(chars, 0, sizeof(chars));
+    for (int c = 1; c < 128; c++) {
+      uint8_t modifiers;
+      uint8_t usage = send_string_usage((char)c, &modifiers);
+      if (usage) chars[usage][modifiers != 0] = (char)c;
+    }
+    reset();
+  }
+
+  void reset() {
+    memset(held, 0, sizeof(held));
+    typed.clear();
+    reports = 0;
+    lastReportMs = 0;
+  }
+
+  void report(const uint8_t *keys, uint32_t nowMs) {
+    reports++;
+    lastReportMs = nowMs;
+    // Modifier changes and releases first: only the modifiers of the new
+    // report matter to its presses
+    bool shift = HidReportQueue::holds(keys, KEY_LEFT_SHIFT) || HidReportQueue::holds(keys, KEY_RIGHT_SHIFT);
+    for (uint8_t i = 0; i < 6; i++) {
+      uint8_t usage = keys[i];
+      if (usage == 0 || HidReportQueue::isModifier(usage) || HidReportQueue::holds(held, usage)) continue;
+      char c = chars[usage][shift];
+      typed += c ? c : '?';
+    }
+    memcpy(held, keys, sizeof(held));
+  }
+};
+
+static Host host;
+
+// The RP2040 build's report path: a queue committed at start of frame
+struct FrameBoard : SimBoard {
+  static HidReportQueue queue;
+  static uint32_t refused;
+
+  static uint8_t hidRoom() { return HID_QUEUE_SIZE - queue.depth(); }
+  static bool hidCanTake(uint8_t keyboard, uint8_t) { return keyboard <= hidRoom(); }
+
+  static void hidSend(const uint8_t *keys) {
+    if (!queue.push(keys)) refused++;
+    memcpy(simState.hidKeys, keys, sizeof(simState.hidKeys));
+    simState.hidReports++;
+  }
+
+  static void idle() {
+    simState.nowMs += FRAME_MS;
+    uint8_t keys[6];
+    if (queue.take(keys)) host.report(keys, simState.nowMs);
+  }
+};
+
+HidReportQueue FrameBoard::queue;
+uint32_t FrameBoard::refused;
+
+typedef KeyboardCore<FrameBoard> Core;
+
+static Core core;
+
+// The text as the host should type it: characters without a key dropped
+static std::string typeable(const char *text) {
+  std::string out;
+  for (const char *p = text; *p; p++) {
+    uint8_t modifiers;
+    if (send_string_usage(*p, &modifiers)) out += *p;
+  }
+  return out;
+}
+
+struct Result {
+  uint32_t reports = 0;
+  uint32_t ms = 0;
+  uint32_t maxScanGapMs = 0;
+  uint32_t refused = 0;
+  bool correct = false;
+};
+
+// One loop pass, keeping the longest gap between two scans
+static void scan(Result &r, uint32_t &lastScan) {
+  core.loop();
+  uint32_t gap = core.lastScanTime - lastScan;
+  if (gap > r.maxScanGapMs) r.maxScanGapMs = gap;
+  lastScan = core.lastScanTime;
+}
+
+static void boot() {
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = true;
+  simState.otherHalfSilent = true;
+  FrameBoard::queue.reset();
+  FrameBoard::refused = 0;
+  core.reset();
+  core.setup(nullptr);
+  for (int i = 0; i < 10; i++) core.loop();
+  host.reset();
+}
+
+static Result typeString(const char *text) {
+  boot();
+  Result r;
+  uint32_t start = simState.nowMs, lastScan = core.lastScanTime;
+  core.typeString(text);
+  while (core.typing.active || FrameBoard::queue.depth() > 0) {
+    scan(r, lastScan);
+  }
+  r.reports = host.reports;
+  r.ms = host.lastReportMs - start;
+  r.refused = FrameBoard::refused;
+  r.correct = host.typed == typeable(text);
+  return r;
+}
+
+// Press in one loop pass, release in the next
+static Result tapPerLoop(const char *text) {
+  boot();
+  Result r;
+  uint32_t start = simState.nowMs, lastScan = core.lastScanTime;
+  for (const char *p = text; *p; p++) {
+    uint8_t modifiers;
+    uint8_t usage = send_string_usage(*p, &modifiers);
+    if (!usage) continue;
+    uint8_t press[6] = {0};
+    uint8_t n = 0;
+    if (modifiers) press[n++] = KEY_LEFT_SHIFT;
+    press[n] = usage;
+    const uint8_t release[6] = {0};
+    FrameBoard::hidSend(press);
+    scan(r, lastScan);
+    FrameBoard::hidSend(release);
+    scan(r, lastScan);
+  }
+  while (FrameBoard::queue.depth() > 0) {
+    scan(r, lastScan);
+  }
+  r.reports = host.reports;
+  r.ms = host.lastReportMs - start;
+  r.refused = FrameBoard::refused;
+  r.correct = host.typed == typeable(text);
+  return r;
+}
+
+// send_string(): each register/unregister is a report that waits for the
+// endpoint, the loop stalls until the string is done
+static Result qmk(const char *text) {
+  host.reset();
+  Result r;
+  uint32_t now = 0;
+  uint8_t keys[6] = {0};
+  for (const char *p = text; *p; p++) {
+    uint8_t modifiers;
+    uint8_t usage = send_string_usage(*p, &modifiers);
+    if (!usage) continue;
+    if (modifiers) {
+      keys[0] = KEY_LEFT_SHIFT;
+      host.report(keys, now += FRAME_MS);
+    }
+    keys[1] = usage;
+    host.report(keys, now += FRAME_MS);
+    keys[1] = 0;
+    host.report(keys, now += FRAME_MS);
+    if (modifiers) {
+      keys[0] = 0;
+      host.report(keys, now += FRAME_MS);
+    }
+  }
+  r.reports = host.reports;
+  r.ms = now;
+  r.maxScanGapMs = now + SCAN_INTERVAL;
+  r.correct = host.typed == typeable(text);
+  return r;
+}
+
+static volatile uint32_t sink;  // keeps the timed loop from being optimised out
+
+static void compilerCost(const std::string &text) {
+  const uint32_t rounds = 2000;
+  uint32_t reports = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < rounds; i++) {
+    send_string_t s;
+    send_string_report_t report;
+    send_string_start(&s, text.c_str());
+    while (send_string_next(&s, &report)) reports += report.key;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() /
+              ((double)rounds * text.size());
+  sink = reports;
+  printf("send_string_next(): %.1f ns per character (%zu characters x %u)\n\n", ns, text.size(), rounds);
+}
+
+int main(int argc, char **argv) {
+  const char *corpus = "firmware_host/corpus/prose.txt";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+      corpus = argv[++i];
+    } else {
+      fprintf(stderr, "usage: send_string_bench [--corpus FILE]\n");
+      return 1;
+    }
+  }
+  FILE *f = fopen(corpus, "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", corpus);
+    return 1;
+  }
+  std::string prose;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) prose.append(buf, n);
+  fclose(f);
+
+  struct Text {
+    const char *name;
+    std::string text;
+  };
+  const Text texts[] = {
+      {"email signature", "Best regards,\nJane Doe\njane.doe@example.com"},
+      {"repeats and caps", "AAAaaa!!1 bookkeeper HELLO llama 0x00FF ((())) ...\n"},
+      {"prose corpus", prose},
+  };
+
+  compilerCost(prose);
+
+  printf("%-18s %-14s %6s %8s %8s %9s %12s %s\n", "text", "scheme", "chars", "reports", "ms", "chars/s",
+         "scan gap ms", "typed");
+  for (const Text &t : texts) {
+    const char *text = t.text.c_str();
+    size_t chars = typeable(text).size();
+    struct Scheme {
+      const char *name;
+      Result r;
+    } schemes[] = {
+        {"typeString", typeString(text)},
+        {"tap per loop", tapPerLoop(text)},
+        {"QMK", qmk(text)},
+    };
+    for (const Scheme &s : schemes) {
+      printf("%-18s %-14s %6zu %8u %8u %9.0f %12u %s\n", t.name, s.name, chars, s.r.reports, s.r.ms,
+             s.r.ms ? chars * 1000.0 / s.r.ms : 0.0, s.r.maxScanGapMs, s.r.correct ? "ok" : "WRONG");
+      check(s.r.correct, s.name, t.name, "the host typed something else");
+      check(s.r.refused == 0, s.name, t.name, "the queue refused a report");
+    }
+    check(schemes[0].r.maxScanGapMs <= SCAN_INTERVAL, "typeString", t.name, "a scan was late");
+  }
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,332 @@
+// Two-thread stress test of the left half's I2C answer
+// (firmware_handwritten/split_link.h, KeyboardCore::sendKeyStates()).
+//
+// One thread runs the left half's loop() on virtual time, toggling random
+// keys and now and then a six-key chord, so debounced changes keep landing;
+// like on the keyboard the master asks at least once per scan. The other
+// thread plays the request interrupt: it calls sendKeyStates() back to back
+// and reads every answer the way the master does, keeping its own copy of
+// the left half's keys. Both threads yield at random between rows, inside
+// the handler and while the answer is on the bus, so the interleavings also
+// happen on a single core.
+//
+//   snapshot - the answer the loop published after its last scan
+//   legacy   - the request handler as it was: drains the event queue and
+//              packs debouncedKeyState on the spot, while the loop may be
+//              halfway through a scan
+//
+// Checked for every answer:
+//   torn   - the bitmap disagrees with the keys the events so far add up
+//            to (an answer without SPLIT_MORE or SPLIT_OVERFLOW claims both)
+//   order  - an event presses a key already down or releases one already up
+//            (lost or duplicated events)
+// and at the end that every change the loop made came through exactly once.
+// Also the time per request handler call, which is what the master's clock
+// is stretched by, measured separately on one thread. Exits non-zero when
+// the snapshot path tears, loses or repeats an event.
+//
+//   split_link_stress [--seconds N] [--seed N]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 -pthread firmware_host/bench/split_link_stress.cpp -o /tmp/split_link_stress
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#include "../sim/sim_board.h"
+
+static std::atomic<uint32_t> virtualMs;
+static uint8_t wire[SPLIT_ANSWER_MAX];  // owned by the request thread
+
+// Sometimes hand the CPU to the other thread. On a single core the threads
+// otherwise only meet at time slice boundaries, which almost never fall
+// inside a request handler; with two cores this just adds jitter.
+static bool chaos = true;
+
+static void preempt() {
+  if (!chaos) return;
+  thread_local std::minstd_rand rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  if ((rng() & 3) == 0) std::this_thread::yield();
+}
+
+struct StressBoard : SimBoard {
+  static uint32_t millis() { return virtualMs.load(std::memory_order_relaxed); }
+  static void idle() { virtualMs.fetch_add(1, std::memory_order_relaxed); }
+  static void settle() { preempt(); }  // between rows, halfway through a scan
+  static void sendToMaster(const uint8_t *data, uint8_t len) {
+    preempt();  // while the answer is on the bus
+    memcpy(wire, data, len);
+  }
+};
+
+typedef KeyboardCore<StressBoard> Core;
+
+static const uint8_t kKeys = Core::totalKeys;
+static const uint8_t kCols = StressBoard::ColPins::size;
+
+static Core core;
+static std::atomic<bool> producing;
+static std::atomic<bool> stop;
+static std::atomic<uint32_t> produced;  // debounced changes made by the loop
+static std::atomic<uint64_t> taken;     // answers the request thread has read
+static bool singleCore;
+
+// The request handler before the answer was built by the loop
+static uint8_t legacyTail;
+
+static void legacySendKeyStates() {
+  uint8_t packet[Core::linkPacketSize] = {0};
+  SplitEventQueue &q = core.linkQueue;
+  uint8_t t = legacyTail, count = 0;
+  packet[5] = t;
+  uint8_t *out = packet + SPLIT_HEADER_SIZE;
+  while (t != q.head && count < SPLIT_EVENTS_PER_PACKET) {
+    const SplitEvent &e = q.events[t % SPLIT_QUEUE_SIZE];
+    out[0] = e.key;
+    out[1] = (uint8_t)e.time;
+    out[2] = (uint8_t)(e.time >> 8);
+    out += 3;
+    t++;
+    count++;
+  }
+  legacyTail = t;
+  q.sent = t;
+  packet[0] = count;
+  if (t != q.head) packet[0] |= SPLIT_MORE;
+  if (q.overflowed) packet[0] |= SPLIT_OVERFLOW;
+  preempt();
+
+  uint8_t *bitmap = packet + SPLIT_PACKET_SIZE(0);
+  for (uint8_t i = 0; i < kKeys; i++) {
+    if (core.debouncedKeyState[i]) {
+      bitmap[i / 8] |= (1 << (i % 8));
+    }
+  }
+  StressBoard::sendToMaster(packet, sizeof(packet));
+}
+
+struct Result {
+  uint64_t answers = 0;
+  uint64_t repeats = 0;   // answers with no event the reader didn't have
+  uint64_t events = 0;    // events taken in
+  uint64_t torn = 0;
+  uint64_t order = 0;
+  uint64_t resyncs = 0;   // gaps or overflows, resynced from the bitmap
+  uint32_t produced = 0;
+  bool finalMatch = false;
+  std::vector<uint32_t> handlerTicks;
+  double ticksPerNs = 1;
+};
+
+// The master's side: events once each by queue index, then the bitmap
+struct Reader {
+  bool keys[kKeys] = {};
+  uint8_t next = 0;
+
+  void take(const uint8_t *a, Result &r) {
+    uint8_t count = a[0] & SPLIT_COUNT_MASK;
+    uint8_t skip = (uint8_t)(next - a[5]);
+    bool gap = skip > count;
+    if (gap) skip = 0;
+    next = a[5] + count;
+    r.answers++;
+    if (skip == count) r.repeats++;
+
+    for (uint8_t i = skip; i < count; i++) {
+      uint8_t key = a[SPLIT_HEADER_SIZE + 3 * i];
+      uint8_t pos = key & ~SPLIT_PRESSED;
+      bool pressed = key & SPLIT_PRESSED;
+      if (pos >= kKeys || keys[pos] == pressed) r.order++;
+      if (pos < kKeys) keys[pos] = pressed;
+      r.events++;
+    }
+
+    const uint8_t *bitmap = a + SPLIT_PACKET_SIZE(0);
+    bool differs = false;
+    for (uint8_t i = 0; i < kKeys; i++) differs |= keys[i] != (bool)(bitmap[i / 8] & (1 << (i % 8)));
+    if (gap || (a[0] & SPLIT_OVERFLOW)) {
+      r.resyncs += differs || gap;
+    } else if (!(a[0] & SPLIT_MORE) && differs) {
+      r.torn++;
+    } else {
+      return;
+    }
+    for (uint8_t i = 0; i < kKeys; i++) keys[i] = bitmap[i / 8] & (1 << (i % 8));
+  }
+};
+
+// One pass of the left half's loop, counting the debounced changes it makes;
+// returns once the master has asked at least once, as it does every scan
+static void step() {
+  bool before[kKeys];
+  memcpy(before, core.debouncedKeyState, sizeof(before));
+  uint64_t seen = taken;
+  core.loop();
+  uint32_t changes = 0;
+  for (uint8_t i = 0; i < kKeys; i++) changes += before[i] != core.debouncedKeyState[i];
+  produced.fetch_add(changes, std::memory_order_relaxed);
+  while (taken == seen) std::this_thread::yield();
+}
+
+// Random typing for one scan: a key now and then, sometimes a six-key
+// chord, more than one answer carries
+struct Typist {
+  std::mt19937 rng;
+  std::uniform_int_distribution<int> key{0, kKeys - 1}, chance{0, 99};
+
+  explicit Typist(uint32_t seed) : rng(seed) {}
+
+  void toggle() {
+    int k = key(rng);
+    simState.pressed[k / kCols] ^= 1u << (k % kCols);
+  }
+  void type() {
+    if (chance(rng) < 30) toggle();
+    if (chance(rng) == 0) {
+      for (int i = 0; i < 6; i++) toggle();
+    }
+  }
+};
+
+static void produce(uint32_t seed, double seconds) {
+  Typist typist(seed);
+  auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+  uint32_t loops = 0;
+  while (producing) {
+    if ((++loops & 1023) == 0 && std::chrono::steady_clock::now() > end) producing = false;
+    if (producing) typist.type();
+    step();
+  }
+}
+
+static void startHalf() {
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  simState.rightSide = false;
+  virtualMs = 0;
+  core.reset();
+  core.setup(nullptr);
+  legacyTail = 0;
+}
+
+static Result runOne(bool legacy, uint32_t seed, double seconds) {
+  startHalf();
+  produced = 0;
+  taken = 0;
+  producing = true;
+  stop = false;
+
+  Result r;
+  Reader reader;
+  std::thread requests([&] {
+    while (!stop) {
+      if (legacy) {
+        legacySendKeyStates();
+      } else {
+        core.sendKeyStates();
+      }
+      reader.take(wire, r);
+      taken++;
+      if (singleCore) std::this_thread::yield();
+    }
+  });
+
+  produce(seed, seconds);
+  // Keys stay put now: let the last changes through
+  for (int i = 0; i < 2000; i++) step();
+  stop = true;
+  requests.join();
+
+  r.produced = produced;
+  r.finalMatch = !memcmp(reader.keys, core.debouncedKeyState, sizeof(reader.keys));
+  return r;
+}
+
+// Time per handler call on one thread, one request per scan and no
+// preemption, so the numbers are the handler's own work
+static void timeHandler(bool legacy, uint32_t seed, Result &r) {
+  startHalf();
+  chaos = false;
+  Typist typist(seed);
+  r.handlerTicks.reserve(1 << 20);
+  auto wall0 = std::chrono::steady_clock::now();
+#ifdef BENCH_HAVE_TSC
+  uint64_t tsc0 = __rdtsc();
+#endif
+  for (uint32_t i = 0; i < (1u << 20); i++) {
+    typist.type();
+    core.loop();
+#ifdef BENCH_HAVE_TSC
+    uint64_t c0 = __rdtsc();
+#endif
+    if (legacy) {
+      legacySendKeyStates();
+    } else {
+      core.sendKeyStates();
+    }
+#ifdef BENCH_HAVE_TSC
+    r.handlerTicks.push_back((uint32_t)(__rdtsc() - c0));
+#endif
+  }
+#ifdef BENCH_HAVE_TSC
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - wall0).count();
+  r.ticksPerNs = (__rdtsc() - tsc0) / ns;
+#endif
+  chaos = true;
+}
+
+static void print(const char *name, Result &r) {
+  std::sort(r.handlerTicks.begin(), r.handlerTicks.end());
+  auto pct = [&](double p) {
+    return r.handlerTicks.empty() ? 0.0 : r.handlerTicks[(size_t)(p * (r.handlerTicks.size() - 1))] / r.ticksPerNs;
+  };
+  printf("  %-9s %10llu %9.1f%% %9llu/%-9u %6llu %6llu %7llu %5s %8.1f %8.1f %8.1f\n", name,
+         (unsigned long long)r.answers, 100.0 * r.repeats / std::max<uint64_t>(r.answers, 1),
+         (unsigned long long)r.events, r.produced, (unsigned long long)r.torn, (unsigned long long)r.order,
+         (unsigned long long)r.resyncs, r.finalMatch ? "yes" : "NO", pct(0.5), pct(0.99), pct(1.0));
+}
+
+int main(int argc, char **argv) {
+  double seconds = 2;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    } else {
+      fprintf(stderr, "usage: split_link_stress [--seconds N] [--seed N]\n");
+      return 1;
+    }
+  }
+
+  singleCore = std::thread::hardware_concurrency() < 2;
+  printf("two threads, %.1f s each: left half loop() against back-to-back request handler calls%s\n", seconds,
+         singleCore ? " (one core)" : "");
+  printf("handler time: one thread, one request per scan\n");
+  printf("  %-9s %10s %10s %19s %6s %6s %7s %5s %8s %8s %8s\n", "handler", "answers", "repeats", "events/changes",
+         "torn", "order", "resync", "final", "p50 ns", "p99 ns", "max ns");
+  Result legacy = runOne(true, seed, seconds);
+  timeHandler(true, seed, legacy);
+  print("legacy", legacy);
+  Result snapshot = runOne(false, seed, seconds);
+  timeHandler(false, seed, snapshot);
+  print("snapshot", snapshot);
+
+  bool ok = snapshot.torn == 0 && snapshot.order == 0 && snapshot.resyncs == 0 && snapshot.finalMatch &&
+            snapshot.events == snapshot.produced;
+  printf("%s\n", ok ? "snapshot answers consistent" : "FAILED");
+  return ok ? 0 : 1;
+}
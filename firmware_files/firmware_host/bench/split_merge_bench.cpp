@@ -0,0 +1,367 @@
+// Order of cross-hand rolls through the split link of the handwritten
+// firmware (firmware_handwritten/split_link.h), with the halves' clocks
+// deliberately apart.
+//
+// Two KeyboardCore<SimBoard> instances run on their own clocks: the left
+// half boots at a different millis(), runs skewPpm faster or slower and
+// scans at its own phase. The right half polls it every loop; each request
+// is answered by the left half at that moment on its own clock. A scripted
+// typist rolls between the hands with press gaps from 1 to 40 ms.
+//
+// For every pair of consecutive presses on different hands, by the gap
+// between them, how often the merged stream puts them in the wrong order:
+//   poll   - the old bitmap link: a key counts from the first poll that
+//            shows it, keys seen in the same loop in report (position) order
+//   events - the merged stream out of KeyboardCore::keyEvent()
+// plus the merge latency (debounced change on its half to merged, ms: the
+// left half's wait for the next poll, and how long right half events are
+// held back for it), the press latency of the left half (physical press to
+// merged) and the error of the converted left stamps against the master
+// clock.
+//
+// Exits non-zero when a press goes missing from either stream or the merged
+// stream swaps presses more than two scan intervals apart; closer than one
+// scan interval the order is down to which half scanned first.
+//
+//   split_merge_bench [--presses N] [--boot-ms N] [--seed N]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/split_merge_bench.cpp -o /tmp/split_merge_bench
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "../sim/sim_board.h"
+
+typedef KeyboardCore<SimBoard> Core;
+
+static const uint8_t kHalfKeys = Core::totalKeys;
+static const uint8_t kCols = SimBoard::ColPins::size;
+
+// Both halves share the global simState, so each one's state is swapped in
+// around its loop() and the left one's around the I2C request
+struct Half {
+  Core core;
+  SimState state;
+
+  void enter() { simState = state; }
+  void leave() { state = simState; }
+};
+
+static Half leftHalf;
+static Half rightHalf;
+
+struct Press {
+  uint64_t downUs;
+  uint64_t upUs;
+  uint8_t pos;  // keymap position, left half from kHalfKeys
+};
+
+struct Merged {
+  uint8_t pos;
+  bool pressed;
+  uint32_t stampMs;  // event time on the master clock
+  uint32_t emitMs;   // master time it came out of the merge
+};
+
+struct Clocks {
+  int32_t skewPpm;
+  uint32_t bootMs;  // left millis() at t = 0
+  uint32_t leftMs(uint64_t us) const { return bootMs + (uint32_t)((us * (1000000 + skewPpm)) / 1000000000ull); }
+  static uint32_t rightMs(uint64_t us) { return (uint32_t)(us / 1000); }
+};
+
+static Clocks clocks;
+static uint64_t nowUs;
+static std::vector<Merged> merged;
+static uint8_t leftBitmap[Core::linkBitmapBytes];
+// Left half stamps as sent, in order
+static std::vector<uint16_t> leftStamps;
+static uint8_t leftNextEvent;
+// Master ms at which the left half's loop with a given 16 bit stamp ran
+static std::vector<uint32_t> stampToMaster(65536);
+
+static void onKeyEvent(uint8_t pos, bool pressed, uint32_t timeMs) {
+  merged.push_back(Merged{pos, pressed, timeMs, simState.nowMs});
+}
+
+// The left half answers on its own clock, in the middle of the right half's loop
+static void onRequest() {
+  SimState master = simState;
+  leftHalf.enter();
+  simState.nowMs = clocks.leftMs(nowUs);
+  leftHalf.core.sendKeyStates();
+  leftHalf.leave();
+  simState = master;
+  memcpy(simState.otherHalf, leftHalf.state.sentToMaster, sizeof(simState.otherHalf));
+  const uint8_t *packet = leftHalf.state.sentToMaster;
+  // Each event once: an answer repeats events when the left half hasn't scanned since the last request
+  for (uint8_t i = 0; i < (packet[0] & SPLIT_COUNT_MASK); i++) {
+    if ((uint8_t)(packet[5] + i) != leftNextEvent) continue;
+    leftStamps.push_back(packet[SPLIT_HEADER_SIZE + 3 * i + 1] | packet[SPLIT_HEADER_SIZE + 3 * i + 2] << 8);
+    leftNextEvent++;
+  }
+  memcpy(leftBitmap, packet + SPLIT_PACKET_SIZE(0), sizeof(leftBitmap));
+}
+
+// Interleaved rolls: mostly alternating hands, gaps of 1-40 ms, keys held
+// 60-140 ms (longer than the debounce takes on a slow clock), a key is only
+// pressed again well after its release
+static std::vector<Press> script(uint32_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> gap(1000, 40000), dwell(60000, 140000), key(0, 3 * kCols - 1);
+  std::uniform_real_distribution<double> coin(0, 1);
+  std::vector<Press> out;
+  std::vector<uint64_t> freeAt(2 * kHalfKeys, 0);
+  uint64_t t = 100000;
+  uint8_t hand = 0;
+  while (out.size() < count) {
+    if (coin(rng) < 0.75) hand ^= 1;
+    t += gap(rng);
+    if (coin(rng) < 0.05) t += 300000;  // pause between words
+    uint8_t pos;
+    do {
+      pos = hand * kHalfKeys + key(rng);
+    } while (freeAt[pos] > t);
+    uint64_t up = t + dwell(rng);
+    freeAt[pos] = up + 60000;
+    out.push_back(Press{t, up, pos});
+  }
+  return out;
+}
+
+struct Run {
+  std::vector<Merged> events;     // merged stream
+  std::vector<uint8_t> pollOrder; // presses as the poll link shows them
+  std::vector<uint32_t> pollMs;   // master ms each of them was seen
+  std::vector<uint32_t> clockErr; // |converted left stamp - master time of that left loop|
+};
+
+static Run simulate(const std::vector<Press> &presses) {
+  Half *halves[2] = {&rightHalf, &leftHalf};
+  for (int h = 0; h < 2; h++) {
+    memset(&simState, 0, sizeof(simState));
+    simState.levels = ~0ull;
+    simState.rightSide = h == 0;
+    simState.nowMs = h == 0 ? 0 : clocks.bootMs;
+    halves[h]->core.reset();
+    halves[h]->core.setup(nullptr);
+    halves[h]->leave();
+  }
+  rightHalf.state.onRequest = onRequest;
+  rightHalf.state.onKeyEvent = onKeyEvent;
+  leftHalf.core.lastScanTime -= SCAN_INTERVAL - 4;  // left half scans 4 ms after the right
+  merged.clear();
+  leftStamps.clear();
+  leftNextEvent = 0;
+  memset(leftBitmap, 0, sizeof(leftBitmap));
+
+  // Key edges in time order
+  struct Edge {
+    uint64_t us;
+    uint8_t pos;
+    bool down;
+  };
+  std::vector<Edge> edges;
+  for (const Press &p : presses) {
+    edges.push_back(Edge{p.downUs, p.pos, true});
+    edges.push_back(Edge{p.upUs, p.pos, false});
+  }
+  std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.us < b.us; });
+
+  Run run;
+  uint64_t pollMask = 0;
+  size_t next = 0;
+  uint64_t endUs = edges.back().us + 200000;
+  for (nowUs = 0; nowUs < endUs; nowUs += 100) {
+    for (; next < edges.size() && edges[next].us <= nowUs; next++) {
+      const Edge &e = edges[next];
+      Half &half = e.pos < kHalfKeys ? rightHalf : leftHalf;
+      uint8_t local = e.pos % kHalfKeys;
+      uint32_t bit = 1u << (local % kCols);
+      if (e.down) {
+        half.state.pressed[local / kCols] |= bit;
+      } else {
+        half.state.pressed[local / kCols] &= ~bit;
+      }
+    }
+
+    uint32_t leftNow = clocks.leftMs(nowUs);
+    if (leftNow - leftHalf.core.lastScanTime >= SCAN_INTERVAL) {
+      stampToMaster[leftNow & 0xFFFF] = Clocks::rightMs(nowUs);
+      leftHalf.enter();
+      simState.nowMs = leftNow;
+      leftHalf.core.loop();
+      leftHalf.leave();
+    }
+
+    uint32_t rightNow = Clocks::rightMs(nowUs);
+    if (rightNow - rightHalf.core.lastScanTime >= SCAN_INTERVAL) {
+      rightHalf.enter();
+      simState.nowMs = rightNow;
+      rightHalf.core.loop();
+      rightHalf.leave();
+
+      // What the bitmap link would have shown this loop
+      uint64_t mask = 0;
+      for (uint8_t i = 0; i < kHalfKeys; i++) {
+        if (rightHalf.core.debouncedKeyState[i]) mask |= 1ull << i;
+        if (leftBitmap[i / 8] & (1 << (i % 8))) mask |= 1ull << (i + kHalfKeys);
+      }
+      uint64_t down = mask & ~pollMask;
+      for (uint8_t pos = 0; down; pos++, down >>= 1) {
+        if (down & 1) {
+          run.pollOrder.push_back(pos);
+          run.pollMs.push_back(rightNow);
+        }
+      }
+      pollMask = mask;
+    }
+  }
+  run.events = merged;
+  size_t left = 0;
+  for (const Merged &m : merged) {
+    if (m.pos >= kHalfKeys && left < leftStamps.size()) {
+      uint32_t truth = stampToMaster[leftStamps[left++]];
+      run.clockErr.push_back(m.stampMs > truth ? m.stampMs - truth : truth - m.stampMs);
+    }
+  }
+  return run;
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+static const uint32_t kBucketsMs[] = {2, 5, 10, 20, 40};
+static const int kBuckets = sizeof(kBucketsMs) / sizeof(kBucketsMs[0]);
+
+static int bucketOf(uint64_t gapUs) {
+  for (int b = 0; b < kBuckets; b++) {
+    if (gapUs < kBucketsMs[b] * 1000ull) return b;
+  }
+  return kBuckets - 1;
+}
+
+// Rank of every press in an observed order, matched per position in FIFO order
+static std::vector<int64_t> ranks(const std::vector<Press> &presses, const std::vector<uint8_t> &observed) {
+  std::vector<std::deque<size_t>> byPos(2 * kHalfKeys);
+  for (size_t i = 0; i < presses.size(); i++) {
+    byPos[presses[i].pos].push_back(i);
+  }
+  std::vector<int64_t> rank(presses.size(), -1);
+  for (size_t r = 0; r < observed.size(); r++) {
+    std::deque<size_t> &q = byPos[observed[r]];
+    if (!q.empty()) {
+      rank[q.front()] = (int64_t)r;
+      q.pop_front();
+    }
+  }
+  return rank;
+}
+
+static uint32_t maxOf(const std::vector<uint32_t> &v) {
+  return v.empty() ? 0 : *std::max_element(v.begin(), v.end());
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = 5000, seed = 1;
+  clocks.bootMs = 31337;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (!strcmp(argv[i], "--presses")) {
+      count = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--boot-ms")) {
+      clocks.bootMs = atoi(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--seed")) {
+      seed = atoi(argv[i + 1]);
+    } else {
+      fprintf(stderr, "usage: split_merge_bench [--presses N] [--boot-ms N] [--seed N]\n");
+      return 1;
+    }
+  }
+
+  std::vector<Press> presses = script(count, seed);
+  printf("%u presses, left clock %u ms ahead at boot, loop every %u ms per half, debounce %u ms\n", count,
+         clocks.bootMs, SCAN_INTERVAL, DEBOUNCE_TIME);
+  printf("cross-hand press pairs out of order, by gap:\n");
+  printf("%-10s %-6s %7s %7s %7s %7s %7s  %-18s %-13s %s\n", "skew", "link", "<2ms", "2-5ms", "5-10ms",
+         "10-20ms", ">=20ms", "merge ms", "left press ms", "clock err ms");
+  printf("%-10s %-6s %39s  %-18s %-13s %s\n", "", "", "", "left p50/p99 right", "p50/p99", "max");
+
+  bool failed = false;
+  const int32_t skews[] = {0, 100, -500, 20000, -20000};
+  for (int32_t skew : skews) {
+    clocks.skewPpm = skew;
+    Run run = simulate(presses);
+
+    std::vector<uint8_t> eventOrder;
+    std::vector<uint32_t> mergeLeft, mergeRight;
+    for (const Merged &m : run.events) {
+      if (m.pressed) eventOrder.push_back(m.pos);
+      (m.pos < kHalfKeys ? mergeRight : mergeLeft).push_back(m.emitMs - m.stampMs);
+    }
+    std::vector<int64_t> eventRank = ranks(presses, eventOrder);
+    std::vector<int64_t> pollRank = ranks(presses, run.pollOrder);
+
+    // Physical press on the left half to the master seeing it
+    std::vector<uint32_t> pressEvents, pressPoll;
+    std::vector<const Merged *> pressEvent;
+    for (const Merged &m : run.events) {
+      if (m.pressed) pressEvent.push_back(&m);
+    }
+    uint32_t missing = 0;
+    for (size_t i = 0; i < presses.size(); i++) {
+      if (eventRank[i] < 0 || pollRank[i] < 0) {
+        missing++;
+        continue;
+      }
+      if (presses[i].pos < kHalfKeys) continue;
+      uint32_t downMs = (uint32_t)(presses[i].downUs / 1000);
+      pressEvents.push_back(pressEvent[eventRank[i]]->emitMs - downMs);
+      pressPoll.push_back(run.pollMs[pollRank[i]] - downMs);
+    }
+
+    uint32_t pairs[kBuckets] = {}, pollWrong[kBuckets] = {}, eventWrong[kBuckets] = {};
+    for (size_t i = 0; i + 1 < presses.size(); i++) {
+      const Press &a = presses[i], &b = presses[i + 1];
+      if ((a.pos < kHalfKeys) == (b.pos < kHalfKeys)) continue;
+      if (eventRank[i] < 0 || eventRank[i + 1] < 0 || pollRank[i] < 0 || pollRank[i + 1] < 0) continue;
+      int bucket = bucketOf(b.downUs - a.downUs);
+      pairs[bucket]++;
+      pollWrong[bucket] += pollRank[i] > pollRank[i + 1];
+      eventWrong[bucket] += eventRank[i] > eventRank[i + 1];
+    }
+
+    char skewName[16];
+    snprintf(skewName, sizeof(skewName), "%+d ppm", skew);
+    printf("%-10s %-6s", skewName, "poll");
+    for (int b = 0; b < kBuckets; b++) {
+      printf(" %6.1f%%", pairs[b] ? 100.0 * pollWrong[b] / pairs[b] : 0.0);
+    }
+    printf("  %-18s %u/%u\n", "-", percentile(pressPoll, 0.5), percentile(pressPoll, 0.99));
+    printf("%-10s %-6s", "", "events");
+    for (int b = 0; b < kBuckets; b++) {
+      printf(" %6.1f%%", pairs[b] ? 100.0 * eventWrong[b] / pairs[b] : 0.0);
+    }
+    char merge[32], press[32];
+    snprintf(merge, sizeof(merge), "%u/%u %u", percentile(mergeLeft, 0.5), percentile(mergeLeft, 0.99),
+             maxOf(mergeRight));
+    snprintf(press, sizeof(press), "%u/%u", percentile(pressEvents, 0.5), percentile(pressEvents, 0.99));
+    printf("  %-18s %-13s %u\n", merge, press, maxOf(run.clockErr));
+    if (missing) {
+      printf("  %u of %zu presses missing from a stream\n", missing, presses.size());
+    }
+    failed |= missing || eventWrong[kBuckets - 1];
+  }
+  printf("merged order: %s\n", failed ? "FAILED" : "ok");
+  return failed ? 1 : 0;
+}
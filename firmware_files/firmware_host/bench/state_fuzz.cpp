@@ -0,0 +1,466 @@
+// Differential fuzzing of the handwritten firmware's state machine
+// (KeyboardCore::runStateMachine, firmware_handwritten/state_table.h)
+// against the model of the Stateflow chart (firmware_host/sim/
+// stateflow_model.h), on the keymap of firmware_handwritten/.
+//
+// An input is a byte string, one key matrix change per byte:
+//   bits 0-5  key position 0-47 to toggle, 48 + n to switch to layer n,
+//             anything else: no change
+//   bit 6     more changes in the same 10 ms sample; clear: run a sample
+// Each sample feeds both machines the same keys and layer; specialKeys of
+// the chart are the command keys the firmware sees held (PROGRAM, MACRO
+// RECORD, LAYER on the current layer). After every sample the state,
+// recordingMacro and programSrcKey must agree.
+//
+// The model runs with the firmware's known differences from the chart
+// switched on (CHART_FIRMWARE), so a divergence is a bug in one of the
+// two. --as-written runs the chart as the script has it and counts how
+// often it disagrees with the firmware instead of stopping.
+//
+// Before fuzzing, every transition label and junction test in the chart
+// script is checked against the model's rows.
+//
+//   state_fuzz [--as-written] [--runs N] [--seconds S] [--seed N] [--max-len N]
+//              [--chart file.m] [--hex BYTES] [input file...]
+//
+// Without inputs it generates random sequences and stops at the first
+// divergence, printing it minimized, sample by sample, with a --hex line to
+// replay it. With input files or --hex it replays those and prints them.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/state_fuzz.cpp -o /tmp/state_fuzz
+// As a libFuzzer target (clang; crashes on divergence, corpus handling is libFuzzer's):
+//   clang++ -g -O1 -std=c++17 -fsanitize=fuzzer,address -DSTATE_FUZZ_LIBFUZZER firmware_host/bench/state_fuzz.cpp -o /tmp/state_fuzz_lf
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../sim/sim_board.h"
+#include "../sim/stateflow_model.h"
+
+typedef KeyboardCore<SimBoard> Core;
+
+#define FUZZ_MORE 0x40
+
+static const char *const kChartNames[StateflowModel::STATE_COUNT] = {
+  "STATE_NORMAL", "STATE_WAITING", "STATE_PROGRAMMING_SRC", "STATE_PROGRAMMING_DST",
+  "STATE_MACRO_RECORD_TRIGGER", "STATE_MACRO_RECORD", "STATE_MACRO_PLAY",
+};
+
+// Chart state -> firmware state
+static const uint8_t kFirmwareState[StateflowModel::STATE_COUNT] = {
+  STATE_NORMAL, STATE_WAITING, STATE_PROGRAMMING_SRC, STATE_PROGRAMMING_DST,
+  STATE_MACRO_RECORD_TRIGGER, STATE_MACRO_RECORD, STATE_MACRO_PLAY,
+};
+
+static uint8_t firmwareKeymapCode(uint8_t layer, uint8_t index) {
+  return keymapLookup(1ul << LAYER_DEFAULT | 1ul << layer, index);
+}
+
+// Positions holding a command key with some layer over the default one, as
+// the core's stack masks see them
+static uint64_t commandKeysOnAnyLayer() {
+  uint64_t keys = 0;
+  for (uint8_t layer = 0; layer < KEYMAP_LAYERS; layer++) {
+    for (uint8_t i = 0; i < KEYMAP_POSITIONS; i++) {
+      uint8_t code = firmwareKeymapCode(layer, i);
+      if (code >= CMD_LAYER_CHANGE && code <= CMD_PROGRAM_MODE) keys |= 1ull << i;
+    }
+  }
+  return keys;
+}
+
+struct Machines {
+  Core core;
+  StateflowModel model;
+  uint32_t samples = 0;
+
+  explicit Machines(uint8_t options) : model(options) { model.keymapCode = firmwareKeymapCode; }
+
+  void reset() {
+    memset(core.debouncedKeyState, 0, sizeof(core.debouncedKeyState));
+    memset(core.otherHalfKeyState, 0, sizeof(core.otherHalfKeyState));
+    core.pressedMask = 0;
+    core.comboActionCount = 0;
+    core.selectLayer(LAYER_DEFAULT);
+    core.currentState = STATE_NORMAL;
+    core.nextState = STATE_NORMAL;
+    core.pressedKeyCount = 0;
+    core.programSrcKey = 0;
+    core.recordingMacro = false;
+    model.reset();
+    model.currentLayer = LAYER_DEFAULT;
+    samples = 0;
+  }
+
+  void apply(uint8_t byte) {
+    uint8_t v = byte & 0x3F;
+    if (v < KEYMAP_POSITIONS) {
+      bool down = !((core.pressedMask >> v) & 1);
+      core.pressedMask ^= 1ull << v;
+      if (v < Core::totalKeys) {
+        core.debouncedKeyState[v] = down;
+        model.keyMatrix[v] = down;
+      } else {
+        core.otherHalfKeyState[v - Core::totalKeys] = down;
+        model.otherHalfKeys[v - Core::totalKeys] = down;
+      }
+    } else if (v < KEYMAP_POSITIONS + KEYMAP_LAYERS) {
+      core.selectLayer(v - KEYMAP_POSITIONS);
+      if (model.options & CHART_LAYER_INPUT) {
+        model.currentLayer = core.currentLayer;
+      }
+    }
+  }
+
+  // One sample of both; false when they disagree afterwards
+  bool sample() {
+    uint8_t commands = core.heldCommands();
+    model.specialKeys[CHART_KEY_PROGRAM] = (commands & STATE_CMD(CMD_PROGRAM_MODE)) != 0;
+    model.specialKeys[CHART_KEY_MACRO] = (commands & STATE_CMD(CMD_MACRO_RECORD)) != 0;
+    model.specialKeys[CHART_KEY_LAYER] = (commands & STATE_CMD(CMD_LAYER_CHANGE)) != 0;
+    model.specialKeys[CHART_KEY_FN] = 0;
+    model.timer = samples * SCAN_INTERVAL;
+    samples++;
+
+    core.runStateMachine();
+    model.step();
+    return same();
+  }
+
+  bool same() const {
+    return core.currentState == kFirmwareState[model.state] && core.recordingMacro == model.recordingMacro &&
+           core.programSrcKey == model.programSrcKey;
+  }
+};
+
+// Runs an input; returns the sample that diverged, or -1
+static int32_t runInput(Machines &m, const uint8_t *data, size_t size, uint32_t *visits = nullptr) {
+  m.reset();
+  for (size_t i = 0; i < size; i++) {
+    m.apply(data[i]);
+    if ((data[i] & FUZZ_MORE) && i + 1 < size) {
+      continue;
+    }
+    if (!m.sample()) {
+      return (int32_t)m.samples - 1;
+    }
+    if (visits) {
+      visits[m.model.state]++;
+    }
+  }
+  return -1;
+}
+
+#ifdef STATE_FUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static Machines m(CHART_FIRMWARE);
+  if (runInput(m, data, size) >= 0) {
+    __builtin_trap();
+  }
+  return 0;
+}
+
+#else
+
+// ---------------------------------------------------------------------------
+// Chart script against the model's rows
+
+static bool checkChart(const char *path) {
+  std::ifstream in(path);
+  if (!in) {
+    printf("chart: cannot open %s\n", path);
+    return false;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string text = ss.str();
+
+  std::map<std::string, int> stateOf;  // variable -> chart state number
+  std::regex stateName("(\\w+)\\.Name = '(\\w+)';");
+  for (auto it = std::sregex_iterator(text.begin(), text.end(), stateName); it != std::sregex_iterator(); ++it) {
+    for (int s = 0; s < StateflowModel::STATE_COUNT; s++) {
+      if ((*it)[2] == kChartNames[s]) stateOf[(*it)[1]] = s;
+    }
+  }
+
+  struct Transition {
+    std::string source, destination, label;
+  };
+  std::map<std::string, Transition> transitions;
+  std::regex field("(\\w+)\\.(Source|Destination|LabelString) = (?:'(.*)'|(\\w+));");
+  for (auto it = std::sregex_iterator(text.begin(), text.end(), field); it != std::sregex_iterator(); ++it) {
+    Transition &t = transitions[(*it)[1]];
+    std::string value = (*it)[3].matched ? (*it)[3].str() : (*it)[4].str();
+    if ((*it)[2] == "Source") t.source = value;
+    if ((*it)[2] == "Destination") t.destination = value;
+    if ((*it)[2] == "LabelString") t.label = value;
+  }
+
+  uint8_t count;
+  const StateflowModel::Transition *rows = StateflowModel::transitions(count);
+  std::vector<bool> matched(count, false);
+  bool ok = true;
+  uint32_t checked = 0;
+  std::regex nextTest("^nextState == (\\d+)");
+  for (const auto &entry : transitions) {
+    const Transition &t = entry.second;
+    std::smatch m;
+    if (!stateOf.count(t.source)) {
+      // Junction rows: the model's target for the tested value
+      if (stateOf.count(t.destination) && std::regex_search(t.label, m, nextTest)) {
+        checked++;
+        if (StateflowModel::junctionTarget((uint8_t)std::stoi(m[1])) != stateOf[t.destination]) {
+          printf("chart: %s '%s' goes to %s, not in the model\n", entry.first.c_str(), t.label.c_str(),
+                 kChartNames[stateOf[t.destination]]);
+          ok = false;
+        }
+      }
+      continue;
+    }
+    checked++;
+    bool found = false;
+    for (uint8_t r = 0; r < count; r++) {
+      if (rows[r].from != stateOf[t.source] || t.label != rows[r].label) continue;
+      // WAITING's transition ends on the junction
+      bool toJunction = rows[r].from == StateflowModel::WAITING;
+      if (toJunction || (stateOf.count(t.destination) && stateOf[t.destination] == rows[r].to)) {
+        found = true;
+        matched[r] = true;
+      }
+    }
+    if (!found) {
+      printf("chart: %s from %s '%s' has no row in the model\n", entry.first.c_str(),
+             kChartNames[stateOf[t.source]], t.label.c_str());
+      ok = false;
+    }
+  }
+  for (uint8_t r = 0; r < count; r++) {
+    if (!matched[r]) {
+      printf("chart: model row %s '%s' is not in the chart\n", kChartNames[rows[r].from], rows[r].label);
+      ok = false;
+    }
+  }
+  printf("chart %s: %u transitions and junction tests, %s\n", path, checked, ok ? "same as the model" : "MISMATCH");
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+
+static const char *firmwareStateName(uint8_t state) {
+  for (uint8_t s = 0; s < StateflowModel::STATE_COUNT; s++) {
+    if (kFirmwareState[s] == state) return kChartNames[s];
+  }
+  return "?";
+}
+
+static void printTrace(uint8_t options, const std::vector<uint8_t> &input) {
+  Machines m(options);
+  m.reset();
+  printf("  %-6s %-20s %4s %5s %5s | %-26s %3s %3s | %-26s %3s %3s\n", "sample", "changes", "held", "layer", "P M L",
+         "firmware", "src", "rec", "chart", "src", "rec");
+  std::string changes;
+  for (size_t i = 0; i < input.size(); i++) {
+    uint8_t v = input[i] & 0x3F;
+    char change[16] = "";
+    if (v < KEYMAP_POSITIONS) {
+      snprintf(change, sizeof(change), "%c%u ", (m.core.pressedMask >> v) & 1 ? '-' : '+', v);
+    } else if (v < KEYMAP_POSITIONS + KEYMAP_LAYERS) {
+      snprintf(change, sizeof(change), "L%u ", v - KEYMAP_POSITIONS);
+    }
+    changes += change;
+    m.apply(input[i]);
+    if ((input[i] & FUZZ_MORE) && i + 1 < input.size()) {
+      continue;
+    }
+    bool ok = m.sample();
+    const StateflowModel &c = m.model;
+    printf("  %-6u %-20s %4u %5u %u %u %u | %-26s %3u %3u | %-26s %3u %3u%s\n", m.samples - 1, changes.c_str(),
+           __builtin_popcountll(m.core.pressedMask), m.core.currentLayer, c.specialKeys[CHART_KEY_PROGRAM],
+           c.specialKeys[CHART_KEY_MACRO], c.specialKeys[CHART_KEY_LAYER], firmwareStateName(m.core.currentState),
+           m.core.programSrcKey, m.core.recordingMacro, kChartNames[c.state], c.programSrcKey, c.recordingMacro,
+           ok ? "" : "  <-");
+    changes.clear();
+  }
+  printf("  replay: --hex ");
+  for (uint8_t b : input) {
+    printf("%02x", b);
+  }
+  printf("\n");
+}
+
+// Drop bytes while the input still diverges
+static void minimize(Machines &m, std::vector<uint8_t> &input) {
+  for (size_t i = input.size(); i-- > 0;) {
+    std::vector<uint8_t> shorter = input;
+    shorter.erase(shorter.begin() + i);
+    if (runInput(m, shorter.data(), shorter.size()) >= 0) {
+      input = shorter;
+    }
+  }
+}
+
+// Random input: half the presses on command keys, releases as likely as
+// presses so every key comes up now and then, a few layer switches
+static void randomInput(uint32_t &rng, size_t maxLen, std::vector<uint8_t> &input) {
+  static const uint64_t commandKeys = commandKeysOnAnyLayer();
+  auto next = [&rng]() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+  };
+  input.clear();
+  size_t len = 1 + next() % maxLen;
+  uint64_t held = 0;
+  for (size_t i = 0; i < len; i++) {
+    uint32_t r = next();
+    uint8_t byte;
+    if (r % 16 == 0) {
+      byte = KEYMAP_POSITIONS + (r >> 4) % KEYMAP_LAYERS;
+    } else {
+      bool release = held && ((r >> 4) & 1);
+      uint64_t keys = release ? held : ((r >> 5) & 1) && (commandKeys & ~held) ? commandKeys & ~held : ~held;
+      keys &= ~0ull >> (64 - KEYMAP_POSITIONS);
+      uint8_t n = (r >> 6) % __builtin_popcountll(keys);
+      while (n--) keys &= keys - 1;
+      byte = __builtin_ctzll(keys);
+      held ^= 1ull << byte;
+    }
+    if ((r >> 16) % 4 == 0) {
+      byte |= FUZZ_MORE;
+    }
+    input.push_back(byte);
+  }
+}
+
+static bool parseHex(const char *hex, std::vector<uint8_t> &out) {
+  out.clear();
+  for (const char *p = hex; p[0] && p[1]; p += 2) {
+    char pair[3] = {p[0], p[1], 0};
+    char *end;
+    out.push_back((uint8_t)strtoul(pair, &end, 16));
+    if (*end) return false;
+  }
+  return strlen(hex) % 2 == 0;
+}
+
+int main(int argc, char **argv) {
+  uint8_t options = CHART_FIRMWARE;
+  uint64_t runs = 0;
+  double seconds = 5;
+  uint32_t seed = 1;
+  size_t maxLen = 16;
+  const char *chart = "firmware_simulink/stateflow_chart_creator.m";
+  std::vector<std::vector<uint8_t>> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--as-written") {
+      options = 0;
+    } else if (arg == "--runs" && i + 1 < argc) {
+      runs = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--seconds" && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = (uint32_t)strtoul(argv[++i], nullptr, 10) | 1;
+    } else if (arg == "--max-len" && i + 1 < argc) {
+      maxLen = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--chart" && i + 1 < argc) {
+      chart = argv[++i];
+    } else if (arg == "--hex" && i + 1 < argc) {
+      inputs.emplace_back();
+      if (!parseHex(argv[++i], inputs.back())) {
+        fprintf(stderr, "bad hex input: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg[0] != '-') {
+      std::ifstream in(arg, std::ios::binary);
+      if (!in) {
+        fprintf(stderr, "cannot open %s\n", arg.c_str());
+        return 1;
+      }
+      inputs.emplace_back((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    } else {
+      fprintf(stderr,
+              "usage: state_fuzz [--as-written] [--runs N] [--seconds S] [--seed N] [--max-len N] "
+              "[--chart file.m] [--hex BYTES] [input...]\n");
+      return 1;
+    }
+  }
+  if (maxLen == 0) maxLen = 1;
+
+  if (!checkChart(chart)) {
+    return 1;
+  }
+
+  Machines m(options);
+  if (!inputs.empty()) {
+    bool same = true;
+    for (const std::vector<uint8_t> &input : inputs) {
+      int32_t at = runInput(m, input.data(), input.size());
+      printf("input of %zu bytes: %s", input.size(), at < 0 ? "same\n" : "");
+      if (at >= 0) printf("diverges at sample %d\n", at);
+      printTrace(options, input);
+      same &= at < 0;
+    }
+    return same ? 0 : 1;
+  }
+
+  printf("%s, inputs up to %zu bytes, seed %u\n",
+         options ? "firmware differences on (CHART_FIRMWARE)" : "chart as written", maxLen, seed);
+
+  uint32_t rng = seed;
+  uint64_t sequences = 0, samples = 0, diverged = 0;
+  uint32_t visits[StateflowModel::STATE_COUNT] = {};
+  std::vector<uint8_t> input, shortest;
+  auto start = std::chrono::steady_clock::now();
+  double elapsed = 0;
+  while (runs ? sequences < runs : elapsed < seconds) {
+    for (uint32_t batch = 0; batch < 4096 && (!runs || sequences < runs); batch++) {
+      randomInput(rng, maxLen, input);
+      int32_t at = runInput(m, input.data(), input.size(), visits);
+      sequences++;
+      samples += m.samples;
+      if (at >= 0) {
+        diverged++;
+        if (shortest.empty() || input.size() < shortest.size()) {
+          shortest = input;
+        }
+      }
+    }
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (diverged && options) {
+      break;
+    }
+  }
+
+  printf("%llu sequences, %llu samples in %.2f s: %.2f M sequences/s, %.1f M samples/s\n",
+         (unsigned long long)sequences, (unsigned long long)samples, elapsed, sequences / elapsed / 1e6,
+         samples / elapsed / 1e6);
+  printf("samples per chart state:");
+  for (uint8_t s = 0; s < StateflowModel::STATE_COUNT; s++) {
+    printf(" %s %u", kChartNames[s] + 6, visits[s]);
+  }
+  printf("\n");
+
+  if (!diverged) {
+    printf("no divergence\n");
+    return 0;
+  }
+  minimize(m, shortest);
+  printf("%llu of %llu sequences diverge (%.2f%%); shortest, minimized to %zu bytes:\n", (unsigned long long)diverged,
+         (unsigned long long)sequences, 100.0 * diverged / sequences, shortest.size());
+  printTrace(options, shortest);
+  // The chart as written is expected to differ; the firmware settings are not
+  return options ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,489 @@
+// State machine of the handwritten firmware core: the transition table
+// (firmware_handwritten/state_table.h) against the switch and per-state
+// handlers it replaced, which counted held keys over both halves' key
+// arrays every loop and re-tested command keys in every handler.
+//
+//   lockstep - states and state-to-state edges of the table against the
+//              Stateflow chart in firmware_simulink/stateflow_chart_creator.m
+//              (an edge into WAITING counts as going to the nextState it
+//              stores, as the chart's junction after WAITING does)
+//   same     - both machines driven with the same random key traffic,
+//              biased towards command keys and layer changes, must walk the
+//              same states and save the same source keys
+//   cycles   - per loop, harness cost subtracted
+//
+//   state_machine_bench [chart.m]
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/bench/state_machine_bench.cpp -o /tmp/state_machine_bench
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#include "../sim/sim_board.h"
+
+#define LOOPS 4000000
+#define BATCH 1000
+
+typedef KeyboardCore<SimBoard> Core;
+
+static const char *const kStateNames[STATE_COUNT] = {
+  "STATE_NORMAL", "STATE_PROGRAMMING_SRC", "STATE_PROGRAMMING_DST", "STATE_MACRO_RECORD_TRIGGER",
+  "STATE_MACRO_RECORD", "STATE_MACRO_PLAY", "STATE_WAITING",
+};
+
+// ---------------------------------------------------------------------------
+// The state machine as it was: switch over the states, handlers testing
+// command keys one at a time, held keys counted over both halves' arrays
+
+enum LegacyState {
+  LEGACY_NORMAL,
+  LEGACY_LAYER_SWITCH,
+  LEGACY_PROGRAMMING,
+  LEGACY_PROGRAMMING_SRC,
+  LEGACY_PROGRAMMING_DST,
+  LEGACY_MACRO_RECORD_TRIGGER,
+  LEGACY_MACRO_RECORD,
+  LEGACY_MACRO_PLAY,
+  LEGACY_WAITING,
+  LEGACY_PRINTING
+};
+
+// Command keys per layer as the core derives them through its layer stack,
+// with the layer selected over the default one
+static uint64_t gCommandMask[KEYMAP_LAYERS][4];
+static uint64_t gAnyCommandKeys;
+
+static void loadCommandMasks() {
+  Core core;
+  for (uint8_t layer = 0; layer < KEYMAP_LAYERS; layer++) {
+    core.selectLayer(layer);
+    for (uint8_t cmd = 0; cmd < 4; cmd++) {
+      gCommandMask[layer][cmd] = core.commandMasks()[cmd];
+      gAnyCommandKeys |= gCommandMask[layer][cmd];
+    }
+  }
+}
+
+static const uint8_t kLegacyToState[] = {
+  STATE_NORMAL, 0xFF, 0xFF, STATE_PROGRAMMING_SRC, STATE_PROGRAMMING_DST, STATE_MACRO_RECORD_TRIGGER,
+  STATE_MACRO_RECORD, STATE_MACRO_PLAY, STATE_WAITING, 0xFF,
+};
+
+struct LegacyMachine {
+  static const uint8_t totalKeys = Core::totalKeys;
+  bool debouncedKeyState[totalKeys] = {};
+  bool otherHalfKeyState[totalKeys] = {};
+  uint64_t pressedMask = 0;
+  uint8_t currentLayer = 0;
+  uint16_t comboActions[COMBO_MAX_ACTIVE] = {};
+  uint8_t comboActionCount = 0;
+
+  LegacyState currentState = LEGACY_NORMAL;
+  LegacyState nextState = LEGACY_NORMAL;
+  uint8_t pressedKeyCount = 0;
+  uint8_t programSrcKey = 0;
+  bool recordingMacro = false;
+
+  uint8_t keycodeAt(uint8_t position) const { return keymapLookup(1ul << LAYER_DEFAULT | 1ul << currentLayer, position); }
+
+  bool commandKeyPressed(uint8_t command) {
+    if (pressedMask & gCommandMask[currentLayer][command - CMD_LAYER_CHANGE]) return true;
+    for (uint8_t i = 0; i < comboActionCount; i++) {
+      if (comboActions[i] == command) return true;
+    }
+    return false;
+  }
+
+  __attribute__((noinline)) void step() {
+    // Count pressed keys (was in scanKeys())
+    pressedKeyCount = 0;
+    for (uint8_t i = 0; i < totalKeys; i++) {
+      if (debouncedKeyState[i]) pressedKeyCount++;
+      if (otherHalfKeyState[i]) pressedKeyCount++;
+    }
+
+    switch (currentState) {
+      case LEGACY_NORMAL:
+        handleStateNormal();
+        break;
+      case LEGACY_WAITING:
+        if (pressedKeyCount == 0) {
+          currentState = nextState;
+          nextState = LEGACY_NORMAL;
+        }
+        break;
+      case LEGACY_PROGRAMMING_SRC:
+      case LEGACY_PROGRAMMING_DST:
+        handleStateProgramming();
+        break;
+      case LEGACY_MACRO_RECORD_TRIGGER:
+        if (pressedKeyCount > 0) {
+          currentState = LEGACY_WAITING;
+          nextState = LEGACY_MACRO_RECORD;
+        }
+        break;
+      case LEGACY_MACRO_RECORD:
+        handleStateMacroRecord();
+        break;
+      case LEGACY_MACRO_PLAY:
+        break;
+      default:
+        currentState = LEGACY_NORMAL;
+        break;
+    }
+  }
+
+  void handleStateNormal() {
+    bool programPressed = commandKeyPressed(CMD_PROGRAM_MODE);
+    bool macroRecordPressed = commandKeyPressed(CMD_MACRO_RECORD);
+    if (programPressed && macroRecordPressed) {
+      currentState = LEGACY_WAITING;
+      nextState = LEGACY_MACRO_RECORD_TRIGGER;
+    } else if (programPressed) {
+      currentState = LEGACY_WAITING;
+      nextState = LEGACY_PROGRAMMING_SRC;
+    }
+  }
+
+  void handleStateProgramming() {
+    if (pressedKeyCount == 1) {
+      uint8_t pressedKey = 0xFF;
+      for (uint8_t i = 0; i < totalKeys; i++) {
+        if (debouncedKeyState[i]) {
+          pressedKey = keycodeAt(i);
+          break;
+        }
+      }
+      for (uint8_t i = 0; i < totalKeys; i++) {
+        if (otherHalfKeyState[i]) {
+          pressedKey = keycodeAt(i + totalKeys);
+          break;
+        }
+      }
+      if (currentState == LEGACY_PROGRAMMING_SRC) {
+        programSrcKey = pressedKey;
+        currentState = LEGACY_WAITING;
+        nextState = LEGACY_PROGRAMMING_DST;
+      } else {
+        currentState = LEGACY_WAITING;
+        nextState = LEGACY_PROGRAMMING_SRC;
+      }
+    } else if (pressedKeyCount >= 2) {
+      if (commandKeyPressed(CMD_PROGRAM_MODE)) {
+        currentState = LEGACY_WAITING;
+        nextState = LEGACY_NORMAL;
+      }
+    }
+  }
+
+  void handleStateMacroRecord() {
+    if (!recordingMacro) {
+      recordingMacro = true;
+    }
+    if (commandKeyPressed(CMD_MACRO_RECORD) && commandKeyPressed(CMD_PROGRAM_MODE)) {
+      recordingMacro = false;
+      currentState = LEGACY_WAITING;
+      nextState = LEGACY_NORMAL;
+    }
+  }
+
+  void setKey(uint8_t pos, bool down) {
+    bool *half = pos < totalKeys ? debouncedKeyState : otherHalfKeyState;
+    half[pos % totalKeys] = down;
+    pressedMask = down ? pressedMask | (1ull << pos) : pressedMask & ~(1ull << pos);
+  }
+
+  uint8_t state() const { return kLegacyToState[currentState]; }
+  uint8_t next() const { return kLegacyToState[nextState]; }
+};
+
+// ---------------------------------------------------------------------------
+
+struct TableMachine {
+  Core core;
+
+  __attribute__((noinline)) void step() { core.runStateMachine(); }
+
+  void setKey(uint8_t pos, bool down) {
+    bool *half = pos < Core::totalKeys ? core.debouncedKeyState : core.otherHalfKeyState;
+    half[pos % Core::totalKeys] = down;
+    core.pressedMask = down ? core.pressedMask | (1ull << pos) : core.pressedMask & ~(1ull << pos);
+  }
+
+  uint8_t state() const { return core.currentState; }
+  uint8_t next() const { return core.nextState; }
+};
+
+// Harness cost only, subtracted from the other rows
+struct NullMachine {
+  uint64_t pressedMask = 0;
+  uint8_t currentLayer = 0;
+  __attribute__((noinline)) void step() { __asm__ volatile("" ::: "memory"); }
+  void setKey(uint8_t pos, bool down) {
+    pressedMask = down ? pressedMask | (1ull << pos) : pressedMask & ~(1ull << pos);
+  }
+};
+
+static void setLayer(LegacyMachine &m, uint8_t layer) { m.currentLayer = layer; }
+static void setLayer(TableMachine &m, uint8_t layer) { m.core.selectLayer(layer); }
+static void setLayer(NullMachine &m, uint8_t layer) { m.currentLayer = layer; }
+
+static uint64_t heldMask(const LegacyMachine &m) { return m.pressedMask; }
+static uint64_t heldMask(const TableMachine &m) { return m.core.pressedMask; }
+static uint64_t heldMask(const NullMachine &m) { return m.pressedMask; }
+
+// Key traffic: releases as often as presses so every key comes up now and
+// then, half the presses on a command key of some layer, at most four keys
+// held, a quarter of the loops with two changes (a scan can see both), the
+// layer moves now and then
+static void stepKey(uint32_t &rng, uint64_t held, uint8_t &pos, bool &down) {
+  const uint64_t commandKeys = gAnyCommandKeys;
+  rng = rng * 1664525u + 1013904223u;
+  uint32_t r = rng >> 16;
+  down = held == 0 || ((r & 1) && __builtin_popcountll(held) < 4);
+  uint64_t keys = held;
+  if (down) {
+    keys = (r & 2) && (commandKeys & ~held) ? commandKeys & ~held : ~held & (~0ull >> (64 - KEYMAP_POSITIONS));
+  }
+  // n-th candidate key
+  uint8_t n = (r >> 2) % __builtin_popcountll(keys);
+  while (n--) keys &= keys - 1;
+  pos = __builtin_ctzll(keys);
+}
+
+template <typename Machine> static void traffic(uint32_t &rng, Machine &m) {
+  uint8_t changes = (rng >> 8) % 4 == 0 ? 2 : 1;
+  if ((rng >> 4) % 64 == 0) setLayer(m, (uint8_t)((rng >> 12) % KEYMAP_LAYERS));
+  while (changes--) {
+    uint8_t pos;
+    bool down;
+    stepKey(rng, heldMask(m), pos, down);
+    m.setKey(pos, down);
+  }
+}
+
+// Both machines on the same traffic
+struct PairMachine {
+  LegacyMachine &legacy;
+  TableMachine &table;
+  void setKey(uint8_t pos, bool down) {
+    legacy.setKey(pos, down);
+    table.setKey(pos, down);
+  }
+};
+
+static void setLayer(PairMachine &m, uint8_t layer) {
+  setLayer(m.legacy, layer);
+  setLayer(m.table, layer);
+}
+static uint64_t heldMask(const PairMachine &m) { return m.legacy.pressedMask; }
+
+struct Result {
+  double nsPerLoop;
+  double cyclesPerLoop;
+};
+
+template <typename Machine> static Result run(Machine &m) {
+  uint32_t rng = 12345;
+  uint64_t totalNs = 0, totalCycles = 0;
+  for (uint32_t batch = 0; batch < LOOPS / BATCH; batch++) {
+    auto t0 = std::chrono::steady_clock::now();
+#ifdef BENCH_HAVE_TSC
+    uint64_t c0 = __rdtsc();
+#endif
+    for (uint32_t i = 0; i < BATCH; i++) {
+      traffic(rng, m);
+      m.step();
+    }
+#ifdef BENCH_HAVE_TSC
+    totalCycles += __rdtsc() - c0;
+#endif
+    totalNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+  }
+  return Result{(double)totalNs / LOOPS, (double)totalCycles / LOOPS};
+}
+
+// ---------------------------------------------------------------------------
+// Chart side of the lockstep check
+
+struct Chart {
+  std::set<std::string> states;
+  std::set<std::pair<std::string, std::string>> edges;
+  std::string initial;
+};
+
+static bool readChart(const char *path, Chart &chart, std::string &err) {
+  std::ifstream in(path);
+  if (!in) {
+    err = std::string("cannot open ") + path;
+    return false;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string text = ss.str();
+
+  std::map<std::string, std::string> stateOf;  // variable -> state name
+  std::set<std::string> junctions;
+  std::smatch m;
+  std::regex stateName("(\\w+)\\.Name = '(\\w+)';");
+  for (auto it = std::sregex_iterator(text.begin(), text.end(), stateName); it != std::sregex_iterator(); ++it) {
+    stateOf[(*it)[1]] = (*it)[2];
+    chart.states.insert((*it)[2]);
+  }
+  std::regex junction("(\\w+) = Stateflow\\.Junction");
+  for (auto it = std::sregex_iterator(text.begin(), text.end(), junction); it != std::sregex_iterator(); ++it) {
+    junctions.insert((*it)[1]);
+  }
+
+  // Every transition: source, destination, label
+  struct Transition {
+    std::string source, destination, label;
+  };
+  std::map<std::string, Transition> transitions;
+  std::regex field("(\\w+)\\.(Source|Destination|LabelString) = (?:'(.*)'|(\\w+));");
+  for (auto it = std::sregex_iterator(text.begin(), text.end(), field); it != std::sregex_iterator(); ++it) {
+    Transition &t = transitions[(*it)[1]];
+    std::string value = (*it)[3].matched ? (*it)[3].str() : (*it)[4].str();
+    if ((*it)[2] == "Source") t.source = value;
+    if ((*it)[2] == "Destination") t.destination = value;
+    if ((*it)[2] == "LabelString") t.label = value;
+  }
+
+  // The junction after WAITING: nextState value -> state
+  std::map<int, std::string> nextTarget;
+  std::regex nextTest("nextState == (\\d+)");
+  for (const auto &entry : transitions) {
+    const Transition &t = entry.second;
+    if (junctions.count(t.source) && stateOf.count(t.destination) && std::regex_search(t.label, m, nextTest)) {
+      nextTarget[std::stoi(m[1])] = stateOf[t.destination];
+    }
+  }
+
+  std::regex nextSet("nextState = (\\d+)");
+  for (const auto &entry : transitions) {
+    const Transition &t = entry.second;
+    if (t.source == "chart_obj" && stateOf.count(t.destination)) {
+      chart.initial = stateOf[t.destination];
+    }
+    if (!stateOf.count(t.source) || !stateOf.count(t.destination)) {
+      continue;
+    }
+    std::string to = stateOf[t.destination];
+    if (to == "STATE_WAITING") {
+      if (!std::regex_search(t.label, m, nextSet) || !nextTarget.count(std::stoi(m[1]))) {
+        err = entry.first + ": transition into STATE_WAITING without a nextState the junction knows";
+        return false;
+      }
+      to = nextTarget[std::stoi(m[1])];
+    }
+    chart.edges.insert(std::make_pair(stateOf[t.source], to));
+  }
+  return true;
+}
+
+static bool checkLockstep(const char *path) {
+  Chart chart;
+  std::string err;
+  if (!readChart(path, chart, err)) {
+    printf("lockstep: %s\n", err.c_str());
+    return false;
+  }
+
+  std::set<std::string> states(kStateNames, kStateNames + STATE_COUNT);
+  std::set<std::pair<std::string, std::string>> edges;
+  for (uint8_t row = 0; row < stateTransitionCount; row++) {
+    const StateTransition &t = stateTransitions[row];
+    if (t.to == STATE_NEXT) continue;
+    uint8_t to = t.to == STATE_WAITING ? t.next : t.to;
+    edges.insert(std::make_pair(kStateNames[t.from], kStateNames[to]));
+  }
+
+  bool ok = chart.initial == kStateNames[STATE_NORMAL];
+  if (!ok) printf("lockstep: chart starts in %s, the firmware in STATE_NORMAL\n", chart.initial.c_str());
+  for (const std::string &s : chart.states) {
+    if (!states.count(s)) printf("lockstep: chart state %s missing from the firmware\n", s.c_str()), ok = false;
+  }
+  for (const std::string &s : states) {
+    if (!chart.states.count(s)) printf("lockstep: firmware state %s not in the chart\n", s.c_str()), ok = false;
+  }
+  for (const auto &e : chart.edges) {
+    if (!edges.count(e)) printf("lockstep: chart edge %s -> %s missing\n", e.first.c_str(), e.second.c_str()), ok = false;
+  }
+  for (const auto &e : edges) {
+    if (!chart.edges.count(e)) printf("lockstep: table edge %s -> %s not in the chart\n", e.first.c_str(), e.second.c_str()), ok = false;
+  }
+  printf("lockstep with %s: %zu states, %zu edges, %s\n", path, chart.states.size(), chart.edges.size(),
+         ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+
+// Both machines on the same traffic, compared after every loop
+static bool checkSame(uint32_t loops) {
+  LegacyMachine legacy;
+  TableMachine table;
+  PairMachine both = {legacy, table};
+  uint32_t rng = 777;
+  uint32_t visits[STATE_COUNT] = {};
+  for (uint32_t i = 0; i < loops; i++) {
+    traffic(rng, both);
+    legacy.step();
+    table.step();
+    visits[table.state()]++;
+    if (legacy.state() != table.state() || legacy.next() != table.next() ||
+        legacy.programSrcKey != table.core.programSrcKey) {
+      printf("same: loop %u: switch in %s (next %s, source %u), table in %s (next %s, source %u)\n", i,
+             kStateNames[legacy.state()], kStateNames[legacy.next()], legacy.programSrcKey,
+             kStateNames[table.state()], kStateNames[table.next()], table.core.programSrcKey);
+      return false;
+    }
+  }
+  printf("same states and source keys over %u loops; loops per state:", loops);
+  for (uint8_t s = 0; s < STATE_COUNT; s++) {
+    printf(" %s %u", kStateNames[s] + 6, visits[s]);
+  }
+  printf("\n");
+  return true;
+}
+
+int main(int argc, char **argv) {
+  const char *chart = argc > 1 ? argv[1] : "firmware_simulink/stateflow_chart_creator.m";
+  memset(&simState, 0, sizeof(simState));
+  simState.levels = ~0ull;
+  loadCommandMasks();
+
+  bool ok = checkLockstep(chart);
+  ok = checkSame(LOOPS) && ok;
+
+  NullMachine null;
+  LegacyMachine legacy;
+  TableMachine table;
+  Result base = run(null);
+  Result results[2] = {run(legacy), run(table)};
+  const char *names[2] = {"switch", "table"};
+
+  printf("state machine step per loop, %d loops, harness cost subtracted\n", LOOPS);
+  printf("  %-8s %9s %12s\n", "variant", "ns/loop", "cycles/loop");
+  for (int i = 0; i < 2; i++) {
+#ifdef BENCH_HAVE_TSC
+    printf("  %-8s %9.2f %12.1f\n", names[i], results[i].nsPerLoop - base.nsPerLoop,
+           results[i].cyclesPerLoop - base.cyclesPerLoop);
+#else
+    printf("  %-8s %9.2f %12s\n", names[i], results[i].nsPerLoop - base.nsPerLoop, "-");
+#endif
+  }
+  return ok ? 0 : 1;
+}
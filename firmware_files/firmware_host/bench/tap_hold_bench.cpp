@@ -0,0 +1,228 @@
+// Home row mod resolution on typing traces of the QMK hrm keymap
+// (trace_tool gen on firmware_qmk/keyboard.json + keymaps/hrm/keymap.json,
+// which puts GUI/Alt/Ctrl/Shift mod-taps on A S D F and J K L ;).
+//
+// Traces are debounced per key (5 ms, like sym_defer_g) and run through the
+// QMK tap-hold model in firmware_host/sim/tap_hold.h with:
+//   fixed         - TAPPING_TERM for every mod-tap, nothing else: QMK's
+//                   default and what firmware_qmk/config.h alone does
+//   permissive    - per-key terms from firmware_qmk/home_row.c, CHORDAL_HOLD
+//                   with PERMISSIVE_HOLD across hands, FLOW_TAP_TERM (the
+//                   hrm keymap's settings)
+//   hold on press - the same with HOLD_ON_OTHER_KEY_PRESS across hands
+//   no flow tap   - permissive without FLOW_TAP_TERM
+//
+// Per resolver: how many mod-tap presses came out as the wrong thing
+// against the holds the generator recorded in the trace (false hold: a
+// letter turned into a modifier; false tap: a modifier typed as a letter),
+// and the delay added between a debounced press and QMK sending it, over
+// all keystrokes and over mod-tap taps alone.
+//
+//   tap_hold_bench trace...
+//
+// Build (from firmware_files/):
+//   gcc -O2 -include firmware_qmk/config.h -include firmware_qmk/keymaps/hrm/config.h -Ifirmware_host/qmk_shim
+//       firmware_host/bench/tap_hold_bench.cpp firmware_qmk/home_row.c -lstdc++ -o /tmp/tap_hold_bench
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "quantum.h"
+
+#define KEYMAP_TABLES_IMPLEMENTATION
+#include "../../firmware_qmk/keymaps/hrm/keymap_tables.h"
+
+extern "C" {
+#include "../../firmware_qmk/home_row.h"
+}
+
+#include "../sim/tap_hold.h"
+#include "../sim/trace.h"
+
+#define DEBOUNCE_MS 5
+// A recorded hold matches a debounced press this soon after it
+#define HOLD_MATCH_MS 20
+
+struct KeyEvent {
+  uint32_t ms;
+  uint8_t pos;
+  bool pressed;
+};
+
+// Debounced press/release events at 1 ms ticks, pos = row * MATRIX_COLS + col
+static std::vector<KeyEvent> debounceTrace(const Trace &trace) {
+  TraceCursor cursor(trace);
+  std::vector<KeyEvent> events;
+  uint16_t raw[TRACE_MAX_ROWS] = {0}, cooked[TRACE_MAX_ROWS] = {0};
+  uint32_t changedAt[TRACE_MAX_ROWS][TRACE_MAX_COLS] = {};
+  for (uint32_t ms = 0; !cursor.done() || memcmp(raw, cooked, sizeof(raw)) != 0; ms++) {
+    cursor.advance(ms * 1000);
+    for (uint8_t row = 0; row < trace.rows; row++) {
+      uint16_t now = cursor.rows[row];
+      for (uint8_t col = 0; col < trace.cols; col++) {
+        uint16_t bit = 1 << col;
+        if ((now ^ raw[row]) & bit) {
+          changedAt[row][col] = ms;
+        } else if (((now ^ cooked[row]) & bit) && ms - changedAt[row][col] >= DEBOUNCE_MS) {
+          cooked[row] ^= bit;
+          events.push_back(KeyEvent{ms, (uint8_t)(row * MATRIX_COLS + col), (cooked[row] & bit) != 0});
+        }
+      }
+      raw[row] = now;
+    }
+  }
+  return events;
+}
+
+struct Resolver {
+  const char *name;
+  bool perKey;
+  bool chordal;
+  bool flow;
+  TapHoldModel::Cross cross;
+};
+
+static const Resolver kResolvers[] = {
+  {"fixed", false, false, false, TapHoldModel::CROSS_NONE},
+  {"permissive", true, true, true, TapHoldModel::CROSS_PERMISSIVE},
+  {"hold on press", true, true, true, TapHoldModel::CROSS_HOLD_ON_PRESS},
+  {"no flow tap", true, true, false, TapHoldModel::CROSS_PERMISSIVE},
+};
+
+static std::vector<TapHoldKey> keyConfig(const Resolver &r) {
+  std::vector<TapHoldKey> keys(MATRIX_ROWS * MATRIX_COLS);
+  for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+    for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+      uint16_t keycode = keymap_keycodes[0][row][col];
+      TapHoldKey &k = keys[row * MATRIX_COLS + col];
+      k.hand = home_row_hand(row);
+      k.typing = home_row_typing_key(keycode);
+      if (IS_QK_MOD_TAP(keycode)) {
+        k.term = r.perKey ? home_row_term(col) : TAPPING_TERM;
+        k.flowTerm = home_row_flow_term(keycode);
+      }
+    }
+  }
+  return keys;
+}
+
+static uint32_t percentile(std::vector<uint32_t> v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[(size_t)(p * (v.size() - 1) + 0.5)];
+}
+
+static double mean(const std::vector<uint32_t> &v) {
+  double sum = 0;
+  for (uint32_t x : v) {
+    sum += x;
+  }
+  return v.empty() ? 0 : sum / v.size();
+}
+
+struct Result {
+  uint32_t modTapPresses = 0;
+  uint32_t intendedHolds = 0;
+  uint32_t falseHolds = 0;
+  uint32_t falseTaps = 0;
+  std::vector<uint32_t> added;    // every keystroke
+  std::vector<uint32_t> tapAdded; // mod-taps settled as tap
+};
+
+static Result run(const Resolver &r, const std::vector<KeyEvent> &events, const Trace &trace) {
+  std::vector<TapHoldKey> keys = keyConfig(r);
+  TapHoldModel model(keys);
+  model.chordal = r.chordal;
+  model.flow = r.flow;
+  model.cross = r.cross;
+
+  std::vector<std::deque<uint32_t>> pressedAt(keys.size());
+  for (const KeyEvent &e : events) {
+    if (e.pressed) {
+      model.press(e.pos, e.ms);
+      pressedAt[e.pos].push_back(e.ms);
+    } else {
+      model.release(e.pos, e.ms);
+    }
+  }
+  model.task(UINT32_MAX / 2);
+
+  std::vector<std::vector<uint32_t>> holdsAt(keys.size());
+  for (const TraceHold &h : trace.holds) {
+    holdsAt[h.row * MATRIX_COLS + h.col].push_back(h.timeUs / 1000);
+  }
+
+  Result res;
+  for (const TapHoldEvent &out : model.out) {
+    if (!out.pressed || pressedAt[out.pos].empty()) {
+      continue;
+    }
+    uint32_t in = pressedAt[out.pos].front();
+    pressedAt[out.pos].pop_front();
+    res.added.push_back(out.timeMs - in);
+    if (!keys[out.pos].term) {
+      continue;
+    }
+    bool intended = false;
+    for (uint32_t t : holdsAt[out.pos]) {
+      intended |= t <= in && in - t <= HOLD_MATCH_MS;
+    }
+    res.modTapPresses++;
+    res.intendedHolds += intended;
+    res.falseHolds += out.hold && !intended;
+    res.falseTaps += !out.hold && intended;
+    if (!out.hold) {
+      res.tapAdded.push_back(out.timeMs - in);
+    }
+  }
+  return res;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: tap_hold_bench <trace>...\n");
+    return 1;
+  }
+  printf("TAPPING_TERM %u, FLOW_TAP_TERM %u, per-key terms %u-%u ms\n", TAPPING_TERM, FLOW_TAP_TERM,
+         home_row_term(0), home_row_term(4));
+
+  for (int i = 1; i < argc; i++) {
+    Trace trace;
+    std::string err = trace.load(argv[i]);
+    if (!err.empty()) {
+      fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    if (trace.rows != MATRIX_ROWS || trace.cols != MATRIX_COLS) {
+      fprintf(stderr, "%s: %ux%u trace, expected the QMK %ux%u matrix\n", argv[i], trace.rows, trace.cols,
+              MATRIX_ROWS, MATRIX_COLS);
+      return 1;
+    }
+    std::vector<KeyEvent> events = debounceTrace(trace);
+
+    bool header = true;
+    for (const Resolver &r : kResolvers) {
+      Result res = run(r, events, trace);
+      if (header) {
+        printf("%s: %zu keystrokes, %u on mod-taps, %u meant as holds\n", argv[i], res.added.size(),
+               res.modTapPresses, res.intendedHolds);
+        printf("  %-13s %11s %10s %26s %20s\n", "resolver", "false holds", "false taps",
+               "added ms mean/p50/p99/max", "mod-tap taps p50/p99");
+        header = false;
+      }
+      uint32_t misfires = res.falseHolds + res.falseTaps;
+      printf("  %-13s %11u %10u  (%4.1f%%) %7.1f/%u/%u/%u %16u/%u\n", r.name, res.falseHolds, res.falseTaps,
+             res.modTapPresses ? 100.0 * misfires / res.modTapPresses : 0.0, mean(res.added),
+             percentile(res.added, 0.5), percentile(res.added, 0.99),
+             res.added.empty() ? 0 : *std::max_element(res.added.begin(), res.added.end()),
+             percentile(res.tapAdded, 0.5), percentile(res.tapAdded, 0.99));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,309 @@
+// Replays typing-session traces (firmware_host/sim/trace.h) through the
+// firmware's matrix pipeline in virtual time, as fast as the host allows.
+//
+//   qmk         - every scan tick the raw matrix goes through
+//                 fix_encoder_action() and fix_ghosting() (firmware_qmk/,
+//                 built unmodified against firmware_host/qmk_shim) and then
+//                 QMK's default sym_defer_g debounce (DEBOUNCE ms)
+//   handwritten - two KeyboardCore<SimBoard> instances: the left half scans
+//                 trace rows 4-7 and answers I2C requests, the right half
+//                 scans rows 0-3, merges, runs the state machine and sends
+//                 HID reports; each runs its own loop() every SCAN_INTERVAL
+//
+// Per trace: replay throughput (scans per wall second, trace seconds per
+// wall second), registered presses against the presses the generator
+// intended, and press latency from the first raw press edge to the
+// debounced press.
+//
+//   trace_replay [--target qmk|handwritten] [--scan-us N] [--debounce-ms N] trace...
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -Ifirmware_host/qmk_shim firmware_host/bench/trace_replay.cpp firmware_qmk/encoder.c
+//       firmware_qmk/ghosting.c firmware_qmk/mouse_motion.c firmware_host/qmk_shim/qmk_shim.c -lstdc++ -o /tmp/trace_replay
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../sim/sim_board.h"
+#include "../sim/trace.h"
+
+#include "quantum.h"
+extern "C" {
+#include "../../firmware_qmk/encoder.h"
+#include "../../firmware_qmk/ghosting.h"
+}
+
+// A raw press with no debounced press within this window was filtered out
+#define PENDING_TIMEOUT_US 500000
+
+// Matches raw press edges to debounced presses per matrix position
+struct PressTracker {
+  uint32_t pendingUs[TRACE_MAX_ROWS][TRACE_MAX_COLS];
+  bool pending[TRACE_MAX_ROWS][TRACE_MAX_COLS] = {};
+  uint16_t raw[TRACE_MAX_ROWS] = {0};
+  uint16_t cooked[TRACE_MAX_ROWS] = {0};
+  std::vector<uint32_t> latencyUs;
+  uint32_t registered = 0;
+  uint32_t unmatched = 0;  // debounced presses without a pending raw press
+
+  void rawScan(uint32_t nowUs, const uint16_t *rows, uint8_t rowCount) {
+    for (uint8_t row = 0; row < rowCount; row++) {
+      uint16_t pressed = rows[row] & ~raw[row];
+      for (uint8_t col = 0; pressed; col++, pressed >>= 1) {
+        if ((pressed & 1) && (!pending[row][col] || nowUs - pendingUs[row][col] > PENDING_TIMEOUT_US)) {
+          pending[row][col] = true;
+          pendingUs[row][col] = nowUs;
+        }
+      }
+      raw[row] = rows[row];
+    }
+  }
+
+  void debouncedScan(uint32_t nowUs, const uint16_t *rows, uint8_t rowCount) {
+    for (uint8_t row = 0; row < rowCount; row++) {
+      // Bounce on release looks like raw presses; the debounced release ends them
+      uint16_t released = cooked[row] & ~rows[row];
+      for (uint8_t col = 0; released; col++, released >>= 1) {
+        if (released & 1) {
+          pending[row][col] = false;
+        }
+      }
+      uint16_t pressed = rows[row] & ~cooked[row];
+      for (uint8_t col = 0; pressed; col++, pressed >>= 1) {
+        if (!(pressed & 1)) {
+          continue;
+        }
+        registered++;
+        if (pending[row][col]) {
+          latencyUs.push_back(nowUs - pendingUs[row][col]);
+          pending[row][col] = false;
+        } else {
+          unmatched++;
+        }
+      }
+      cooked[row] = rows[row];
+    }
+  }
+};
+
+struct ReplayResult {
+  uint64_t scans = 0;
+  double wallSeconds = 0;
+  uint32_t hidReports = 0;
+  uint32_t encoderTaps = 0;
+  PressTracker presses;
+};
+
+// QMK: scan fixes, then sym_defer_g: one timer for the whole matrix, the
+// cooked matrix takes the raw one once nothing changed for DEBOUNCE ms
+static void replayQmk(const Trace &trace, uint32_t scanUs, uint32_t debounceMs, ReplayResult &result) {
+  qmk_shim_reset();
+  TraceCursor cursor(trace);
+  matrix_row_t matrix[MATRIX_ROWS] = {0};
+  matrix_row_t raw[MATRIX_ROWS] = {0};
+  matrix_row_t cooked[MATRIX_ROWS] = {0};
+  bool debouncing = false;
+  uint32_t debounceStartUs = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (uint32_t nowUs = 0; !cursor.done() || debouncing; nowUs += scanUs) {
+    cursor.advance(nowUs);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      matrix[row] = cursor.rows[row];
+    }
+    result.presses.rawScan(nowUs, cursor.rows, MATRIX_ROWS);
+
+    fix_encoder_action(matrix);
+    fix_ghosting(matrix);
+
+    if (memcmp(matrix, raw, sizeof(raw)) != 0) {
+      memcpy(raw, matrix, sizeof(raw));
+      debouncing = true;
+      debounceStartUs = nowUs;
+    } else if (debouncing && nowUs - debounceStartUs >= debounceMs * 1000) {
+      memcpy(cooked, raw, sizeof(cooked));
+      debouncing = false;
+      result.presses.debouncedScan(nowUs, cooked, MATRIX_ROWS);
+    }
+    result.scans++;
+  }
+  result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  result.encoderTaps = qmk_shim_state.taps;
+}
+
+// Handwritten: both halves share the global simState, so each one's state
+// is swapped in around its loop()
+struct Half {
+  KeyboardCore<SimBoard> core;
+  SimState state;
+
+  void enter() { simState = state; }
+  void leave() { state = simState; }
+};
+
+static Half leftHalf;
+static Half rightHalf;
+
+static void leftRequest() { leftHalf.core.sendKeyStates(); }
+
+static void replayHandwritten(const Trace &trace, ReplayResult &result) {
+  const uint8_t halfRows = SimBoard::RowPins::size;
+  Half *halves[2] = {&rightHalf, &leftHalf};
+  for (int h = 0; h < 2; h++) {
+    Half &half = *halves[h];
+    memset(&simState, 0, sizeof(simState));
+    simState.levels = ~0ull;
+    simState.rightSide = h == 0;
+    half.core.reset();
+    half.core.setup(leftRequest);
+    half.leave();
+  }
+
+  TraceCursor cursor(trace);
+  auto t0 = std::chrono::steady_clock::now();
+  bool settling = true;
+  while (!cursor.done() || settling) {
+    uint32_t nowUs = rightHalf.state.nowMs * 1000;
+    cursor.advance(nowUs);
+    result.presses.rawScan(nowUs, cursor.rows, trace.rows);
+
+    // Left half scans first; the I2C request reads its last debounced state
+    leftHalf.enter();
+    for (uint8_t row = 0; row < halfRows; row++) {
+      simState.pressed[row] = cursor.rows[row + halfRows];
+    }
+    simState.nowMs = rightHalf.state.nowMs;
+    leftHalf.core.loop();
+    leftHalf.core.sendKeyStates();
+    leftHalf.leave();
+
+    rightHalf.enter();
+    for (uint8_t row = 0; row < halfRows; row++) {
+      simState.pressed[row] = cursor.rows[row];
+    }
+    memcpy(simState.otherHalf, leftHalf.state.sentToMaster, sizeof(simState.otherHalf));
+    rightHalf.core.loop();
+    rightHalf.leave();
+
+    uint16_t debounced[TRACE_MAX_ROWS] = {0};
+    const uint8_t cols = SimBoard::ColPins::size;
+    for (uint8_t i = 0; i < rightHalf.core.totalKeys; i++) {
+      if (rightHalf.core.debouncedKeyState[i]) {
+        debounced[i / cols] |= 1 << (i % cols);
+      }
+      if (rightHalf.core.otherHalfKeyState[i]) {
+        debounced[halfRows + i / cols] |= 1 << (i % cols);
+      }
+    }
+    result.presses.debouncedScan(nowUs, debounced, trace.rows);
+    result.scans += 2;
+
+    bool idle = true;
+    for (uint8_t row = 0; row < trace.rows; row++) {
+      idle = idle && cursor.rows[row] == debounced[row];
+    }
+    settling = !idle;
+  }
+  result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  result.hidReports = rightHalf.state.hidReports;
+}
+
+static uint32_t percentile(std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+static void report(const char *path, const Trace &trace, ReplayResult &r) {
+  std::vector<uint32_t> &lat = r.presses.latencyUs;
+  std::sort(lat.begin(), lat.end());
+  double traceSeconds = trace.durationUs / 1e6;
+
+  printf("%s\n", path);
+  printf("  %zu samples, %.1f s of typing, %llu scans in %.3f s: %.2f M scans/s, %.0fx real time\n",
+         trace.samples.size(), traceSeconds, (unsigned long long)r.scans, r.wallSeconds,
+         r.scans / r.wallSeconds / 1e6, traceSeconds / r.wallSeconds);
+  printf("  presses: %u registered", r.presses.registered);
+  if (trace.intendedPresses) {
+    printf(" of %u intended", trace.intendedPresses);
+  }
+  printf(", %u without a raw press edge\n", r.presses.unmatched);
+  printf("  press latency (first raw edge to debounced): p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+         percentile(lat, 0.5) / 1000.0, percentile(lat, 0.99) / 1000.0, lat.empty() ? 0.0 : lat.back() / 1000.0);
+  if (r.hidReports) {
+    printf("  HID reports: %u (%.1f per registered press)\n", r.hidReports,
+           r.presses.registered ? (double)r.hidReports / r.presses.registered : 0.0);
+  }
+  if (r.encoderTaps) {
+    printf("  encoder taps: %u\n", r.encoderTaps);
+  }
+}
+
+static void usage() {
+  fprintf(stderr, "usage: trace_replay [--target qmk|handwritten] [--scan-us N] [--debounce-ms N] <trace>...\n");
+}
+
+int main(int argc, char **argv) {
+  std::string target = "qmk";
+  uint32_t scanUs = 500;
+  uint32_t debounceMs = 5;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--target" && i + 1 < argc) {
+      target = argv[++i];
+    } else if (arg == "--scan-us" && i + 1 < argc) {
+      scanUs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--debounce-ms" && i + 1 < argc) {
+      debounceMs = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    } else if (arg[0] == '-') {
+      usage();
+      return 1;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty() || scanUs == 0 || (target != "qmk" && target != "handwritten")) {
+    usage();
+    return 1;
+  }
+
+  if (target == "qmk") {
+    printf("target qmk: scan every %u us, sym_defer_g debounce %u ms\n", scanUs, debounceMs);
+  } else {
+    printf("target handwritten: loop every %d ms per half, per-key debounce %d ms\n", SCAN_INTERVAL, DEBOUNCE_TIME);
+  }
+
+  for (const char *path : paths) {
+    Trace trace;
+    std::string err = trace.load(path);
+    if (!err.empty()) {
+      fprintf(stderr, "%s\n", err.c_str());
+      return 1;
+    }
+    ReplayResult result;
+    if (target == "qmk") {
+      if (trace.rows != MATRIX_ROWS || trace.cols != MATRIX_COLS) {
+        fprintf(stderr, "%s: %ux%u trace, the QMK matrix is %dx%d\n", path, trace.rows, trace.cols, MATRIX_ROWS,
+                MATRIX_COLS);
+        return 1;
+      }
+      replayQmk(trace, scanUs, debounceMs, result);
+    } else {
+      if (trace.rows != 2 * SimBoard::RowPins::size || trace.cols != SimBoard::ColPins::size) {
+        fprintf(stderr, "%s: %ux%u trace, the handwritten matrix is %dx%d\n", path, trace.rows, trace.cols,
+                2 * SimBoard::RowPins::size, SimBoard::ColPins::size);
+        return 1;
+      }
+      replayHandwritten(trace, result);
+    }
+    report(path, trace, result);
+  }
+  return 0;
+}
@@ -0,0 +1,225 @@
+// RP2040 status LED driver (firmware_handwritten/ws2812_pio.c) built
+// unmodified against firmware_host/pico_shim, which runs the PIO program
+// cycle by cycle on what the DMA channel feeds it, on virtual time.
+//
+// Checked:
+//   encoding    - ws2812EncodeGrb() packs g<<24 | r<<16 | b<<8 for every
+//                 value of each channel and random colours, and the frame
+//                 on the pin is 24 pulses, G7 first and B0 last, with high
+//                 times inside the WS2812B-V5 datasheet's T0H (220-380 ns)
+//                 and T1H (580-1000 ns)
+//   burst       - many ws2812SetColor() calls between two loop passes end
+//                 in exactly one frame, with the last colour
+//   busy burst  - colours set every 10 us for 300 us while a frame is on
+//                 the wire and latching end in exactly one more frame, with the last
+//                 colour, once the latch gap is over
+//   unchanged   - setting the colour already on the LED sends nothing, and
+//                 A, B, A between two passes with A shown sends nothing
+//   latch gap   - every frame starts at least 280 us after the one before
+//                 ended
+// Exits non-zero when a check fails.
+//
+// Build (from firmware_files/; gcc picks C or C++ per file extension):
+//   gcc -O2 -DARDUINO_ARCH_RP2040 -Ifirmware_host/pico_shim firmware_host/bench/ws2812_bench.cpp
+//       firmware_handwritten/ws2812_pio.c firmware_host/pico_shim/pico_shim.c -lstdc++ -o /tmp/ws2812_bench
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "../../firmware_handwritten/ws2812_pio.h"
+#include "pico_shim.h"
+
+#define LED_PIN 16
+#define LOOP_US 1000        // loop() pass with its delay(1)
+#define T0H_MIN_NS 220
+#define T0H_MAX_NS 380
+#define T1H_MIN_NS 580
+#define T1H_MAX_NS 1000
+#define LATCH_MIN_US 280
+
+static int failures = 0;
+
+static void check(bool ok, const char *scenario, const char *what) {
+  if (!ok) {
+    printf("FAIL %s: %s\n", scenario, what);
+    failures++;
+  }
+}
+
+// One loop pass: the driver's task, then the time until the next pass
+static void pass(uint32_t us = LOOP_US) {
+  ws2812Task();
+  pico_shim_state.now_us += us;
+}
+
+static uint32_t frames() { return pico_shim_state.frame_count; }
+
+static const pico_shim_frame_t &lastFrame() { return pico_shim_state.frames[(frames() - 1) % PICO_SHIM_MAX_FRAMES]; }
+
+static void boot() {
+  pico_shim_reset();
+  ws2812Init(LED_PIN);
+  pass();
+}
+
+struct Row {
+  const char *name;
+  uint32_t setCalls;
+  uint32_t frames;
+  uint32_t expected;
+};
+
+static void print(const Row &r) {
+  printf("%-12s %9u %7u %9u %s\n", r.name, r.setCalls, r.frames, r.expected, r.frames == r.expected ? "ok" : "WRONG");
+  check(r.frames == r.expected, r.name, "wrong number of frames");
+}
+
+// The colour of a frame as the LED reads it: a pulse per bit, long is 1
+static bool decode(const pico_shim_frame_t &f, uint8_t *r, uint8_t *g, uint8_t *b, uint16_t *t0h, uint16_t *t1h) {
+  if (f.pulses != WS2812_FRAME_BITS) return false;
+  uint32_t bits = 0;
+  t0h[0] = t1h[0] = 0xFFFF;
+  t0h[1] = t1h[1] = 0;
+  for (uint8_t i = 0; i < f.pulses; i++) {
+    bool one = f.high_ns[i] > (T0H_MAX_NS + T1H_MIN_NS) / 2;
+    uint16_t *range = one ? t1h : t0h;
+    if (f.high_ns[i] < range[0]) range[0] = f.high_ns[i];
+    if (f.high_ns[i] > range[1]) range[1] = f.high_ns[i];
+    bits = bits << 1 | one;
+  }
+  *g = bits >> 16;
+  *r = bits >> 8;
+  *b = bits;
+  return true;
+}
+
+static Row encoding() {
+  boot();
+  Row row = {"encoding", 0, 0, 0};
+  std::mt19937 rng(1);
+  uint16_t t0h[2] = {0xFFFF, 0}, t1h[2] = {0xFFFF, 0};
+  bool packed = true, sent = true;
+  uint32_t shown = ~0u, before = frames();
+  for (int i = 0; i < 256 * 3 + 1000; i++) {
+    uint8_t rgb[3] = {0, 0, 0};
+    if (i < 256 * 3) {
+      rgb[i / 256] = (uint8_t)i;
+    } else {
+      uint32_t v = rng();
+      rgb[0] = v, rgb[1] = v >> 8, rgb[2] = v >> 16;
+    }
+    uint32_t word = ws2812EncodeGrb(rgb[0], rgb[1], rgb[2]);
+    packed &= word == ((uint32_t)rgb[1] << 24 | (uint32_t)rgb[0] << 16 | (uint32_t)rgb[2] << 8);
+
+    ws2812SetColor(rgb[0], rgb[1], rgb[2]);
+    row.setCalls++;
+    pass();
+    if (word == shown) continue;  // nothing to send
+    shown = word;
+    row.expected++;
+    uint8_t r, g, b;
+    uint16_t f0[2], f1[2];
+    if (!decode(lastFrame(), &r, &g, &b, f0, f1) || r != rgb[0] || g != rgb[1] || b != rgb[2]) {
+      sent = false;
+      continue;
+    }
+    if (f0[0] < t0h[0]) t0h[0] = f0[0];
+    if (f0[1] > t0h[1]) t0h[1] = f0[1];
+    if (f1[0] < t1h[0]) t1h[0] = f1[0];
+    if (f1[1] > t1h[1]) t1h[1] = f1[1];
+  }
+  row.frames = frames() - before;
+  check(packed, row.name, "ws2812EncodeGrb() is not g<<24 | r<<16 | b<<8");
+  check(sent, row.name, "a frame on the pin is not the colour set, G7 first");
+  check(t0h[0] >= T0H_MIN_NS && t0h[1] <= T0H_MAX_NS, row.name, "T0H outside the datasheet");
+  check(t1h[0] >= T1H_MIN_NS && t1h[1] <= T1H_MAX_NS, row.name, "T1H outside the datasheet");
+  printf("bits on the pin: T0H %u-%u ns, T1H %u-%u ns, frame %u us\n\n", t0h[0], t0h[1], t1h[0], t1h[1],
+         lastFrame().end_us - lastFrame().start_us);
+  return row;
+}
+
+static Row burst() {
+  boot();
+  Row row = {"burst", 0, 0, 1};
+  uint32_t before = frames();
+  for (int i = 0; i < 50; i++) {
+    ws2812SetColor((uint8_t)i, (uint8_t)(2 * i), (uint8_t)(3 * i));
+    row.setCalls++;
+  }
+  for (int i = 0; i < 5; i++) pass();
+  row.frames = frames() - before;
+  check(lastFrame().word == ws2812EncodeGrb(49, 98, 147), row.name, "the frame is not the last colour");
+  return row;
+}
+
+static Row busyBurst() {
+  boot();
+  Row row = {"busy burst", 0, 0, 1};
+  ws2812SetColor(10, 20, 30);
+  pass(10);
+  uint32_t before = frames();
+  uint32_t latchEnd = lastFrame().end_us + LATCH_MIN_US;
+  for (int i = 0; i < 30; i++) {
+    ws2812SetColor((uint8_t)(100 + i), 0, (uint8_t)i);
+    row.setCalls++;
+    pass(10);
+  }
+  for (int i = 0; i < 5; i++) pass();
+  row.frames = frames() - before;
+  check(lastFrame().word == ws2812EncodeGrb(129, 0, 29), row.name, "the frame is not the last colour");
+  check(lastFrame().start_us >= latchEnd, row.name, "the frame started before the latch gap was over");
+  return row;
+}
+
+static Row unchanged() {
+  boot();
+  Row row = {"unchanged", 0, 0, 0};
+  ws2812SetColor(0, 64, 0);
+  for (int i = 0; i < 5; i++) pass();
+  uint32_t before = frames();
+  for (int i = 0; i < 20; i++) {
+    ws2812SetColor(0, 64, 0);
+    row.setCalls++;
+    pass();
+  }
+  for (int i = 0; i < 20; i++) {
+    ws2812SetColor(64, 0, 64);
+    ws2812SetColor(0, 64, 0);
+    row.setCalls += 2;
+    pass();
+  }
+  row.frames = frames() - before;
+  return row;
+}
+
+// Colours set at random moments, passes 1-120 us apart: the gap before
+// every frame the driver starts
+static void latchGap() {
+  boot();
+  std::mt19937 rng(2);
+  uint32_t seen = frames(), prevEnd = 0, shortest = ~0u;
+  for (int i = 0; i < 20000; i++) {
+    uint32_t v = rng();
+    ws2812SetColor(v, v >> 8, v >> 16);
+    pass(1 + v % 120);
+    if (frames() == seen) continue;
+    if (seen > 0 && lastFrame().start_us - prevEnd < shortest) shortest = lastFrame().start_us - prevEnd;
+    seen = frames();
+    prevEnd = lastFrame().end_us;
+  }
+  printf("\nlatch gap: shortest %u us over %u frames (WS2812B-V5 needs %u)\n", shortest, seen, LATCH_MIN_US);
+  check(shortest >= LATCH_MIN_US, "latch gap", "a frame started before the previous one latched");
+}
+
+int main() {
+  Row rows[] = {encoding(), burst(), busyBurst(), unchanged()};
+  printf("%-12s %9s %7s %9s\n", "scenario", "set calls", "frames", "expected");
+  for (const Row &r : rows) print(r);
+  latchGap();
+  if (failures) {
+    printf("\n%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
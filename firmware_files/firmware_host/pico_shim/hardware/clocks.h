@@ -0,0 +1,14 @@
+// Host stand-in for the Pico SDK's hardware/clocks.h, see pico_shim.h
+#pragma once
+
+#include "../pico_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#ifdef __cplusplus
+}
+#endif
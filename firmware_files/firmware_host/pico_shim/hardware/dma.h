@@ -0,0 +1,23 @@
+// Host stand-in for the Pico SDK's hardware/dma.h, see pico_shim.h
+#pragma once
+
+#include "../pico_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count);
+bool dma_channel_is_busy(uint channel);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,27 @@
+// Host stand-in for the Pico SDK's hardware/pio.h, see pico_shim.h
+#pragma once
+
+#include "../pico_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint pio_add_program(PIO pio, const struct pio_program *program);
+uint pio_claim_unused_sm(PIO pio, bool required);
+void pio_gpio_init(PIO pio, uint pin);
+int  pio_sm_set_consistent_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+pio_sm_config pio_get_default_sm_config(void);
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap);
+void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs);
+void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base);
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold);
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join);
+void sm_config_set_clkdiv(pio_sm_config *c, float div);
+int  pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+// Host stand-in for the Pico SDK's hardware/timer.h, see pico_shim.h
+#pragma once
+
+#include "../pico_shim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t time_us_32(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,212 @@
+// Host implementation of the Pico SDK calls declared in the shim headers,
+// see pico_shim.h
+
+#include <string.h>
+
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "hardware/timer.h"
+
+pio_hw_t          pico_shim_pio[2];
+pico_shim_state_t pico_shim_state;
+
+void pico_shim_reset(void) {
+    memset(&pico_shim_state, 0, sizeof(pico_shim_state));
+    memset(pico_shim_pio, 0, sizeof(pico_shim_pio));
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void)clk_index;
+    return PICO_SHIM_CLK_SYS_HZ;
+}
+
+uint32_t time_us_32(void) {
+    return pico_shim_state.now_us;
+}
+
+uint pio_add_program(PIO pio, const struct pio_program *program) {
+    (void)pio;
+    // Loaded at offset 0, so JMP targets need no relocation
+    memcpy(pico_shim_state.instructions, program->instructions, program->length * sizeof(uint16_t));
+    return 0;
+}
+
+uint pio_claim_unused_sm(PIO pio, bool required) {
+    (void)pio;
+    (void)required;
+    return 0;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+    (void)pio;
+    (void)pin;
+}
+
+int pio_sm_set_consistent_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    (void)pio;
+    (void)sm;
+    (void)pin_base;
+    (void)pin_count;
+    (void)is_out;
+    return 0;
+}
+
+pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c;
+    memset(&c, 0, sizeof(c));
+    c.wrap = 31;
+    c.out_shift_right = true;
+    c.pull_threshold = 32;
+    c.clkdiv = 1.0f;
+    return c;
+}
+
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    (void)optional;
+    (void)pindirs;
+    c->sideset_bits = bit_count;
+}
+
+void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+    c->sideset_base = sideset_base;
+}
+
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    c->out_shift_right = shift_right;
+    c->autopull = autopull;
+    c->pull_threshold = pull_threshold ? pull_threshold : 32;
+}
+
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    c->fifo_join = join;
+}
+
+void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    c->clkdiv = div;
+}
+
+int pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    (void)pio;
+    (void)sm;
+    pico_shim_state.sm_config = *config;
+    pico_shim_state.sm_initial_pc = initial_pc;
+    return 0;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    (void)pio;
+    (void)sm;
+    pico_shim_state.sm_enabled = enabled;
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return (pio == pio1 ? 8 : 0) + sm + (is_tx ? 0 : 4);
+}
+
+// Runs the program on one word until the next OUT would need another pull
+static void shift_out(uint32_t word, pico_shim_frame_t *f) {
+    const pio_sm_config *c = &pico_shim_state.sm_config;
+    double cycle_ns = c->clkdiv * 1e9 / PICO_SHIM_CLK_SYS_HZ;
+    uint delay_bits = 5 - c->sideset_bits;
+    uint32_t osr = word, x = 0, cycles = 0, high_from = 0;
+    uint shifted = 0, pc = pico_shim_state.sm_initial_pc;
+    bool level = false;
+
+    f->word = word;
+    f->pulses = 0;
+    for (int steps = 0; steps < 10000; steps++) {
+        uint16_t ins = pico_shim_state.instructions[pc];
+        uint op = ins >> 13, field = (ins >> 8) & 0x1F;
+        if (op == 3 && c->autopull && shifted >= c->pull_threshold) break; // stalls on an empty FIFO
+
+        bool side = c->sideset_bits ? (field >> delay_bits) & 1 : level;
+        if (side && !level) high_from = cycles;
+        if (!side && level && f->pulses < 32) f->high_ns[f->pulses++] = (uint16_t)((cycles - high_from) * cycle_ns + 0.5);
+        level = side;
+
+        bool jumped = false;
+        if (op == 3) {
+            uint n = ins & 0x1F ? ins & 0x1F : 32;
+            uint32_t value = c->out_shift_right ? osr & (uint32_t)((1ull << n) - 1) : (uint32_t)((uint64_t)osr >> (32 - n));
+            osr = c->out_shift_right ? (uint32_t)((uint64_t)osr >> n) : (uint32_t)((uint64_t)osr << n);
+            shifted += n;
+            if (((ins >> 5) & 7) == 1) x = value;
+        } else if (op == 0) {
+            uint cond = (ins >> 5) & 7;
+            if (cond == 0 || (cond == 1 && x == 0)) {
+                pc = ins & 0x1F;
+                jumped = true;
+            }
+        }
+        cycles += 1 + (field & ((1u << delay_bits) - 1));
+        if (!jumped) pc = pc == c->wrap ? c->wrap_target : pc + 1;
+    }
+    if (level && f->pulses < 32) f->high_ns[f->pulses++] = (uint16_t)((cycles - high_from) * cycle_ns + 0.5);
+
+    uint32_t start = pico_shim_state.now_us;
+    if ((int32_t)(pico_shim_state.line_free_us - start) > 0) start = pico_shim_state.line_free_us;
+    f->start_us = start;
+    f->end_us = start + (uint32_t)(cycles * cycle_ns / 1000 + 0.999);
+    pico_shim_state.line_free_us = f->end_us;
+}
+
+int dma_claim_unused_channel(bool required) {
+    (void)required;
+    pico_shim_state.dma_claimed = true;
+    return 0;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    dma_channel_config c;
+    c.size = DMA_SIZE_32;
+    c.read_increment = true;
+    c.write_increment = false;
+    c.dreq = 0x3F;
+    return c;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = dreq;
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    (void)channel;
+    const volatile uint32_t *words = (const volatile uint32_t *)read_addr;
+    for (uint32_t i = 0; i < transfer_count; i++) {
+        pico_shim_state.dma_transfers++;
+        if (pico_shim_state.dma_write != &pico_shim_pio[1].txf[0] || !pico_shim_state.sm_enabled) continue;
+        uint32_t n = pico_shim_state.frame_count++;
+        shift_out(words[i], &pico_shim_state.frames[n % PICO_SHIM_MAX_FRAMES]);
+    }
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    (void)config;
+    pico_shim_state.dma_write = write_addr;
+    if (trigger) dma_channel_transfer_from_buffer_now(channel, read_addr, transfer_count);
+}
+
+bool dma_channel_is_busy(uint channel) {
+    (void)channel;
+    return false;
+}
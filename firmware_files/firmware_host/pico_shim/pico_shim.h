@@ -0,0 +1,99 @@
+// Host stand-in for the parts of the Pico SDK the RP2040 sources use:
+// PIO state machines, DMA channels, clocks and the microsecond timer, on
+// virtual time (pico_shim_state.now_us)
+//
+// A DMA transfer into a state machine's TX FIFO is taken as done at once
+// (the joined FIFO holds 8 words). The state machine then runs the loaded
+// program on each word, cycle by cycle: OUT, JMP (always, !X) and MOV as a
+// nop, with a non-optional side-set driving the pin, autopull at the
+// configured threshold and direction, and the clock divider setting the
+// cycle time. Every word lands in pico_shim_state.frames with the width of
+// each high pulse it put on the pin and when it started and ended on the
+// wire.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned int uint;
+
+#define PICO_SHIM_CLK_SYS_HZ 125000000u
+#define PICO_SHIM_MAX_FRAMES 256
+
+typedef struct {
+    volatile uint32_t txf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t pico_shim_pio[2];
+
+#define pio0 (&pico_shim_pio[0])
+#define pio1 (&pico_shim_pio[1])
+
+struct pio_program {
+    const uint16_t *instructions;
+    uint8_t         length;
+    int8_t          origin;
+};
+
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+
+typedef struct {
+    uint  wrap_target, wrap;
+    uint  sideset_bits, sideset_base;
+    bool  out_shift_right, autopull;
+    uint  pull_threshold;
+    enum pio_fifo_join fifo_join;
+    float clkdiv;
+} pio_sm_config;
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment, write_increment;
+    uint dreq;
+} dma_channel_config;
+
+enum clock_index { clk_sys = 5 };
+
+// One word shifted out by a state machine
+typedef struct {
+    uint32_t word;
+    uint16_t high_ns[32]; // each high pulse on the pin, in order
+    uint8_t  pulses;
+    uint32_t start_us, end_us;
+} pico_shim_frame_t;
+
+typedef struct {
+    uint32_t now_us;
+
+    // State machine 0 of pio1, the only one the sources claim
+    uint16_t      instructions[32];
+    pio_sm_config sm_config;
+    uint          sm_initial_pc;
+    bool          sm_enabled;
+    uint32_t      line_free_us; // end of the frame on the wire
+
+    // DMA channel 0: where it writes, and transfers started
+    bool           dma_claimed;
+    volatile void *dma_write;
+    uint32_t       dma_transfers;
+
+    // The last PICO_SHIM_MAX_FRAMES words, frame n at n % PICO_SHIM_MAX_FRAMES
+    pico_shim_frame_t frames[PICO_SHIM_MAX_FRAMES];
+    uint32_t          frame_count;
+} pico_shim_state_t;
+
+extern pico_shim_state_t pico_shim_state;
+
+void pico_shim_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
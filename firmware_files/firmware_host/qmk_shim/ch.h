@@ -0,0 +1,20 @@
+// Host stand-in for the ChibiOS system time calls firmware_qmk/ uses; one
+// tick is one microsecond of virtual time
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t systime_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+systime_t chVTGetSystemTimeX(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define TIME_I2US(ticks) ((uint32_t)(ticks))
+#define TIME_I2MS(ticks) ((uint32_t)(ticks) / 1000)
@@ -0,0 +1,23 @@
+// Host stand-in for QMK's debounce.h; qmk_shim.c implements the default
+// sym_defer_g algorithm on virtual time
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "matrix.h"
+
+#ifndef DEBOUNCE
+#    define DEBOUNCE 5
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void debounce_init(uint8_t num_rows);
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows, bool changed);
+
+#ifdef __cplusplus
+}
+#endif
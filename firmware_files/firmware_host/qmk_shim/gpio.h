@@ -0,0 +1,66 @@
+// Host stand-in for QMK's gpio.h over the simulated pins in qmk_shim_state:
+// outputs drive their level, inputs read what the pressed switches connect
+// them to (see qmk_shim.c)
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t pin_t;
+
+#define GP0 0
+#define GP1 1
+#define GP2 2
+#define GP3 3
+#define GP4 4
+#define GP5 5
+#define GP6 6
+#define GP7 7
+#define GP8 8
+#define GP9 9
+#define GP10 10
+#define GP11 11
+#define GP12 12
+#define GP13 13
+#define GP14 14
+#define GP15 15
+#define GP16 16
+#define GP17 17
+#define GP18 18
+#define GP19 19
+#define GP20 20
+#define GP21 21
+#define GP22 22
+#define GP23 23
+#define GP24 24
+#define GP25 25
+#define GP26 26
+#define GP27 27
+#define GP28 28
+#define GP29 29
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void setPinInput(pin_t pin);
+void setPinInputHigh(pin_t pin);
+void setPinOutput(pin_t pin);
+void writePin(pin_t pin, bool level);
+bool readPin(pin_t pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define writePinHigh(pin) writePin((pin), true)
+#define writePinLow(pin) writePin((pin), false)
+
+// Current QMK names
+#define gpio_set_pin_input(pin) setPinInput(pin)
+#define gpio_set_pin_input_high(pin) setPinInputHigh(pin)
+#define gpio_set_pin_output(pin) setPinOutput(pin)
+#define gpio_write_pin(pin, level) writePin((pin), (level))
+#define gpio_write_pin_high(pin) writePin((pin), true)
+#define gpio_write_pin_low(pin) writePin((pin), false)
+#define gpio_read_pin(pin) readPin(pin)
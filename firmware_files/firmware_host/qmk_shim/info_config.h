@@ -0,0 +1,20 @@
+// Host stand-in for the info_config.h QMK generates from
+// firmware_qmk/keyboard.json: matrix size and pins of the duplex matrix.
+// Every column pin is listed twice; col_pins[2n] drives column pair n.
+#pragma once
+
+#ifndef MATRIX_ROWS
+#    define MATRIX_ROWS 8
+#endif
+#ifndef MATRIX_COLS
+#    define MATRIX_COLS 12
+#endif
+
+#ifndef MATRIX_ROW_PINS
+#    define MATRIX_ROW_PINS { GP3, GP1, GP2, GP0, GP27, GP28, GP29, GP8 }
+#endif
+#ifndef MATRIX_COL_PINS
+#    define MATRIX_COL_PINS { GP6, GP6, GP5, GP5, GP4, GP4, GP14, GP14, GP15, GP15, GP26, GP26 }
+#endif
+
+#define DIODE_DIRECTION ROW2COL
@@ -0,0 +1,27 @@
+// Host stand-in for QMK's matrix.h, sized for the cheapino duplex matrix
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "info_config.h"
+
+typedef uint16_t matrix_row_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+matrix_row_t matrix_get_row(uint8_t row);
+
+// matrix_common.c: custom matrix scan, then debounce, like QMK's CUSTOM_MATRIX = lite
+void matrix_init(void);
+uint8_t matrix_scan(void);
+void matrix_init_custom(void);
+bool matrix_scan_custom(matrix_row_t current_matrix[]);
+void matrix_scan_kb(void);
+void matrix_scan_user(void);
+
+#ifdef __cplusplus
+}
+#endif
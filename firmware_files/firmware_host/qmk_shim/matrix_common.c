@@ -0,0 +1,27 @@
+// Host version of QMK's matrix_common.c for CUSTOM_MATRIX = lite: the
+// keyboard's matrix_scan_custom() fills the raw matrix, debounce() cooks it
+// into what matrix_get_row() returns. Link with firmware_qmk/matrix.c.
+
+#include <string.h>
+
+#include "debounce.h"
+#include "quantum.h"
+
+__attribute__((weak)) void matrix_scan_user(void) {}
+
+__attribute__((weak)) void matrix_scan_kb(void) {
+    matrix_scan_user();
+}
+
+void matrix_init(void) {
+    memset(qmk_shim_state.raw, 0, sizeof(qmk_shim_state.raw));
+    memset(qmk_shim_state.matrix, 0, sizeof(qmk_shim_state.matrix));
+    matrix_init_custom();
+}
+
+uint8_t matrix_scan(void) {
+    bool changed = matrix_scan_custom(qmk_shim_state.raw);
+    changed      = debounce(qmk_shim_state.raw, qmk_shim_state.matrix, MATRIX_ROWS, changed);
+    matrix_scan_kb();
+    return changed;
+}
@@ -0,0 +1,238 @@
+// Host implementation of the QMK calls declared in the shim headers
+//
+// Pins: an output drives its level; an input with the pull-up reads high
+// unless a held switch connects it to a low net. Every switch of the duplex
+// matrix sits in series with a diode: odd columns conduct from the column
+// pin into the row pin (seen with the row driven low), even columns from
+// the row pin into the column pin (seen with the column driven low). Low
+// spreads across conducting diodes until nothing changes, so three or more
+// held switches can pull down pins no single switch would, as on the board.
+// An input without pull-up reads high. A pin model set in
+// qmk_shim_pin_model takes over the reads.
+
+#include <string.h>
+
+#include "ch.h"
+#include "debounce.h"
+#include "quantum.h"
+#include "raw_hid.h"
+
+qmk_shim_state_t qmk_shim_state;
+const qmk_shim_pin_model_t *qmk_shim_pin_model;
+void (*qmk_shim_send_report)(const uint8_t report[8]);
+void (*qmk_shim_send_extra)(uint8_t report_id, uint16_t usage);
+
+static const pin_t shim_row_pins[] = MATRIX_ROW_PINS;
+static const pin_t shim_col_pins[] = MATRIX_COL_PINS;
+
+// Input levels, recomputed on the first read after a pin or switch changes
+static uint32_t pin_levels;
+static bool     pin_levels_valid;
+
+// Called before anything the pin levels depend on changes
+static void pins_changing(void) {
+    if (qmk_shim_pin_model) qmk_shim_pin_model->sync();
+    pin_levels_valid = false;
+}
+
+void qmk_shim_reset(void) {
+    memset(&qmk_shim_state, 0, sizeof(qmk_shim_state));
+    qmk_shim_state.layer_state = 1;
+    pin_levels_valid = false;
+}
+
+void qmk_shim_set_switch(uint8_t row, uint8_t col, bool pressed) {
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
+    pins_changing();
+    if (pressed) {
+        qmk_shim_state.switches[row] |= (matrix_row_t)1 << col;
+    } else {
+        qmk_shim_state.switches[row] &= ~((matrix_row_t)1 << col);
+    }
+}
+
+static uint32_t resolve_levels(void) {
+    uint32_t low = qmk_shim_state.pin_output & ~qmk_shim_state.pin_high;
+    uint32_t driven = qmk_shim_state.pin_output;
+    uint32_t before;
+    do {
+        before = low;
+        for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+            matrix_row_t held = qmk_shim_state.switches[row];
+            for (uint8_t col = 0; held; col++, held >>= 1) {
+                if (!(held & 1)) continue;
+                uint32_t row_bit = 1u << shim_row_pins[row];
+                uint32_t col_bit = 1u << shim_col_pins[col];
+                // The diode's cathode pulls its anode down, unless something drives the anode
+                uint32_t cathode = (col & 1) ? row_bit : col_bit;
+                uint32_t anode   = (col & 1) ? col_bit : row_bit;
+                if ((low & cathode) && !(driven & anode)) low |= anode;
+            }
+        }
+    } while (low != before);
+    return ~low;
+}
+
+void setPinInput(pin_t pin) {
+    pins_changing();
+    qmk_shim_state.pin_output &= ~(1u << pin);
+    qmk_shim_state.pin_pullup &= ~(1u << pin);
+}
+
+void setPinInputHigh(pin_t pin) {
+    pins_changing();
+    qmk_shim_state.pin_output &= ~(1u << pin);
+    qmk_shim_state.pin_pullup |= 1u << pin;
+}
+
+void setPinOutput(pin_t pin) {
+    pins_changing();
+    qmk_shim_state.pin_output |= 1u << pin;
+    qmk_shim_state.pin_pullup &= ~(1u << pin);
+}
+
+void writePin(pin_t pin, bool level) {
+    pins_changing();
+    if (level) {
+        qmk_shim_state.pin_high |= 1u << pin;
+    } else {
+        qmk_shim_state.pin_high &= ~(1u << pin);
+    }
+}
+
+bool readPin(pin_t pin) {
+    qmk_shim_state.pin_reads++;
+    if (qmk_shim_pin_model) {
+        qmk_shim_pin_model->sync();
+        return qmk_shim_pin_model->read(pin);
+    }
+    if (!pin_levels_valid) {
+        pin_levels       = resolve_levels();
+        pin_levels_valid = true;
+    }
+    return (pin_levels >> pin) & 1;
+}
+
+void wait_us(uint32_t us) {
+    qmk_shim_state.now_us += us;
+    qmk_shim_state.waited_us += us;
+}
+
+void wait_ms(uint32_t ms) {
+    wait_us(ms * 1000);
+}
+
+uint32_t timer_read32(void) {
+    return (uint32_t)(qmk_shim_state.now_us / 1000);
+}
+
+uint16_t timer_read(void) {
+    return (uint16_t)timer_read32();
+}
+
+uint16_t timer_elapsed(uint16_t last) {
+    return (uint16_t)(timer_read() - last);
+}
+
+uint32_t timer_elapsed32(uint32_t last) {
+    return timer_read32() - last;
+}
+
+systime_t chVTGetSystemTimeX(void) {
+    return (systime_t)qmk_shim_state.now_us;
+}
+
+// QMK's default debounce, sym_defer_g: one timer for the whole matrix, the
+// cooked matrix takes the raw one once nothing changed for DEBOUNCE ms
+static bool     debouncing;
+static uint16_t debouncing_time;
+
+void debounce_init(uint8_t num_rows) {
+    (void)num_rows;
+    debouncing = false;
+}
+
+bool debounce(matrix_row_t raw[], matrix_row_t cooked[], uint8_t num_rows, bool changed) {
+    bool cooked_changed = false;
+    if (changed) {
+        debouncing      = true;
+        debouncing_time = timer_read();
+    } else if (debouncing && timer_elapsed(debouncing_time) >= DEBOUNCE) {
+        size_t size = sizeof(matrix_row_t) * num_rows;
+        if (memcmp(cooked, raw, size) != 0) {
+            memcpy(cooked, raw, size);
+            cooked_changed = true;
+        }
+        debouncing = false;
+    }
+    return cooked_changed;
+}
+
+void raw_hid_send(uint8_t *data, uint8_t length) {
+    if (length > QMK_SHIM_RAW_HID_SIZE) length = QMK_SHIM_RAW_HID_SIZE;
+    memcpy(qmk_shim_state.raw_hid_last, data, length);
+    qmk_shim_state.raw_hid_reports++;
+}
+
+static void send_keyboard(const uint8_t report[8]) {
+    qmk_shim_state.keyboard_reports++;
+    if (qmk_shim_send_report) qmk_shim_send_report(report);
+}
+
+static void send_extra(uint8_t report_id, uint16_t usage) {
+    qmk_shim_state.extra_reports++;
+    if (qmk_shim_send_extra) qmk_shim_send_extra(report_id, usage);
+}
+
+// KEYCODE2SYSTEM()/KEYCODE2CONSUMER(), 0 for keycodes of the keyboard report
+static uint16_t system_usage(uint8_t keycode) {
+    return keycode >= KC_PWR && keycode <= KC_WAKE ? 0x81 + (keycode - KC_PWR) : 0;
+}
+
+static uint16_t consumer_usage(uint8_t keycode) {
+    switch (keycode) {
+        case KC_MUTE: return 0xE2;
+        case KC_VOLU: return 0xE9;
+        case KC_VOLD: return 0xEA;
+        case KC_MNXT: return 0xB5;
+        case KC_MPRV: return 0xB6;
+        case KC_MSTP: return 0xB7;
+        case KC_MPLY: return 0xCD;
+        default: return 0;
+    }
+}
+
+void tap_code16(uint16_t keycode) {
+    qmk_shim_state.tap_log[qmk_shim_state.taps % QMK_SHIM_TAP_LOG] = keycode;
+    qmk_shim_state.taps++;
+
+    // register_code16(): the modifiers in a report of their own, then the
+    // key; unregister_code16() in reverse
+    uint8_t mods   = (keycode >> 8) & 0x1F;
+    uint8_t report[8] = {mods & 0x10 ? (uint8_t)((mods & 0x0F) << 4) : mods};
+    if (mods) send_keyboard(report);
+    if (system_usage(keycode & 0xFF)) {
+        send_extra(REPORT_ID_SYSTEM, system_usage(keycode & 0xFF));
+        send_extra(REPORT_ID_SYSTEM, 0);
+    } else if (consumer_usage(keycode & 0xFF)) {
+        send_extra(REPORT_ID_CONSUMER, consumer_usage(keycode & 0xFF));
+        send_extra(REPORT_ID_CONSUMER, 0);
+    } else {
+        report[2] = keycode & 0xFF;
+        send_keyboard(report);
+        report[2] = 0;
+        send_keyboard(report);
+    }
+    if (mods) {
+        report[0] = 0;
+        send_keyboard(report);
+    }
+}
+
+void tap_code(uint8_t keycode) {
+    tap_code16(keycode);
+}
+
+matrix_row_t matrix_get_row(uint8_t row) {
+    return row < MATRIX_ROWS ? qmk_shim_state.matrix[row] : 0;
+}
@@ -0,0 +1,218 @@
+// Host stand-in for the parts of QMK's quantum.h that firmware_qmk/
+// sources use. Keycodes, modifier wrappers, mod-taps and MO() have their
+// QMK values, enough to build firmware_qmk/keymap_tables.h; tapped keys are
+// recorded in qmk_shim_state and optionally sent on as reports. Pins, waits and timers run on the simulated
+// matrix and virtual time in qmk_shim_state too.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpio.h"
+#include "matrix.h"
+#include "timer.h"
+#include "wait.h"
+
+// Basic keycodes (HID usage IDs)
+#define KC_NO 0x0000
+#define KC_TRNS 0x0001
+#define KC_A 0x0004
+#define KC_B 0x0005
+#define KC_C 0x0006
+#define KC_D 0x0007
+#define KC_E 0x0008
+#define KC_F 0x0009
+#define KC_G 0x000A
+#define KC_H 0x000B
+#define KC_I 0x000C
+#define KC_J 0x000D
+#define KC_K 0x000E
+#define KC_L 0x000F
+#define KC_M 0x0010
+#define KC_N 0x0011
+#define KC_O 0x0012
+#define KC_P 0x0013
+#define KC_Q 0x0014
+#define KC_R 0x0015
+#define KC_S 0x0016
+#define KC_T 0x0017
+#define KC_U 0x0018
+#define KC_V 0x0019
+#define KC_W 0x001A
+#define KC_X 0x001B
+#define KC_Y 0x001C
+#define KC_Z 0x001D
+#define KC_1 0x001E
+#define KC_2 0x001F
+#define KC_3 0x0020
+#define KC_4 0x0021
+#define KC_5 0x0022
+#define KC_6 0x0023
+#define KC_7 0x0024
+#define KC_8 0x0025
+#define KC_9 0x0026
+#define KC_0 0x0027
+#define KC_ENT 0x0028
+#define KC_ESC 0x0029
+#define KC_BSPC 0x002A
+#define KC_TAB 0x002B
+#define KC_SPC 0x002C
+#define KC_MINS 0x002D
+#define KC_EQL 0x002E
+#define KC_LBRC 0x002F
+#define KC_RBRC 0x0030
+#define KC_BSLS 0x0031
+#define KC_SCLN 0x0033
+#define KC_QUOT 0x0034
+#define KC_GRV 0x0035
+#define KC_COMM 0x0036
+#define KC_DOT 0x0037
+#define KC_SLSH 0x0038
+#define KC_PGUP 0x004B
+#define KC_PGDN 0x004E
+#define KC_RGHT 0x004F
+#define KC_LEFT 0x0050
+#define KC_DOWN 0x0051
+#define KC_UP 0x0052
+#define KC_PWR 0x00A5
+#define KC_SLEP 0x00A6
+#define KC_WAKE 0x00A7
+#define KC_MUTE 0x00A8
+#define KC_VOLU 0x00A9
+#define KC_VOLD 0x00AA
+#define KC_MNXT 0x00AB
+#define KC_MPRV 0x00AC
+#define KC_MSTP 0x00AD
+#define KC_MPLY 0x00AE
+#define RGB_HUI 0x7823
+#define RGB_HUD 0x7824
+#define RGB_SAI 0x7825
+#define RGB_SAD 0x7826
+#define RGB_VAI 0x7827
+#define RGB_VAD 0x7828
+#define KC_LCTL 0x00E0
+#define KC_LSFT 0x00E1
+#define KC_LALT 0x00E2
+#define KC_LGUI 0x00E3
+#define KC_RCTL 0x00E4
+#define KC_RSFT 0x00E5
+#define KC_RALT 0x00E6
+#define KC_RGUI 0x00E7
+
+#define LCTL(kc) (0x0100 | (kc))
+#define LSFT(kc) (0x0200 | (kc))
+#define LALT(kc) (0x0400 | (kc))
+#define LGUI(kc) (0x0800 | (kc))
+
+#define KC_EXLM LSFT(KC_1)
+#define KC_AT LSFT(KC_2)
+#define KC_HASH LSFT(KC_3)
+#define KC_DLR LSFT(KC_4)
+#define KC_PERC LSFT(KC_5)
+#define KC_CIRC LSFT(KC_6)
+#define KC_AMPR LSFT(KC_7)
+#define KC_ASTR LSFT(KC_8)
+#define KC_LPRN LSFT(KC_9)
+#define KC_RPRN LSFT(KC_0)
+#define KC_UNDS LSFT(KC_MINS)
+#define KC_PLUS LSFT(KC_EQL)
+#define KC_LCBR LSFT(KC_LBRC)
+#define KC_RCBR LSFT(KC_RBRC)
+#define KC_PIPE LSFT(KC_BSLS)
+
+// Mod-tap and layer keys
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+#define MOD_RCTL 0x11
+#define MOD_RSFT 0x12
+#define MOD_RALT 0x14
+#define MOD_RGUI 0x18
+
+#define QK_MOD_TAP 0x2000
+#define QK_MOD_TAP_MAX 0x3FFF
+#define QK_MOMENTARY 0x5220
+
+#define MT(mod, kc) (QK_MOD_TAP | (((mod)&0x1F) << 8) | ((kc)&0xFF))
+#define LCTL_T(kc) MT(MOD_LCTL, kc)
+#define LSFT_T(kc) MT(MOD_LSFT, kc)
+#define LALT_T(kc) MT(MOD_LALT, kc)
+#define LGUI_T(kc) MT(MOD_LGUI, kc)
+#define RCTL_T(kc) MT(MOD_RCTL, kc)
+#define RSFT_T(kc) MT(MOD_RSFT, kc)
+#define RALT_T(kc) MT(MOD_RALT, kc)
+#define RGUI_T(kc) MT(MOD_RGUI, kc)
+#define MO(layer) (QK_MOMENTARY | ((layer)&0x1F))
+
+#define IS_QK_MOD_TAP(code) ((code) >= QK_MOD_TAP && (code) <= QK_MOD_TAP_MAX)
+#define QK_MOD_TAP_GET_MODS(kc) (((kc) >> 8) & 0x1F)
+#define QK_MOD_TAP_GET_TAP_KEYCODE(kc) ((kc)&0xFF)
+
+#define QMK_SHIM_TAP_LOG 64
+#define QMK_SHIM_RAW_HID_SIZE 32
+
+typedef struct {
+    uint32_t layer_state;
+    uint32_t taps;                       // tap_code()/tap_code16() calls
+    uint16_t tap_log[QMK_SHIM_TAP_LOG];  // last taps, taps % QMK_SHIM_TAP_LOG is next
+    matrix_row_t matrix[MATRIX_ROWS];    // what matrix_get_row() returns (debounced)
+    matrix_row_t raw[MATRIX_ROWS];       // last matrix_scan_custom() result in matrix_scan()
+
+    // Simulated board: virtual time and the GPIOs
+    uint64_t now_us;                     // advanced by wait_us()/wait_ms() and the caller
+    uint32_t waited_us;                  // time spent in wait_us()/wait_ms()
+    uint32_t pin_output;                 // bit n: GPn is an output
+    uint32_t pin_high;                   // bit n: output level of GPn
+    uint32_t pin_pullup;                 // bit n: GPn has its pull-up on
+    uint32_t pin_reads;                  // readPin() calls
+    matrix_row_t switches[MATRIX_ROWS];  // switches held down, by matrix position
+
+    uint32_t keyboard_reports;           // boot keyboard reports tap_code16() sent
+    uint32_t extra_reports;              // system and consumer control reports it sent
+
+    uint32_t raw_hid_reports;
+    uint8_t raw_hid_last[QMK_SHIM_RAW_HID_SIZE];
+} qmk_shim_state_t;
+
+// Optional pin model replacing the ideal one in qmk_shim.c (e.g. the
+// electrical one in firmware_host/sim/duplex_analog.h). sync() is called
+// before every pin or switch change and before every read, read() for the
+// level. Not touched by qmk_shim_reset().
+typedef struct {
+    void (*sync)(void);
+    bool (*read)(pin_t pin);
+} qmk_shim_pin_model_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern qmk_shim_state_t qmk_shim_state;
+extern const qmk_shim_pin_model_t *qmk_shim_pin_model;
+
+// Optional sink for the boot keyboard reports (modifier bits, reserved, six
+// usages) QMK would send for tapped keys, e.g. firmware_host/sim/uinput_hid.h:
+// tap_code16() goes out as QMK's register/unregister sequence. Not touched
+// by qmk_shim_reset().
+extern void (*qmk_shim_send_report)(const uint8_t report[8]);
+
+// Optional sink for the system and consumer control reports: with
+// EXTRAKEY_ENABLE (keyboard.json "extrakey") QMK sends KC_PWR..KC_WAKE and
+// the media keycodes as a usage in a report of their own, then 0 on
+// release. Not touched by qmk_shim_reset().
+#define REPORT_ID_SYSTEM 3
+#define REPORT_ID_CONSUMER 4
+extern void (*qmk_shim_send_extra)(uint8_t report_id, uint16_t usage);
+
+void qmk_shim_reset(void);
+// Hold or release the switch at a matrix position
+void qmk_shim_set_switch(uint8_t row, uint8_t col, bool pressed);
+void tap_code(uint8_t keycode);
+void tap_code16(uint16_t keycode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define IS_LAYER_ON(layer) ((qmk_shim_state.layer_state >> (layer)) & 1)
@@ -0,0 +1,14 @@
+// Host stand-in for QMK's raw_hid.h: reports are counted and the last one kept
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void raw_hid_send(uint8_t *data, uint8_t length);
+
+#ifdef __cplusplus
+}
+#endif
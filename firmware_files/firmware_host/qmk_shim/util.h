@@ -0,0 +1,12 @@
+// Host stand-in for QMK's util.h
+#pragma once
+
+#ifndef MIN
+#    define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#    define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#ifndef ARRAY_SIZE
+#    define ARRAY_SIZE(array) (sizeof((array)) / sizeof((array)[0]))
+#endif
@@ -0,0 +1,15 @@
+// Host stand-in for QMK's wait.h: waits advance virtual time and return
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wait_us(uint32_t us);
+void wait_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
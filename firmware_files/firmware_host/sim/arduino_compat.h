@@ -0,0 +1,31 @@
+// Just enough of the Arduino/HID-Project environment to build the
+// handwritten firmware core (firmware_handwritten/keyboard_core.h) and its
+// generated keymap_tables.h on the host.
+
+#pragma once
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+// HID-Project KeyboardKeycode values (HID usage page 0x07) used by the keymaps
+enum KeyboardKeycode : uint8_t {
+  KEY_RESERVED = 0,
+  KEY_A = 4, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+  KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z,
+  KEY_1, KEY_2, KEY_3, KEY_4, KEY_5, KEY_6, KEY_7, KEY_8, KEY_9, KEY_0,
+  KEY_ENTER, KEY_ESC, KEY_BACKSPACE, KEY_TAB, KEY_SPACE, KEY_MINUS, KEY_EQUAL, KEY_LEFT_BRACE,
+  KEY_RIGHT_BRACE, KEY_BACKSLASH, KEY_NON_US_NUM, KEY_SEMICOLON, KEY_QUOTE, KEY_TILDE, KEY_COMMA,
+  KEY_PERIOD, KEY_SLASH, KEY_CAPS_LOCK,
+  KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_F11, KEY_F12,
+  KEY_PRINT_SCREEN, KEY_SCROLL_LOCK, KEY_PAUSE, KEY_INSERT, KEY_HOME, KEY_PAGE_UP, KEY_DELETE,
+  KEY_END, KEY_PAGE_DOWN, KEY_RIGHT_ARROW, KEY_LEFT_ARROW, KEY_DOWN_ARROW, KEY_UP_ARROW,
+  KEY_NUM_LOCK, KEY_KP_SLASH, KEY_KP_ASTERISK, KEY_KP_MINUS, KEY_KP_PLUS, KEY_KP_ENTER,
+  KEY_KP_1, KEY_KP_2, KEY_KP_3, KEY_KP_4, KEY_KP_5, KEY_KP_6, KEY_KP_7, KEY_KP_8, KEY_KP_9,
+  KEY_KP_0, KEY_KP_DOT,
+  KEY_MUTE = 0x7F, KEY_VOLUME_UP = 0x80, KEY_VOLUME_DOWN = 0x81,
+  KEY_LEFT_CTRL = 0xE0, KEY_LEFT_SHIFT, KEY_LEFT_ALT, KEY_LEFT_GUI,
+  KEY_RIGHT_CTRL, KEY_RIGHT_SHIFT, KEY_RIGHT_ALT, KEY_RIGHT_GUI,
+};
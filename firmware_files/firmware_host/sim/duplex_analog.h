@@ -0,0 +1,359 @@
+// Electrical model of the QMK build's 8x12 duplex matrix, plugged under
+// firmware_host/qmk_shim as its pin model.
+//
+// One net per row pin and per column pin pair (keyboard.json lists every
+// column pin twice). Each net has a capacitance to ground (pad, trace,
+// stray) and, while it is an input, the RP2040 pad pull-up; a pin set as
+// output drives its net through the pad's output resistance. A held switch
+// puts its diode (from the keebio:Diode-dual footprint) between a row and a
+// column net: odd columns conduct from the column into the row, even
+// columns from the row into the column, as read_cols_on_row() and
+// read_rows_on_col() expect. The diode is piecewise linear (nothing below
+// the forward drop, a small resistance above it) with its junction
+// capacitance coupling the two nets.
+//
+// Time is the shim's virtual time: before the firmware changes a pin or a
+// switch changes, the shim has the model integrate up to now with the old
+// setup (implicit Euler, the step grows while the nets are quiet and skips
+// ahead once they are at rest). readPin() compares the net voltage with the
+// RP2040 input thresholds; between VIL and VIH the level is undefined and
+// the pin flips at vSwitch (the midpoint unless set).
+//
+// Every read is logged with what a scan analysis needs: the net voltage,
+// the level it will settle to with the current setup (DC operating point),
+// when the read level last changed and when the setup last changed.
+
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "quantum.h"
+
+struct DuplexParams {
+  double vdd = 3.3;
+  double rPullup = 80e3;    // RP2040 pad pull-up is 50-80 kOhm: the slow end
+  double rDriver = 40;      // pad output resistance at the default 4 mA drive
+  double cLine = 15e-12;    // per net: pad, trace and stray to ground
+  double cDiode = 4e-12;    // 1N4148 junction, coupled in while its switch is held
+  double vForward = 0.55;   // diode drop at the tens of uA a pull-up sources
+  double rDiode = 50;       // diode slope above the drop
+  double vil = 0.8;         // RP2040 input thresholds at IOVDD 3.3 V
+  double vih = 2.0;
+  double vSwitch = 1.4;     // where a pin between VIL and VIH flips
+};
+
+enum DuplexLevel : uint8_t { LEVEL_LOW, LEVEL_HIGH, LEVEL_UNDEFINED };
+
+struct DuplexRead {
+  pin_t pin;
+  int driven;          // net driven low during the read, -1 if none
+  double timeUs;       // virtual time of the read
+  double setupUs;      // when the pins last changed before it
+  double settledUs;    // when the read net last crossed a threshold
+  double volts;
+  double finalVolts;   // DC operating point with this setup
+  DuplexLevel level;
+  DuplexLevel finalLevel;
+};
+
+class DuplexAnalog {
+ public:
+  static const int maxNets = MATRIX_ROWS + MATRIX_COLS / 2;
+
+  DuplexParams params;
+  std::vector<DuplexRead> reads;  // appended by every readPin()
+  bool traceVoltages = false;     // record every integration step in samples
+  struct Sample {
+    double timeUs;
+    double volts[maxNets];
+  };
+  std::vector<Sample> samples;
+
+  int nets = 0;
+  pin_t netPin[maxNets];
+
+  DuplexAnalog() {
+    static const pin_t rows[] = MATRIX_ROW_PINS;
+    static const pin_t cols[] = MATRIX_COL_PINS;
+    memset(netOfPin, -1, sizeof(netOfPin));
+    for (pin_t pin : rows) addNet(pin);
+    for (uint8_t col = 0; col < MATRIX_COLS; col += 2) addNet(cols[col]);
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+      for (uint8_t col = 0; col < MATRIX_COLS; col++) {
+        int rowNet = netOfPin[rows[row]], colNet = netOfPin[cols[col]];
+        anodeOf[row][col] = (col & 1) ? colNet : rowNet;
+        cathodeOf[row][col] = (col & 1) ? rowNet : colNet;
+      }
+    }
+    reset();
+  }
+
+  int netOf(pin_t pin) const { return pin < 32 ? netOfPin[pin] : -1; }
+
+  // Nets charged to VDD, all diodes off, the shim's time as the start
+  void reset() {
+    for (int i = 0; i < nets; i++) {
+      volts[i] = params.vdd;
+      levels[i] = LEVEL_HIGH;
+      changedUs[i] = 0;
+    }
+    memset(diodeOn, 0, sizeof(diodeOn));
+    timeUs = (double)qmk_shim_state.now_us;
+    setupUs = timeUs;
+    dtUs = dtMinUs;
+    finalValid = false;
+    readSetup();
+    reads.clear();
+    samples.clear();
+  }
+
+  // Bring the nets up to the shim's time with the pins and switches as they
+  // were since the last call
+  void sync() {
+    double endUs = (double)qmk_shim_state.now_us;
+    if (!sameSetup()) {
+      readSetup();
+      setupUs = timeUs;
+      dtUs = dtMinUs;
+      finalValid = false;
+    }
+    while (timeUs < endUs) {
+      double h = fmin(dtUs, endUs - timeUs);
+      double before[maxNets];
+      memcpy(before, volts, sizeof(before));
+      double change = step(h * 1e-6, false);
+      timeUs += h;
+      for (int i = 0; i < nets; i++) {
+        DuplexLevel level = levelOf(volts[i]);
+        if (level != levels[i]) {
+          // Crossed VIH going up or coming down from HIGH, VIL otherwise
+          bool upper = level == LEVEL_HIGH || levels[i] == LEVEL_HIGH;
+          double threshold = upper ? params.vih : params.vil;
+          changedUs[i] = timeUs - h + h * (before[i] - threshold) / (before[i] - volts[i]);
+          levels[i] = level;
+        }
+      }
+      if (traceVoltages) record();
+      if (change < restVolts) {
+        timeUs = endUs;  // at rest: nothing moves until the setup changes
+      } else if (change < quietVolts) {
+        dtUs = fmin(dtUs * 2, dtMaxUs);
+      } else if (change > busyVolts) {
+        dtUs = fmax(dtUs / 2, dtMinUs);
+      }
+    }
+    timeUs = endUs;
+  }
+
+  bool read(pin_t pin) {
+    int net = netOf(pin);
+    if (net < 0) return true;  // not part of the matrix: pull-up only
+    if (!finalValid) settleFinal();
+    DuplexRead r;
+    r.pin = pin;
+    r.driven = -1;
+    for (int i = 0; i < nets; i++) {
+      if (driven[i] && !high[i]) r.driven = i;
+    }
+    r.timeUs = timeUs;
+    r.setupUs = setupUs;
+    r.settledUs = changedUs[net];
+    r.volts = volts[net];
+    r.finalVolts = finalVolts[net];
+    r.level = levels[net];
+    r.finalLevel = levelOf(finalVolts[net]);
+    reads.push_back(r);
+    return volts[net] > params.vSwitch;
+  }
+
+ private:
+  static constexpr double dtMinUs = 0.005;
+  static constexpr double dtMaxUs = 0.5;
+  static constexpr double busyVolts = 0.1;    // per step: halve the step
+  static constexpr double quietVolts = 0.02;  // per step: let the step grow
+  static constexpr double restVolts = 1e-7;   // per step: at rest
+
+  int netOfPin[32];
+  int anodeOf[MATRIX_ROWS][MATRIX_COLS];
+  int cathodeOf[MATRIX_ROWS][MATRIX_COLS];
+
+  double volts[maxNets];
+  DuplexLevel levels[maxNets];
+  double changedUs[maxNets];
+  double finalVolts[maxNets];
+  bool finalValid;
+  double timeUs, setupUs, dtUs;
+
+  // Setup the nets were last integrated with
+  uint32_t pinOutput, pinHigh, pinPullup;
+  matrix_row_t switches[MATRIX_ROWS];
+  bool driven[maxNets], high[maxNets], pulled[maxNets];
+  bool diodeOn[MATRIX_ROWS][MATRIX_COLS];
+
+  void addNet(pin_t pin) {
+    if (netOfPin[pin] >= 0) return;
+    netOfPin[pin] = nets;
+    netPin[nets++] = pin;
+  }
+
+  bool sameSetup() const {
+    return pinOutput == qmk_shim_state.pin_output && pinHigh == qmk_shim_state.pin_high &&
+           pinPullup == qmk_shim_state.pin_pullup && !memcmp(switches, qmk_shim_state.switches, sizeof(switches));
+  }
+
+  void readSetup() {
+    pinOutput = qmk_shim_state.pin_output;
+    pinHigh = qmk_shim_state.pin_high;
+    pinPullup = qmk_shim_state.pin_pullup;
+    memcpy(switches, qmk_shim_state.switches, sizeof(switches));
+    for (int i = 0; i < nets; i++) {
+      driven[i] = pinOutput >> netPin[i] & 1;
+      high[i] = pinHigh >> netPin[i] & 1;
+      pulled[i] = pinPullup >> netPin[i] & 1;
+    }
+  }
+
+  DuplexLevel levelOf(double v) const {
+    return v < params.vil ? LEVEL_LOW : v > params.vih ? LEVEL_HIGH : LEVEL_UNDEFINED;
+  }
+
+  // One implicit Euler step of h seconds (dc: the operating point instead),
+  // diode states iterated until they agree with the voltages. Returns the
+  // largest voltage change.
+  double step(double h, bool dc) {
+    double next[maxNets];
+    for (int iteration = 0; iteration < 64; iteration++) {
+      double a[maxNets][maxNets + 1] = {};
+      for (int i = 0; i < nets; i++) {
+        a[i][i] += 1e-12;  // keeps a floating net solvable
+        if (!dc) {
+          double g = params.cLine / h;
+          a[i][i] += g;
+          a[i][nets] += g * volts[i];
+        }
+        if (driven[i]) {
+          a[i][i] += 1 / params.rDriver;
+          a[i][nets] += (high[i] ? params.vdd : 0) / params.rDriver;
+        } else if (pulled[i]) {
+          a[i][i] += 1 / params.rPullup;
+          a[i][nets] += params.vdd / params.rPullup;
+        }
+      }
+      for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t held = switches[row];
+        for (uint8_t col = 0; held; col++, held >>= 1) {
+          if (!(held & 1)) continue;
+          int an = anodeOf[row][col], ca = cathodeOf[row][col];
+          if (!dc) {
+            double g = params.cDiode / h, past = volts[an] - volts[ca];
+            stampConductance(a, an, ca, g);
+            a[an][nets] += g * past;
+            a[ca][nets] -= g * past;
+          }
+          if (diodeOn[row][col]) {
+            double g = 1 / params.rDiode;
+            stampConductance(a, an, ca, g);
+            a[an][nets] += g * params.vForward;
+            a[ca][nets] -= g * params.vForward;
+          }
+        }
+      }
+      solve(a, next);
+
+      bool flipped = false;
+      for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t held = switches[row];
+        for (uint8_t col = 0; held; col++, held >>= 1) {
+          if (!(held & 1)) continue;
+          bool on = next[anodeOf[row][col]] - next[cathodeOf[row][col]] > params.vForward;
+          if (on != diodeOn[row][col]) {
+            diodeOn[row][col] = on;
+            flipped = true;
+          }
+        }
+      }
+      if (!flipped) break;
+    }
+
+    double change = 0;
+    for (int i = 0; i < nets; i++) {
+      change = fmax(change, fabs(next[i] - volts[i]));
+      if (dc) {
+        finalVolts[i] = next[i];
+      } else {
+        volts[i] = next[i];
+      }
+    }
+    return change;
+  }
+
+  void settleFinal() {
+    bool saved[MATRIX_ROWS][MATRIX_COLS];
+    memcpy(saved, diodeOn, sizeof(saved));
+    step(0, true);
+    memcpy(diodeOn, saved, sizeof(saved));
+    finalValid = true;
+  }
+
+  void stampConductance(double a[][maxNets + 1], int i, int j, double g) {
+    a[i][i] += g;
+    a[j][j] += g;
+    a[i][j] -= g;
+    a[j][i] -= g;
+  }
+
+  // Gaussian elimination with partial pivoting on the augmented matrix
+  void solve(double a[][maxNets + 1], double *x) {
+    for (int c = 0; c < nets; c++) {
+      int pivot = c;
+      for (int r = c + 1; r < nets; r++) {
+        if (fabs(a[r][c]) > fabs(a[pivot][c])) pivot = r;
+      }
+      if (pivot != c) {
+        for (int k = c; k <= nets; k++) {
+          double t = a[c][k];
+          a[c][k] = a[pivot][k];
+          a[pivot][k] = t;
+        }
+      }
+      for (int r = c + 1; r < nets; r++) {
+        double f = a[r][c] / a[c][c];
+        if (f == 0) continue;
+        for (int k = c; k <= nets; k++) a[r][k] -= f * a[c][k];
+      }
+    }
+    for (int r = nets - 1; r >= 0; r--) {
+      double s = a[r][nets];
+      for (int k = r + 1; k < nets; k++) s -= a[r][k] * x[k];
+      x[r] = s / a[r][r];
+    }
+  }
+
+  void record() {
+    Sample s;
+    s.timeUs = timeUs;
+    memcpy(s.volts, volts, sizeof(s.volts));
+    samples.push_back(s);
+  }
+};
+
+// The model the shim calls into; attach with duplexAnalogAttach()
+static DuplexAnalog *duplexAnalog;
+
+static void duplexAnalogSync(void) {
+  duplexAnalog->sync();
+}
+
+static bool duplexAnalogRead(pin_t pin) {
+  return duplexAnalog->read(pin);
+}
+
+static const qmk_shim_pin_model_t duplexAnalogModel = {duplexAnalogSync, duplexAnalogRead};
+
+static inline void duplexAnalogAttach(DuplexAnalog *model) {
+  duplexAnalog = model;
+  qmk_shim_pin_model = model ? &duplexAnalogModel : nullptr;
+}
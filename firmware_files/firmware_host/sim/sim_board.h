@@ -0,0 +1,280 @@
+// Host board traits for the handwritten firmware core
+// (firmware_handwritten/keyboard_core.h).
+//
+// GPIO levels live in one 64 bit word like the RP2040 SIO input register.
+// Driving a row pin LOW pulls the column pins of every pressed key on that
+// row LOW. Time is virtual: millis() only moves when the caller (or idle())
+// advances it, so loop() runs at full speed. HID reports and I2C transfers
+// are recorded for the caller to inspect; onRequest lets the caller answer
+// I2C requests from the other half at the moment they happen. The host
+// configures the device at usbMountMs; reports sent before that are
+// dropped like a USB stack drops them, and counted.
+//
+// Pins match the RP2040 Zero build: rows GPIO6-9, columns GPIO10-15, side
+// select GPIO28.
+//
+// With HEATMAP_ENABLE the heatmap log lives in simFlash, NOR semantics
+// (programming only clears bits, erasing sets a sector to 0xFF); the caller
+// erases it before the first boot, can charge each operation's time through
+// simFlashOp and suspends the bus with usbSuspended.
+//
+// With KEYMAP_LIVE_ENABLE vendor reports go through simRawRequests (the
+// caller pushes what the host sends) and simRawAnswers (the caller takes
+// what the core answers).
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arduino_compat.h"
+
+// Host builds are single translation units, so the combo engine, the string
+// compiler (and with HEATMAP_ENABLE the heatmap log) are defined here
+#define COMBO_IMPLEMENTATION
+#include "../../firmware_common/combo.h"
+#define SEND_STRING_IMPLEMENTATION
+#include "../../firmware_common/send_string.h"
+#ifdef HEATMAP_ENABLE
+#define HEATMAP_IMPLEMENTATION
+#endif
+
+#include "../../firmware_handwritten/keyboard_core.h"
+
+#ifdef KEYMAP_LIVE_ENABLE
+#include "../../firmware_handwritten/hid_report_queue.h"
+#endif
+
+struct SimState {
+  uint64_t levels;          // GPIO input levels, bit n = GPIOn
+  uint32_t pressed[8];      // pressed keys per row, bit n = column n
+  uint32_t nowMs;
+
+  uint8_t otherHalf[32];    // what the other half answers over I2C
+  bool otherHalfSilent;     // the other half does not answer (not booted yet)
+  uint8_t sentToMaster[32]; // what this half last sent as I2C slave
+  void (*onRequest)();      // when set, called to fill otherHalf on each request
+  void (*onKeyEvent)(uint8_t position, bool pressed, uint32_t timeMs);
+  uint8_t hidKeys[6];       // keys currently held in the HID report
+  uint32_t hidReports;      // HID reports sent (every releaseAll()/press()/send())
+  void (*onHidReport)();    // when set, called after each of those with hidKeys updated
+  bool hidSingleReport;     // the core sends each change as one report
+  uint32_t hidDropped;      // reports sent before usbMountMs
+  uint8_t hidRoom;          // reports hidSend() takes per typeTask() call
+  uint16_t consumerUsage;   // usage held in the consumer control report
+  uint32_t consumerReports; // consumer control reports sent
+  uint8_t systemUsage;      // usage held in the system control report
+  uint32_t systemReports;   // system control reports sent
+  uint32_t usbMountMs;      // host configures the device (0: at power-on, UINT32_MAX: never)
+  bool usbSuspended;        // host suspended the bus (HEATMAP_ENABLE)
+  uint32_t statusChanges;
+  uint8_t lastState;
+  uint8_t lastLayer;
+  bool rightSide;
+  bool verbose;
+};
+
+static SimState simState;
+
+#ifdef HEATMAP_ENABLE
+static uint8_t simFlash[HEATMAP_LOG_SECTORS * HEATMAP_LOG_SECTOR_SIZE];
+static void (*simFlashOp)(bool erase);
+#endif
+
+#ifdef KEYMAP_LIVE_ENABLE
+static HidRawQueue<KEYMAP_LIVE_REPORT_SIZE> simRawRequests;
+static HidRawQueue<KEYMAP_LIVE_REPORT_SIZE> simRawAnswers;
+#endif
+
+// Index of Pin in a PinList, -1 if absent
+template <typename Pins, uint8_t Pin, int Index = 0> struct PinIndex {
+  static const int value = Pins::first == Pin ? Index : PinIndex<typename Pins::Tail, Pin, Index + 1>::value;
+};
+
+template <uint8_t Pin, int Index> struct PinIndex<PinList<>, Pin, Index> {
+  static const int value = -1;
+};
+
+struct SimBoard {
+  typedef PinList<6, 7, 8, 9> RowPins;
+  typedef PinList<10, 11, 12, 13, 14, 15> ColPins;
+
+  static const uint8_t sidePin = 28;
+  static const uint8_t i2cAddress = 0x23;
+
+  static const uint64_t colMask = ((1ull << ColPins::size) - 1) << ColPins::first;
+  static_assert(PinOps<SimBoard, ColPins>::contiguousFrom(ColPins::first), "sim columns must be consecutive GPIOs");
+
+  // Shared by the compile-time and runtime pin paths: update the level of
+  // one pin and, for a row pin, the columns it pulls down
+  static void drive(uint8_t pin, int row, bool high) {
+    if (high) {
+      simState.levels |= 1ull << pin;
+    } else {
+      simState.levels &= ~(1ull << pin);
+    }
+    if (row >= 0) {
+      uint64_t pulled = high ? 0 : (uint64_t)simState.pressed[row] << ColPins::first;
+      simState.levels = (simState.levels | colMask) & ~(pulled & colMask);
+    }
+  }
+
+  template <uint8_t Pin> static void writePin(bool high) { drive(Pin, PinIndex<RowPins, Pin>::value, high); }
+  template <uint8_t Pin> static bool readPin() { return (simState.levels >> Pin) & 1; }
+  static uint32_t readColumns() { return PinOps<SimBoard, ColPins>::readLow(); }
+
+  static void pinOutput(uint8_t) {}
+  static void pinInputPullup(uint8_t pin) {
+    if (pin != sidePin || simState.rightSide) {
+      simState.levels |= 1ull << pin;
+    } else {
+      simState.levels &= ~(1ull << pin);  // left side select is strapped to GND
+    }
+  }
+  static void settle() {}
+  static void sideSettle() {}
+  static uint32_t millis() { return simState.nowMs; }
+
+  static void init() {}
+  static void begin(bool, void (*)()) {}
+
+  static uint8_t requestOtherHalf(uint8_t *data, uint8_t len) {
+    if (simState.otherHalfSilent) {
+      return 0;
+    }
+    if (simState.onRequest) {
+      simState.onRequest();
+    }
+    uint8_t n = len < sizeof(simState.otherHalf) ? len : sizeof(simState.otherHalf);
+    memcpy(data, simState.otherHalf, n);
+    return n;
+  }
+
+  static void sendToMaster(const uint8_t *data, uint8_t len) {
+    uint8_t n = len < sizeof(simState.sentToMaster) ? len : sizeof(simState.sentToMaster);
+    memcpy(simState.sentToMaster, data, n);
+  }
+
+  static void keyEvent(uint8_t position, bool pressed, uint32_t timeMs) {
+    if (simState.onKeyEvent) {
+      simState.onKeyEvent(position, pressed, timeMs);
+    }
+  }
+
+  static bool hostReady() { return simState.nowMs >= simState.usbMountMs; }
+
+  static void hidReleaseAll() {
+    if (!hostReady()) {
+      simState.hidDropped++;
+      return;
+    }
+    memset(simState.hidKeys, 0, sizeof(simState.hidKeys));
+    simState.hidReports++;
+    if (simState.onHidReport) {
+      simState.onHidReport();
+    }
+  }
+
+  static void hidPress(uint8_t keycode) {
+    if (!hostReady()) {
+      simState.hidDropped++;
+      return;
+    }
+    for (uint8_t i = 0; i < 6; i++) {
+      if (simState.hidKeys[i] == 0) {
+        simState.hidKeys[i] = keycode;
+        break;
+      }
+    }
+    simState.hidReports++;
+    if (simState.onHidReport) {
+      simState.onHidReport();
+    }
+  }
+
+  static bool hidSingleReport() { return simState.hidSingleReport; }
+  static uint8_t hidRoom() { return simState.hidRoom; }
+  static bool hidCanTake(uint8_t, uint8_t) { return true; }
+
+  static void hidSend(const uint8_t *keys) {
+    if (!hostReady()) {
+      simState.hidDropped++;
+      return;
+    }
+    memcpy(simState.hidKeys, keys, sizeof(simState.hidKeys));
+    simState.hidReports++;
+    if (simState.onHidReport) {
+      simState.onHidReport();
+    }
+  }
+
+  static void hidConsumer(uint16_t usage) {
+    if (!hostReady()) {
+      simState.hidDropped++;
+      return;
+    }
+    simState.consumerUsage = usage;
+    simState.consumerReports++;
+  }
+
+  static void hidSystem(uint8_t usage) {
+    if (!hostReady()) {
+      simState.hidDropped++;
+      return;
+    }
+    simState.systemUsage = usage;
+    simState.systemReports++;
+  }
+
+  static void statusChanged(uint8_t state, uint8_t layer) {
+    simState.lastState = state;
+    simState.lastLayer = layer;
+    simState.statusChanges++;
+  }
+
+  static void logLine(const char *line) {
+    if (simState.verbose) {
+      puts(line);
+    }
+  }
+
+  static void task() {}
+  static void idle() { simState.nowMs++; }
+
+#ifdef KEYMAP_LIVE_ENABLE
+  static bool rawHidReceive(uint8_t *report) { return simRawRequests.take(report); }
+  static void rawHidSend(const uint8_t *report) { simRawAnswers.push(report); }
+#endif
+
+#ifdef HEATMAP_ENABLE
+  static const uint8_t *heatmapFlash() { return simFlash; }
+
+  static void heatmapProgram(uint32_t offset, const uint8_t *page) {
+    for (uint32_t i = 0; i < HEATMAP_LOG_PAGE_SIZE; i++) {
+      simFlash[offset + i] &= page[i];
+    }
+    if (simFlashOp) {
+      simFlashOp(false);
+    }
+  }
+
+  static void heatmapErase(uint32_t offset) {
+    memset(simFlash + offset, 0xFF, HEATMAP_LOG_SECTOR_SIZE);
+    if (simFlashOp) {
+      simFlashOp(true);
+    }
+  }
+
+  static bool hostSuspended() { return hostReady() && simState.usbSuspended; }
+#endif
+};
+
+// Press or release a key of the simulated half
+static inline void simSetKey(uint8_t row, uint8_t col, bool pressed) {
+  if (pressed) {
+    simState.pressed[row] |= 1u << col;
+  } else {
+    simState.pressed[row] &= ~(1u << col);
+  }
+}
@@ -0,0 +1,271 @@
+// Executable model of the Stateflow chart in
+// firmware_simulink/stateflow_chart_creator.m, hand-translated so the
+// chart can be run on a Linux box at native speed (firmware_host/bench/
+// state_fuzz checks the handwritten state machine against it).
+//
+// One step() is one 10 ms sample of the discrete chart, with Stateflow's
+// semantics: the active state's outgoing transitions are tried in the order
+// the script creates them; the first valid one runs its condition action,
+// the state is left and the destination entered (with its entry action);
+// when none is valid the state's during action runs instead. WAITING's exit
+// goes through the junction on nextState; a junction with no valid path
+// backtracks and WAITING stays active. Each transition keeps the chart's
+// LabelString verbatim so a harness can check the rows against the script.
+//
+// Modelled: the states, every transition, the MACRO_RECORD entry action,
+// and the during actions that feed the guards (countPressedKeys,
+// calculateActiveLayer). Not modelled: processKeys/keyReport and
+// ledStatus, which have no counterpart in the state machine of the
+// firmware (keys are reported by key processing, LEDs by the board).
+//
+// The firmware differs from the chart on purpose in a few places; each
+// difference can be switched on so the model behaves like the firmware and
+// anything left is a bug in one of them:
+//   CHART_FRESH_COUNT   guards see this sample's key count; the chart
+//                       counts keys in during actions, after the guards
+//   CHART_PROGRAM_EXIT  programming is left on PROGRAM with any other key,
+//                       through WAITING; the chart leaves on PROGRAM+FN
+//                       (specialKeys(3)) straight to NORMAL
+//   CHART_LAYER_INPUT   the layer is an input; the firmware changes layers
+//                       in key processing, outside the state machine
+//   CHART_FIRMWARE      all of the above
+
+#pragma once
+
+#include <stdint.h>
+
+#define CHART_FRESH_COUNT  0x01
+#define CHART_PROGRAM_EXIT 0x02
+#define CHART_LAYER_INPUT  0x04
+#define CHART_FIRMWARE     (CHART_FRESH_COUNT | CHART_PROGRAM_EXIT | CHART_LAYER_INPUT)
+
+// specialKeys indices of the chart, 0-based
+#define CHART_KEY_PROGRAM 0
+#define CHART_KEY_MACRO   1
+#define CHART_KEY_LAYER   2
+#define CHART_KEY_FN      3
+
+struct StateflowModel {
+  // State numbers as the chart uses them in nextState and getLEDStatus
+  enum State {
+    NORMAL,
+    WAITING,
+    PROGRAMMING_SRC,
+    PROGRAMMING_DST,
+    MACRO_RECORD_TRIGGER,
+    MACRO_RECORD,
+    MACRO_PLAY,
+    STATE_COUNT
+  };
+
+  enum Guard {
+    GUARD_PROGRAM_AND_MACRO,     // specialKeys(1) && specialKeys(2)
+    GUARD_PROGRAM_NOT_MACRO,     // specialKeys(1) && ~specialKeys(2)
+    GUARD_NO_KEYS,               // pressedKeyCount == 0
+    GUARD_ONE_KEY,               // pressedKeyCount == 1
+    GUARD_SOME_KEYS,             // pressedKeyCount > 0
+    GUARD_PROGRAM_AND_FN,        // specialKeys(1) && specialKeys(3)
+  };
+
+  enum Action {
+    ACTION_NONE,
+    ACTION_SAVE_SOURCE,  // programSrcKey = getKeycode()
+    ACTION_STOP_MACRO,   // recordingMacro = false
+  };
+
+  struct Transition {
+    uint8_t from;
+    uint8_t guard;
+    uint8_t action;
+    uint8_t to;         // WAITING: through the junction on nextState
+    uint8_t nextState;  // set by the condition action, 0xFF: left alone
+    const char *label;  // LabelString in the script
+  };
+
+  // Chart transitions in creation order, which is execution order within a
+  // state. The junction's own rows are in junctionTarget().
+  static const Transition *transitions(uint8_t &count) {
+    static const Transition rows[] = {
+      {NORMAL, GUARD_PROGRAM_AND_MACRO, ACTION_NONE, WAITING, MACRO_RECORD_TRIGGER,
+       "specialKeys(1) && specialKeys(2) \\n{nextState = 4; /* MACRO_RECORD_TRIGGER */}"},
+      {NORMAL, GUARD_PROGRAM_NOT_MACRO, ACTION_NONE, WAITING, PROGRAMMING_SRC,
+       "specialKeys(1) && ~specialKeys(2) \\n{nextState = 2; /* PROGRAMMING_SRC */}"},
+      {WAITING, GUARD_NO_KEYS, ACTION_NONE, NORMAL, 0xFF, "pressedKeyCount == 0"},
+      {PROGRAMMING_SRC, GUARD_ONE_KEY, ACTION_SAVE_SOURCE, WAITING, PROGRAMMING_DST,
+       "pressedKeyCount == 1 \\n{programSrcKey = getKeycode(); nextState = 3;}"},
+      {PROGRAMMING_SRC, GUARD_PROGRAM_AND_FN, ACTION_NONE, NORMAL, 0xFF,
+       "specialKeys(1) && specialKeys(3) \\n/* PROGRAM + FN keys */"},
+      {PROGRAMMING_DST, GUARD_ONE_KEY, ACTION_NONE, WAITING, PROGRAMMING_SRC,
+       "pressedKeyCount == 1 \\n{/* Remap key */ nextState = 2;}"},
+      {PROGRAMMING_DST, GUARD_PROGRAM_AND_FN, ACTION_NONE, NORMAL, 0xFF,
+       "specialKeys(1) && specialKeys(3) \\n/* PROGRAM + FN keys */"},
+      {MACRO_RECORD_TRIGGER, GUARD_SOME_KEYS, ACTION_NONE, WAITING, MACRO_RECORD,
+       "pressedKeyCount > 0 \\n{/* Save trigger */ nextState = 5;}"},
+      {MACRO_RECORD_TRIGGER, GUARD_PROGRAM_AND_MACRO, ACTION_NONE, NORMAL, 0xFF,
+       "specialKeys(1) && specialKeys(2) \\n/* PROGRAM + MACRO keys */"},
+      {MACRO_RECORD, GUARD_PROGRAM_AND_MACRO, ACTION_STOP_MACRO, WAITING, NORMAL,
+       "specialKeys(1) && specialKeys(2) \\n{recordingMacro = false; /* Save macro */ nextState = 0;}"},
+    };
+    count = sizeof(rows) / sizeof(rows[0]);
+    return rows;
+  }
+
+  // Junction after WAITING: 'nextState == 2' ... 'nextState == 0 || nextState > 6'.
+  // No valid path for 1 and 6.
+  static uint8_t junctionTarget(uint8_t next) {
+    if (next >= PROGRAMMING_SRC && next <= MACRO_RECORD) return next;
+    if (next == NORMAL || next > MACRO_PLAY) return NORMAL;
+    return 0xFF;
+  }
+
+  // Inputs, set before each step()
+  bool keyMatrix[24];
+  bool otherHalfKeys[24];
+  uint8_t specialKeys[4];  // program, macro, layer, fn
+  uint32_t timer;
+
+  // Outputs and locals
+  uint8_t currentLayer;
+  uint8_t state;
+  uint8_t pressedKeyCount;
+  uint8_t programSrcKey;
+  bool recordingMacro;
+  uint8_t nextState;
+
+  uint8_t options;
+  // getKeymapCode(layer, index) with a 0-based index; the chart's own is a placeholder
+  uint8_t (*keymapCode)(uint8_t layer, uint8_t index);
+
+  explicit StateflowModel(uint8_t opts = 0) : options(opts), keymapCode(placeholderKeymapCode) { reset(); }
+
+  void reset() {
+    for (uint8_t i = 0; i < 24; i++) {
+      keyMatrix[i] = false;
+      otherHalfKeys[i] = false;
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+      specialKeys[i] = 0;
+    }
+    timer = 0;
+    currentLayer = 0;
+    pressedKeyCount = 0;
+    programSrcKey = 0;
+    recordingMacro = false;
+    nextState = 0;
+    // Default transition
+    state = NORMAL;
+  }
+
+  // One sample of the chart
+  void step() {
+    if (options & CHART_FRESH_COUNT) {
+      countPressedKeys();
+    }
+
+    uint8_t count;
+    const Transition *rows = transitions(count);
+    for (uint8_t i = 0; i < count; i++) {
+      const Transition &t = rows[i];
+      if (t.from != state || !guard(t.guard)) {
+        continue;
+      }
+      uint8_t to = t.to;
+      if (state == WAITING) {
+        // Through the junction; no valid path backtracks
+        to = junctionTarget(nextState);
+        if (to == 0xFF) continue;
+      }
+      if (t.action == ACTION_SAVE_SOURCE) {
+        programSrcKey = getKeycode();
+      } else if (t.action == ACTION_STOP_MACRO) {
+        recordingMacro = false;
+      }
+      if (t.nextState != 0xFF) {
+        nextState = t.nextState;
+      }
+      enter(to);
+      return;
+    }
+    during();
+  }
+
+ private:
+  bool guard(uint8_t g) const {
+    switch (g) {
+      case GUARD_PROGRAM_AND_MACRO:
+        return specialKeys[CHART_KEY_PROGRAM] && specialKeys[CHART_KEY_MACRO];
+      case GUARD_PROGRAM_NOT_MACRO:
+        return specialKeys[CHART_KEY_PROGRAM] && !specialKeys[CHART_KEY_MACRO];
+      case GUARD_NO_KEYS:
+        return pressedKeyCount == 0;
+      case GUARD_ONE_KEY:
+        return pressedKeyCount == 1;
+      case GUARD_SOME_KEYS:
+        return pressedKeyCount > 0;
+      case GUARD_PROGRAM_AND_FN:
+        if (options & CHART_PROGRAM_EXIT) {
+          return specialKeys[CHART_KEY_PROGRAM] && pressedKeyCount >= 2;
+        }
+        return specialKeys[CHART_KEY_PROGRAM] && specialKeys[CHART_KEY_LAYER];
+    }
+    return false;
+  }
+
+  void enter(uint8_t to) {
+    if ((options & CHART_PROGRAM_EXIT) && to == NORMAL &&
+        (state == PROGRAMMING_SRC || state == PROGRAMMING_DST)) {
+      // The firmware waits for the keys to come up first
+      nextState = NORMAL;
+      to = WAITING;
+    }
+    state = to;
+    if (state == MACRO_RECORD && !recordingMacro) {
+      // Entry action
+      recordingMacro = true;
+    }
+  }
+
+  void during() {
+    if (state == NORMAL && !(options & CHART_LAYER_INPUT)) {
+      currentLayer = calculateActiveLayer();
+    }
+    if (state != MACRO_PLAY && !(options & CHART_FRESH_COUNT)) {
+      countPressedKeys();
+    }
+    // MACRO_PLAY: playNextMacroKey() is a placeholder that is never done
+  }
+
+  void countPressedKeys() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < 24; i++) {
+      count += keyMatrix[i];
+      count += otherHalfKeys[i];
+    }
+    pressedKeyCount = count;
+  }
+
+  uint8_t calculateActiveLayer() const {
+    if (specialKeys[CHART_KEY_LAYER]) {
+      return currentLayer == 0 ? 1 : 0;
+    }
+    return currentLayer;
+  }
+
+  // First pressed key, this half first
+  uint8_t getKeycode() const {
+    for (uint8_t i = 0; i < 24; i++) {
+      if (keyMatrix[i]) return keymapCode(currentLayer, i);
+    }
+    for (uint8_t i = 0; i < 24; i++) {
+      if (otherHalfKeys[i]) return keymapCode(currentLayer, i + 24);
+    }
+    return 0;
+  }
+
+  static uint8_t placeholderKeymapCode(uint8_t layer, uint8_t index) {
+    // a-z 0-9 / F1-F12 1-9 / numpad 0-9 . /
+    if (layer == 0) return index < 26 ? 97 + index : index < 36 ? 48 + index - 26 : 0;
+    if (layer == 1) return index < 12 ? 112 + index : index < 21 ? 49 + index - 12 : 0;
+    return index < 10 ? 96 + index : index == 10 ? 110 : index == 11 ? 111 : 0;
+  }
+};
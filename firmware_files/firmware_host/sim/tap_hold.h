@@ -0,0 +1,179 @@
+// Model of QMK's tap-hold decision for mod-tap keys, for host benchmarks
+// (firmware_host/bench/tap_hold_bench). Feed it debounced press/release
+// events; it emits them again in the order and at the time QMK would send
+// them, with every mod-tap press marked as tap or hold.
+//
+// A mod-tap press stays undecided, and every key event after it is held
+// back, until one of:
+//   - the mod-tap is released                          -> tap
+//   - its term runs out                                -> hold
+//   - flow tap: it was pressed within flowTerm of a typing key press
+//     (FLOW_TAP_TERM)                                  -> tap, on the spot
+//   - chordal hold (CHORDAL_HOLD), another key is pressed:
+//       same hand, not a mod-tap                       -> tap
+//       same hand, a mod-tap                           -> wait (mod chords)
+//       other hand, HOLD_ON_OTHER_KEY_PRESS            -> hold
+//       other hand, PERMISSIVE_HOLD                    -> hold once that key
+//                                                         is released first
+// With none of the options this is QMK's default: only release or term
+// decide (TAPPING_TERM). Held-back events are replayed through the same
+// rules once the mod-tap is settled, so a second mod-tap behind the first
+// gets its own decision.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+struct TapHoldKey {
+  uint16_t term = 0;     // 0: not a mod-tap
+  uint16_t flowTerm = 0; // tap at once when pressed this soon after a typing key, 0 = never
+  char hand = '*';       // 'L', 'R', '*' for either
+  bool typing = false;   // counts as a typing key for flow tap
+};
+
+struct TapHoldEvent {
+  uint8_t pos;
+  bool pressed;
+  bool hold;       // press or release of a mod-tap settled as hold
+  uint32_t timeMs; // when QMK would send it
+};
+
+struct TapHoldModel {
+  enum Cross { CROSS_NONE, CROSS_HOLD_ON_PRESS, CROSS_PERMISSIVE };
+
+  std::vector<TapHoldKey> keys; // per matrix position
+  bool chordal = false;
+  bool flow = false;
+  Cross cross = CROSS_NONE;
+
+  std::vector<TapHoldEvent> out; // resolved events, appended in send order
+
+  explicit TapHoldModel(const std::vector<TapHoldKey> &k) : keys(k), heldAsHold(k.size(), false) {}
+
+  void press(uint8_t pos, uint32_t timeMs) {
+    task(timeMs);
+    nowMs = timeMs;
+    pressAt(pos, timeMs);
+  }
+
+  void release(uint8_t pos, uint32_t timeMs) {
+    task(timeMs);
+    nowMs = timeMs;
+    releaseAt(pos, timeMs);
+  }
+
+  // Settle a mod-tap whose term ran out by timeMs
+  void task(uint32_t timeMs) {
+    while (pending && timeMs - pendingStart >= keys[pendingPos].term) {
+      uint32_t due = pendingStart + keys[pendingPos].term;
+      if (due > nowMs) {
+        nowMs = due;
+      }
+      settle(true);
+    }
+  }
+
+  bool undecided() const { return pending; }
+
+ private:
+  struct Held {
+    uint8_t pos;
+    bool pressed;
+    uint32_t timeMs;
+  };
+
+  bool pending = false;
+  uint8_t pendingPos = 0;
+  uint32_t pendingStart = 0;
+  std::vector<Held> buffer;
+  std::vector<bool> heldAsHold;
+  uint32_t nowMs = 0;
+  bool havePrev = false;
+  uint32_t prevPressMs = 0;
+  bool prevTyping = false;
+
+  void emit(uint8_t pos, bool pressed, bool hold) { out.push_back(TapHoldEvent{pos, pressed, hold, nowMs}); }
+
+  bool sameHand(uint8_t a, uint8_t b) const { return keys[a].hand == keys[b].hand && keys[a].hand != '*'; }
+
+  void pressAt(uint8_t pos, uint32_t timeMs) {
+    const TapHoldKey &k = keys[pos];
+    if (pending) {
+      bool same = sameHand(pendingPos, pos);
+      if (chordal && same && !k.term) {
+        settle(false);
+        pressAt(pos, timeMs);
+        return;
+      }
+      if (chordal && !same && cross == CROSS_HOLD_ON_PRESS) {
+        settle(true);
+        pressAt(pos, timeMs);
+        return;
+      }
+      buffer.push_back(Held{pos, true, timeMs});
+      return;
+    }
+
+    bool flowTap = flow && k.term && k.flowTerm && havePrev && prevTyping && timeMs - prevPressMs < k.flowTerm;
+    havePrev = true;
+    prevPressMs = timeMs;
+    prevTyping = k.typing;
+    if (k.term && !flowTap) {
+      pending = true;
+      pendingPos = pos;
+      pendingStart = timeMs;
+      return;
+    }
+    emit(pos, true, false);
+  }
+
+  void releaseAt(uint8_t pos, uint32_t timeMs) {
+    if (pending) {
+      if (pos == pendingPos) {
+        settle(false);
+        releaseAt(pos, timeMs);
+        return;
+      }
+      bool pressedWhilePending = false;
+      for (const Held &h : buffer) {
+        pressedWhilePending |= h.pressed && h.pos == pos;
+      }
+      if (!pressedWhilePending) {
+        emit(pos, false, heldAsHold[pos]);
+        heldAsHold[pos] = false;
+        return;
+      }
+      if (chordal && cross == CROSS_PERMISSIVE && !sameHand(pendingPos, pos)) {
+        settle(true);
+        releaseAt(pos, timeMs);
+        return;
+      }
+      buffer.push_back(Held{pos, false, timeMs});
+      return;
+    }
+    emit(pos, false, heldAsHold[pos]);
+    heldAsHold[pos] = false;
+  }
+
+  // Send the undecided mod-tap, then replay what was held back behind it
+  void settle(bool hold) {
+    pending = false;
+    emit(pendingPos, true, hold);
+    heldAsHold[pendingPos] = hold;
+    if (hold) {
+      prevTyping = false;
+    }
+    std::vector<Held> replay;
+    replay.swap(buffer);
+    for (const Held &h : replay) {
+      task(h.timeMs);
+      if (h.pressed) {
+        pressAt(h.pos, h.timeMs);
+      } else {
+        releaseAt(h.pos, h.timeMs);
+      }
+    }
+  }
+};
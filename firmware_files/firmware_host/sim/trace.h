@@ -0,0 +1,261 @@
+// Typing-session traces: raw matrix samples of both halves with microsecond
+// timestamps, as produced by firmware_host/tools/trace_tool (synthetic
+// corpora, or converted from a QMK telemetry capture) and consumed by
+// firmware_host/bench/trace_replay.
+//
+// File layout, all integers little endian:
+//   header, TRACE_HEADER_SIZE bytes
+//     [0..3]   "NFTR"
+//     [4]      format version (TRACE_VERSION)
+//     [5]      matrix rows (<= TRACE_MAX_ROWS)
+//     [6]      matrix cols (<= TRACE_MAX_COLS)
+//     [7]      reserved, 0
+//     [8..11]  sample count
+//     [12..15] trace length in microseconds
+//     [16..19] intended key presses, 0 if unknown (captured traces)
+//   samples, one per instant at which the raw matrix changed
+//     varint   microseconds since the previous sample (LEB128)
+//     u8       bitmask of the rows that changed
+//     u16      per changed row, lowest row first: XOR with the previous row value
+//
+// The matrix starts all released. A quiet stretch costs nothing, a sample
+// touching one row is 4-5 bytes.
+//
+// Optional section after the samples (older readers stop before it):
+//   "HOLD", u32 count, then per press the generator meant as a modifier or
+//   layer hold: varint microseconds since the previous entry, u8 row, u8 col.
+//   Only generated traces have it; benches use it as ground truth for
+//   tap-hold decisions.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#define TRACE_MAGIC "NFTR"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 20
+#define TRACE_MAX_ROWS 8
+#define TRACE_MAX_COLS 16
+#define TRACE_HOLD_TAG "HOLD"
+
+struct TraceSample {
+  uint32_t timeUs;
+  uint16_t rows[TRACE_MAX_ROWS]; // full matrix after this sample
+};
+
+// A press that was meant as a hold, timed at its first raw edge
+struct TraceHold {
+  uint32_t timeUs;
+  uint8_t row;
+  uint8_t col;
+};
+
+struct Trace {
+  uint8_t rows = 0;
+  uint8_t cols = 0;
+  uint32_t durationUs = 0;
+  uint32_t intendedPresses = 0;
+  std::vector<TraceSample> samples;
+  std::vector<TraceHold> holds; // in time order
+
+  // Append the matrix state at timeUs; identical states are dropped
+  void add(uint32_t timeUs, const uint16_t *matrix) {
+    const uint16_t *last = samples.empty() ? nullptr : samples.back().rows;
+    if (last && memcmp(last, matrix, sizeof(uint16_t) * rows) == 0) {
+      return;
+    }
+    if (!samples.empty() && samples.back().timeUs == timeUs) {
+      memcpy(samples.back().rows, matrix, sizeof(uint16_t) * rows);
+      return;
+    }
+    TraceSample s = {};
+    s.timeUs = timeUs;
+    memcpy(s.rows, matrix, sizeof(uint16_t) * rows);
+    samples.push_back(s);
+    if (timeUs > durationUs) {
+      durationUs = timeUs;
+    }
+  }
+
+  bool save(const std::string &path) const {
+    std::vector<uint8_t> out(TRACE_HEADER_SIZE, 0);
+    memcpy(out.data(), TRACE_MAGIC, 4);
+    out[4] = TRACE_VERSION;
+    out[5] = rows;
+    out[6] = cols;
+    put32(&out[8], (uint32_t)samples.size());
+    put32(&out[12], durationUs);
+    put32(&out[16], intendedPresses);
+
+    uint16_t prev[TRACE_MAX_ROWS] = {0};
+    uint32_t prevTime = 0;
+    for (const TraceSample &s : samples) {
+      putVarint(out, s.timeUs - prevTime);
+
+      uint8_t changed = 0;
+      for (uint8_t row = 0; row < rows; row++) {
+        if (s.rows[row] != prev[row]) {
+          changed |= 1 << row;
+        }
+      }
+      out.push_back(changed);
+      for (uint8_t row = 0; row < rows; row++) {
+        if (changed & (1 << row)) {
+          uint16_t x = s.rows[row] ^ prev[row];
+          out.push_back(x & 0xFF);
+          out.push_back(x >> 8);
+        }
+      }
+      memcpy(prev, s.rows, sizeof(prev));
+      prevTime = s.timeUs;
+    }
+
+    if (!holds.empty()) {
+      out.insert(out.end(), TRACE_HOLD_TAG, TRACE_HOLD_TAG + 4);
+      out.resize(out.size() + 4);
+      put32(&out[out.size() - 4], (uint32_t)holds.size());
+      prevTime = 0;
+      for (const TraceHold &h : holds) {
+        putVarint(out, h.timeUs - prevTime);
+        out.push_back(h.row);
+        out.push_back(h.col);
+        prevTime = h.timeUs;
+      }
+    }
+
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+      return false;
+    }
+    bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+    return fclose(f) == 0 && ok;
+  }
+
+  // Returns an error message, empty on success
+  std::string load(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+      return "cannot open " + path;
+    }
+    std::vector<uint8_t> in;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      in.insert(in.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    if (in.size() < TRACE_HEADER_SIZE || memcmp(in.data(), TRACE_MAGIC, 4) != 0) {
+      return path + ": not a trace file";
+    }
+    if (in[4] != TRACE_VERSION) {
+      return path + ": unsupported trace version " + std::to_string(in[4]);
+    }
+    rows = in[5];
+    cols = in[6];
+    if (rows > TRACE_MAX_ROWS || cols > TRACE_MAX_COLS) {
+      return path + ": matrix too large";
+    }
+    uint32_t count = get32(&in[8]);
+    durationUs = get32(&in[12]);
+    intendedPresses = get32(&in[16]);
+
+    samples.clear();
+    samples.reserve(count);
+    size_t pos = TRACE_HEADER_SIZE;
+    TraceSample s = {};
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t delta;
+      if (!getVarint(in, pos, delta) || pos >= in.size()) {
+        return path + ": truncated sample " + std::to_string(i);
+      }
+      uint8_t changed = in[pos++];
+      for (uint8_t row = 0; row < rows; row++) {
+        if (changed & (1 << row)) {
+          if (pos + 2 > in.size()) {
+            return path + ": truncated sample " + std::to_string(i);
+          }
+          s.rows[row] ^= in[pos] | (in[pos + 1] << 8);
+          pos += 2;
+        }
+      }
+      s.timeUs += delta;
+      samples.push_back(s);
+    }
+
+    holds.clear();
+    if (pos + 8 <= in.size() && memcmp(&in[pos], TRACE_HOLD_TAG, 4) == 0) {
+      uint32_t holdCount = get32(&in[pos + 4]);
+      pos += 8;
+      uint32_t timeUs = 0;
+      for (uint32_t i = 0; i < holdCount; i++) {
+        uint32_t delta;
+        if (!getVarint(in, pos, delta) || pos + 2 > in.size()) {
+          return path + ": truncated hold " + std::to_string(i);
+        }
+        timeUs += delta;
+        holds.push_back(TraceHold{timeUs, in[pos], in[pos + 1]});
+        pos += 2;
+      }
+    }
+    return "";
+  }
+
+ private:
+  static void putVarint(std::vector<uint8_t> &out, uint32_t v) {
+    do {
+      out.push_back((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+      v >>= 7;
+    } while (v);
+  }
+  static bool getVarint(const std::vector<uint8_t> &in, size_t &pos, uint32_t &v) {
+    v = 0;
+    for (int shift = 0; shift <= 28; shift += 7) {
+      if (pos >= in.size()) {
+        return false;
+      }
+      uint8_t b = in[pos++];
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  static void put32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+  }
+  static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+};
+
+// Steps through a trace in time order, for replay drivers
+struct TraceCursor {
+  const Trace &trace;
+  size_t next = 0;
+  uint16_t rows[TRACE_MAX_ROWS] = {0};
+
+  explicit TraceCursor(const Trace &t) : trace(t) {}
+
+  // Apply every sample up to and including timeUs, true if the matrix changed
+  bool advance(uint32_t timeUs) {
+    bool changed = false;
+    while (next < trace.samples.size() && trace.samples[next].timeUs <= timeUs) {
+      memcpy(rows, trace.samples[next].rows, sizeof(rows));
+      next++;
+      changed = true;
+    }
+    return changed;
+  }
+
+  bool done() const { return next >= trace.samples.size(); }
+};
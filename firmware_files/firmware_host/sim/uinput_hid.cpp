@@ -0,0 +1,203 @@
+// uinput device and evdev reader behind sim/uinput_hid.h. Link this file
+// into host builds that use it.
+
+#include "uinput_hid.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+// drivers/hid/hid-input.c hid_keyboard[], usage page 0x07 -> KEY_*
+static const uint8_t hidKeyboard[256] = {
+    0,   0,   0,   0,   30,  48,  46,  32,  18,  33,  34,  35,  23,  36,  37,  38,
+    50,  49,  24,  25,  16,  19,  31,  20,  22,  47,  17,  45,  21,  44,  2,   3,
+    4,   5,   6,   7,   8,   9,   10,  11,  28,  1,   14,  15,  57,  12,  13,  26,
+    27,  43,  43,  39,  40,  41,  51,  52,  53,  58,  59,  60,  61,  62,  63,  64,
+    65,  66,  67,  68,  87,  88,  99,  70,  119, 110, 102, 104, 111, 107, 109, 106,
+    105, 108, 103, 69,  98,  55,  74,  78,  96,  79,  80,  81,  75,  76,  77,  71,
+    72,  73,  82,  83,  86,  127, 116, 117, 183, 184, 185, 186, 187, 188, 189, 190,
+    191, 192, 193, 194, 134, 138, 130, 132, 128, 129, 131, 137, 133, 135, 136, 113,
+    115, 114, 0,   0,   0,   121, 0,   89,  93,  124, 92,  94,  95,  0,   0,   0,
+    122, 123, 90,  91,  85,  0,   0,   0,   0,   0,   0,   0,   111, 0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   179, 180, 0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   111, 0,   0,   0,   0,   0,   0,   0,
+    29,  42,  56,  125, 97,  54,  100, 126, 164, 166, 165, 163, 161, 115, 114, 113,
+    150, 158, 159, 128, 136, 177, 178, 176, 142, 152, 173, 140, 0,   0,   0,   0,
+};
+
+uint16_t hidUsageToEvdev(uint8_t usage) { return hidKeyboard[usage]; }
+
+uint64_t monotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static bool hasUsage(const uint8_t report[8], uint8_t usage) {
+  return memchr(report + 2, usage, 6) != nullptr;
+}
+
+size_t hidReportToEvents(const uint8_t prev[8], const uint8_t next[8], EvdevEvent *out) {
+  size_t n = 0;
+  // The modifier byte is a variable field: one key per bit
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    bool was = prev[0] >> bit & 1, is = next[0] >> bit & 1;
+    if (was != is) out[n++] = {0, EVDEV_EV_KEY, hidUsageToEvdev(0xE0 + bit), is};
+  }
+  // The key array: usages that left, then usages that came (hid_input_array_field)
+  for (uint8_t i = 2; i < 8; i++) {
+    if (prev[i] > 1 && !hasUsage(next, prev[i]) && hidUsageToEvdev(prev[i])) {
+      out[n++] = {0, EVDEV_EV_KEY, hidUsageToEvdev(prev[i]), 0};
+    }
+  }
+  for (uint8_t i = 2; i < 8; i++) {
+    if (next[i] > 1 && !hasUsage(prev, next[i]) && hidUsageToEvdev(next[i])) {
+      out[n++] = {0, EVDEV_EV_KEY, hidUsageToEvdev(next[i]), 1};
+    }
+  }
+  if (n) out[n++] = {0, EVDEV_EV_SYN, SYN_REPORT, 0};
+  return n;
+}
+
+// /dev/input/eventN of the uinput device, which udev or devtmpfs creates
+// shortly after UI_DEV_CREATE
+static int openEventNode(int uinputFd, char *error, size_t errorLen) {
+  char sysname[64];
+  if (ioctl(uinputFd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0) {
+    snprintf(error, errorLen, "UI_GET_SYSNAME: %s", strerror(errno));
+    return -1;
+  }
+  char dirPath[128];
+  snprintf(dirPath, sizeof(dirPath), "/sys/devices/virtual/input/%s", sysname);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    if (DIR *dir = opendir(dirPath)) {
+      char node[320] = "";
+      while (struct dirent *entry = readdir(dir)) {
+        if (!strncmp(entry->d_name, "event", 5)) snprintf(node, sizeof(node), "/dev/input/%s", entry->d_name);
+      }
+      closedir(dir);
+      int fd = node[0] ? ::open(node, O_RDONLY | O_NONBLOCK) : -1;
+      if (fd >= 0) return fd;
+    }
+    usleep(10000);
+  }
+  snprintf(error, errorLen, "no event node for %s", dirPath);
+  return -1;
+}
+
+bool UinputKeyboard::open(const char *name, char *error, size_t errorLen) {
+  close();
+  uinputFd = ::open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+  if (uinputFd < 0) {
+    snprintf(error, errorLen, "/dev/uinput: %s", strerror(errno));
+    return false;
+  }
+
+  bool ok = ioctl(uinputFd, UI_SET_EVBIT, EV_KEY) >= 0;
+  for (int usage = 0; usage < 256 && ok; usage++) {
+    if (hidKeyboard[usage]) ok = ioctl(uinputFd, UI_SET_KEYBIT, hidKeyboard[usage]) >= 0;
+  }
+  struct uinput_setup setup;
+  memset(&setup, 0, sizeof(setup));
+  setup.id.bustype = BUS_USB;
+  setup.id.vendor = 0x1209;  // pid.codes test range
+  setup.id.product = 0x0001;
+  snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "%s", name);
+  ok = ok && ioctl(uinputFd, UI_DEV_SETUP, &setup) >= 0 && ioctl(uinputFd, UI_DEV_CREATE) >= 0;
+  if (!ok) {
+    snprintf(error, errorLen, "uinput setup: %s", strerror(errno));
+    close();
+    return false;
+  }
+
+  eventFd = openEventNode(uinputFd, error, errorLen);
+  int clock = CLOCK_MONOTONIC;
+  if (eventFd < 0 || ioctl(eventFd, EVIOCSCLOCKID, &clock) < 0 || ioctl(eventFd, EVIOCGRAB, 1) < 0) {
+    if (eventFd >= 0) snprintf(error, errorLen, "event node: %s", strerror(errno));
+    close();
+    return false;
+  }
+  memset(lastReport, 0, sizeof(lastReport));
+  return true;
+}
+
+void UinputKeyboard::openLoopback() {
+  close();
+  loopbackMode = true;
+  memset(lastReport, 0, sizeof(lastReport));
+}
+
+void UinputKeyboard::close() {
+  if (eventFd >= 0) ::close(eventFd);
+  if (uinputFd >= 0) {
+    ioctl(uinputFd, UI_DEV_DESTROY);
+    ::close(uinputFd);
+  }
+  eventFd = uinputFd = -1;
+  loopbackMode = false;
+  queueHead = queueTail = 0;
+}
+
+int UinputKeyboard::send(const uint8_t report[8]) {
+  EvdevEvent events[8 + 12 + 1];
+  size_t n = hidReportToEvents(lastReport, report, events);
+  memcpy(lastReport, report, sizeof(lastReport));
+
+  if (loopbackMode) {
+    uint64_t now = monotonicNs();
+    for (size_t i = 0; i < n && queueTail - queueHead < queueSize; i++) {
+      events[i].timeNs = now;
+      queue[queueTail++ % queueSize] = events[i];
+    }
+    return (int)n;
+  }
+
+  // The kernel stamps the events as it takes them from this write
+  struct input_event raw[8 + 12 + 1];
+  memset(raw, 0, sizeof(raw));
+  for (size_t i = 0; i < n; i++) {
+    raw[i].type = events[i].type;
+    raw[i].code = events[i].code;
+    raw[i].value = events[i].value;
+  }
+  size_t bytes = n * sizeof(raw[0]);
+  if (n && write(uinputFd, raw, bytes) != (ssize_t)bytes) return -1;
+  return (int)n;
+}
+
+bool UinputKeyboard::readEvent(EvdevEvent &event, uint32_t timeoutUs) {
+  if (loopbackMode) {
+    if (queueHead == queueTail) return false;
+    event = queue[queueHead++ % queueSize];
+    return true;
+  }
+  if (eventFd < 0) return false;
+
+  uint64_t deadline = monotonicNs() + (uint64_t)timeoutUs * 1000;
+  for (;;) {
+    struct input_event raw;
+    if (read(eventFd, &raw, sizeof(raw)) == (ssize_t)sizeof(raw)) {
+      if (raw.type != EV_KEY && raw.type != EV_SYN) continue;  // EV_MSC and autorepeat are not ours
+      if (raw.type == EV_KEY && raw.value == 2) continue;
+      event.timeNs = (uint64_t)raw.input_event_sec * 1000000000ull + (uint64_t)raw.input_event_usec * 1000;
+      event.type = raw.type;
+      event.code = raw.code;
+      event.value = raw.value;
+      return true;
+    }
+    uint64_t now = monotonicNs();
+    if (now >= deadline) return false;
+    struct pollfd pfd = {eventFd, POLLIN, 0};
+    poll(&pfd, 1, (int)((deadline - now + 999999) / 1000000));
+  }
+}
@@ -0,0 +1,70 @@
+// Linux uinput backend for the simulated keyboards' HID reports
+//
+// send() takes the 8-byte boot keyboard report the firmware would put on
+// USB (modifier bits, reserved, six usages) and turns it into the evdev
+// events the kernel's hid-input makes of it: modifier bits in order, then
+// released usages, then pressed ones, then SYN_REPORT. Written to a uinput
+// device, the events come back on the device's /dev/input/eventN node with
+// the kernel's CLOCK_MONOTONIC timestamps, so a test can see what the OS
+// got and when. The node is grabbed right after it appears, before any
+// event is written: the keys reach this reader only, not the desktop.
+//
+// Without /dev/uinput (containers, no permission) openLoopback() feeds the
+// same events back in process, stamped at send(), so everything up to the
+// kernel can still be checked.
+//
+// Implemented in uinput_hid.cpp; this header stays free of <linux/input.h>,
+// whose KEY_* macros would clash with the HID-Project names in
+// arduino_compat.h.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVDEV_EV_SYN 0x00
+#define EVDEV_EV_KEY 0x01
+
+struct EvdevEvent {
+  uint64_t timeNs;  // CLOCK_MONOTONIC
+  uint16_t type;    // EVDEV_EV_SYN or EVDEV_EV_KEY
+  uint16_t code;    // evdev KEY_* code
+  int32_t value;    // 1 down, 0 up
+};
+
+// evdev code for a HID keyboard usage (the kernel's hid_keyboard[] table), 0 if unmapped
+uint16_t hidUsageToEvdev(uint8_t usage);
+
+// The events hid-input generates going from report prev to next, SYN_REPORT
+// last; out needs room for 8 + 12 + 1. Returns the count, 0 when nothing changed.
+size_t hidReportToEvents(const uint8_t prev[8], const uint8_t next[8], EvdevEvent *out);
+
+uint64_t monotonicNs();
+
+class UinputKeyboard {
+ public:
+  ~UinputKeyboard() { close(); }
+
+  // Creates the virtual keyboard and opens and grabs its event node;
+  // false with the reason in error when that isn't possible
+  bool open(const char *name, char *error, size_t errorLen);
+  void openLoopback();
+  void close();
+  bool loopback() const { return loopbackMode; }
+
+  // One report; the number of events it made, -1 when the write failed
+  int send(const uint8_t report[8]);
+
+  // Next event the OS delivered, waiting up to timeoutUs; false when none came
+  bool readEvent(EvdevEvent &event, uint32_t timeoutUs);
+
+ private:
+  int uinputFd = -1;
+  int eventFd = -1;
+  bool loopbackMode = false;
+  uint8_t lastReport[8] = {0};
+
+  static const size_t queueSize = 256;
+  EvdevEvent queue[queueSize];
+  size_t queueHead = 0, queueTail = 0;
+};
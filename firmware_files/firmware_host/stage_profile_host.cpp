@@ -0,0 +1,12 @@
+// std::chrono time source for firmware_common/stage_profile.h in host builds.
+// Compile the instrumented sources with -DSTAGE_PROFILE_ENABLE -DSTAGE_PROFILE_HOST
+// and link this file.
+
+#include <chrono>
+#include <cstdint>
+
+extern "C" uint32_t stage_profile_host_now(void) {
+  using namespace std::chrono;
+  static const steady_clock::time_point epoch = steady_clock::now();
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now() - epoch).count();
+}
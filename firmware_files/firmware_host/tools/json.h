@@ -0,0 +1,388 @@
+// Minimal JSON reader/writer for the host tools (keyboard.json, keymap.json).
+// Parses the whole document into a tree; errors throw JsonError with the
+// line number. Object member order is preserved so files can be written
+// back without reshuffling them.
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct JsonError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+class Json {
+ public:
+  enum Type { Null, Bool, Number, String, Array, Object };
+
+  Json() = default;
+  explicit Json(bool b) : type_(Bool), bool_(b) {}
+  explicit Json(double n) : type_(Number), number_(n) {}
+  explicit Json(std::string s) : type_(String), string_(std::move(s)) {}
+  static Json array() {
+    Json j;
+    j.type_ = Array;
+    return j;
+  }
+  static Json object() {
+    Json j;
+    j.type_ = Object;
+    return j;
+  }
+
+  Type type() const { return type_; }
+  bool isNull() const { return type_ == Null; }
+  bool isArray() const { return type_ == Array; }
+  bool isObject() const { return type_ == Object; }
+  bool isString() const { return type_ == String; }
+  bool isNumber() const { return type_ == Number; }
+
+  bool asBool() const {
+    expect(Bool, "boolean");
+    return bool_;
+  }
+  double asNumber() const {
+    expect(Number, "number");
+    return number_;
+  }
+  int asInt() const { return (int)asNumber(); }
+  const std::string &asString() const {
+    expect(String, "string");
+    return string_;
+  }
+
+  size_t size() const { return type_ == Array ? items_.size() : type_ == Object ? members_.size() : 0; }
+  const Json &operator[](size_t i) const {
+    expect(Array, "array");
+    if (i >= items_.size()) {
+      throw JsonError("array index out of range");
+    }
+    return items_[i];
+  }
+  const std::vector<Json> &items() const {
+    expect(Array, "array");
+    return items_;
+  }
+  const std::vector<std::pair<std::string, Json>> &members() const {
+    expect(Object, "object");
+    return members_;
+  }
+
+  // Object member or nullptr
+  const Json *find(const std::string &key) const {
+    if (type_ != Object) {
+      return nullptr;
+    }
+    for (const auto &m : members_) {
+      if (m.first == key) {
+        return &m.second;
+      }
+    }
+    return nullptr;
+  }
+  const Json &at(const std::string &key) const {
+    const Json *j = find(key);
+    if (!j) {
+      throw JsonError("missing key \"" + key + "\"");
+    }
+    return *j;
+  }
+
+  void push(Json j) {
+    expect(Array, "array");
+    items_.push_back(std::move(j));
+  }
+  void set(const std::string &key, Json j) {
+    expect(Object, "object");
+    for (auto &m : members_) {
+      if (m.first == key) {
+        m.second = std::move(j);
+        return;
+      }
+    }
+    members_.emplace_back(key, std::move(j));
+  }
+
+  static Json parse(const std::string &text) {
+    Parser p{text, 0};
+    Json j = p.value();
+    p.skipSpace();
+    if (p.pos != text.size()) {
+      p.fail("trailing characters");
+    }
+    return j;
+  }
+
+  static Json parseFile(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+      throw JsonError("cannot open " + path);
+    }
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      text.append(buf, n);
+    }
+    fclose(f);
+    try {
+      return parse(text);
+    } catch (const JsonError &e) {
+      throw JsonError(path + ": " + e.what());
+    }
+  }
+
+  // Pretty print with two space indent; arrays of scalars stay on one line
+  // per element like the QMK configurator exports.
+  std::string dump(int indent = 0) const {
+    std::string out;
+    write(out, indent);
+    return out;
+  }
+
+ private:
+  struct Parser {
+    const std::string &s;
+    size_t pos;
+
+    [[noreturn]] void fail(const char *what) const {
+      size_t line = 1;
+      for (size_t i = 0; i < pos && i < s.size(); i++) {
+        line += s[i] == '\n';
+      }
+      throw JsonError(std::string(what) + " at line " + std::to_string(line));
+    }
+
+    void skipSpace() {
+      while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+        pos++;
+      }
+    }
+
+    bool consume(const char *word) {
+      size_t len = strlen(word);
+      if (s.compare(pos, len, word) == 0) {
+        pos += len;
+        return true;
+      }
+      return false;
+    }
+
+    Json value() {
+      skipSpace();
+      if (pos >= s.size()) {
+        fail("unexpected end of input");
+      }
+      char c = s[pos];
+      if (c == '{') {
+        return object();
+      }
+      if (c == '[') {
+        return array();
+      }
+      if (c == '"') {
+        return Json(string());
+      }
+      if (consume("true")) {
+        return Json(true);
+      }
+      if (consume("false")) {
+        return Json(false);
+      }
+      if (consume("null")) {
+        return Json();
+      }
+      if (c == '-' || (c >= '0' && c <= '9')) {
+        const char *start = s.c_str() + pos;
+        char *end;
+        double n = strtod(start, &end);
+        pos += end - start;
+        return Json(n);
+      }
+      fail("unexpected character");
+    }
+
+    Json object() {
+      Json j = Json::object();
+      pos++;
+      skipSpace();
+      if (pos < s.size() && s[pos] == '}') {
+        pos++;
+        return j;
+      }
+      while (true) {
+        skipSpace();
+        if (pos >= s.size() || s[pos] != '"') {
+          fail("expected object key");
+        }
+        std::string key = string();
+        skipSpace();
+        if (pos >= s.size() || s[pos] != ':') {
+          fail("expected ':'");
+        }
+        pos++;
+        j.members_.emplace_back(std::move(key), value());
+        skipSpace();
+        if (pos < s.size() && s[pos] == ',') {
+          pos++;
+          continue;
+        }
+        if (pos < s.size() && s[pos] == '}') {
+          pos++;
+          return j;
+        }
+        fail("expected ',' or '}'");
+      }
+    }
+
+    Json array() {
+      Json j = Json::array();
+      pos++;
+      skipSpace();
+      if (pos < s.size() && s[pos] == ']') {
+        pos++;
+        return j;
+      }
+      while (true) {
+        j.items_.push_back(value());
+        skipSpace();
+        if (pos < s.size() && s[pos] == ',') {
+          pos++;
+          continue;
+        }
+        if (pos < s.size() && s[pos] == ']') {
+          pos++;
+          return j;
+        }
+        fail("expected ',' or ']'");
+      }
+    }
+
+    std::string string() {
+      std::string out;
+      pos++;
+      while (pos < s.size() && s[pos] != '"') {
+        char c = s[pos++];
+        if (c != '\\') {
+          out += c;
+          continue;
+        }
+        if (pos >= s.size()) {
+          break;
+        }
+        char e = s[pos++];
+        switch (e) {
+          case 'n': out += '\n'; break;
+          case 't': out += '\t'; break;
+          case 'r': out += '\r'; break;
+          case 'b': out += '\b'; break;
+          case 'f': out += '\f'; break;
+          case 'u': {
+            // Keymaps are ASCII, keep anything else as UTF-8
+            unsigned code = (unsigned)strtoul(s.substr(pos, 4).c_str(), nullptr, 16);
+            pos += 4;
+            if (code < 0x80) {
+              out += (char)code;
+            } else if (code < 0x800) {
+              out += (char)(0xC0 | (code >> 6));
+              out += (char)(0x80 | (code & 0x3F));
+            } else {
+              out += (char)(0xE0 | (code >> 12));
+              out += (char)(0x80 | ((code >> 6) & 0x3F));
+              out += (char)(0x80 | (code & 0x3F));
+            }
+            break;
+          }
+          default: out += e; break;
+        }
+      }
+      if (pos >= s.size()) {
+        fail("unterminated string");
+      }
+      pos++;
+      return out;
+    }
+  };
+
+  void expect(Type t, const char *name) const {
+    if (type_ != t) {
+      throw JsonError(std::string("expected ") + name);
+    }
+  }
+
+  static void writeString(std::string &out, const std::string &s) {
+    out += '"';
+    for (char c : s) {
+      switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        case '\r': out += "\\r"; break;
+        default: out += c; break;
+      }
+    }
+    out += '"';
+  }
+
+  void write(std::string &out, int indent) const {
+    std::string pad(indent + 2, ' ');
+    switch (type_) {
+      case Null: out += "null"; break;
+      case Bool: out += bool_ ? "true" : "false"; break;
+      case Number: {
+        char buf[32];
+        if (number_ == (double)(long long)number_) {
+          snprintf(buf, sizeof(buf), "%lld", (long long)number_);
+        } else {
+          snprintf(buf, sizeof(buf), "%.17g", number_);
+        }
+        out += buf;
+        break;
+      }
+      case String: writeString(out, string_); break;
+      case Array:
+        if (items_.empty()) {
+          out += "[]";
+          break;
+        }
+        out += "[\n";
+        for (size_t i = 0; i < items_.size(); i++) {
+          out += pad;
+          items_[i].write(out, indent + 2);
+          out += i + 1 < items_.size() ? ",\n" : "\n";
+        }
+        out += std::string(indent, ' ') + "]";
+        break;
+      case Object:
+        if (members_.empty()) {
+          out += "{}";
+          break;
+        }
+        out += "{\n";
+        for (size_t i = 0; i < members_.size(); i++) {
+          out += pad;
+          writeString(out, members_[i].first);
+          out += ": ";
+          members_[i].second.write(out, indent + 2);
+          out += i + 1 < members_.size() ? ",\n" : "\n";
+        }
+        out += std::string(indent, ' ') + "}";
+        break;
+    }
+  }
+
+  Type type_ = Null;
+  bool bool_ = false;
+  double number_ = 0;
+  std::string string_;
+  std::vector<Json> items_;
+  std::vector<std::pair<std::string, Json>> members_;
+};
@@ -0,0 +1,1116 @@
+// Keymap/layout compiler: turns a keyboard.json + keymap.json pair into
+// static tables for the firmware, so positions, keycodes and ghost masks are
+// resolved at build time instead of by scanning the keymap at run time.
+//
+//   keymap_compiler --target handwritten|qmk [--strict] <keyboard.json> <keymap.json> -o <keymap_tables.h>
+//   keymap_compiler --target handwritten [--strict] <keyboard.json> <keymap.json> --sync /dev/hidrawN
+//
+// Emitted tables:
+//   - matrix position -> layout index
+//   - keycodes per layer, indexed by matrix position (handwritten target:
+//     sparse, a presence bitmap per layer and the keycodes it sets packed,
+//     see firmware_handwritten/keymap_layers.h)
+//   - per-layer masks of special keys (qmk target: layer keys, media keys,
+//     empty positions; the handwritten core derives its own through the
+//     layer stack)
+//   - ghost topology: the keys on every physical row and column wire
+//   - combos (handwritten target): optional "combos" array in keymap.json,
+//     {"keys": [layout indices], "action": "KC_..."}, emitted as matrix
+//     bitmasks for firmware_common/combo.h
+//   - macros (handwritten target): QMK's "macros" array, text only (a
+//     string, or an array of strings typed one after the other), typed by
+//     QK_MACRO_n as NUL separated strings
+//
+// --sync puts the keymap on a running RP2040 build over raw HID instead of
+// (or as well as) writing the tables: the live keymap image
+// (firmware_handwritten/keymap_live.h) is built from the same keycodes and
+// macros, with the settings the board has unless keymap.json sets them
+// ("config": {"combo": {"term": ms}}), uploaded in chunks when its CRC
+// differs from the board's and checked against the board's CRC afterwards.
+//
+// Validation: unknown keycodes, layers of the wrong size, matrix positions
+// that are duplicated or out of range, layer keys pointing at missing
+// layers, combos with unknown or repeated keys (errors) and layers that
+// cannot be reached from layer 0 (warning, error with --strict).
+//
+// Targets:
+//   handwritten - C++ for firmware_handwritten: QMK names are translated to
+//                 HID-Project KEY_* codes (media and system keys without
+//                 one to the core's MEDIA_* and SYS_*), TG(1) is
+//                 CMD_LAYER_CHANGE and CMD_* names pass through. KC_TRNS
+//                 leaves the position out of its layer (on layer 0 it is
+//                 KC_NO). Masks are packed uint64_t over the matrix.
+//                 Up to 32 layers.
+//   qmk         - C for firmware_qmk: keycodes stay QMK names, masks are
+//                 matrix_row_t per row. Definitions are only emitted where
+//                 KEYMAP_TABLES_IMPLEMENTATION is defined.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/tools/keymap_compiler.cpp -o /tmp/keymap_compiler
+
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "../../firmware_handwritten/keymap_live.h"
+#include "json.h"
+
+enum KeyClass {
+  CLASS_NONE, CLASS_TRANSPARENT, CLASS_BASIC, CLASS_MODIFIER, CLASS_MEDIA, CLASS_LAYER, CLASS_COMMAND, CLASS_MACRO
+};
+
+// Handwritten firmware commands, in the order of their CMD_* values (0xF0..)
+static const char *const kCommands[] = {"CMD_LAYER_CHANGE", "CMD_MACRO_RECORD", "CMD_MACRO_PLAY", "CMD_PROGRAM_MODE"};
+#define COMMAND_COUNT 4
+
+// Macro keys of the handwritten firmware, MACRO(n) = 0xF8 + n (keyboard_core.h)
+#define MACRO_COUNT 8
+
+struct Translation {
+  const char *qmk;
+  const char *hid;
+  KeyClass cls;
+};
+
+// QMK keycode -> HID-Project KeyboardKeycode, for the names our keymaps use
+static const Translation kTranslations[] = {
+  {"KC_NO", "KEY_RESERVED", CLASS_NONE},
+  {"XXXXXXX", "KEY_RESERVED", CLASS_NONE},
+  {"KC_A", "KEY_A", CLASS_BASIC}, {"KC_B", "KEY_B", CLASS_BASIC}, {"KC_C", "KEY_C", CLASS_BASIC},
+  {"KC_D", "KEY_D", CLASS_BASIC}, {"KC_E", "KEY_E", CLASS_BASIC}, {"KC_F", "KEY_F", CLASS_BASIC},
+  {"KC_G", "KEY_G", CLASS_BASIC}, {"KC_H", "KEY_H", CLASS_BASIC}, {"KC_I", "KEY_I", CLASS_BASIC},
+  {"KC_J", "KEY_J", CLASS_BASIC}, {"KC_K", "KEY_K", CLASS_BASIC}, {"KC_L", "KEY_L", CLASS_BASIC},
+  {"KC_M", "KEY_M", CLASS_BASIC}, {"KC_N", "KEY_N", CLASS_BASIC}, {"KC_O", "KEY_O", CLASS_BASIC},
+  {"KC_P", "KEY_P", CLASS_BASIC}, {"KC_Q", "KEY_Q", CLASS_BASIC}, {"KC_R", "KEY_R", CLASS_BASIC},
+  {"KC_S", "KEY_S", CLASS_BASIC}, {"KC_T", "KEY_T", CLASS_BASIC}, {"KC_U", "KEY_U", CLASS_BASIC},
+  {"KC_V", "KEY_V", CLASS_BASIC}, {"KC_W", "KEY_W", CLASS_BASIC}, {"KC_X", "KEY_X", CLASS_BASIC},
+  {"KC_Y", "KEY_Y", CLASS_BASIC}, {"KC_Z", "KEY_Z", CLASS_BASIC},
+  {"KC_1", "KEY_1", CLASS_BASIC}, {"KC_2", "KEY_2", CLASS_BASIC}, {"KC_3", "KEY_3", CLASS_BASIC},
+  {"KC_4", "KEY_4", CLASS_BASIC}, {"KC_5", "KEY_5", CLASS_BASIC}, {"KC_6", "KEY_6", CLASS_BASIC},
+  {"KC_7", "KEY_7", CLASS_BASIC}, {"KC_8", "KEY_8", CLASS_BASIC}, {"KC_9", "KEY_9", CLASS_BASIC},
+  {"KC_0", "KEY_0", CLASS_BASIC},
+  {"KC_ENT", "KEY_ENTER", CLASS_BASIC}, {"KC_ENTER", "KEY_ENTER", CLASS_BASIC},
+  {"KC_ESC", "KEY_ESC", CLASS_BASIC}, {"KC_ESCAPE", "KEY_ESC", CLASS_BASIC},
+  {"KC_BSPC", "KEY_BACKSPACE", CLASS_BASIC}, {"KC_TAB", "KEY_TAB", CLASS_BASIC},
+  {"KC_SPC", "KEY_SPACE", CLASS_BASIC}, {"KC_SPACE", "KEY_SPACE", CLASS_BASIC},
+  {"KC_MINS", "KEY_MINUS", CLASS_BASIC}, {"KC_EQL", "KEY_EQUAL", CLASS_BASIC},
+  {"KC_LBRC", "KEY_LEFT_BRACE", CLASS_BASIC}, {"KC_RBRC", "KEY_RIGHT_BRACE", CLASS_BASIC},
+  {"KC_BSLS", "KEY_BACKSLASH", CLASS_BASIC}, {"KC_SCLN", "KEY_SEMICOLON", CLASS_BASIC},
+  {"KC_QUOT", "KEY_QUOTE", CLASS_BASIC}, {"KC_GRV", "KEY_TILDE", CLASS_BASIC},
+  {"KC_COMM", "KEY_COMMA", CLASS_BASIC}, {"KC_DOT", "KEY_PERIOD", CLASS_BASIC},
+  {"KC_SLSH", "KEY_SLASH", CLASS_BASIC}, {"KC_CAPS", "KEY_CAPS_LOCK", CLASS_BASIC},
+  {"KC_F1", "KEY_F1", CLASS_BASIC}, {"KC_F2", "KEY_F2", CLASS_BASIC}, {"KC_F3", "KEY_F3", CLASS_BASIC},
+  {"KC_F4", "KEY_F4", CLASS_BASIC}, {"KC_F5", "KEY_F5", CLASS_BASIC}, {"KC_F6", "KEY_F6", CLASS_BASIC},
+  {"KC_F7", "KEY_F7", CLASS_BASIC}, {"KC_F8", "KEY_F8", CLASS_BASIC}, {"KC_F9", "KEY_F9", CLASS_BASIC},
+  {"KC_F10", "KEY_F10", CLASS_BASIC}, {"KC_F11", "KEY_F11", CLASS_BASIC}, {"KC_F12", "KEY_F12", CLASS_BASIC},
+  {"KC_PSCR", "KEY_PRINT_SCREEN", CLASS_BASIC}, {"KC_SCRL", "KEY_SCROLL_LOCK", CLASS_BASIC},
+  {"KC_PAUS", "KEY_PAUSE", CLASS_BASIC}, {"KC_INS", "KEY_INSERT", CLASS_BASIC},
+  {"KC_HOME", "KEY_HOME", CLASS_BASIC}, {"KC_PGUP", "KEY_PAGE_UP", CLASS_BASIC},
+  {"KC_DEL", "KEY_DELETE", CLASS_BASIC}, {"KC_END", "KEY_END", CLASS_BASIC},
+  {"KC_PGDN", "KEY_PAGE_DOWN", CLASS_BASIC},
+  {"KC_RGHT", "KEY_RIGHT_ARROW", CLASS_BASIC}, {"KC_LEFT", "KEY_LEFT_ARROW", CLASS_BASIC},
+  {"KC_DOWN", "KEY_DOWN_ARROW", CLASS_BASIC}, {"KC_UP", "KEY_UP_ARROW", CLASS_BASIC},
+  {"KC_NUM", "KEY_NUM_LOCK", CLASS_BASIC}, {"KC_PSLS", "KEY_KP_SLASH", CLASS_BASIC},
+  {"KC_PAST", "KEY_KP_ASTERISK", CLASS_BASIC}, {"KC_PMNS", "KEY_KP_MINUS", CLASS_BASIC},
+  {"KC_PPLS", "KEY_KP_PLUS", CLASS_BASIC}, {"KC_PENT", "KEY_KP_ENTER", CLASS_BASIC},
+  {"KC_P1", "KEY_KP_1", CLASS_BASIC}, {"KC_P2", "KEY_KP_2", CLASS_BASIC}, {"KC_P3", "KEY_KP_3", CLASS_BASIC},
+  {"KC_P4", "KEY_KP_4", CLASS_BASIC}, {"KC_P5", "KEY_KP_5", CLASS_BASIC}, {"KC_P6", "KEY_KP_6", CLASS_BASIC},
+  {"KC_P7", "KEY_KP_7", CLASS_BASIC}, {"KC_P8", "KEY_KP_8", CLASS_BASIC}, {"KC_P9", "KEY_KP_9", CLASS_BASIC},
+  {"KC_P0", "KEY_KP_0", CLASS_BASIC}, {"KC_PDOT", "KEY_KP_DOT", CLASS_BASIC},
+  {"KC_LCTL", "KEY_LEFT_CTRL", CLASS_MODIFIER}, {"KC_LSFT", "KEY_LEFT_SHIFT", CLASS_MODIFIER},
+  {"KC_LALT", "KEY_LEFT_ALT", CLASS_MODIFIER}, {"KC_LGUI", "KEY_LEFT_GUI", CLASS_MODIFIER},
+  {"KC_RCTL", "KEY_RIGHT_CTRL", CLASS_MODIFIER}, {"KC_RSFT", "KEY_RIGHT_SHIFT", CLASS_MODIFIER},
+  {"KC_RALT", "KEY_RIGHT_ALT", CLASS_MODIFIER}, {"KC_RGUI", "KEY_RIGHT_GUI", CLASS_MODIFIER},
+  {"KC_MUTE", "KEY_MUTE", CLASS_MEDIA}, {"KC_VOLU", "KEY_VOLUME_UP", CLASS_MEDIA},
+  {"KC_VOLD", "KEY_VOLUME_DOWN", CLASS_MEDIA},
+  {"KC_MNXT", "MEDIA_NEXT", CLASS_MEDIA}, {"KC_MPRV", "MEDIA_PREV", CLASS_MEDIA},
+  {"KC_MSTP", "MEDIA_STOP", CLASS_MEDIA}, {"KC_MPLY", "MEDIA_PLAY_PAUSE", CLASS_MEDIA},
+  {"KC_PWR", "SYS_POWER", CLASS_MEDIA}, {"KC_SLEP", "SYS_SLEEP", CLASS_MEDIA},
+  {"KC_WAKE", "SYS_WAKE", CLASS_MEDIA},
+};
+
+// QMK consumer/system keycodes, for the qmk target's media mask
+static const char *const kQmkMedia[] = {
+  "KC_MUTE", "KC_VOLU", "KC_VOLD", "KC_MNXT", "KC_MPRV", "KC_MSTP", "KC_MPLY", "KC_MSEL", "KC_EJCT",
+  "KC_MAIL", "KC_CALC", "KC_MYCM", "KC_WSCH", "KC_WHOM", "KC_WBAK", "KC_WFWD", "KC_WSTP", "KC_WREF",
+  "KC_WFAV", "KC_MFFD", "KC_MRWD", "KC_BRIU", "KC_BRID", "KC_PWR", "KC_SLEP", "KC_WAKE",
+};
+
+struct Key {
+  std::string source; // name in keymap.json
+  std::string code;   // name emitted into the table
+  KeyClass cls = CLASS_NONE;
+  int layerTarget = -1;
+  int command = -1;
+  int macro = -1;
+};
+
+struct Board {
+  int rows = 0;
+  int cols = 0;
+  int halves = 1;
+  std::string layoutName;
+  std::vector<std::pair<int, int>> layout; // layout index -> (row, col)
+  std::vector<int> colWire;                // matrix column -> column wire within a half
+  int colWiresPerHalf = 0;
+
+  int wireOf(int row, int col) const { return (row / (rows / halves)) * colWiresPerHalf + colWire[col]; }
+};
+
+struct Combo {
+  std::vector<int> keys; // layout indices
+  Key action;
+  uint64_t mask = 0;     // matrix positions
+};
+
+struct Diagnostics {
+  int errors = 0;
+  int warnings = 0;
+  void error(const std::string &msg) {
+    fprintf(stderr, "error: %s\n", msg.c_str());
+    errors++;
+  }
+  void warning(const std::string &msg) {
+    fprintf(stderr, "warning: %s\n", msg.c_str());
+    warnings++;
+  }
+};
+
+static bool layerKey(const std::string &name, int &target) {
+  static const char *const kPrefixes[] = {"MO(", "TG(", "TO(", "TT(", "OSL(", "DF(", "PDF(", "LT(", "LM("};
+  for (const char *prefix : kPrefixes) {
+    size_t len = strlen(prefix);
+    if (name.compare(0, len, prefix) == 0) {
+      target = atoi(name.c_str() + len);
+      return true;
+    }
+  }
+  return false;
+}
+
+static Key classify(const std::string &name, bool handwritten, Diagnostics &diag, const std::string &where) {
+  Key key;
+  key.source = name;
+  key.code = name;
+
+  if (!handwritten) {
+    if (name == "KC_NO" || name == "XXXXXXX") {
+      key.cls = CLASS_NONE;
+    } else if (name == "KC_TRNS" || name == "_______") {
+      key.cls = CLASS_TRANSPARENT;
+    } else if (layerKey(name, key.layerTarget)) {
+      key.cls = CLASS_LAYER;
+    } else {
+      key.cls = CLASS_BASIC;
+      for (const char *media : kQmkMedia) {
+        if (name == media) {
+          key.cls = CLASS_MEDIA;
+        }
+      }
+    }
+    return key;
+  }
+
+  if (name == "KC_TRNS" || name == "_______") {
+    key.code = "KEY_TRANSPARENT";
+    key.cls = CLASS_TRANSPARENT;
+    return key;
+  }
+  for (int i = 0; i < COMMAND_COUNT; i++) {
+    if (name == kCommands[i]) {
+      key.cls = CLASS_COMMAND;
+      key.command = i;
+      return key;
+    }
+  }
+  if (name.compare(0, 9, "QK_MACRO_") == 0) {
+    int n = atoi(name.c_str() + 9);
+    if (n >= 0 && n < MACRO_COUNT && name.size() > 9) {
+      key.code = "MACRO(" + std::to_string(n) + ")";
+      key.cls = CLASS_MACRO;
+      key.macro = n;
+      return key;
+    }
+  }
+  // The handwritten firmware's only layer key toggles between layers 0 and 1
+  if (name == "TG(1)") {
+    key.code = kCommands[0];
+    key.cls = CLASS_COMMAND;
+    key.command = 0;
+    key.layerTarget = 1;
+    return key;
+  }
+  for (const Translation &t : kTranslations) {
+    if (name == t.qmk) {
+      key.code = t.hid;
+      key.cls = t.cls;
+      return key;
+    }
+  }
+  diag.error(where + ": keycode " + name + " is not supported by the handwritten firmware");
+  key.code = "KEY_RESERVED";
+  return key;
+}
+
+static Board loadBoard(const Json &kb, const std::string &layoutName, Diagnostics &diag) {
+  Board board;
+  board.layoutName = layoutName;
+
+  std::vector<std::string> colPins;
+  if (const Json *size = kb.find("matrix_size")) {
+    board.rows = size->at("rows").asInt();
+    board.cols = size->at("cols").asInt();
+  } else {
+    const Json &pins = kb.at("matrix_pins");
+    board.rows = (int)pins.at("rows").size();
+    board.cols = (int)pins.at("cols").size();
+    for (const Json &pin : pins.at("cols").items()) {
+      colPins.push_back(pin.asString());
+    }
+  }
+  if (const Json *split = kb.find("split")) {
+    if (const Json *enabled = split->find("enabled")) {
+      board.halves = enabled->asBool() ? 2 : 1;
+    }
+  }
+
+  // Columns sharing a pin (duplex matrix) are the same physical wire
+  std::map<std::string, int> wireIndex;
+  for (int col = 0; col < board.cols; col++) {
+    std::string pin = col < (int)colPins.size() ? colPins[col] : std::to_string(col);
+    auto it = wireIndex.find(pin);
+    if (it == wireIndex.end()) {
+      it = wireIndex.emplace(pin, (int)wireIndex.size()).first;
+    }
+    board.colWire.push_back(it->second);
+  }
+  board.colWiresPerHalf = (int)wireIndex.size();
+
+  const Json *layouts = kb.find("layouts");
+  const Json *layout = layouts ? layouts->find(layoutName) : nullptr;
+  if (!layout) {
+    diag.error("layout " + layoutName + " not found in keyboard.json");
+    return board;
+  }
+
+  std::set<std::pair<int, int>> used;
+  const Json &keys = layout->at("layout");
+  for (size_t i = 0; i < keys.size(); i++) {
+    const Json &m = keys[i].at("matrix");
+    std::pair<int, int> pos(m[0].asInt(), m[1].asInt());
+    std::string where = layoutName + "[" + std::to_string(i) + "]";
+    if (pos.first < 0 || pos.first >= board.rows || pos.second < 0 || pos.second >= board.cols) {
+      diag.error(where + ": matrix position [" + std::to_string(pos.first) + ", " + std::to_string(pos.second) +
+                 "] is outside the " + std::to_string(board.rows) + "x" + std::to_string(board.cols) + " matrix");
+    } else if (!used.insert(pos).second) {
+      diag.error(where + ": matrix position [" + std::to_string(pos.first) + ", " + std::to_string(pos.second) +
+                 "] is used twice");
+    }
+    board.layout.push_back(pos);
+  }
+  return board;
+}
+
+// Layers reachable from layer 0 through layer keys on already reachable layers
+static std::vector<bool> reachableLayers(const std::vector<std::vector<Key>> &layers) {
+  std::vector<bool> reached(layers.size(), false);
+  std::vector<int> todo = {0};
+  reached[0] = true;
+  while (!todo.empty()) {
+    int layer = todo.back();
+    todo.pop_back();
+    for (const Key &key : layers[layer]) {
+      int t = key.layerTarget;
+      if (t >= 0 && t < (int)layers.size() && !reached[t]) {
+        reached[t] = true;
+        todo.push_back(t);
+      }
+      // TG() toggles back off as well, so anything below stays reachable
+    }
+  }
+  return reached;
+}
+
+struct Output {
+  std::string text;
+  void line(const std::string &s = "") { text += s + "\n"; }
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    text += buf;
+  }
+};
+
+static std::string hex64(uint64_t v) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "0x%016llxull", (unsigned long long)v);
+  return buf;
+}
+
+static std::string hex16(uint32_t v) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "0x%04x", v);
+  return buf;
+}
+
+static void emitHeader(Output &out, const std::string &kbPath, const std::string &kmPath, const std::string &outPath,
+                       const char *target, const Board &board, const std::vector<bool> &reached) {
+  out.printf("// Generated by firmware_host/tools/keymap_compiler from %s and %s (%s).\n", kbPath.c_str(),
+             kmPath.c_str(), board.layoutName.c_str());
+  out.line("// Do not edit, regenerate with:");
+  out.printf("//   keymap_compiler --target %s %s %s -o %s\n", target, kbPath.c_str(), kmPath.c_str(),
+             outPath.c_str());
+  for (size_t layer = 0; layer < reached.size(); layer++) {
+    if (!reached[layer]) {
+      out.printf("// Note: layer %zu cannot be reached from layer 0.\n", layer);
+    }
+  }
+  out.line();
+  out.line("#pragma once");
+  out.line();
+}
+
+// C string literal of text; octal escapes, which never run into the next character
+static std::string cString(const std::string &text) {
+  std::string out = "\"";
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += (char)c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if (c < 0x20 || c >= 0x7F) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\%03o", c);
+      out += buf;
+    } else {
+      out += (char)c;
+    }
+  }
+  return out + "\"";
+}
+
+static void emitHandwritten(Output &out, const Board &board, const std::vector<std::vector<Key>> &matrixKeys,
+                            const std::vector<Combo> &combos, const std::vector<std::string> &macros) {
+  int layers = (int)matrixKeys.size();
+  int positions = board.rows * board.cols;
+
+  out.printf("#define KEYMAP_LAYERS %d\n", layers);
+  out.printf("#define KEYMAP_MATRIX_ROWS %d\n", board.rows);
+  out.printf("#define KEYMAP_MATRIX_COLS %d\n", board.cols);
+  out.printf("#define KEYMAP_POSITIONS %d\n", positions);
+  out.printf("#define KEYMAP_LAYOUT_KEYS %zu\n", board.layout.size());
+  out.printf("#define KEYMAP_COLUMN_WIRES %d\n", board.colWiresPerHalf * board.halves);
+  out.printf("#define KEYMAP_COMBOS %zu\n", combos.size());
+  out.printf("#define KEYMAP_MACROS %zu\n", macros.size());
+  out.line();
+
+  std::vector<int> layoutIndex(positions, 0xFF);
+  for (size_t i = 0; i < board.layout.size(); i++) {
+    layoutIndex[board.layout[i].first * board.cols + board.layout[i].second] = (int)i;
+  }
+  out.printf("// Matrix position (row * KEYMAP_MATRIX_COLS + col) -> %s index, 0xFF if unused\n",
+             board.layoutName.c_str());
+  out.line("const uint8_t keymapLayoutIndex[KEYMAP_POSITIONS] PROGMEM = {");
+  for (int row = 0; row < board.rows; row++) {
+    std::string line = " ";
+    for (int col = 0; col < board.cols; col++) {
+      char buf[16];
+      snprintf(buf, sizeof(buf), " %d,", layoutIndex[row * board.cols + col]);
+      line += buf;
+    }
+    out.line(line);
+  }
+  out.line("};");
+  out.line();
+
+  // Sparse keycodes (firmware_handwritten/keymap_layers.h): layer 0 whole,
+  // then per upper layer what it holds and where its keycodes start
+  int blocks = (positions + 7) / 8;
+  std::vector<std::vector<int>> presence(layers, std::vector<int>(blocks, 0));
+  std::vector<int> layerStart(layers, 0);
+  int packed = 0;
+  for (int layer = 0; layer < layers; layer++) {
+    layerStart[layer] = packed;
+    for (int pos = 0; pos < positions; pos++) {
+      if (layer == 0 || matrixKeys[layer][pos].cls != CLASS_TRANSPARENT) {
+        presence[layer][pos / 8] |= 1 << (pos % 8);
+        packed++;
+      }
+    }
+  }
+  out.printf("#define KEYMAP_BLOCKS %d\n", blocks);
+  out.printf("#define KEYMAP_KEYCODES %d\n", packed);
+  out.line();
+  out.printf("// Keycodes per layer, sparse: %d of %d positions set, %d bytes of flash\n", packed, layers * positions,
+             packed + (layers - 1) * (blocks + 2));
+  out.printf("// (%d as a full table)\n", layers * positions);
+  if (layers > 1) {
+    out.line("// Upper layers: bit i of presence byte b is set when matrix position 8b + i");
+    out.line("// is set on the layer, clear where the layer is transparent");
+    out.line("const uint8_t keymapPresence[KEYMAP_LAYERS - 1][KEYMAP_BLOCKS] PROGMEM = {");
+    for (int layer = 1; layer < layers; layer++) {
+      std::string line = "  {";
+      for (int b = 0; b < blocks; b++) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "0x%02x%s", presence[layer][b], b + 1 < blocks ? ", " : "},");
+        line += buf;
+      }
+      out.printf("%s // Layer %d\n", line.c_str(), layer);
+    }
+    out.line("};");
+    out.line("// Upper layers: index of the layer's first keycode in keymapKeycodes");
+    out.line("const uint16_t keymapLayerStart[KEYMAP_LAYERS - 1] PROGMEM = {");
+    std::string line = " ";
+    for (int layer = 1; layer < layers; layer++) {
+      line += " " + std::to_string(layerStart[layer]) + ",";
+    }
+    out.line(line);
+    out.line("};");
+    out.line();
+  }
+  out.line("// Layer 0 by matrix position, then the keycodes each upper layer sets in");
+  out.line("// matrix position order (/*___*/ where it is transparent)");
+  out.line("const uint8_t keymapKeycodes[KEYMAP_KEYCODES] PROGMEM = {");
+  for (int layer = 0; layer < layers; layer++) {
+    out.printf("  // Layer %d\n", layer);
+    int halfRows = board.rows / board.halves;
+    for (int row = 0; row < board.rows; row++) {
+      if (board.halves > 1 && row % halfRows == 0) {
+        if (row > 0) {
+          out.line();
+        }
+        out.printf("  // Matrix rows %d-%d\n", row, row + halfRows - 1);
+      }
+      std::string line = " ";
+      for (int col = 0; col < board.cols; col++) {
+        const Key &key = matrixKeys[layer][row * board.cols + col];
+        line += layer > 0 && key.cls == CLASS_TRANSPARENT ? " /*___*/" : " " + key.code + ",";
+      }
+      out.line(line);
+    }
+    if (layer + 1 < layers) {
+      out.line();
+    }
+  }
+  out.line("};");
+  out.line();
+
+  // No per-layer special-key masks: a transparent position takes its key from
+  // whichever layer below is active, so the core derives them through its
+  // layer stack (layersChanged())
+
+  out.line("// Ghost topology: keys sharing a row wire and a column wire. Three pressed");
+  out.line("// corners of a rectangle over these wires make the fourth one ghost.");
+  out.line("constexpr uint64_t keymapRowWireMask[KEYMAP_MATRIX_ROWS] = {");
+  for (int row = 0; row < board.rows; row++) {
+    uint64_t mask = 0;
+    for (int col = 0; col < board.cols; col++) {
+      if (layoutIndex[row * board.cols + col] != 0xFF) {
+        mask |= 1ull << (row * board.cols + col);
+      }
+    }
+    out.printf("  %s,\n", hex64(mask).c_str());
+  }
+  out.line("};");
+  out.line("constexpr uint64_t keymapColumnWireMask[KEYMAP_COLUMN_WIRES] = {");
+  for (int wire = 0; wire < board.colWiresPerHalf * board.halves; wire++) {
+    uint64_t mask = 0;
+    for (int row = 0; row < board.rows; row++) {
+      for (int col = 0; col < board.cols; col++) {
+        if (board.wireOf(row, col) == wire && layoutIndex[row * board.cols + col] != 0xFF) {
+          mask |= 1ull << (row * board.cols + col);
+        }
+      }
+    }
+    out.printf("  %s,\n", hex64(mask).c_str());
+  }
+  out.line("};");
+
+  if (!combos.empty()) {
+    out.line();
+    out.line("// Combos for firmware_common/combo.h: matrix positions and the action while held");
+    out.line("const combo_t keymapCombos[KEYMAP_COMBOS] = {");
+    for (const Combo &combo : combos) {
+      std::string keys;
+      for (int index : combo.keys) {
+        keys += (keys.empty() ? "" : " + ") + matrixKeys[0][board.layout[index].first * board.cols +
+                                                           board.layout[index].second].code;
+      }
+      out.printf("  {%s, %s}, // %s\n", hex64(combo.mask).c_str(), combo.action.code.c_str(), keys.c_str());
+    }
+    out.line("};");
+  }
+
+  if (!macros.empty()) {
+    out.line();
+    out.line("// Macros typed by MACRO(n), one NUL terminated string each");
+    out.line("const char keymapMacroText[] =");
+    for (size_t i = 0; i < macros.size(); i++) {
+      out.printf("  %s%s // MACRO(%zu)\n", cString(macros[i]).c_str(), i + 1 < macros.size() ? " \"\\0\"" : ";", i);
+    }
+  }
+}
+
+static void emitQmk(Output &out, const Board &board, const std::vector<std::vector<Key>> &matrixKeys) {
+  int layers = (int)matrixKeys.size();
+
+  out.printf("#define KEYMAP_LAYERS %d\n", layers);
+  out.printf("#define KEYMAP_LAYOUT_KEYS %zu\n", board.layout.size());
+  out.printf("#define KEYMAP_COLUMN_WIRES %d\n", board.colWiresPerHalf * board.halves);
+  out.line();
+  out.line("extern const uint8_t      keymap_layout_index[MATRIX_ROWS][MATRIX_COLS];");
+  out.line("extern const uint16_t     keymap_keycodes[KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS];");
+  out.line("extern const matrix_row_t keymap_layer_key_mask[KEYMAP_LAYERS][MATRIX_ROWS];");
+  out.line("extern const matrix_row_t keymap_media_mask[KEYMAP_LAYERS][MATRIX_ROWS];");
+  out.line("extern const matrix_row_t keymap_empty_mask[KEYMAP_LAYERS][MATRIX_ROWS];");
+  out.line("extern const matrix_row_t keymap_populated_mask[MATRIX_ROWS];");
+  out.line("extern const uint8_t      keymap_column_wire[MATRIX_COLS];");
+  out.line();
+  out.line("#ifdef KEYMAP_TABLES_IMPLEMENTATION");
+  out.line();
+
+  std::vector<int> layoutIndex(board.rows * board.cols, 0xFF);
+  for (size_t i = 0; i < board.layout.size(); i++) {
+    layoutIndex[board.layout[i].first * board.cols + board.layout[i].second] = (int)i;
+  }
+  out.printf("// Matrix position -> %s index, 0xFF if unused\n", board.layoutName.c_str());
+  out.line("const uint8_t keymap_layout_index[MATRIX_ROWS][MATRIX_COLS] = {");
+  for (int row = 0; row < board.rows; row++) {
+    std::string line = "    {";
+    for (int col = 0; col < board.cols; col++) {
+      line += std::to_string(layoutIndex[row * board.cols + col]) + (col + 1 < board.cols ? ", " : "},");
+    }
+    out.line(line);
+  }
+  out.line("};");
+  out.line();
+
+  out.line("// Keycodes per layer, indexed by matrix position");
+  out.line("const uint16_t keymap_keycodes[KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS] = {");
+  for (int layer = 0; layer < layers; layer++) {
+    out.line("    {");
+    for (int row = 0; row < board.rows; row++) {
+      std::string line = "        {";
+      for (int col = 0; col < board.cols; col++) {
+        line += matrixKeys[layer][row * board.cols + col].code + (col + 1 < board.cols ? ", " : "},");
+      }
+      out.line(line);
+    }
+    out.line("    },");
+  }
+  out.line("};");
+  out.line();
+
+  auto emitMask = [&](const char *name, const char *doc, KeyClass cls) {
+    out.printf("// %s, per layer and row\n", doc);
+    out.printf("const matrix_row_t %s[KEYMAP_LAYERS][MATRIX_ROWS] = {\n", name);
+    for (int layer = 0; layer < layers; layer++) {
+      std::string line = "    {";
+      for (int row = 0; row < board.rows; row++) {
+        uint32_t mask = 0;
+        for (int col = 0; col < board.cols; col++) {
+          const Key &k = matrixKeys[layer][row * board.cols + col];
+          if (k.cls == cls && layoutIndex[row * board.cols + col] != 0xFF) {
+            mask |= 1u << col;
+          }
+        }
+        line += hex16(mask) + (row + 1 < board.rows ? ", " : "},");
+      }
+      out.line(line);
+    }
+    out.line("};");
+  };
+  emitMask("keymap_layer_key_mask", "Layer switching keys", CLASS_LAYER);
+  emitMask("keymap_media_mask", "Consumer/system control keys", CLASS_MEDIA);
+  emitMask("keymap_empty_mask", "KC_NO positions", CLASS_NONE);
+  out.line();
+
+  out.line("// Ghost topology: populated keys per row wire, and the column wire every");
+  out.line("// matrix column is read through (duplex columns share a wire)");
+  std::string line = "const matrix_row_t keymap_populated_mask[MATRIX_ROWS] = {";
+  for (int row = 0; row < board.rows; row++) {
+    uint32_t mask = 0;
+    for (int col = 0; col < board.cols; col++) {
+      if (layoutIndex[row * board.cols + col] != 0xFF) {
+        mask |= 1u << col;
+      }
+    }
+    line += hex16(mask) + (row + 1 < board.rows ? ", " : "};");
+  }
+  out.line(line);
+  line = "const uint8_t keymap_column_wire[MATRIX_COLS] = {";
+  for (int col = 0; col < board.cols; col++) {
+    line += std::to_string(board.colWire[col]) + (col + 1 < board.cols ? ", " : "};");
+  }
+  out.line(line);
+  out.line();
+  out.line("#endif // KEYMAP_TABLES_IMPLEMENTATION");
+}
+
+// HID-Project KeyboardKeycode values (and the core's own codes) of the
+// names the handwritten target emits, for the live keymap image
+static int hidValue(const std::string &code) {
+  static const std::pair<const char *, int> kValues[] = {
+    {"KEY_RESERVED", 0x00}, {"KEY_TRANSPARENT", 0x01}, {"KEY_ENTER", 0x28}, {"KEY_ESC", 0x29}, {"KEY_BACKSPACE", 0x2A}, {"KEY_TAB", 0x2B},
+    {"KEY_SPACE", 0x2C}, {"KEY_MINUS", 0x2D}, {"KEY_EQUAL", 0x2E}, {"KEY_LEFT_BRACE", 0x2F},
+    {"KEY_RIGHT_BRACE", 0x30}, {"KEY_BACKSLASH", 0x31}, {"KEY_SEMICOLON", 0x33}, {"KEY_QUOTE", 0x34},
+    {"KEY_TILDE", 0x35}, {"KEY_COMMA", 0x36}, {"KEY_PERIOD", 0x37}, {"KEY_SLASH", 0x38}, {"KEY_CAPS_LOCK", 0x39},
+    {"KEY_PRINT_SCREEN", 0x46}, {"KEY_SCROLL_LOCK", 0x47}, {"KEY_PAUSE", 0x48}, {"KEY_INSERT", 0x49},
+    {"KEY_HOME", 0x4A}, {"KEY_PAGE_UP", 0x4B}, {"KEY_DELETE", 0x4C}, {"KEY_END", 0x4D}, {"KEY_PAGE_DOWN", 0x4E},
+    {"KEY_RIGHT_ARROW", 0x4F}, {"KEY_LEFT_ARROW", 0x50}, {"KEY_DOWN_ARROW", 0x51}, {"KEY_UP_ARROW", 0x52},
+    {"KEY_NUM_LOCK", 0x53}, {"KEY_KP_SLASH", 0x54}, {"KEY_KP_ASTERISK", 0x55}, {"KEY_KP_MINUS", 0x56},
+    {"KEY_KP_PLUS", 0x57}, {"KEY_KP_ENTER", 0x58}, {"KEY_KP_0", 0x62}, {"KEY_KP_DOT", 0x63},
+    {"KEY_MUTE", 0x7F}, {"KEY_VOLUME_UP", 0x80}, {"KEY_VOLUME_DOWN", 0x81},
+    {"SYS_POWER", 0xA5}, {"SYS_SLEEP", 0xA6}, {"SYS_WAKE", 0xA7},
+    {"MEDIA_NEXT", 0xAB}, {"MEDIA_PREV", 0xAC}, {"MEDIA_STOP", 0xAD}, {"MEDIA_PLAY_PAUSE", 0xAE},
+    {"KEY_LEFT_CTRL", 0xE0}, {"KEY_LEFT_SHIFT", 0xE1}, {"KEY_LEFT_ALT", 0xE2}, {"KEY_LEFT_GUI", 0xE3},
+    {"KEY_RIGHT_CTRL", 0xE4}, {"KEY_RIGHT_SHIFT", 0xE5}, {"KEY_RIGHT_ALT", 0xE6}, {"KEY_RIGHT_GUI", 0xE7},
+  };
+  for (const auto &v : kValues) {
+    if (code == v.first) {
+      return v.second;
+    }
+  }
+  // Runs: letters, digits (1-9, then 0), F keys, keypad digits 1-9
+  if (code.size() == 5 && code.compare(0, 4, "KEY_") == 0 && code[4] >= 'A' && code[4] <= 'Z') {
+    return 0x04 + code[4] - 'A';
+  }
+  if (code.size() == 5 && code.compare(0, 4, "KEY_") == 0 && code[4] >= '0' && code[4] <= '9') {
+    return code[4] == '0' ? 0x27 : 0x1E + code[4] - '1';
+  }
+  if (code.compare(0, 5, "KEY_F") == 0 && code.size() > 5 && atoi(code.c_str() + 5) >= 1 && atoi(code.c_str() + 5) <= 12) {
+    return 0x3A + atoi(code.c_str() + 5) - 1;
+  }
+  if (code.size() == 8 && code.compare(0, 7, "KEY_KP_") == 0 && code[7] >= '1' && code[7] <= '9') {
+    return 0x59 + code[7] - '1';
+  }
+  for (int i = 0; i < COMMAND_COUNT; i++) {
+    if (code == kCommands[i]) {
+      return 0xF0 + i;
+    }
+  }
+  if (code.compare(0, 6, "MACRO(") == 0) {
+    return 0xF8 + atoi(code.c_str() + 6);
+  }
+  return -1;
+}
+
+static bool liveRequest(int fd, const uint8_t *request) {
+  uint8_t packet[KEYMAP_LIVE_REPORT_SIZE + 1];
+  packet[0] = KEYMAP_LIVE_REPORT_ID;
+  memcpy(packet + 1, request, KEYMAP_LIVE_REPORT_SIZE);
+  return write(fd, packet, sizeof(packet)) == (ssize_t)sizeof(packet);
+}
+
+// Next vendor report from the board within timeoutMs, skipping key reports
+static bool liveAnswer(int fd, uint8_t *answer, int timeoutMs) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  errno = 0;
+  while (poll(&pfd, 1, timeoutMs) > 0) {
+    uint8_t buf[KEYMAP_LIVE_REPORT_SIZE + 1];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    if (n == (ssize_t)sizeof(buf) && buf[0] == KEYMAP_LIVE_REPORT_ID) {
+      memcpy(answer, buf + 1, KEYMAP_LIVE_REPORT_SIZE);
+      return true;
+    }
+  }
+  if (errno == 0 || errno == EINTR) {
+    errno = ETIMEDOUT;
+  }
+  return false;
+}
+
+// A request and the answer to it
+static bool liveCall(int fd, const uint8_t *request, uint8_t *answer) {
+  if (!liveRequest(fd, request)) {
+    return false;
+  }
+  while (liveAnswer(fd, answer, 1000)) {
+    if (answer[0] == request[0]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static const char *liveStatus(uint8_t status) {
+  static const char *const kNames[] = {"ok", "chunk out of order", "chunk checksum wrong", "size wrong",
+                                       "image checksum wrong", "macros not terminated", "busy", "unknown command"};
+  return status < sizeof(kNames) / sizeof(kNames[0]) ? kNames[status] : "unknown status";
+}
+
+static int sync(const char *device, const Board &board, const std::vector<std::vector<Key>> &matrixKeys,
+                const std::vector<std::string> &macros, int comboTerm) {
+  int fd = open(device, O_RDWR);
+  if (fd < 0) {
+    fprintf(stderr, "error: cannot open %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+  uint8_t request[KEYMAP_LIVE_REPORT_SIZE] = {KEYMAP_LIVE_CMD_INFO};
+  uint8_t answer[KEYMAP_LIVE_REPORT_SIZE];
+  if (!liveCall(fd, request, answer)) {
+    fprintf(stderr, "error: %s does not answer the live keymap protocol: %s\n", device, strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  // The image is laid out for the board's build; the keymap has to fit it exactly
+  size_t layers = answer[2], positions = answer[3], macroBytes = keymapLiveGet16(answer + 4);
+  size_t settingsBytes = answer[6], size = keymapLiveGet16(answer + 7);
+  uint32_t boardCrc = keymapLiveGet32(answer + 9);
+  std::string text;
+  for (const std::string &macro : macros) {
+    text += macro + '\0';
+  }
+  if (layers != matrixKeys.size() || positions != (size_t)(board.rows * board.cols) ||
+      size != layers * positions + macroBytes + settingsBytes) {
+    fprintf(stderr, "error: board holds %zu layers of %zu positions, keymap has %zu of %d\n", layers, positions,
+            matrixKeys.size(), board.rows * board.cols);
+    close(fd);
+    return 1;
+  }
+  if (text.size() > macroBytes - 1) {
+    fprintf(stderr, "error: macros take %zu bytes, board has room for %zu\n", text.size(), macroBytes - 1);
+    close(fd);
+    return 1;
+  }
+
+  std::vector<uint8_t> image(size, 0);
+  for (size_t layer = 0; layer < layers; layer++) {
+    for (size_t i = 0; i < positions; i++) {
+      int value = hidValue(matrixKeys[layer][i].code);
+      if (value < 0) {
+        fprintf(stderr, "error: no keycode value for %s\n", matrixKeys[layer][i].code.c_str());
+        close(fd);
+        return 1;
+      }
+      image[layer * positions + i] = (uint8_t)value;
+    }
+  }
+  memcpy(&image[layers * positions], text.data(), text.size());
+
+  // Settings the keymap leaves alone stay as they are on the board
+  size_t settings = layers * positions + macroBytes;
+  for (size_t offset = 0; offset < settingsBytes;) {
+    memset(request, 0, sizeof(request));
+    request[0] = KEYMAP_LIVE_CMD_READ;
+    keymapLivePut16(request + 1, (uint16_t)(settings + offset));
+    request[3] = (uint8_t)(settingsBytes - offset);
+    if (!liveCall(fd, request, answer) || answer[1] != KEYMAP_LIVE_OK || answer[4] == 0) {
+      fprintf(stderr, "error: reading the board's settings failed\n");
+      close(fd);
+      return 1;
+    }
+    memcpy(&image[settings + offset], answer + KEYMAP_LIVE_CHUNK_HEADER, answer[4]);
+    offset += answer[4];
+  }
+  if (comboTerm >= 0) {
+    keymapLivePut16(&image[settings + KEYMAP_LIVE_SET_COMBO_TERM], (uint16_t)comboTerm);
+  }
+
+  uint32_t crc = keymapLiveCrc32(image.data(), (uint16_t)size);
+  if (crc == boardCrc) {
+    printf("%s already has this keymap (crc %08x)\n", device, crc);
+    close(fd);
+    return 0;
+  }
+
+  // Chunks back to back, then the commit; a chunk the board could not take
+  // comes back as an error with the offset to go on from
+  auto start = std::chrono::steady_clock::now();
+  uint16_t from = 0;
+  uint32_t reports = 0;
+  bool done = false;
+  for (int attempt = 0; attempt < 5 && !done; attempt++) {
+    for (uint16_t offset = from; offset < size;) {
+      offset += keymapLiveWriteRequest(request, image.data(), (uint16_t)size, offset);
+      if (!liveRequest(fd, request)) {
+        fprintf(stderr, "error: write to %s failed: %s\n", device, strerror(errno));
+        close(fd);
+        return 1;
+      }
+      reports++;
+    }
+    keymapLiveCommitRequest(request, image.data(), (uint16_t)size);
+    liveRequest(fd, request);
+    reports++;
+
+    from = 0;
+    while (liveAnswer(fd, answer, 1000)) {
+      if (answer[0] == KEYMAP_LIVE_CMD_WRITE) {
+        from = keymapLiveGet16(answer + 2);
+        fprintf(stderr, "chunk at %u: %s, resending\n", from, liveStatus(answer[1]));
+      } else if (answer[0] == KEYMAP_LIVE_CMD_COMMIT) {
+        done = answer[1] == KEYMAP_LIVE_OK;
+        if (!done) {
+          fprintf(stderr, "commit: %s, resending\n", liveStatus(answer[1]));
+        }
+        break;
+      }
+    }
+  }
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (!done) {
+    fprintf(stderr, "error: upload to %s failed\n", device);
+    close(fd);
+    return 1;
+  }
+
+  memset(request, 0, sizeof(request));
+  request[0] = KEYMAP_LIVE_CMD_INFO;
+  if (!liveCall(fd, request, answer) || keymapLiveGet32(answer + 9) != crc) {
+    fprintf(stderr, "error: board's keymap differs after the upload\n");
+    close(fd);
+    return 1;
+  }
+  printf("%s: %zu bytes in %u reports, %.1f ms, active from the next scan (crc %08x)\n", device, size, reports, ms,
+         crc);
+  close(fd);
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: keymap_compiler --target handwritten|qmk [--strict] <keyboard.json> <keymap.json> -o <output.h>\n"
+          "       keymap_compiler --target handwritten [--strict] <keyboard.json> <keymap.json> --sync /dev/hidrawN\n");
+}
+
+int main(int argc, char **argv) {
+  std::string target, kbPath, kmPath, outPath, syncPath;
+  bool strict = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+      target = argv[++i];
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      outPath = argv[++i];
+    } else if (strcmp(argv[i], "--sync") == 0 && i + 1 < argc) {
+      syncPath = argv[++i];
+    } else if (strcmp(argv[i], "--strict") == 0) {
+      strict = true;
+    } else if (kbPath.empty()) {
+      kbPath = argv[i];
+    } else if (kmPath.empty()) {
+      kmPath = argv[i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if ((target != "handwritten" && target != "qmk") || kbPath.empty() || kmPath.empty() ||
+      (outPath.empty() && syncPath.empty()) || (!syncPath.empty() && target != "handwritten")) {
+    usage();
+    return 2;
+  }
+  bool handwritten = target == "handwritten";
+
+  Diagnostics diag;
+  Board board;
+  std::vector<std::vector<Key>> layers;
+  std::vector<Combo> combos;
+  std::vector<std::string> macros;
+  int comboTerm = -1;
+  try {
+    Json kb = Json::parseFile(kbPath);
+    Json km = Json::parseFile(kmPath);
+    board = loadBoard(kb, km.at("layout").asString(), diag);
+
+    const Json &jsonLayers = km.at("layers");
+    for (size_t layer = 0; layer < jsonLayers.size(); layer++) {
+      const Json &keys = jsonLayers[layer];
+      if (keys.size() != board.layout.size()) {
+        diag.error("layer " + std::to_string(layer) + " has " + std::to_string(keys.size()) + " keys, " +
+                   board.layoutName + " has " + std::to_string(board.layout.size()));
+      }
+      std::vector<Key> parsed;
+      for (size_t i = 0; i < keys.size(); i++) {
+        std::string where = "layer " + std::to_string(layer) + " key " + std::to_string(i);
+        parsed.push_back(classify(keys[i].asString(), handwritten, diag, where));
+      }
+      layers.push_back(parsed);
+    }
+
+    if (const Json *jsonCombos = km.find("combos")) {
+      for (size_t i = 0; i < jsonCombos->size(); i++) {
+        const Json &c = (*jsonCombos)[i];
+        std::string where = "combo " + std::to_string(i);
+        Combo combo;
+        combo.action = classify(c.at("action").asString(), handwritten, diag, where);
+        for (const Json &k : c.at("keys").items()) {
+          int index = k.asInt();
+          if (index < 0 || index >= (int)board.layout.size()) {
+            diag.error(where + ": key " + std::to_string(index) + " is not in " + board.layoutName);
+            continue;
+          }
+          uint64_t bit = 1ull << (board.layout[index].first * board.cols + board.layout[index].second);
+          if (combo.mask & bit) {
+            diag.error(where + ": key " + std::to_string(index) + " is listed twice");
+          }
+          combo.keys.push_back(index);
+          combo.mask |= bit;
+        }
+        if (combo.keys.size() < 2) {
+          diag.error(where + ": a combo needs at least two keys");
+        }
+        for (const Combo &other : combos) {
+          if (other.mask == combo.mask) {
+            diag.error(where + ": same keys as an earlier combo");
+          }
+        }
+        combos.push_back(combo);
+      }
+      if (!handwritten && !combos.empty()) {
+        diag.warning("combos are ignored for the qmk target, use QMK's COMBO_ENABLE");
+      }
+    }
+
+    // QMK's macros take text and key actions; the handwritten firmware types text
+    const Json *jsonMacros = handwritten ? km.find("macros") : nullptr;
+    for (size_t i = 0; jsonMacros && i < jsonMacros->size(); i++) {
+      const Json &m = (*jsonMacros)[i];
+      std::string text;
+      for (size_t j = 0; j < (m.isArray() ? m.size() : 1); j++) {
+        const Json &part = m.isArray() ? m[j] : m;
+        if (!part.isString()) {
+          diag.error("macro " + std::to_string(i) + ": only text is supported by the handwritten firmware");
+          continue;
+        }
+        text += part.asString();
+      }
+      if (text.find('\0') != std::string::npos) {
+        diag.error("macro " + std::to_string(i) + ": text contains a NUL");
+      }
+      macros.push_back(text);
+    }
+    if (macros.size() > MACRO_COUNT) {
+      diag.error("keymap has " + std::to_string(macros.size()) + " macros, the handwritten firmware types " +
+                 std::to_string(MACRO_COUNT));
+    }
+    const Json *config = km.find("config");
+    const Json *combo = config ? config->find("combo") : nullptr;
+    if (const Json *term = combo ? combo->find("term") : nullptr) {
+      comboTerm = term->asInt();
+    }
+  } catch (const JsonError &e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return 1;
+  }
+
+  if (layers.empty()) {
+    diag.error("keymap has no layers");
+  }
+  if (handwritten && board.rows * board.cols > 64) {
+    diag.error("handwritten target packs the matrix into 64 bits, matrix has " +
+               std::to_string(board.rows * board.cols) + " positions");
+  }
+  if (handwritten && layers.size() > 32) {
+    diag.error("handwritten target keeps the layer stack in 32 bits, keymap has " + std::to_string(layers.size()) +
+               " layers");
+  }
+  for (size_t layer = 0; layer < layers.size(); layer++) {
+    for (size_t i = 0; i < layers[layer].size(); i++) {
+      int t = layers[layer][i].layerTarget;
+      if (t >= (int)layers.size()) {
+        diag.error("layer " + std::to_string(layer) + " key " + std::to_string(i) + ": " + layers[layer][i].source +
+                   " targets missing layer " + std::to_string(t));
+      }
+      if (layers[layer][i].macro >= (int)macros.size()) {
+        diag.error("layer " + std::to_string(layer) + " key " + std::to_string(i) + ": " + layers[layer][i].source +
+                   " has no macro");
+      }
+    }
+  }
+  if (diag.errors) {
+    fprintf(stderr, "%d error(s)\n", diag.errors);
+    return 1;
+  }
+
+  std::vector<bool> reached = reachableLayers(layers);
+  for (size_t layer = 0; layer < reached.size(); layer++) {
+    if (!reached[layer]) {
+      std::string msg = "layer " + std::to_string(layer) + " cannot be reached from layer 0";
+      if (strict) {
+        diag.error(msg);
+      } else {
+        diag.warning(msg);
+      }
+    }
+  }
+  if (diag.errors) {
+    return 1;
+  }
+
+  // Re-index from layout order to matrix order. Unused positions stay
+  // empty; for the handwritten target they are transparent above layer 0,
+  // and layer 0 has nothing under it to be transparent to.
+  std::vector<std::vector<Key>> matrixKeys(layers.size());
+  for (size_t layer = 0; layer < layers.size(); layer++) {
+    Key empty = classify("KC_NO", handwritten, diag, "");
+    Key unused = handwritten && layer > 0 ? classify("KC_TRNS", handwritten, diag, "") : empty;
+    matrixKeys[layer].assign(board.rows * board.cols, unused);
+    for (size_t i = 0; i < board.layout.size(); i++) {
+      Key key = layers[layer][i];
+      if (handwritten && layer == 0 && key.cls == CLASS_TRANSPARENT) {
+        key = empty;
+      }
+      matrixKeys[layer][board.layout[i].first * board.cols + board.layout[i].second] = key;
+    }
+  }
+
+  if (!syncPath.empty() && sync(syncPath.c_str(), board, matrixKeys, macros, comboTerm) != 0) {
+    return 1;
+  }
+  if (outPath.empty()) {
+    return 0;
+  }
+
+  Output out;
+  emitHeader(out, kbPath, kmPath, outPath, target.c_str(), board, reached);
+  if (handwritten) {
+    emitHandwritten(out, board, matrixKeys, combos, macros);
+  } else {
+    emitQmk(out, board, matrixKeys);
+  }
+
+  // Left alone when unchanged, so a build that regenerates it every time
+  // (firmware_qmk/rules.mk) doesn't recompile what includes it
+  if (FILE *f = fopen(outPath.c_str(), "r")) {
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, n);
+    fclose(f);
+    if (text == out.text) return 0;
+  }
+
+  FILE *f = fopen(outPath.c_str(), "w");
+  if (!f) {
+    fprintf(stderr, "error: cannot write %s\n", outPath.c_str());
+    return 1;
+  }
+  fputs(out.text.c_str(), f);
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,597 @@
+// Rearrange the character keys of a keymap.json's base layer for less
+// finger travel and fewer same-finger bigrams.
+//
+//   layout_optimizer --keyboard keyboard.json --keymap keymap.json
+//                    (--corpus FILE... | --heatmap FILE) [-o out.json]
+//                    [--threads N] [--restarts N] [--iterations N]
+//                    [--sfb-weight W] [--pin KC_X,KC_Y...] [--seed N]
+//
+// Keys that move: layer 0 keys typing a letter or punctuation character
+// (KC_A-KC_Z, ; , . / ' - = [ ] \ `) that appear once on the layer. A
+// mod-tap keeps its modifier on its position and only its tap key moves,
+// so home row mods stay where they are. Everything else, the other layers
+// and --pin keys stay put.
+//
+// Cost model, from the layout's x/y (key units):
+//   - fingers by column within each hand, from the outside: pinky for all
+//     but the four inner columns, then ring, middle, and index on the two
+//     innermost; a finger's home key is the middle key of its column
+//     nearest the middle finger
+//   - travel: distance from the finger's home key, times the finger's
+//     weight (pinky 1.5, ring 1.2, middle and index 1.0), per keystroke
+//   - same-finger bigram: two different keys in a row on one finger cost
+//     --sfb-weight (default 2) times 1 + the distance between them
+// --corpus counts keystrokes and bigrams in text (case folded, shifted
+// punctuation on its key, other characters break a bigram); counting is
+// split across the threads. --heatmap takes the layer 0 counts of a
+// `telemetry_analyze heatmap` dump instead, which has no bigrams, so only
+// travel is optimised.
+//
+// Search: --restarts simulated annealing runs (default 16) of --iterations
+// key swaps each (default 200000), from random arrangements, cooling
+// geometrically from the mean cost change of a random swap to 1/1000 of
+// it; the runs are spread over --threads (default: all cores) and the best
+// is written. Run n always uses seed + n, so the result doesn't depend on
+// the thread count. Prints the cost, travel per keystroke, same-finger
+// bigram rate and finger load before and after, the new base layer, and
+// the time spent counting and searching.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 -pthread firmware_host/tools/layout_optimizer.cpp -o /tmp/layout_optimizer
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.h"
+
+enum Finger { PINKY, RING, MIDDLE, INDEX, FINGERS };
+
+static const char *const kFingerNames[FINGERS] = {"pinky", "ring", "middle", "index"};
+static const double kFingerWeight[FINGERS] = {1.5, 1.2, 1.0, 1.0};
+
+// Characters a movable key types: unshifted, shifted
+static const struct {
+  const char *keycode;
+  char plain;
+  char shifted;
+} kCharKeys[] = {
+  {"KC_SCLN", ';', ':'}, {"KC_COMM", ',', '<'}, {"KC_DOT", '.', '>'},  {"KC_SLSH", '/', '?'},
+  {"KC_QUOT", '\'', '"'}, {"KC_MINS", '-', '_'}, {"KC_EQL", '=', '+'}, {"KC_LBRC", '[', '{'},
+  {"KC_RBRC", ']', '}'}, {"KC_BSLS", '\\', '|'}, {"KC_GRV", '`', '~'},
+};
+
+static std::string canonical(const std::string &name) {
+  static const std::map<std::string, std::string> aliases = {
+    {"KC_MINUS", "KC_MINS"}, {"KC_EQUAL", "KC_EQL"}, {"KC_COMMA", "KC_COMM"}, {"KC_SLASH", "KC_SLSH"},
+    {"KC_SEMICOLON", "KC_SCLN"}, {"KC_QUOTE", "KC_QUOT"}, {"KC_GRAVE", "KC_GRV"},
+    {"KC_LEFT_BRACKET", "KC_LBRC"}, {"KC_RIGHT_BRACKET", "KC_RBRC"}, {"KC_BACKSLASH", "KC_BSLS"},
+  };
+  auto it = aliases.find(name);
+  return it == aliases.end() ? name : it->second;
+}
+
+static bool isCharKey(const std::string &keycode) {
+  if (keycode.size() == 4 && keycode.compare(0, 3, "KC_") == 0 && keycode[3] >= 'A' && keycode[3] <= 'Z') {
+    return true;
+  }
+  for (const auto &k : kCharKeys) {
+    if (keycode == k.keycode) return true;
+  }
+  return false;
+}
+
+// Tap key of a layer 0 entry and where it sits in the string: KC_A, or the
+// argument of LGUI_T(KC_A) / MT(MOD_LGUI, KC_A)
+static bool tapKey(const std::string &name, std::string &tap, size_t &at) {
+  size_t open = name.find('(');
+  if (open == std::string::npos) {
+    tap = canonical(name);
+    at = 0;
+    return true;
+  }
+  if (name.back() != ')') return false;
+  std::string head = name.substr(0, open);
+  at = open + 1;
+  if (head == "MT") {
+    size_t comma = name.find(',', open);
+    if (comma == std::string::npos) return false;
+    at = name.find_first_not_of(' ', comma + 1);
+  } else if (!(head.size() == 6 && head.compare(4, 2, "_T") == 0)) {
+    return false;
+  }
+  tap = canonical(name.substr(at, name.size() - 1 - at));
+  return true;
+}
+
+struct Slot {
+  int index;       // layout index
+  double x, y;
+  char hand;       // 'L' or 'R'
+  int finger;
+  double travel;   // from the finger's home key
+};
+
+struct Model {
+  std::vector<Slot> slots;            // movable positions
+  std::vector<std::string> keys;      // movable tap keycodes, key k starts in slot k
+  std::vector<bool> pinned;           // per key
+  std::vector<double> effort;         // per slot: finger weight * travel
+  std::vector<double> sfb;            // per slot pair: 1 + distance if same finger, else 0
+  std::vector<double> uni;            // per key
+  std::vector<double> big;            // per key pair
+  bool haveBigrams = false;
+  double sfbWeight = 2.0;
+  int16_t charKey[256];               // character -> key, -1 if none
+
+  size_t n() const { return keys.size(); }
+
+  double cost(const std::vector<int> &pos) const {
+    double c = 0;
+    for (size_t a = 0; a < n(); a++) {
+      c += uni[a] * effort[pos[a]];
+      for (size_t b = 0; b < n(); b++) {
+        c += sfbWeight * big[a * n() + b] * sfb[pos[a] * n() + pos[b]];
+      }
+    }
+    return c;
+  }
+
+  // Cost of the terms that involve key a or b
+  double part(const std::vector<int> &pos, int a, int b) const {
+    const size_t N = n();
+    double c = uni[a] * effort[pos[a]] + uni[b] * effort[pos[b]];
+    double s = 0;
+    for (size_t k = 0; k < N; k++) {
+      s += big[a * N + k] * sfb[pos[a] * N + pos[k]] + big[k * N + a] * sfb[pos[k] * N + pos[a]];
+      if ((int)k != a) {
+        s += big[b * N + k] * sfb[pos[b] * N + pos[k]] + big[k * N + b] * sfb[pos[k] * N + pos[b]];
+      }
+    }
+    return c + sfbWeight * s;
+  }
+
+  double swapDelta(std::vector<int> &pos, int a, int b) const {
+    double before = part(pos, a, b);
+    std::swap(pos[a], pos[b]);
+    double after = part(pos, a, b);
+    std::swap(pos[a], pos[b]);
+    return after - before;
+  }
+};
+
+static void loadLayout(Model &m, const Json &kb, const Json &km, const std::set<std::string> &pins) {
+  const Json &layout = kb.at("layouts").at(km.at("layout").asString()).at("layout");
+  const Json &base = km.at("layers")[0];
+  if (base.size() != layout.size()) {
+    throw JsonError("layer 0 has " + std::to_string(base.size()) + " keys, the layout " +
+                    std::to_string(layout.size()));
+  }
+
+  double minX = 1e9, maxX = -1e9;
+  for (const Json &key : layout.items()) {
+    minX = std::min(minX, key.at("x").asNumber());
+    maxX = std::max(maxX, key.at("x").asNumber());
+  }
+  double middle = (minX + maxX) / 2;
+
+  std::map<std::string, int> seen;
+  for (size_t i = 0; i < base.size(); i++) {
+    std::string tap;
+    size_t at;
+    if (tapKey(base[i].asString(), tap, at) && isCharKey(tap)) seen[tap]++;
+  }
+  for (size_t i = 0; i < base.size(); i++) {
+    std::string tap;
+    size_t at;
+    if (!tapKey(base[i].asString(), tap, at) || !isCharKey(tap) || seen[tap] != 1) continue;
+    Slot s;
+    s.index = (int)i;
+    s.x = layout[i].at("x").asNumber();
+    s.y = layout[i].at("y").asNumber();
+    s.hand = s.x < middle ? 'L' : 'R';
+    m.slots.push_back(s);
+    m.keys.push_back(tap);
+    m.pinned.push_back(pins.count(tap) != 0);
+  }
+
+  // Columns per hand, innermost first: two for the index finger, then
+  // middle, ring and pinky for the rest
+  for (char hand : {'L', 'R'}) {
+    std::vector<double> cols;
+    for (const Slot &s : m.slots) {
+      if (s.hand == hand && std::find(cols.begin(), cols.end(), std::round(s.x)) == cols.end()) {
+        cols.push_back(std::round(s.x));
+      }
+    }
+    std::sort(cols.begin(), cols.end(), [&](double a, double b) { return fabs(a - middle) < fabs(b - middle); });
+    auto fingerOf = [](size_t rank) { return rank < 2 ? INDEX : rank == 2 ? MIDDLE : rank == 3 ? RING : PINKY; };
+    for (int f = 0; f < FINGERS; f++) {
+      // Home column: this finger's column nearest the middle finger
+      int homeCol = -1;
+      for (size_t r = 0; r < cols.size(); r++) {
+        if (fingerOf(r) != f) continue;
+        if (homeCol < 0 || fabs((double)r - 2) < fabs((double)homeCol - 2)) homeCol = (int)r;
+      }
+      if (homeCol < 0) continue;
+      std::vector<const Slot *> column;
+      for (const Slot &s : m.slots) {
+        if (s.hand == hand && std::round(s.x) == cols[homeCol]) column.push_back(&s);
+      }
+      std::sort(column.begin(), column.end(), [](const Slot *a, const Slot *b) { return a->y < b->y; });
+      const Slot *home = column[(column.size() - 1) / 2];
+      for (Slot &s : m.slots) {
+        size_t r = std::find(cols.begin(), cols.end(), std::round(s.x)) - cols.begin();
+        if (s.hand == hand && fingerOf(r) == f) {
+          s.finger = f;
+          s.travel = hypot(s.x - home->x, s.y - home->y);
+        }
+      }
+    }
+  }
+
+  const size_t N = m.n();
+  m.effort.resize(N);
+  m.sfb.assign(N * N, 0);
+  for (size_t s = 0; s < N; s++) {
+    m.effort[s] = kFingerWeight[m.slots[s].finger] * m.slots[s].travel;
+    for (size_t t = 0; t < N; t++) {
+      const Slot &a = m.slots[s], &b = m.slots[t];
+      if (s != t && a.hand == b.hand && a.finger == b.finger) {
+        m.sfb[s * N + t] = 1 + hypot(a.x - b.x, a.y - b.y);
+      }
+    }
+  }
+
+  memset(m.charKey, 0xFF, sizeof(m.charKey));
+  for (size_t k = 0; k < N; k++) {
+    const std::string &key = m.keys[k];
+    if (key.size() == 4) {
+      m.charKey[(uint8_t)(key[3] - 'A' + 'a')] = (int16_t)k;
+      m.charKey[(uint8_t)key[3]] = (int16_t)k;
+    }
+    for (const auto &c : kCharKeys) {
+      if (key == c.keycode) {
+        m.charKey[(uint8_t)c.plain] = (int16_t)k;
+        m.charKey[(uint8_t)c.shifted] = (int16_t)k;
+      }
+    }
+  }
+}
+
+static bool readFile(const std::string &path, std::string &text) {
+  FILE *f = fopen(path.c_str(), "rb");
+  if (!f) return false;
+  char buf[65536];
+  size_t got;
+  while ((got = fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, got);
+  fclose(f);
+  return true;
+}
+
+// Keystrokes and bigrams, each thread counting a slice of the text
+static void countCorpus(Model &m, const std::string &text, unsigned threads) {
+  const size_t N = m.n();
+  std::vector<std::vector<double>> uni(threads, std::vector<double>(N, 0));
+  std::vector<std::vector<double>> big(threads, std::vector<double>(N * N, 0));
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back([&, t] {
+      size_t from = text.size() * t / threads, to = text.size() * (t + 1) / threads;
+      // The bigram across the slice boundary belongs to this slice
+      int prev = from > 0 ? m.charKey[(uint8_t)text[from - 1]] : -1;
+      std::vector<uint64_t> u(N, 0), b(N * N, 0);
+      for (size_t i = from; i < to; i++) {
+        int k = m.charKey[(uint8_t)text[i]];
+        if (k >= 0) {
+          u[k]++;
+          if (prev >= 0) b[prev * N + k]++;
+        }
+        prev = k;
+      }
+      for (size_t k = 0; k < N; k++) uni[t][k] = (double)u[k];
+      for (size_t k = 0; k < N * N; k++) big[t][k] = (double)b[k];
+    });
+  }
+  for (std::thread &w : workers) w.join();
+
+  m.uni.assign(N, 0);
+  m.big.assign(N * N, 0);
+  for (unsigned t = 0; t < threads; t++) {
+    for (size_t k = 0; k < N; k++) m.uni[k] += uni[t][k];
+    for (size_t k = 0; k < N * N; k++) m.big[k] += big[t][k];
+  }
+  m.haveBigrams = true;
+}
+
+// Layer 0 counts of a `telemetry_analyze heatmap` dump, by layout index
+static bool readHeatmap(Model &m, const std::string &path) {
+  std::string text;
+  if (!readFile(path, text)) return false;
+  std::vector<double> counts;
+  int layer = -1;
+  size_t i = 0;
+  while (i < text.size()) {
+    size_t end = text.find('\n', i);
+    if (end == std::string::npos) end = text.size();
+    std::string line = text.substr(i, end - i);
+    i = end + 1;
+    unsigned l;
+    if (sscanf(line.c_str(), "layer %u:", &l) == 1) {
+      layer = (int)l;
+      continue;
+    }
+    if (layer != 0) continue;
+    const char *p = line.c_str();
+    char *next;
+    for (double v = strtod(p, &next); next != p; v = strtod(p, &next)) {
+      counts.push_back(v);
+      p = next;
+    }
+  }
+  m.uni.assign(m.n(), 0);
+  m.big.assign(m.n() * m.n(), 0);
+  for (size_t k = 0; k < m.n(); k++) {
+    int index = m.slots[k].index;
+    if (index < (int)counts.size()) m.uni[k] = counts[index];
+  }
+  return true;
+}
+
+struct Run {
+  std::vector<int> pos;
+  double cost = 0;
+};
+
+static Run anneal(const Model &m, uint64_t seed, uint64_t iterations) {
+  std::mt19937_64 rng(seed);
+  std::vector<int> movable;
+  for (size_t k = 0; k < m.n(); k++) {
+    if (!m.pinned[k]) movable.push_back((int)k);
+  }
+  Run r;
+  r.pos.resize(m.n());
+  for (size_t k = 0; k < m.n(); k++) r.pos[k] = (int)k;
+  if (movable.size() < 2) {
+    r.cost = m.cost(r.pos);
+    return r;
+  }
+
+  // Random start among the movable keys
+  std::vector<int> freeSlots;
+  for (int k : movable) freeSlots.push_back(r.pos[k]);
+  std::shuffle(freeSlots.begin(), freeSlots.end(), rng);
+  for (size_t i = 0; i < movable.size(); i++) r.pos[movable[i]] = freeSlots[i];
+
+  std::uniform_int_distribution<size_t> pick(0, movable.size() - 1);
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  double mean = 0;
+  for (int i = 0; i < 200; i++) {
+    int a = movable[pick(rng)], b = movable[pick(rng)];
+    if (a != b) mean += fabs(m.swapDelta(r.pos, a, b)) / 200;
+  }
+  double t0 = mean > 0 ? mean : 1, t1 = t0 / 1000;
+  double cool = pow(t1 / t0, 1.0 / (double)iterations);
+
+  double cost = m.cost(r.pos), temp = t0;
+  Run best = r;
+  best.cost = cost;
+  for (uint64_t i = 0; i < iterations; i++, temp *= cool) {
+    int a = movable[pick(rng)], b = movable[pick(rng)];
+    if (a == b) continue;
+    double delta = m.swapDelta(r.pos, a, b);
+    if (delta <= 0 || unit(rng) < exp(-delta / temp)) {
+      std::swap(r.pos[a], r.pos[b]);
+      cost += delta;
+      if (cost < best.cost) {
+        best.pos = r.pos;
+        best.cost = cost;
+      }
+    }
+  }
+  best.cost = m.cost(best.pos);  // without the rounding the deltas added up
+  return best;
+}
+
+static void describe(const Model &m, const std::vector<int> &pos, const char *label) {
+  const size_t N = m.n();
+  double strokes = 0, travel = 0, bigrams = 0, sfbs = 0;
+  double load[2][FINGERS] = {{0}};
+  for (size_t a = 0; a < N; a++) {
+    const Slot &s = m.slots[pos[a]];
+    strokes += m.uni[a];
+    travel += m.uni[a] * s.travel;
+    load[s.hand == 'R'][s.finger] += m.uni[a];
+    for (size_t b = 0; b < N; b++) {
+      bigrams += m.big[a * N + b];
+      if (m.sfb[pos[a] * N + pos[b]] > 0) sfbs += m.big[a * N + b];
+    }
+  }
+  printf("%-7s cost %.4g, travel %.3f keys/stroke", label, m.cost(pos), strokes > 0 ? travel / strokes : 0.0);
+  if (m.haveBigrams) printf(", same-finger bigrams %.2f%%", bigrams > 0 ? 100 * sfbs / bigrams : 0.0);
+  printf("\n        load L");
+  for (int f = PINKY; f < FINGERS; f++) printf(" %s %.1f%%", kFingerNames[f], strokes > 0 ? 100 * load[0][f] / strokes : 0.0);
+  printf(" | R");
+  for (int f = INDEX; f >= PINKY; f--) printf(" %s %.1f%%", kFingerNames[f], strokes > 0 ? 100 * load[1][f] / strokes : 0.0);
+  printf("\n");
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: layout_optimizer --keyboard keyboard.json --keymap keymap.json (--corpus FILE... | --heatmap FILE)\n"
+          "                        [-o out.json] [--threads N] [--restarts N] [--iterations N]\n"
+          "                        [--sfb-weight W] [--pin KC_X,KC_Y...] [--seed N]\n");
+}
+
+int main(int argc, char **argv) {
+  std::string kbPath, kmPath, heatmapPath, outPath;
+  std::vector<std::string> corpora;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  unsigned restarts = 16;
+  uint64_t iterations = 200000, seed = 1;
+  double sfbWeight = 2.0;
+  std::set<std::string> pins;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool more = i + 1 < argc;
+    if (arg == "--keyboard" && more) {
+      kbPath = argv[++i];
+    } else if (arg == "--keymap" && more) {
+      kmPath = argv[++i];
+    } else if (arg == "--corpus" && more) {
+      while (i + 1 < argc && argv[i + 1][0] != '-') corpora.push_back(argv[++i]);
+    } else if (arg == "--heatmap" && more) {
+      heatmapPath = argv[++i];
+    } else if (arg == "-o" && more) {
+      outPath = argv[++i];
+    } else if (arg == "--threads" && more) {
+      threads = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--restarts" && more) {
+      restarts = std::max(1, atoi(argv[++i]));
+    } else if (arg == "--iterations" && more) {
+      iterations = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--sfb-weight" && more) {
+      sfbWeight = atof(argv[++i]);
+    } else if (arg == "--seed" && more) {
+      seed = strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--pin" && more) {
+      std::string list = argv[++i];
+      for (size_t at = 0; at <= list.size();) {
+        size_t comma = list.find(',', at);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > at) pins.insert(canonical(list.substr(at, comma - at)));
+        at = comma + 1;
+      }
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (kbPath.empty() || kmPath.empty() || corpora.empty() == heatmapPath.empty()) {
+    usage();
+    return 1;
+  }
+
+  Model m;
+  m.sfbWeight = sfbWeight;
+  Json km;
+  try {
+    Json kb = Json::parseFile(kbPath);
+    km = Json::parseFile(kmPath);
+    loadLayout(m, kb, km, pins);
+  } catch (const JsonError &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  if (m.n() < 2) {
+    fprintf(stderr, "layer 0 has no character keys to rearrange\n");
+    return 1;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  size_t chars = 0;
+  if (!corpora.empty()) {
+    std::string text;
+    for (const std::string &path : corpora) {
+      if (!readFile(path, text)) {
+        fprintf(stderr, "cannot read %s\n", path.c_str());
+        return 1;
+      }
+    }
+    chars = text.size();
+    t0 = std::chrono::steady_clock::now();
+    countCorpus(m, text, threads);
+  } else if (!readHeatmap(m, heatmapPath)) {
+    fprintf(stderr, "cannot read %s\n", heatmapPath.c_str());
+    return 1;
+  }
+  double countS = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  // Runs handed out to the threads one at a time
+  t0 = std::chrono::steady_clock::now();
+  std::vector<Run> runs(restarts);
+  std::atomic<unsigned> next(0);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < std::min(threads, restarts); t++) {
+    workers.emplace_back([&] {
+      for (unsigned r; (r = next++) < restarts;) runs[r] = anneal(m, seed + r, iterations);
+    });
+  }
+  for (std::thread &w : workers) w.join();
+  double searchS = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+  std::vector<int> original(m.n());
+  for (size_t k = 0; k < m.n(); k++) original[k] = (int)k;
+  Run best;
+  best.pos = original;
+  best.cost = m.cost(original);
+  for (const Run &r : runs) {
+    if (r.cost < best.cost - 1e-9) best = r;
+  }
+
+  printf("%zu movable keys (%zu pinned), %s\n", m.n(), pins.size(),
+         m.haveBigrams ? "corpus: travel and same-finger bigrams" : "heatmap: travel only");
+  if (chars) {
+    printf("counted %zu chars in %.3f s on %u threads (%.1f Mchar/s)\n", chars, countS, threads,
+           chars / countS / 1e6);
+  }
+  printf("%u runs x %llu swaps in %.2f s on %u threads (%.2f Mswaps/s)\n", restarts,
+         (unsigned long long)iterations, searchS, std::min(threads, restarts),
+         restarts * (double)iterations / searchS / 1e6);
+  describe(m, original, "before");
+  describe(m, best.pos, "after");
+
+  // Base layer with the keys moved, wrappers (mod-taps) left on their positions
+  Json layers = Json::array();
+  for (size_t l = 0; l < km.at("layers").size(); l++) {
+    Json layer = km.at("layers")[l];
+    if (l == 0) {
+      Json moved = Json::array();
+      for (size_t i = 0; i < layer.size(); i++) {
+        std::string name = layer[i].asString();
+        for (size_t s = 0; s < m.n(); s++) {
+          if (m.slots[s].index != (int)i) continue;
+          size_t k = std::find(best.pos.begin(), best.pos.end(), (int)s) - best.pos.begin();
+          std::string tap;
+          size_t at;
+          tapKey(name, tap, at);
+          size_t len = name.find('(') == std::string::npos ? name.size() : name.size() - 1 - at;
+          name = name.substr(0, at) + m.keys[k] + name.substr(at + len);
+        }
+        moved.push(Json(name));
+      }
+      layer = moved;
+    }
+    layers.push(layer);
+  }
+
+  printf("\nlayer 0:\n");
+  const Json &base = layers[0];
+  for (size_t i = 0; i < base.size(); i++) {
+    printf("%-16s%s", base[i].asString().c_str(), i % 10 == 9 || i + 1 == base.size() ? "\n" : "");
+  }
+
+  if (!outPath.empty()) {
+    km.set("layers", layers);
+    FILE *out = fopen(outPath.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "cannot write %s\n", outPath.c_str());
+      return 1;
+    }
+    std::string text = km.dump() + "\n";
+    fwrite(text.data(), 1, text.size(), out);
+    fclose(out);
+  }
+  return 0;
+}
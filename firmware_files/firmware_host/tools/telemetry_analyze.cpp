@@ -0,0 +1,488 @@
+// Capture and analyze the raw HID matrix telemetry stream
+// (format in firmware_common/telemetry.h).
+//
+//   telemetry_analyze capture /dev/hidrawN capture.bin [--trace]
+//       Starts the stream and appends every telemetry report to the file
+//       until Ctrl-C, then stops the stream again. --trace also records the
+//       unfiltered scan edges, for trace_tool from-telemetry.
+//
+//   telemetry_analyze report capture.bin [--chatter-us N] [--top N]
+//       Reads a capture in fixed size chunks (memory use does not grow with
+//       capture length) and reports chatter per key, per half the debounce
+//       latency (first raw press edge to debounced press) and the press to
+//       report latency (first raw press edge to the keyboard report its
+//       press sent, which for a tap-hold key or a combo key includes the
+//       time it was held back), and the skew between the halves: for keys
+//       on both halves whose first raw press edges came in the same scan,
+//       the time between their debounced presses.
+//
+//   telemetry_analyze heatmap /dev/hidrawN [--clear]
+//       Reads the press counters per key and layer (firmware_common/
+//       key_heatmap.h) and prints them per layer in layout order, ten keys
+//       a line. --clear zeroes them on the keyboard after reading.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/tools/telemetry_analyze.cpp -o /tmp/telemetry_analyze
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "../../firmware_common/key_heatmap.h"
+#include "../../firmware_common/telemetry.h"
+
+#define MAX_ROWS 32
+#define MAX_COLS 32
+
+// Latency histogram: 10 us buckets up to 100 ms, then one overflow bucket
+#define LATENCY_BUCKET_US 10
+#define LATENCY_BUCKETS 10000
+
+// A raw press older than this without a debounced press is a glitch
+#define PENDING_TIMEOUT_US 1000000
+
+// Debounced presses per half kept to pair with the other half's
+#define RECENT_PRESSES 8
+
+struct KeyStats {
+  uint64_t rawEdges = 0;
+  uint64_t debouncedEdges = 0;
+  uint64_t chatter = 0;
+  uint64_t lastRawUs = 0;
+  uint64_t pendingPressUs = 0;
+  uint64_t reportPressUs = 0; // first raw edge of a debounced press waiting for its report
+  bool seen = false;
+  bool pressPending = false;
+  bool reportPending = false;
+};
+
+struct LatencyStats {
+  std::vector<uint64_t> buckets = std::vector<uint64_t>(LATENCY_BUCKETS + 1, 0);
+  uint64_t count = 0;
+  uint64_t totalUs = 0;
+  uint64_t maxUs = 0;
+
+  void add(uint64_t us) {
+    uint64_t bucket = us / LATENCY_BUCKET_US;
+    buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS]++;
+    count++;
+    totalUs += us;
+    maxUs = std::max(maxUs, us);
+  }
+
+  // Upper edge of the bucket holding the given percentile
+  uint64_t percentile(double p) const {
+    if (count == 0) {
+      return 0;
+    }
+    uint64_t target = (uint64_t)(p * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+      seen += buckets[i];
+      if (seen >= target) {
+        return i < LATENCY_BUCKETS ? (i + 1) * LATENCY_BUCKET_US : maxUs;
+      }
+    }
+    return maxUs;
+  }
+
+  double mean() const { return count ? (double)totalUs / count : 0.0; }
+};
+
+// A debounced press and the scan its first raw edge came in
+struct RecentPress {
+  uint64_t rawUs = 0;
+  uint64_t debouncedUs = 0;
+  bool paired = true;
+};
+
+struct Analyzer {
+  uint64_t chatterUs = 5000;
+
+  KeyStats keys[MAX_ROWS][MAX_COLS];
+  LatencyStats latency[2]; // [0] right half, [1] left half
+  LatencyStats reportLatency[2];
+
+  // Cross-half pairs: |left - right| between the debounced presses, and the
+  // signed sum for the mean
+  RecentPress recent[2][RECENT_PRESSES];
+  uint8_t recentNext[2] = {0, 0};
+  LatencyStats skew;
+  int64_t skewSumUs = 0;
+
+  uint64_t reports = 0;
+  uint64_t records = 0;
+  uint64_t lostReports = 0;
+  uint64_t droppedRecords = 0;
+  uint64_t badReports = 0;
+  uint64_t firstUs = 0;
+  uint64_t lastUs = 0;
+
+  uint8_t expectedSeq = 0;
+  uint32_t lastRawTime = 0;
+  uint64_t wrapOffset = 0;
+
+  // Extend the 32 bit device clock to 64 bits across wraps
+  uint64_t unwrap(uint32_t t) {
+    if (records > 0 && t < lastRawTime && lastRawTime - t > 0x80000000u) {
+      wrapOffset += 0x100000000ull;
+    }
+    lastRawTime = t;
+    return wrapOffset + t;
+  }
+
+  void addReport(const uint8_t *report) {
+    if (report[0] != TELEMETRY_REPORT_ID || report[2] > TELEMETRY_RECORDS_PER_REPORT) {
+      badReports++;
+      return;
+    }
+    if (reports > 0) {
+      lostReports += (uint8_t)(report[1] - expectedSeq);
+    }
+    expectedSeq = report[1] + 1;
+    droppedRecords += report[3];
+    reports++;
+
+    for (uint8_t i = 0; i < report[2]; i++) {
+      telemetry_record_t rec;
+      telemetry_unpack(&rec, &report[TELEMETRY_HEADER_SIZE + i * TELEMETRY_RECORD_SIZE]);
+      addRecord(rec);
+    }
+  }
+
+  void addRecord(const telemetry_record_t &rec) {
+    uint64_t t = unwrap(rec.time_us);
+    if (records == 0) {
+      firstUs = t;
+    }
+    lastUs = t;
+    records++;
+
+    if (rec.row >= MAX_ROWS || rec.col >= MAX_COLS) {
+      return;
+    }
+    if (rec.flags & TELEMETRY_UNFILTERED) {
+      return; // trace recording only, the raw edges below cover the same keys
+    }
+    KeyStats &key = keys[rec.row][rec.col];
+    key.seen = true;
+    bool pressed = rec.flags & TELEMETRY_PRESSED;
+    int half = (rec.flags & TELEMETRY_LEFT_HALF) ? 1 : 0;
+
+    if (rec.flags & TELEMETRY_HID_REPORT) {
+      // The first report the key's press sent, even if that came after
+      // its release (a tap)
+      if (pressed && key.reportPending) {
+        reportLatency[half].add(t - key.reportPressUs);
+        key.reportPending = false;
+      }
+      return;
+    }
+
+    if (!(rec.flags & TELEMETRY_DEBOUNCED)) {
+      // Raw edge closer than the chatter window to the previous one
+      if (key.rawEdges > 0 && t - key.lastRawUs < chatterUs) {
+        key.chatter++;
+      }
+      key.rawEdges++;
+      key.lastRawUs = t;
+      if (key.pressPending && t - key.pendingPressUs > PENDING_TIMEOUT_US) {
+        key.pressPending = false;
+      }
+      if (pressed && !key.pressPending) {
+        key.pressPending = true;
+        key.pendingPressUs = t;
+      }
+      return;
+    }
+
+    key.debouncedEdges++;
+    if (pressed && key.pressPending) {
+      latency[half].add(t - key.pendingPressUs);
+      pairAcrossHalves(half, key.pendingPressUs, t);
+      key.reportPending = true;
+      key.reportPressUs = key.pendingPressUs;
+    }
+    key.pressPending = false;
+  }
+
+  // Pairs a debounced press with one on the other half that started in the
+  // same scan (raw edges of one scan share its timestamp)
+  void pairAcrossHalves(int half, uint64_t rawUs, uint64_t debouncedUs) {
+    RecentPress *match = nullptr;
+    for (RecentPress &other : recent[1 - half]) {
+      if (!other.paired && other.rawUs == rawUs) {
+        match = &other;
+        break;
+      }
+    }
+    if (match) {
+      match->paired = true;
+      int64_t leftMinusRight = half == 1 ? (int64_t)(debouncedUs - match->debouncedUs)
+                                         : (int64_t)(match->debouncedUs - debouncedUs);
+      skew.add(leftMinusRight < 0 ? -leftMinusRight : leftMinusRight);
+      skewSumUs += leftMinusRight;
+      return;
+    }
+    RecentPress &slot = recent[half][recentNext[half]];
+    recentNext[half] = (recentNext[half] + 1) % RECENT_PRESSES;
+    slot.rawUs = rawUs;
+    slot.debouncedUs = debouncedUs;
+    slot.paired = false;
+  }
+
+  void print(unsigned top) const {
+    printf("reports %llu, records %llu, lost reports %llu, dropped records %llu, bad reports %llu\n",
+           (unsigned long long)reports, (unsigned long long)records, (unsigned long long)lostReports,
+           (unsigned long long)droppedRecords, (unsigned long long)badReports);
+    printf("span %.1f s\n\n", (lastUs - firstUs) / 1e6);
+
+    const char *names[2] = {"right", "left"};
+    auto table = [&names](const char *title, const LatencyStats *stats) {
+      printf("%s (us)\n", title);
+      printf("  half   presses     mean      p50      p90      p99      max\n");
+      for (int half = 0; half < 2; half++) {
+        const LatencyStats &l = stats[half];
+        printf("  %-5s %8llu %8.0f %8llu %8llu %8llu %8llu\n", names[half], (unsigned long long)l.count, l.mean(),
+               (unsigned long long)l.percentile(0.50), (unsigned long long)l.percentile(0.90),
+               (unsigned long long)l.percentile(0.99), (unsigned long long)l.maxUs);
+      }
+    };
+    table("debounce latency, first raw press edge to debounced press", latency);
+    printf("\n");
+    table("press to report, first raw press edge to the keyboard report the press sent", reportLatency);
+
+    printf("\ncross-half skew, keys on both halves pressed in the same scan: debounced left - right (us)\n");
+    if (skew.count) {
+      printf("  pairs %llu, mean %+.0f, |skew| p50 %llu p99 %llu max %llu\n", (unsigned long long)skew.count,
+             (double)skewSumUs / skew.count, (unsigned long long)skew.percentile(0.50),
+             (unsigned long long)skew.percentile(0.99), (unsigned long long)skew.maxUs);
+    } else {
+      printf("  no pairs in this capture\n");
+    }
+
+    struct Entry {
+      uint8_t row, col;
+      const KeyStats *stats;
+    };
+    std::vector<Entry> entries;
+    for (uint8_t row = 0; row < MAX_ROWS; row++) {
+      for (uint8_t col = 0; col < MAX_COLS; col++) {
+        if (keys[row][col].seen) {
+          entries.push_back({row, col, &keys[row][col]});
+        }
+      }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.stats->chatter > b.stats->chatter; });
+
+    printf("\nchatter (raw edges < %llu us apart), worst %u keys\n", (unsigned long long)chatterUs, top);
+    printf("  row col   raw edges  debounced    chatter  raw/debounced\n");
+    for (size_t i = 0; i < entries.size() && i < top; i++) {
+      const KeyStats &k = *entries[i].stats;
+      printf("  %3u %3u %11llu %10llu %10llu %14.2f\n", entries[i].row, entries[i].col,
+             (unsigned long long)k.rawEdges, (unsigned long long)k.debouncedEdges, (unsigned long long)k.chatter,
+             k.debouncedEdges ? (double)k.rawEdges / k.debouncedEdges : 0.0);
+    }
+  }
+};
+
+static int report(const char *path, uint64_t chatterUs, unsigned top) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  // Large analyzer state lives on the heap, the capture is streamed
+  Analyzer *analyzer = new Analyzer();
+  analyzer->chatterUs = chatterUs;
+
+  static uint8_t chunk[TELEMETRY_REPORT_SIZE * 1024];
+  size_t got;
+  while ((got = fread(chunk, TELEMETRY_REPORT_SIZE, 1024, in)) > 0) {
+    for (size_t i = 0; i < got; i++) {
+      analyzer->addReport(&chunk[i * TELEMETRY_REPORT_SIZE]);
+    }
+  }
+  fclose(in);
+
+  analyzer->print(top);
+  delete analyzer;
+  return 0;
+}
+
+static volatile sig_atomic_t stopCapture = 0;
+
+static void onSignal(int) { stopCapture = 1; }
+
+static bool sendCommand(int fd, uint8_t command) {
+  // Leading zero is the (absent) report id
+  uint8_t packet[TELEMETRY_REPORT_SIZE + 1] = {0};
+  packet[1] = TELEMETRY_REPORT_ID;
+  packet[2] = command;
+  return write(fd, packet, sizeof(packet)) == (ssize_t)sizeof(packet);
+}
+
+static int capture(const char *device, const char *path, bool trace) {
+  int fd = open(device, O_RDWR);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+  FILE *out = fopen(path, "ab");
+  if (!out) {
+    fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+    close(fd);
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  if (!sendCommand(fd, trace ? TELEMETRY_CMD_START_TRACE : TELEMETRY_CMD_START)) {
+    fprintf(stderr, "cannot start telemetry: %s\n", strerror(errno));
+  }
+
+  uint64_t count = 0;
+  uint8_t buf[64];
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (!stopCapture) {
+    if (poll(&pfd, 1, 200) <= 0) {
+      continue;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "read failed: %s\n", strerror(errno));
+      break;
+    }
+    if (n == TELEMETRY_REPORT_SIZE && buf[0] == TELEMETRY_REPORT_ID) {
+      fwrite(buf, TELEMETRY_REPORT_SIZE, 1, out);
+      if (++count % 1000 == 0) {
+        fprintf(stderr, "\r%llu reports", (unsigned long long)count);
+      }
+    }
+  }
+
+  sendCommand(fd, TELEMETRY_CMD_STOP);
+  fprintf(stderr, "\r%llu reports captured\n", (unsigned long long)count);
+  fclose(out);
+  close(fd);
+  return 0;
+}
+
+// One heatmap request and its answer, skipping any telemetry reports in between
+static bool heatmapRequest(int fd, uint8_t command, uint16_t first, uint8_t *answer) {
+  uint8_t packet[HEATMAP_REPORT_SIZE + 1] = {0};
+  packet[1] = HEATMAP_REPORT_ID;
+  packet[2] = command;
+  heatmap_put16(&packet[3], first);
+  if (write(fd, packet, sizeof(packet)) != (ssize_t)sizeof(packet)) {
+    return false;
+  }
+  struct pollfd pfd = {fd, POLLIN, 0};
+  errno = 0;
+  while (poll(&pfd, 1, 1000) > 0) {
+    uint8_t buf[64];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    if (n == HEATMAP_REPORT_SIZE && buf[0] == HEATMAP_REPORT_ID && heatmap_get16(&buf[2]) == first) {
+      memcpy(answer, buf, HEATMAP_REPORT_SIZE);
+      return true;
+    }
+  }
+  if (errno == 0 || errno == EINTR) {
+    errno = ETIMEDOUT;
+  }
+  return false;
+}
+
+static int heatmap(const char *device, bool clear) {
+  int fd = open(device, O_RDWR);
+  if (fd < 0) {
+    fprintf(stderr, "cannot open %s: %s\n", device, strerror(errno));
+    return 1;
+  }
+
+  std::vector<uint16_t> counts;
+  uint8_t layers = 0, keys = 0;
+  uint8_t answer[HEATMAP_REPORT_SIZE];
+  do {
+    if (!heatmapRequest(fd, HEATMAP_CMD_READ, (uint16_t)counts.size(), answer)) {
+      fprintf(stderr, "heatmap read failed: %s\n", strerror(errno));
+      close(fd);
+      return 1;
+    }
+    layers = answer[5];
+    keys = answer[6];
+    for (uint8_t i = 0; i < answer[4]; i++) {
+      counts.push_back(heatmap_get16(&answer[HEATMAP_HEADER_SIZE + 2 * i]));
+    }
+  } while (answer[4] > 0 && counts.size() < (size_t)layers * keys);
+
+  for (uint8_t layer = 0; layer < layers; layer++) {
+    uint64_t total = 0;
+    for (uint8_t key = 0; key < keys; key++) {
+      total += counts[layer * keys + key];
+    }
+    printf("layer %u: %llu presses\n", layer, (unsigned long long)total);
+    for (uint8_t key = 0; key < keys; key++) {
+      printf("%6u%s", counts[layer * keys + key], key % 10 == 9 || key + 1 == keys ? "\n" : "");
+    }
+  }
+
+  if (clear && !heatmapRequest(fd, HEATMAP_CMD_CLEAR, 0, answer)) {
+    fprintf(stderr, "heatmap clear failed: %s\n", strerror(errno));
+  }
+  close(fd);
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: telemetry_analyze capture <hidraw device> <capture file> [--trace]\n"
+          "       telemetry_analyze report <capture file> [--chatter-us N] [--top N]\n"
+          "       telemetry_analyze heatmap <hidraw device> [--clear]\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 4 && strcmp(argv[1], "capture") == 0) {
+    return capture(argv[2], argv[3], argc >= 5 && strcmp(argv[4], "--trace") == 0);
+  }
+  if (argc >= 3 && strcmp(argv[1], "report") == 0) {
+    uint64_t chatterUs = 5000;
+    unsigned top = 10;
+    for (int i = 3; i + 1 < argc; i += 2) {
+      if (strcmp(argv[i], "--chatter-us") == 0) {
+        chatterUs = strtoull(argv[i + 1], nullptr, 10);
+      } else if (strcmp(argv[i], "--top") == 0) {
+        top = (unsigned)strtoul(argv[i + 1], nullptr, 10);
+      } else {
+        usage();
+        return 1;
+      }
+    }
+    return report(argv[2], chatterUs, top);
+  }
+  if (argc >= 3 && strcmp(argv[1], "heatmap") == 0) {
+    return heatmap(argv[2], argc >= 4 && strcmp(argv[3], "--clear") == 0);
+  }
+  usage();
+  return 1;
+}
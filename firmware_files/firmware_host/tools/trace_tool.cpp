@@ -0,0 +1,789 @@
+// Create and inspect typing-session traces (format in firmware_host/sim/trace.h).
+//
+//   trace_tool gen --keyboard keyboard.json --keymap keymap.json --corpus FILE
+//                  [--kind text|vim|script] [--wpm N] [--seed N] -o out.trace
+//       Types a corpus on the given keymap with a human-like timing model:
+//       log-normal gaps between keys, 40+ ms dwell, rollover where a gap is
+//       shorter than the previous dwell, modifiers and layer keys pressed
+//       before and released after the key they apply to, and 0-3 contact
+//       bounces of 0.1-0.8 ms on every edge. Mod-taps (LSFT_T(KC_F),
+//       MT(MOD_LSFT, KC_F)) type their key and serve as the modifier; the
+//       modifier on the other hand from the key is used, the way home row
+//       mods are typed. Modifier and layer holds are recorded in the trace
+//       as intended holds.
+//         text   - plain text (firmware_host/corpus/prose.txt)
+//         vim    - text with <Esc>, <CR>, <BS>, <Tab> and <C-x> chords
+//                  (firmware_host/corpus/vim.txt)
+//         script - timed press/release lines (firmware_host/corpus/gaming.txt)
+//       Characters the keymap cannot produce are skipped and counted.
+//
+//   trace_tool from-telemetry capture.bin out.trace [--rows N] [--cols N]
+//       Converts a telemetry capture (firmware_host/tools/telemetry_analyze
+//       capture) into a trace. Only the unfiltered scan edges (taken before
+//       the encoder and ghosting fixes) are used.
+//
+//   trace_tool info trace
+//       Header, size and per-key press counts.
+//
+// Build (from firmware_files/):
+//   g++ -O2 -std=c++17 firmware_host/tools/trace_tool.cpp -o /tmp/trace_tool
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "json.h"
+#include "../sim/trace.h"
+#include "../../firmware_common/telemetry.h"
+
+struct Pos {
+  uint8_t row;
+  uint8_t col;
+  bool operator==(const Pos &o) const { return row == o.row && col == o.col; }
+  bool operator<(const Pos &o) const { return row != o.row ? row < o.row : col < o.col; }
+};
+
+// One key with the modifiers and layer keys held around it
+struct Stroke {
+  std::vector<Pos> holds;
+  Pos key;
+};
+
+struct Keymap {
+  uint8_t rows = 0;
+  uint8_t cols = 0;
+  std::vector<Pos> layout;                                 // layout index -> matrix position
+  std::vector<char> hands;                                 // layout index -> 'L' or 'R'
+  std::map<std::string, std::vector<int>> modTaps;         // modifier keycode -> layer 0 mod-taps
+  std::vector<std::vector<std::string>> layers;            // keycode names per layer
+  std::map<std::string, std::pair<int, int>> lookupCache;  // name -> (layer, layout index)
+
+  static std::string canonical(const std::string &name) {
+    static const std::map<std::string, std::string> aliases = {
+      {"KC_ENTER", "KC_ENT"}, {"KC_SPACE", "KC_SPC"}, {"KC_ESCAPE", "KC_ESC"}, {"KC_BACKSPACE", "KC_BSPC"},
+      {"KC_MINUS", "KC_MINS"}, {"KC_EQUAL", "KC_EQL"}, {"KC_COMMA", "KC_COMM"}, {"KC_SLASH", "KC_SLSH"},
+      {"KC_SEMICOLON", "KC_SCLN"}, {"KC_QUOTE", "KC_QUOT"}, {"KC_GRAVE", "KC_GRV"},
+    };
+    auto it = aliases.find(name);
+    return it == aliases.end() ? name : it->second;
+  }
+
+  // LSFT_T(KC_F) or MT(MOD_LSFT, KC_F) -> KC_LSFT and KC_F
+  static bool modTap(const std::string &name, std::string &mod, std::string &tap) {
+    size_t open = name.find('(');
+    if (open == std::string::npos || name.back() != ')') {
+      return false;
+    }
+    std::string head = name.substr(0, open);
+    std::string args = name.substr(open + 1, name.size() - open - 2);
+    if (head == "MT") {
+      size_t comma = args.find(',');
+      if (comma == std::string::npos || args.compare(0, 4, "MOD_") != 0) {
+        return false;
+      }
+      mod = "KC_" + args.substr(4, comma - 4);
+      tap = args.substr(comma + 1);
+      tap.erase(0, tap.find_first_not_of(' '));
+    } else if (head.size() == 6 && head.compare(4, 2, "_T") == 0) {
+      mod = "KC_" + head.substr(0, 4);
+      tap = args;
+    } else {
+      return false;
+    }
+    tap = canonical(tap);
+    return true;
+  }
+
+  void load(const std::string &kbPath, const std::string &kmPath) {
+    Json kb = Json::parseFile(kbPath);
+    Json km = Json::parseFile(kmPath);
+    if (const Json *size = kb.find("matrix_size")) {
+      rows = size->at("rows").asInt();
+      cols = size->at("cols").asInt();
+    } else {
+      rows = kb.at("matrix_pins").at("rows").size();
+      cols = kb.at("matrix_pins").at("cols").size();
+    }
+    if (rows > TRACE_MAX_ROWS || cols > TRACE_MAX_COLS) {
+      throw JsonError("matrix larger than the trace format allows");
+    }
+    const Json &keys = kb.at("layouts").at(km.at("layout").asString()).at("layout");
+    double minX = 1e9, maxX = -1e9;
+    std::vector<double> xs;
+    for (const Json &key : keys.items()) {
+      layout.push_back(Pos{(uint8_t)key.at("matrix")[0].asInt(), (uint8_t)key.at("matrix")[1].asInt()});
+      xs.push_back(key.at("x").asNumber());
+      minX = std::min(minX, xs.back());
+      maxX = std::max(maxX, xs.back());
+    }
+    for (double x : xs) {
+      hands.push_back(x < (minX + maxX) / 2 ? 'L' : 'R');
+    }
+    for (const Json &layer : km.at("layers").items()) {
+      std::vector<std::string> names;
+      for (const Json &name : layer.items()) {
+        std::string mod, tap;
+        if (modTap(name.asString(), mod, tap)) {
+          if (layers.empty()) {
+            modTaps[mod].push_back((int)names.size());
+          }
+          names.push_back(tap);
+        } else {
+          names.push_back(canonical(name.asString()));
+        }
+      }
+      layers.push_back(names);
+    }
+  }
+
+  // First position of a keycode, lowest layer first
+  bool find(const std::string &name, int &layer, int &index) {
+    auto cached = lookupCache.find(name);
+    if (cached != lookupCache.end()) {
+      layer = cached->second.first;
+      index = cached->second.second;
+      return layer >= 0;
+    }
+    layer = index = -1;
+    for (size_t l = 0; l < layers.size() && layer < 0; l++) {
+      for (size_t i = 0; i < layers[l].size(); i++) {
+        if (layers[l][i] == name) {
+          layer = (int)l;
+          index = (int)i;
+          break;
+        }
+      }
+    }
+    lookupCache[name] = std::make_pair(layer, index);
+    return layer >= 0;
+  }
+
+  // Key on layer 0 that activates layer n while held (MO) or toggles it (TG)
+  bool layerKey(int n, Pos &pos, bool &toggle) {
+    int layer, index;
+    if (find("MO(" + std::to_string(n) + ")", layer, index) && layer == 0) {
+      pos = layout[index];
+      toggle = false;
+      return true;
+    }
+    if (find("TG(" + std::to_string(n) + ")", layer, index) && layer == 0) {
+      pos = layout[index];
+      toggle = true;
+      return true;
+    }
+    return false;
+  }
+
+  // Resolve a keycode into the key plus what has to be held (or toggled) first
+  bool stroke(const std::string &name, std::vector<Pos> &holds, std::vector<Pos> &toggles, Pos &key) {
+    int layer, index;
+    if (!find(name, layer, index)) {
+      return false;
+    }
+    if (layer > 0) {
+      Pos lpos;
+      bool toggle;
+      if (!layerKey(layer, lpos, toggle)) {
+        return false;
+      }
+      (toggle ? toggles : holds).push_back(lpos);
+    }
+    key = layout[index];
+    return true;
+  }
+
+  char hand(Pos pos) const {
+    for (size_t i = 0; i < layout.size(); i++) {
+      if (layout[i] == pos) {
+        return hands[i];
+      }
+    }
+    return 'L';
+  }
+
+  // A layer 0 key giving the modifier, on the other hand from key if there is one
+  bool modifier(const char *left, const char *right, Pos key, Pos &pos) {
+    std::vector<int> candidates;
+    for (const char *name : {left, right}) {
+      int layer, index;
+      if (find(name, layer, index) && layer == 0) {
+        candidates.push_back(index);
+      }
+      auto it = modTaps.find(name);
+      if (it != modTaps.end()) {
+        candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+      }
+    }
+    if (candidates.empty()) {
+      return false;
+    }
+    pos = layout[candidates[0]];
+    for (int index : candidates) {
+      if (hands[index] != hand(key)) {
+        pos = layout[index];
+        break;
+      }
+    }
+    return true;
+  }
+
+  // Matrix position a keycode is typed with, ignoring layer keys
+  bool position(const std::string &name, Pos &pos) {
+    int layer, index;
+    if (!find(name, layer, index)) {
+      return false;
+    }
+    pos = layout[index];
+    return true;
+  }
+};
+
+// US layout: unshifted keycode for a character, and whether it needs shift
+static bool charKeycode(char c, std::string &name, bool &shifted, std::string &alias) {
+  static const char *const kUnshifted[][2] = {
+    {" ", "KC_SPC"}, {"\n", "KC_ENT"}, {"\t", "KC_TAB"}, {"-", "KC_MINS"}, {"=", "KC_EQL"},
+    {"[", "KC_LBRC"}, {"]", "KC_RBRC"}, {"\\", "KC_BSLS"}, {";", "KC_SCLN"}, {"'", "KC_QUOT"},
+    {"`", "KC_GRV"}, {",", "KC_COMM"}, {".", "KC_DOT"}, {"/", "KC_SLSH"},
+  };
+  static const char *const kShifted[][3] = {
+    {"!", "KC_1", "KC_EXLM"}, {"@", "KC_2", "KC_AT"}, {"#", "KC_3", "KC_HASH"}, {"$", "KC_4", "KC_DLR"},
+    {"%", "KC_5", "KC_PERC"}, {"^", "KC_6", "KC_CIRC"}, {"&", "KC_7", "KC_AMPR"}, {"*", "KC_8", "KC_ASTR"},
+    {"(", "KC_9", "KC_LPRN"}, {")", "KC_0", "KC_RPRN"}, {"_", "KC_MINS", "KC_UNDS"}, {"+", "KC_EQL", "KC_PLUS"},
+    {"{", "KC_LBRC", "KC_LCBR"}, {"}", "KC_RBRC", "KC_RCBR"}, {"|", "KC_BSLS", "KC_PIPE"},
+    {":", "KC_SCLN", "KC_COLN"}, {"\"", "KC_QUOT", "KC_DQUO"}, {"~", "KC_GRV", "KC_TILD"},
+    {"<", "KC_COMM", "KC_LABK"}, {">", "KC_DOT", "KC_RABK"}, {"?", "KC_SLSH", "KC_QUES"},
+  };
+  shifted = false;
+  alias.clear();
+  if (c >= 'a' && c <= 'z') {
+    name = std::string("KC_") + (char)(c - 'a' + 'A');
+    return true;
+  }
+  if (c >= 'A' && c <= 'Z') {
+    name = std::string("KC_") + c;
+    shifted = true;
+    return true;
+  }
+  if (c >= '0' && c <= '9') {
+    name = std::string("KC_") + c;
+    return true;
+  }
+  for (const auto &u : kUnshifted) {
+    if (c == u[0][0]) {
+      name = u[1];
+      return true;
+    }
+  }
+  for (const auto &s : kShifted) {
+    if (c == s[0][0]) {
+      name = s[1];
+      alias = s[2];
+      shifted = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+struct Interval {
+  Pos pos;
+  double downMs;
+  double upMs;
+  bool hold; // modifier or layer key held around other keys
+};
+
+struct Generator {
+  Keymap &keymap;
+  std::mt19937 rng;
+  double gapMs;   // median gap between key onsets
+  double nowMs = 200;
+  std::vector<Interval> intervals;
+  std::map<Pos, size_t> lastInterval;
+  uint32_t skipped = 0;
+  uint32_t unshifted = 0;
+
+  Generator(Keymap &k, uint32_t seed, double wpm) : keymap(k), rng(seed), gapMs(60000.0 / (wpm * 5)) {}
+
+  double uniform(double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); }
+
+  double gap() {
+    std::lognormal_distribution<double> dist(std::log(gapMs), 0.35);
+    return std::max(25.0, dist(rng));
+  }
+
+  double dwell() {
+    std::normal_distribution<double> dist(95, 20);
+    return std::max(40.0, dist(rng));
+  }
+
+  // Press pos over [down, up]; a hold overlapping its previous hold extends it
+  void press(Pos pos, double down, double up, bool hold) {
+    auto it = lastInterval.find(pos);
+    if (it != lastInterval.end()) {
+      Interval &prev = intervals[it->second];
+      if (hold && prev.hold && down <= prev.upMs + 10) {
+        prev.upMs = std::max(prev.upMs, up);
+        return;
+      }
+      // A key cannot go down again before it came up
+      if (down < prev.upMs + 15) {
+        double shift = prev.upMs + 15 - down;
+        down += shift;
+        up += shift;
+      }
+    }
+    lastInterval[pos] = intervals.size();
+    intervals.push_back(Interval{pos, down, up, hold});
+  }
+
+  void typeStroke(const std::vector<Pos> &holds, const std::vector<Pos> &toggles, Pos key, double gapScale = 1.0) {
+    double onset = nowMs + gap() * gapScale;
+    double len = dwell();
+    for (Pos t : toggles) {
+      press(t, onset - 120, onset - 70, false);
+    }
+    for (size_t i = 0; i < holds.size(); i++) {
+      press(holds[i], onset - 45 + 5 * i, onset + len + 25, true);
+    }
+    press(key, onset, onset + len, false);
+    for (Pos t : toggles) {
+      press(t, onset + len + 40, onset + len + 90, false);
+    }
+    nowMs = onset + (toggles.empty() ? 0 : 90);
+  }
+
+  bool typeKeycode(const std::string &name, std::vector<Pos> holds, double gapScale = 1.0) {
+    std::vector<Pos> toggles;
+    Pos key;
+    if (!keymap.stroke(name, holds, toggles, key)) {
+      return false;
+    }
+    typeStroke(holds, toggles, key, gapScale);
+    return true;
+  }
+
+  void typeChar(char c, double gapScale = 1.0) {
+    std::string name, alias;
+    bool shifted;
+    if (!charKeycode(c, name, shifted, alias)) {
+      skipped++;
+      return;
+    }
+    if (!alias.empty() && typeKeycode(alias, {}, gapScale)) {
+      return;
+    }
+    std::vector<Pos> holds;
+    Pos shift, key;
+    if (shifted) {
+      if (keymap.position(name, key) && keymap.modifier("KC_LSFT", "KC_RSFT", key, shift)) {
+        holds.push_back(shift);
+      } else if (c >= 'A' && c <= 'Z') {
+        unshifted++;
+      } else {
+        skipped++;
+        return;
+      }
+    }
+    if (!typeKeycode(name, holds, gapScale)) {
+      skipped++;
+    }
+  }
+
+  void typeText(const std::string &text) {
+    for (char c : text) {
+      typeChar(c);
+    }
+  }
+
+  // Vim sessions: commands come in fast bursts, <...> tokens are single keys or Ctrl chords
+  void typeVim(const std::string &text) {
+    for (size_t i = 0; i < text.size(); i++) {
+      if (text[i] == '<') {
+        size_t end = text.find('>', i);
+        if (end != std::string::npos) {
+          std::string token = text.substr(i + 1, end - i - 1);
+          i = end;
+          typeVimToken(token);
+          continue;
+        }
+      }
+      typeChar(text[i], 0.8);
+    }
+  }
+
+  void typeVimToken(const std::string &token) {
+    static const std::map<std::string, std::string> keys = {
+      {"Esc", "KC_ESC"}, {"CR", "KC_ENT"}, {"BS", "KC_BSPC"}, {"Tab", "KC_TAB"}, {"Space", "KC_SPC"},
+    };
+    auto it = keys.find(token);
+    if (it != keys.end()) {
+      if (!typeKeycode(it->second, {})) {
+        skipped++;
+      }
+      // Pause after leaving insert mode or running a command
+      nowMs += uniform(150, 400);
+      return;
+    }
+    if (token.size() == 3 && token[0] == 'C' && token[1] == '-') {
+      std::string name, alias;
+      bool shifted;
+      Pos ctrl, key;
+      if (charKeycode(token[2], name, shifted, alias) && keymap.position(name, key) &&
+          keymap.modifier("KC_LCTL", "KC_RCTL", key, ctrl) &&
+          typeKeycode(name, {ctrl}, 1.2)) {
+        return;
+      }
+    }
+    skipped++;
+  }
+
+  // Script lines: "<delay ms> +KEY" / "<delay ms> -KEY", "repeat N" ... "end"
+  std::string typeScript(const std::vector<std::string> &lines) {
+    std::map<Pos, double> down;
+    std::vector<std::pair<size_t, int>> loops; // (line after "repeat", remaining)
+    for (size_t i = 0; i < lines.size(); i++) {
+      const std::string &line = lines[i];
+      char word[32];
+      int count;
+      if (sscanf(line.c_str(), "repeat %d", &count) == 1) {
+        loops.push_back(std::make_pair(i, count));
+        continue;
+      }
+      if (line == "end") {
+        if (loops.empty()) {
+          return "\"end\" without \"repeat\"";
+        }
+        if (--loops.back().second > 0) {
+          i = loops.back().first;
+        } else {
+          loops.pop_back();
+        }
+        continue;
+      }
+      double delay;
+      if (sscanf(line.c_str(), "%lf %31s", &delay, word) != 2 || (word[0] != '+' && word[0] != '-')) {
+        return "bad script line: " + line;
+      }
+      nowMs += delay * uniform(0.9, 1.1);
+
+      std::string key = word + 1;
+      std::string name = key.compare(0, 3, "KC_") == 0 ? key : "KC_" + key;
+      std::string alias;
+      bool shifted;
+      if (key.size() == 1 && !charKeycode(key[0], name, shifted, alias)) {
+        skipped++;
+        continue;
+      }
+      int layer, index;
+      if (!keymap.find(Keymap::canonical(name), layer, index) || layer != 0) {
+        skipped++;
+        continue;
+      }
+      Pos pos = keymap.layout[index];
+      if (word[0] == '+') {
+        down[pos] = nowMs;
+      } else if (down.count(pos)) {
+        press(pos, down[pos], nowMs, false);
+        down.erase(pos);
+      }
+    }
+    for (auto &held : down) {
+      press(held.first, held.second, nowMs + 100, false);
+    }
+    return "";
+  }
+
+  // Turn the key intervals into raw matrix samples, with contact bounce
+  void build(Trace &trace) {
+    struct Edge {
+      double ms;
+      Pos pos;
+      bool down;
+    };
+    std::vector<Edge> edges;
+    for (const Interval &iv : intervals) {
+      for (int e = 0; e < 2; e++) {
+        bool down = e == 0;
+        double t = down ? iv.downMs : iv.upMs;
+        int bounces = (int)uniform(0, 4);
+        for (int b = 0; b < bounces; b++) {
+          edges.push_back(Edge{t, iv.pos, b % 2 == 0 ? down : !down});
+          t += uniform(0.1, 0.8);
+        }
+        edges.push_back(Edge{t, iv.pos, down});
+      }
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.ms < b.ms; });
+
+    uint16_t matrix[TRACE_MAX_ROWS] = {0};
+    for (const Edge &e : edges) {
+      if (e.down) {
+        matrix[e.pos.row] |= 1 << e.pos.col;
+      } else {
+        matrix[e.pos.row] &= ~(1 << e.pos.col);
+      }
+      trace.add((uint32_t)(e.ms * 1000), matrix);
+    }
+    trace.intendedPresses = (uint32_t)intervals.size();
+
+    for (const Interval &iv : intervals) {
+      if (iv.hold) {
+        trace.holds.push_back(TraceHold{(uint32_t)(iv.downMs * 1000), iv.pos.row, iv.pos.col});
+      }
+    }
+    std::sort(trace.holds.begin(), trace.holds.end(),
+              [](const TraceHold &a, const TraceHold &b) { return a.timeUs < b.timeUs; });
+  }
+};
+
+static bool readLines(const std::string &path, std::vector<std::string> &lines) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (!f) {
+    return false;
+  }
+  char buf[4096];
+  while (fgets(buf, sizeof(buf), f)) {
+    std::string line = buf;
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+      line.pop_back();
+    }
+    lines.push_back(line);
+  }
+  fclose(f);
+  return true;
+}
+
+static int gen(int argc, char **argv) {
+  std::string kbPath, kmPath, corpusPath, outPath, kind = "text";
+  uint32_t seed = 1;
+  double wpm = 70;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string opt = argv[i];
+    if (opt == "--keyboard") {
+      kbPath = argv[i + 1];
+    } else if (opt == "--keymap") {
+      kmPath = argv[i + 1];
+    } else if (opt == "--corpus") {
+      corpusPath = argv[i + 1];
+    } else if (opt == "--kind") {
+      kind = argv[i + 1];
+    } else if (opt == "--seed") {
+      seed = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+    } else if (opt == "--wpm") {
+      wpm = atof(argv[i + 1]);
+    } else if (opt == "-o") {
+      outPath = argv[i + 1];
+    } else {
+      fprintf(stderr, "unknown option %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if (kbPath.empty() || kmPath.empty() || corpusPath.empty() || outPath.empty() || wpm <= 0) {
+    fprintf(stderr, "gen needs --keyboard, --keymap, --corpus and -o\n");
+    return 2;
+  }
+
+  Keymap keymap;
+  try {
+    keymap.load(kbPath, kmPath);
+  } catch (const JsonError &e) {
+    fprintf(stderr, "error: %s\n", e.what());
+    return 1;
+  }
+  std::vector<std::string> lines;
+  if (!readLines(corpusPath, lines)) {
+    fprintf(stderr, "cannot open %s\n", corpusPath.c_str());
+    return 1;
+  }
+
+  Generator g(keymap, seed, wpm);
+  if (kind == "text") {
+    std::string text;
+    for (const std::string &line : lines) {
+      text += line + "\n";
+    }
+    g.typeText(text);
+  } else if (kind == "vim" || kind == "script") {
+    std::vector<std::string> body;
+    for (const std::string &line : lines) {
+      if (!line.empty() && line[0] != '#') {
+        body.push_back(line);
+      }
+    }
+    if (kind == "vim") {
+      for (const std::string &line : body) {
+        g.typeVim(line);
+      }
+    } else {
+      std::string err = g.typeScript(body);
+      if (!err.empty()) {
+        fprintf(stderr, "%s: %s\n", corpusPath.c_str(), err.c_str());
+        return 1;
+      }
+    }
+  } else {
+    fprintf(stderr, "unknown kind %s\n", kind.c_str());
+    return 2;
+  }
+
+  Trace trace;
+  trace.rows = keymap.rows;
+  trace.cols = keymap.cols;
+  g.build(trace);
+  if (!trace.save(outPath)) {
+    fprintf(stderr, "cannot write %s\n", outPath.c_str());
+    return 1;
+  }
+  printf("%s: %u key presses, %zu samples, %.1f s", outPath.c_str(), trace.intendedPresses, trace.samples.size(),
+         trace.durationUs / 1e6);
+  if (g.skipped || g.unshifted) {
+    printf(" (%u characters not on this keymap, %u capitals typed without shift)", g.skipped, g.unshifted);
+  }
+  printf("\n");
+  return 0;
+}
+
+static int fromTelemetry(int argc, char **argv) {
+  if (argc < 4) {
+    return 2;
+  }
+  Trace trace;
+  trace.rows = 8;
+  trace.cols = 12;
+  for (int i = 4; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--rows") == 0) {
+      trace.rows = (uint8_t)atoi(argv[i + 1]);
+    } else if (strcmp(argv[i], "--cols") == 0) {
+      trace.cols = (uint8_t)atoi(argv[i + 1]);
+    }
+  }
+  if (trace.rows > TRACE_MAX_ROWS || trace.cols > TRACE_MAX_COLS) {
+    fprintf(stderr, "matrix too large for the trace format\n");
+    return 1;
+  }
+
+  FILE *in = fopen(argv[2], "rb");
+  if (!in) {
+    fprintf(stderr, "cannot open %s\n", argv[2]);
+    return 1;
+  }
+  uint16_t matrix[TRACE_MAX_ROWS] = {0};
+  uint8_t report[TELEMETRY_REPORT_SIZE];
+  bool started = false;
+  uint32_t first = 0, last = 0;
+  uint64_t wrap = 0;
+  uint32_t records = 0;
+  while (fread(report, sizeof(report), 1, in) == 1) {
+    if (report[0] != TELEMETRY_REPORT_ID || report[2] > TELEMETRY_RECORDS_PER_REPORT) {
+      continue;
+    }
+    for (uint8_t i = 0; i < report[2]; i++) {
+      telemetry_record_t rec;
+      telemetry_unpack(&rec, &report[TELEMETRY_HEADER_SIZE + i * TELEMETRY_RECORD_SIZE]);
+      if (!(rec.flags & TELEMETRY_UNFILTERED) || rec.row >= trace.rows || rec.col >= trace.cols) {
+        continue;
+      }
+      if (!started) {
+        first = last = rec.time_us;
+        started = true;
+      }
+      if (rec.time_us < last && last - rec.time_us > 0x80000000u) {
+        wrap += 0x100000000ull;
+      }
+      last = rec.time_us;
+      if (rec.flags & TELEMETRY_PRESSED) {
+        matrix[rec.row] |= 1 << rec.col;
+      } else {
+        matrix[rec.row] &= ~(1 << rec.col);
+      }
+      trace.add((uint32_t)(wrap + rec.time_us - first), matrix);
+      records++;
+    }
+  }
+  fclose(in);
+
+  if (!trace.save(argv[3])) {
+    fprintf(stderr, "cannot write %s\n", argv[3]);
+    return 1;
+  }
+  printf("%s: %u unfiltered edges, %zu samples, %.1f s\n", argv[3], records, trace.samples.size(),
+         trace.durationUs / 1e6);
+  return 0;
+}
+
+static int info(const char *path) {
+  Trace trace;
+  std::string err = trace.load(path);
+  if (!err.empty()) {
+    fprintf(stderr, "%s\n", err.c_str());
+    return 1;
+  }
+  FILE *f = fopen(path, "rb");
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fclose(f);
+
+  uint32_t presses[TRACE_MAX_ROWS][TRACE_MAX_COLS] = {};
+  uint32_t edges = 0;
+  uint16_t prev[TRACE_MAX_ROWS] = {0};
+  for (const TraceSample &s : trace.samples) {
+    for (uint8_t row = 0; row < trace.rows; row++) {
+      uint16_t changed = s.rows[row] ^ prev[row];
+      for (uint8_t col = 0; col < trace.cols; col++) {
+        if (changed & (1 << col)) {
+          edges++;
+          if (s.rows[row] & (1 << col)) {
+            presses[row][col]++;
+          }
+        }
+      }
+      prev[row] = s.rows[row];
+    }
+  }
+
+  printf("%s: %ux%u matrix, %zu samples, %u raw edges, %.1f s, %ld bytes (%.2f bytes/sample)\n", path, trace.rows,
+         trace.cols, trace.samples.size(), edges, trace.durationUs / 1e6, size,
+         trace.samples.empty() ? 0.0 : (double)(size - TRACE_HEADER_SIZE) / trace.samples.size());
+  printf("intended key presses: %u, %zu of them holds\n", trace.intendedPresses, trace.holds.size());
+  printf("raw press edges per position (bounce included):\n");
+  for (uint8_t row = 0; row < trace.rows; row++) {
+    printf("  row %u:", row);
+    for (uint8_t col = 0; col < trace.cols; col++) {
+      printf(" %5u", presses[row][col]);
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: trace_tool gen --keyboard <keyboard.json> --keymap <keymap.json> --corpus <file>\n"
+          "                      [--kind text|vim|script] [--wpm N] [--seed N] -o <out.trace>\n"
+          "       trace_tool from-telemetry <capture.bin> <out.trace> [--rows N] [--cols N]\n"
+          "       trace_tool info <trace>\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc >= 2 && strcmp(argv[1], "gen") == 0) {
+    int rc = gen(argc, argv);
+    if (rc == 2) {
+      usage();
+    }
+    return rc;
+  }
+  if (argc >= 4 && strcmp(argv[1], "from-telemetry") == 0) {
+    return fromTelemetry(argc, argv);
+  }
+  if (argc == 3 && strcmp(argv[1], "info") == 0) {
+    return info(argv[2]);
+  }
+  usage();
+  return 1;
+}
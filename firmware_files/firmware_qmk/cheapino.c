@@ -1,51 +1,192 @@
 #include "wait.h"
 #include "quantum.h"
 
-// This is to keep state between callbacks, when it is 0 the
-// initial RGB flash is finished
-uint8_t _hue_countdown = 50;
-
-// These are to keep track of user selected color, so we
-// can restore it after RGB flash
-uint8_t _hue;
-uint8_t _saturation;
-uint8_t _value;
-
-// Do a little 2.5 seconds display of the different colors
-// Use the deferred executor so the LED flash dance does not
-// stop us from using the keyboard.
+#include "heatmap.h"
+#ifdef HOME_ROW_MODS
+#    include "home_row.h"
+#endif
+#include "mouse_motion.h"
+#include "rgb_anim.h"
+#include "telemetry.h"
+
+#define STAGE_PROFILE_IMPLEMENTATION
+#include "../firmware_common/stage_profile.h"
+
+// Mouse keys run on mouse_motion.c; stock mousekey stays enabled for the
+// mouse report but never sees a key. QK_USER_0 toggles scroll mode (the
+// cursor keys and the encoder move the wheel), QK_USER_1 cycles the curves.
+#define MOUSE_SCROLL_TOGGLE QK_USER_0
+#define MOUSE_CURVE_NEXT QK_USER_1
+
+_Static_assert(MS_RGHT - MS_UP == MOUSE_INPUT_RIGHT - MOUSE_INPUT_UP, "QMK cursor keycodes out of order");
+_Static_assert(MS_WHLR - MS_WHLU == MOUSE_INPUT_WHEEL_RIGHT - MOUSE_INPUT_WHEEL_UP, "QMK wheel keycodes out of order");
+_Static_assert(MS_ACL2 - MS_ACL0 == MOUSE_INPUT_ACCEL2 - MOUSE_INPUT_ACCEL0, "QMK accel keycodes out of order");
+
+static deferred_token _anim_token = INVALID_DEFERRED_TOKEN;
+
+// Step the LED animation from the deferred executor so the LED work
+// never runs on the scan path.
 // https://docs.qmk.fm/#/custom_quantum_functions?id=deferred-executor-registration
-uint32_t flash_led(uint32_t next_trigger_time, void *cb_arg) {
-    rgblight_sethsv(_hue_countdown * 5, 230, 70);
-    _hue_countdown--;
-    if (_hue_countdown == 0) {
-        // Finished, reset to user chosen led color
-        rgblight_sethsv(_hue, _saturation, _value);
-        return 0;
-    } else {
-        return 50;
+static uint32_t anim_frame(uint32_t next_trigger_time, void *cb_arg) {
+    uint32_t next = rgb_anim_task();
+    if (next == 0) {
+        _anim_token = INVALID_DEFERRED_TOKEN;
     }
+    return next;
+}
+
+static void anim_kick(void) {
+    if (_anim_token == INVALID_DEFERRED_TOKEN && rgb_anim_running()) {
+        _anim_token = defer_exec(RGB_ANIM_FRAME_MS, anim_frame, NULL);
+    }
+}
+
+// Frames are precomputed RGB, so skip rgblight's HSV conversion (and its
+// EEPROM write) and set the color directly
+void rgb_anim_output(uint8_t r, uint8_t g, uint8_t b) {
+    rgblight_setrgb(r, g, b);
 }
 
 void keyboard_post_init_user(void) {
     //debug_enable=true;
-    //debug_matrix=true;
+    //debug_matrix=true; (or stream matrix events with firmware_host/tools/telemetry_analyze)
     //debug_keyboard=true;
     //debug_mouse=true;
 
+#ifdef STAGE_PROFILE_ENABLE
+    stage_profile_init();
+#endif
+
+    mouse_motion_init();
+    heatmap_init();
+
     // Store user selected rgb hsv:
-    _hue = rgblight_get_hue();
-    _saturation = rgblight_get_sat();
-    _value = rgblight_get_val();
+    rgb_anim_init(rgblight_get_hue(), rgblight_get_sat(), rgblight_get_val());
+
+    // Do a little 2.5 seconds display of the different colors
+    rgb_anim_startup();
+    anim_kick();
+}
+
+#ifdef HOME_ROW_MODS
+// Home row mods, see keymaps/hrm/config.h. The decisions are modelled on the
+// host by firmware_host/sim/tap_hold.h, keep the two in step.
+uint16_t get_tapping_term(uint16_t keycode, keyrecord_t *record) {
+    return home_row_term(record->event.key.col);
+}
+
+bool is_flow_tap_key(uint16_t keycode) {
+    return home_row_typing_key(keycode);
+}
+
+uint16_t get_flow_tap_term(uint16_t keycode, keyrecord_t *record, uint16_t prev_keycode) {
+    return is_flow_tap_key(prev_keycode) ? home_row_flow_term(keycode) : 0;
+}
+
+char chordal_hold_handedness(keypos_t key) {
+    return home_row_hand(key.row);
+}
+#endif
+
+// Microseconds for the mouse frame grid, the RP2040 system timer runs at 1 MHz
+static uint32_t now_us(void) {
+    return TIME_I2US(chVTGetSystemTimeX());
+}
+
+static bool process_mouse_key(uint16_t keycode, bool pressed) {
+    if (keycode >= MS_UP && keycode <= MS_RGHT) {
+        mouse_motion_input(MOUSE_INPUT_UP + (keycode - MS_UP), pressed, now_us());
+    } else if (keycode >= MS_WHLU && keycode <= MS_WHLR) {
+        mouse_motion_input(MOUSE_INPUT_WHEEL_UP + (keycode - MS_WHLU), pressed, now_us());
+    } else if (keycode >= MS_ACL0 && keycode <= MS_ACL2) {
+        mouse_motion_input(MOUSE_INPUT_ACCEL0 + (keycode - MS_ACL0), pressed, now_us());
+    } else if (keycode >= MS_BTN1 && keycode <= MS_BTN8) {
+        mouse_motion_button(1 << (keycode - MS_BTN1), pressed);
+    } else if (keycode == MOUSE_SCROLL_TOGGLE) {
+        if (pressed) mouse_motion_set_scroll(!mouse_motion_scrolling());
+    } else if (keycode == MOUSE_CURVE_NEXT) {
+        if (pressed) mouse_motion_set_curve((mouse_motion_curve() + 1) % MOUSE_CURVE_COUNT);
+    } else {
+        return true;
+    }
+    return false;
+}
+
+bool process_record_user(uint16_t keycode, keyrecord_t *record) {
+    heatmap_record(record->event.key.row, record->event.key.col, record->event.pressed);
+    return process_mouse_key(keycode, record->event.pressed);
+}
+
+// register_code() sends the keyboard report as it changes, so a report
+// that differs from the last one seen here went out for this event
+void post_process_record_user(uint16_t keycode, keyrecord_t *record) {
+    static report_keyboard_t last;
+    if (memcmp(&last, keyboard_report, sizeof(last)) != 0) {
+        last = *keyboard_report;
+        telemetry_hid_report(record->event.key.row, record->event.key.col, record->event.pressed);
+    }
+}
+
+static void mouse_task(void) {
+    mouse_motion_report_t motion;
+    if (mouse_motion_task(now_us(), &motion)) {
+        report_mouse_t report = {0};
+        report.buttons        = motion.buttons;
+        report.x              = motion.x;
+        report.y              = motion.y;
+        report.v              = motion.v;
+        report.h              = motion.h;
+        host_mouse_send(&report);
+    }
+}
+
+void matrix_scan_user(void) {
+    PROFILE_MARK_END(PROFILE_DEBOUNCE);
+    telemetry_debounced_scan();
+}
+
+#ifdef STAGE_PROFILE_ENABLE
+// Dump and restart the stage timings every few seconds
+static void report_profile(void) {
+    static uint32_t last_report = 0;
+    if (timer_elapsed32(last_report) < STAGE_PROFILE_REPORT_MS) return;
+    last_report = timer_read32();
+
+    char line[160];
+    for (uint8_t stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        if (stage_profile_format(stage, line, sizeof(line))) {
+            uprintf("%s\n", line);
+        }
+    }
+    stage_profile_reset();
+}
+#endif
+
+void housekeeping_task_user(void) {
+    mouse_task();
+    telemetry_task();
+    heatmap_task();
+#ifdef STAGE_PROFILE_ENABLE
+    report_profile();
+#endif
+}
 
-    // Flash a little on start
-    defer_exec(50, flash_led, NULL);
+// Raw HID commands from the host, the first byte selects the feature
+void raw_hid_receive(uint8_t *data, uint8_t length) {
+    switch (data[0]) {
+        case TELEMETRY_REPORT_ID:
+            telemetry_set_enabled(data[1] == TELEMETRY_CMD_START || data[1] == TELEMETRY_CMD_START_TRACE);
+            telemetry_set_unfiltered(data[1] == TELEMETRY_CMD_START_TRACE);
+            break;
+        case HEATMAP_REPORT_ID:
+            heatmap_raw_hid(data);
+            break;
+    }
 }
 
-// Make the builtin RGB led show different colors per layer:
-// This seemed like a good idea but turned out pretty annoying,
-// to me at least... Uncomment the lines below to enable
-/*
+// Make the builtin RGB led show different colors per layer. This used to
+// be too annoying to keep on; with a short fade from precomputed frames it
+// is fine. The base layer keeps the user selected color.
 uint8_t get_hue(uint8_t layer) {
     switch (layer) {
         case 6:
@@ -61,15 +202,19 @@ uint8_t get_hue(uint8_t layer) {
         case 1:
             return 220;
         default:
-            return 0;
+            return rgblight_get_hue();
     }
 }
 
 layer_state_t layer_state_set_user(layer_state_t state) {
-    uint8_t sat = rgblight_get_sat();
-    uint8_t val = rgblight_get_val();
-    uint8_t hue = get_hue(get_highest_layer(state));
-    rgblight_sethsv(hue, sat, val);
+    // Pick up hue/sat/val changes made with the RGB_* keys
+    rgb_anim_set_base(rgblight_get_hue(), rgblight_get_sat(), rgblight_get_val());
+    rgb_anim_layer(get_hue(get_highest_layer(state)));
+    anim_kick();
     return state;
 }
-*/
+
+void caps_word_set_user(bool active) {
+    rgb_anim_caps_word(active);
+    anim_kick();
+}
@@ -25,7 +25,8 @@
 #define WS2812_BYTE_ORDER WS2812_BYTE_ORDER_RGB
 
 
-// Pick good defaults for enabling homerow modifiers
+// Pick good defaults for enabling homerow modifiers (the hrm keymap turns
+// them on and settles them early, see keymaps/hrm/config.h)
 #define TAPPING_TERM 230
 
 
@@ -37,6 +38,10 @@
 
 // #define DEBUG_MATRIX_SCAN_RATE
 
+// Per-stage scan timing, dumped to the console (needs CONSOLE_ENABLE)
+// #define STAGE_PROFILE_ENABLE
+#define STAGE_PROFILE_REPORT_MS 5000
+
 #define RGBLIGHT_DEFAULT_HUE 128 // Sets the default hue value, if none has been set
 #define RGBLIGHT_DEFAULT_SAT 128 // Sets the default saturation value, if none has been set
 #define RGBLIGHT_DEFAULT_VAL 32 // Sets the default brightness value, if none has been set
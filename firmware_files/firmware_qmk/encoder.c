@@ -1,5 +1,6 @@
 #include "matrix.h"
 #include "quantum.h"
+#include "mouse_motion.h"
 
 #define COL_SHIFTER ((uint16_t)1)
 
@@ -16,7 +17,10 @@ void clicked(void) {
 }
 
 void turned(bool clockwise) {
-    if (IS_LAYER_ON(6)) {
+    if (mouse_motion_scrolling()) {
+        // Scroll mode: detents go out with the mouse keys' wheel motion
+        mouse_motion_wheel(clockwise ? -1 : 1, 0);
+    } else if (IS_LAYER_ON(6)) {
         tap_code(clockwise ? KC_VOLU : KC_VOLD);
     } else if (IS_LAYER_ON(3)) {
         tap_code16(clockwise ? LCTL(KC_TAB) : LCTL(LSFT(KC_TAB)));
@@ -0,0 +1,104 @@
+// Press counters per key and layer, counted from the debounced key events
+// that reach process_record_user() and saved in QMK's EEPROM.
+//
+// On the RP2040 QMK's EEPROM is the wear-leveling driver over the last
+// sectors of flash: each write appends to a log (a short page program),
+// and when the log is full the driver consolidates it, erasing its sectors
+// with interrupts off for up to HEATMAP_ERASE_MAX_MS. When that happens is
+// up to the driver, so every write waits for a gap in the typing:
+// heatmap_task() (from housekeeping, which doesn't run while the bus is
+// suspended) writes only once no key is held and none has moved for
+// HEATMAP_IDLE_MS, one HEATMAP_CHUNK_SIZE byte update of changed counters
+// per call. A key pressed during a consolidation is seen when it ends, at
+// most HEATMAP_ERASE_MAX_MS late. Counters wait in RAM until the next gap.
+
+#include "quantum.h"
+#include "raw_hid.h"
+
+// The tables of the keymap being built, see rules.mk
+#define KEYMAP_TABLES_IMPLEMENTATION
+#ifdef KEYMAP_TABLES_H
+#    include KEYMAP_TABLES_H
+#else
+#    include "keymap_tables.h"
+#endif
+
+// Before heatmap.h, which includes key_heatmap.h for the wire format only
+#define HEATMAP_LAYERS KEYMAP_LAYERS
+#define HEATMAP_KEYS KEYMAP_LAYOUT_KEYS
+#include "heatmap.h"
+
+// Counters in EEPROM, after QMK's own eeconfig
+#ifndef HEATMAP_EEPROM_ADDR
+#    define HEATMAP_EEPROM_ADDR 1024
+#endif
+#ifndef HEATMAP_IDLE_MS
+#    define HEATMAP_IDLE_MS 5000
+#endif
+_Static_assert(HEATMAP_IDLE_MS > HEATMAP_ERASE_MAX_MS, "a consolidation must fit in the gap that allows it");
+// Bytes per EEPROM update, a whole number of counters
+#define HEATMAP_CHUNK_SIZE 8
+#define HEATMAP_CHUNK_COUNTERS (HEATMAP_CHUNK_SIZE / 2)
+
+static heatmap_t heatmap;
+static uint8_t   held       = 0;
+static uint32_t  last_event = 0;
+static uint16_t  chunk      = 0; // next chunk to look at
+
+void heatmap_init(void) {
+    eeprom_read_block(heatmap.count, (void *)(uintptr_t)HEATMAP_EEPROM_ADDR, sizeof(heatmap.count));
+    // A fresh EEPROM reads back erased
+    for (uint16_t i = 0; i < HEATMAP_COUNTERS; i++) {
+        if (heatmap.count[i] == 0xFFFF) {
+            heatmap_clear(&heatmap);
+            break;
+        }
+    }
+}
+
+void heatmap_record(uint8_t row, uint8_t col, bool pressed) {
+    // Combos and encoders come with positions outside the matrix
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) return;
+    last_event = timer_read32();
+    if (!pressed) {
+        if (held) held--;
+        return;
+    }
+    held++;
+    uint8_t key = keymap_layout_index[row][col];
+    if (key != 0xFF) {
+        heatmap_press(&heatmap, get_highest_layer(layer_state | default_layer_state), key);
+    }
+}
+
+static bool chunk_dirty(uint16_t c) {
+    for (uint16_t i = c * HEATMAP_CHUNK_COUNTERS; i < (c + 1) * HEATMAP_CHUNK_COUNTERS && i < HEATMAP_COUNTERS; i++) {
+        if (heatmap.dirty[i >> 3] & (1 << (i & 7))) return true;
+    }
+    return false;
+}
+
+void heatmap_task(void) {
+    if (held || timer_elapsed32(last_event) < HEATMAP_IDLE_MS) return;
+
+    const uint16_t chunks = (HEATMAP_COUNTERS + HEATMAP_CHUNK_COUNTERS - 1) / HEATMAP_CHUNK_COUNTERS;
+    while (chunk < chunks && !chunk_dirty(chunk)) chunk++;
+    if (chunk == chunks) {
+        chunk = 0;
+        return;
+    }
+
+    uint16_t first = chunk * HEATMAP_CHUNK_COUNTERS;
+    uint16_t n     = HEATMAP_COUNTERS - first < HEATMAP_CHUNK_COUNTERS ? HEATMAP_COUNTERS - first : HEATMAP_CHUNK_COUNTERS;
+    for (uint16_t i = first; i < first + n; i++) {
+        heatmap.dirty[i >> 3] &= (uint8_t)~(1 << (i & 7));
+    }
+    eeprom_update_block(&heatmap.count[first], (void *)(uintptr_t)(HEATMAP_EEPROM_ADDR + 2 * first), 2 * n);
+    chunk++;
+}
+
+void heatmap_raw_hid(const uint8_t *request) {
+    uint8_t report[HEATMAP_REPORT_SIZE];
+    heatmap_answer(&heatmap, request, report);
+    raw_hid_send(report, sizeof(report));
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../firmware_common/key_heatmap.h"
+
+// Per-key, per-layer press counters (firmware_common/key_heatmap.h), kept
+// in QMK's EEPROM and read over raw HID with HEATMAP_REPORT_ID.
+// heatmap_task() writes to EEPROM in gaps in the typing: call it from
+// housekeeping
+void heatmap_init(void);
+void heatmap_record(uint8_t row, uint8_t col, bool pressed);
+void heatmap_task(void);
+void heatmap_raw_hid(const uint8_t *request);
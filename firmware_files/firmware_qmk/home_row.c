@@ -0,0 +1,49 @@
+#include "quantum.h"
+#include "home_row.h"
+
+// Both halves use the same column order on their own rows (right half
+// rows 0-2 on columns 0-5, left half rows 4-6 on columns 6-11): inner
+// index, index, middle, ring, pinky, thumb. Slower fingers get more time
+// before a lone hold counts; chords with other keys are settled by
+// CHORDAL_HOLD and FLOW_TAP_TERM long before these run out.
+static const uint16_t finger_term[6] = {170, 170, 190, 210, TAPPING_TERM, 200};
+
+uint16_t home_row_term(uint8_t col) {
+    return finger_term[col % 6];
+}
+
+// Shift (capitals) and Ctrl (editor chords) are pressed mid-word, often
+// within FLOW_TAP_TERM of the previous letter, so typing speed alone never
+// settles them as tapped
+uint16_t home_row_flow_term(uint16_t keycode) {
+    if (!home_row_typing_key(keycode)) {
+        return 0;
+    }
+    if (IS_QK_MOD_TAP(keycode) && (QK_MOD_TAP_GET_MODS(keycode) & (MOD_LSFT | MOD_LCTL))) {
+        return 0;
+    }
+    return FLOW_TAP_TERM;
+}
+
+// Keys that mean "typing in progress": letters, space and prose punctuation
+// (QMK's default is_flow_tap_key)
+bool home_row_typing_key(uint16_t keycode) {
+    if (IS_QK_MOD_TAP(keycode)) {
+        keycode = QK_MOD_TAP_GET_TAP_KEYCODE(keycode);
+    }
+    switch (keycode) {
+        case KC_A ... KC_Z:
+        case KC_SPC:
+        case KC_DOT:
+        case KC_COMM:
+        case KC_SCLN:
+        case KC_SLSH:
+            return true;
+    }
+    return false;
+}
+
+// Rows 4-7 are the left half, thumbs included
+char home_row_hand(uint8_t row) {
+    return row >= MATRIX_ROWS / 2 ? 'L' : 'R';
+}
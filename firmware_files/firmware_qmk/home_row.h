@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per-key tap-hold settings for the home row mods, used by the QMK
+// callbacks in cheapino.c and by firmware_host/bench/tap_hold_bench
+uint16_t home_row_term(uint8_t col);
+uint16_t home_row_flow_term(uint16_t keycode);
+bool     home_row_typing_key(uint16_t keycode);
+char     home_row_hand(uint8_t row);
@@ -0,0 +1,15 @@
+#pragma once
+
+// Homerow modifiers (keymap.json layer 0, per-key settings in home_row.c,
+// callbacks in cheapino.c). Most mod-taps are settled by the next key
+// instead of waiting out the term: a key on the same hand makes it a tap, a
+// key on the other hand tapped while it is down makes it a hold, and a
+// mod-tap pressed mid-word is a tap right away. The term only decides a
+// mod-tap held on its own (e.g. Ctrl + mouse); the keyboard's TAPPING_TERM
+// 230 is the pinky value.
+// firmware_host/bench/tap_hold_bench compares these settings on typing traces.
+#define HOME_ROW_MODS
+#define TAPPING_TERM_PER_KEY
+#define CHORDAL_HOLD
+#define PERMISSIVE_HOLD
+#define FLOW_TAP_TERM 150
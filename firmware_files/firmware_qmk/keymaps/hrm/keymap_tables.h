@@ -0,0 +1,104 @@
+// Generated by firmware_host/tools/keymap_compiler from firmware_qmk/keyboard.json and firmware_qmk/keymaps/hrm/keymap.json (LAYOUT_split_3x5_3).
+// Do not edit, regenerate with:
+//   keymap_compiler --target qmk firmware_qmk/keyboard.json firmware_qmk/keymaps/hrm/keymap.json -o firmware_qmk/keymaps/hrm/keymap_tables.h
+
+#pragma once
+
+#define KEYMAP_LAYERS 4
+#define KEYMAP_LAYOUT_KEYS 36
+#define KEYMAP_COLUMN_WIRES 6
+
+extern const uint8_t      keymap_layout_index[MATRIX_ROWS][MATRIX_COLS];
+extern const uint16_t     keymap_keycodes[KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS];
+extern const matrix_row_t keymap_layer_key_mask[KEYMAP_LAYERS][MATRIX_ROWS];
+extern const matrix_row_t keymap_media_mask[KEYMAP_LAYERS][MATRIX_ROWS];
+extern const matrix_row_t keymap_empty_mask[KEYMAP_LAYERS][MATRIX_ROWS];
+extern const matrix_row_t keymap_populated_mask[MATRIX_ROWS];
+extern const uint8_t      keymap_column_wire[MATRIX_COLS];
+
+#ifdef KEYMAP_TABLES_IMPLEMENTATION
+
+// Matrix position -> LAYOUT_split_3x5_3 index, 0xFF if unused
+const uint8_t keymap_layout_index[MATRIX_ROWS][MATRIX_COLS] = {
+    {5, 6, 7, 8, 9, 33, 255, 255, 255, 255, 255, 255},
+    {15, 16, 17, 18, 19, 34, 255, 255, 255, 255, 255, 255},
+    {25, 26, 27, 28, 29, 35, 255, 255, 255, 255, 255, 255},
+    {255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255},
+    {255, 255, 255, 255, 255, 255, 4, 3, 2, 1, 0, 32},
+    {255, 255, 255, 255, 255, 255, 14, 13, 12, 11, 10, 31},
+    {255, 255, 255, 255, 255, 255, 24, 23, 22, 21, 20, 30},
+    {255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255},
+};
+
+// Keycodes per layer, indexed by matrix position
+const uint16_t keymap_keycodes[KEYMAP_LAYERS][MATRIX_ROWS][MATRIX_COLS] = {
+    {
+        {KC_Y, KC_U, KC_I, KC_O, KC_P, MO(2), KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_H, RSFT_T(KC_J), RCTL_T(KC_K), LALT_T(KC_L), RGUI_T(KC_SCLN), KC_ENT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_N, KC_M, KC_COMM, KC_DOT, KC_SLSH, KC_RALT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_T, KC_R, KC_E, KC_W, KC_Q, MO(1)},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_G, LSFT_T(KC_F), LCTL_T(KC_D), LALT_T(KC_S), LGUI_T(KC_A), KC_SPC},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_B, KC_V, KC_C, KC_X, KC_Z, KC_LGUI},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+    },
+    {
+        {KC_6, KC_7, KC_8, KC_9, KC_0, MO(3), KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_LEFT, KC_DOWN, KC_UP, KC_RGHT, KC_NO, KC_ENT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_RALT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_5, KC_4, KC_3, KC_2, KC_1, KC_TRNS},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_SPC},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_LGUI},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+    },
+    {
+        {KC_CIRC, KC_AMPR, KC_ASTR, KC_LPRN, KC_RPRN, KC_TRNS, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_MINS, KC_EQL, KC_LBRC, KC_RBRC, KC_BSLS, KC_ENT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_UNDS, KC_PLUS, KC_LCBR, KC_RCBR, KC_PIPE, KC_RALT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_PERC, KC_DLR, KC_HASH, KC_AT, KC_EXLM, MO(3)},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_SPC},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_LGUI},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+    },
+    {
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_TRNS, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_ENT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_RALT, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_TRNS},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, RGB_VAI, RGB_SAI, RGB_HUI, KC_SPC},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, RGB_VAD, RGB_SAD, RGB_HUD, KC_LGUI},
+        {KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO, KC_NO},
+    },
+};
+
+// Layer switching keys, per layer and row
+const matrix_row_t keymap_layer_key_mask[KEYMAP_LAYERS][MATRIX_ROWS] = {
+    {0x0020, 0x0000, 0x0000, 0x0000, 0x0800, 0x0000, 0x0000, 0x0000},
+    {0x0020, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0800, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+};
+// Consumer/system control keys, per layer and row
+const matrix_row_t keymap_media_mask[KEYMAP_LAYERS][MATRIX_ROWS] = {
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+};
+// KC_NO positions, per layer and row
+const matrix_row_t keymap_empty_mask[KEYMAP_LAYERS][MATRIX_ROWS] = {
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000},
+    {0x0000, 0x0010, 0x001f, 0x0000, 0x0000, 0x07c0, 0x07c0, 0x0000},
+    {0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x07c0, 0x07c0, 0x0000},
+    {0x001f, 0x001f, 0x001f, 0x0000, 0x07c0, 0x00c0, 0x00c0, 0x0000},
+};
+
+// Ghost topology: populated keys per row wire, and the column wire every
+// matrix column is read through (duplex columns share a wire)
+const matrix_row_t keymap_populated_mask[MATRIX_ROWS] = {0x003f, 0x003f, 0x003f, 0x0000, 0x0fc0, 0x0fc0, 0x0fc0, 0x0000};
+const uint8_t keymap_column_wire[MATRIX_COLS] = {0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5};
+
+#endif // KEYMAP_TABLES_IMPLEMENTATION
@@ -0,0 +1 @@
+SRC += home_row.c
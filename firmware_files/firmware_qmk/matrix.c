@@ -27,12 +27,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "debounce.h"
 #include "encoder.h"
 #include "ghosting.h"
+#include "telemetry.h"
 #include "print.h"
+#include "../firmware_common/stage_profile.h"
 
 // How long the scanning code waits for changed io to settle.
 // Adjust from default 30 to weigh up for increased time spent ghost-hunting.
 // (the rp2040 does not seem to have any problems with this value...)
-#define MATRIX_IO_DELAY 25
+// firmware_host/bench/matrix_settle_bench reports what each scan step needs.
+#ifndef MATRIX_IO_DELAY
+#    define MATRIX_IO_DELAY 25
+#endif
 
 #define COL_SHIFTER ((uint16_t)1)
 
@@ -135,17 +140,30 @@ bool has_matrix_changed(matrix_row_t current_matrix[]) {
 bool matrix_scan_custom(matrix_row_t current_matrix[]) {
     store_old_matrix(current_matrix);
     // Set row, read cols
+    PROFILE_BEGIN(PROFILE_SCAN_ROWS);
     for (uint8_t current_row = 0; current_row < MATRIX_ROWS; current_row++) {
         read_cols_on_row(current_matrix, current_row);
     }
+    PROFILE_END(PROFILE_SCAN_ROWS);
     // Set col, read rows
+    PROFILE_BEGIN(PROFILE_SCAN_COLS);
     for (uint8_t current_col = 0; current_col < MATRIX_COLS/2; current_col++) {
         read_rows_on_col(current_matrix, current_col);
     }
+    PROFILE_END(PROFILE_SCAN_COLS);
+    telemetry_unfiltered_scan(current_matrix);
 
+    PROFILE_BEGIN(PROFILE_ENCODER);
     fix_encoder_action(current_matrix);
+    PROFILE_END(PROFILE_ENCODER);
 
+    PROFILE_BEGIN(PROFILE_GHOSTING);
     fix_ghosting(current_matrix);
+    PROFILE_END(PROFILE_GHOSTING);
 
+    // Debounce runs in QMK's matrix_scan() right after we return, the
+    // stage is closed in matrix_scan_user()
+    PROFILE_MARK(PROFILE_DEBOUNCE);
+    telemetry_raw_scan(previous_matrix, current_matrix);
     return has_matrix_changed(current_matrix);
 }
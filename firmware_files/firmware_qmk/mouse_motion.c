@@ -0,0 +1,269 @@
+// Mouse key motion engine, replacing stock mousekey's fixed report interval.
+//
+// Motion runs on a grid of USB frames (MOUSE_MOTION_FRAME_US) in
+// microseconds. mouse_motion_task() is called from every pass of the scan
+// loop, steps the frames that have started since the last call and hands
+// out one report with what they moved, so reports leave within one scan
+// pass of a frame boundary instead of every 10-20 ms. Frames missed while
+// the loop was held up are stepped together, so the distance moved only
+// depends on how long a key was held.
+//
+// Speeds are fixed point, 1/65536 pixel (or detent) per frame, and
+// positions keep their fraction from frame to frame, so slow speeds come
+// out as an even trickle of single pixels. The first frame of a movement
+// moves one pixel straight away for precise nudges. The curves take the
+// time since the movement started as a 0..4096 fraction of the time to top
+// speed: linear uses it directly, quadratic squares it. The constant curve
+// and the MS_ACL keys use fixed tier speeds.
+//
+// The wheel is a second pair of axes with its own speeds. Scroll mode sends
+// the cursor keys to it, and encoder.c feeds its detents into the same
+// reports, so keys and the knob scroll through one path.
+
+#include "mouse_motion.h"
+
+#define SUBPIXEL 65536
+// Per second -> subpixels per frame
+#define PER_FRAME(per_s) ((uint32_t)((uint64_t)(per_s) * SUBPIXEL * MOUSE_MOTION_FRAME_US / 1000000))
+#define FRAMES(ms) ((uint32_t)(ms) * 1000 / MOUSE_MOTION_FRAME_US)
+// Fraction of the ramp per frame, Q12 << 16
+#define RAMP(ms) (FRAMES(ms) ? ((uint32_t)4096 << 16) / FRAMES(ms) : 0)
+
+// (max - start) * 4096 must fit 32 bits
+_Static_assert(MOUSE_MOTION_MAX_SPEED * (uint64_t)MOUSE_MOTION_FRAME_US <= 8000 * 1000,
+               "MOUSE_MOTION_MAX_SPEED too high for the fixed point curves");
+_Static_assert(FRAMES(MOUSE_MOTION_TIME_TO_MAX) <= 65535 && FRAMES(MOUSE_MOTION_WHEEL_TIME_TO_MAX) <= 65535,
+               "time to top speed too long");
+
+typedef struct {
+    uint32_t start;
+    uint32_t max;
+    uint32_t tiers[3];
+    uint32_t ramp;
+    uint16_t frames_to_max;
+} speed_profile_t;
+
+static speed_profile_t cursor_profile;
+static speed_profile_t wheel_profile;
+
+static void init_profile(speed_profile_t *p, uint32_t start, uint32_t max, uint32_t time_to_max, const uint16_t tiers[3]) {
+    p->start = PER_FRAME(start);
+    p->max   = PER_FRAME(max);
+    for (uint8_t i = 0; i < 3; i++) {
+        p->tiers[i] = PER_FRAME(tiers[i]);
+    }
+    p->ramp          = RAMP(time_to_max);
+    p->frames_to_max = FRAMES(time_to_max);
+}
+
+// A pair of axes moving together: x/y or h/v
+typedef struct {
+    int32_t  pos[2];   // subpixels not sent yet
+    uint16_t frames;   // since the movement started
+    bool     active;
+} axes_t;
+
+static bool          inputs[MOUSE_INPUT_COUNT];
+static axes_t        cursor;
+static axes_t        wheel;
+static int16_t       detents[2]; // from mouse_motion_wheel(), h and v
+static uint8_t       buttons;
+static bool          buttons_changed;
+static bool          scrolling;
+static mouse_curve_t curve = MOUSE_MOTION_DEFAULT_CURVE;
+
+static bool     running;
+static uint32_t next_frame_us;
+
+static mouse_motion_stats_t stats;
+
+void mouse_motion_init(void) {
+    static const uint16_t cursor_tiers[3] = MOUSE_MOTION_TIER_SPEEDS;
+    static const uint16_t wheel_tiers[3]  = MOUSE_MOTION_WHEEL_TIER_SPEEDS;
+    init_profile(&cursor_profile, MOUSE_MOTION_START_SPEED, MOUSE_MOTION_MAX_SPEED, MOUSE_MOTION_TIME_TO_MAX, cursor_tiers);
+    init_profile(&wheel_profile, MOUSE_MOTION_WHEEL_START_SPEED, MOUSE_MOTION_WHEEL_MAX_SPEED, MOUSE_MOTION_WHEEL_TIME_TO_MAX,
+                 wheel_tiers);
+
+    for (uint8_t i = 0; i < MOUSE_INPUT_COUNT; i++) {
+        inputs[i] = false;
+    }
+    cursor          = (axes_t){{0, 0}, 0, false};
+    wheel           = (axes_t){{0, 0}, 0, false};
+    detents[0]      = 0;
+    detents[1]      = 0;
+    buttons         = 0;
+    buttons_changed = false;
+    scrolling       = false;
+    curve           = MOUSE_MOTION_DEFAULT_CURVE;
+    running         = false;
+    stats           = (mouse_motion_stats_t){0, 0, 0};
+}
+
+static inline int8_t direction(mouse_input_t negative, mouse_input_t positive) {
+    return (int8_t)inputs[positive] - (int8_t)inputs[negative];
+}
+
+static inline int8_t clamp_direction(int8_t d) {
+    return d > 1 ? 1 : d < -1 ? -1 : d;
+}
+
+// Directions of both pairs from the held keys: x right, y down, h right, v up
+static bool directions(int8_t cursor_dir[2], int8_t wheel_dir[2]) {
+    int8_t x = direction(MOUSE_INPUT_LEFT, MOUSE_INPUT_RIGHT);
+    int8_t y = direction(MOUSE_INPUT_UP, MOUSE_INPUT_DOWN);
+
+    wheel_dir[0] = direction(MOUSE_INPUT_WHEEL_LEFT, MOUSE_INPUT_WHEEL_RIGHT);
+    wheel_dir[1] = direction(MOUSE_INPUT_WHEEL_DOWN, MOUSE_INPUT_WHEEL_UP);
+    if (scrolling) {
+        wheel_dir[0] = clamp_direction(wheel_dir[0] + x);
+        wheel_dir[1] = clamp_direction(wheel_dir[1] - y);
+        x = y = 0;
+    }
+    cursor_dir[0] = x;
+    cursor_dir[1] = y;
+    return x || y || wheel_dir[0] || wheel_dir[1];
+}
+
+static uint32_t speed(const speed_profile_t *profile, uint16_t frames) {
+    // MS_ACL keys win, the slowest one held first
+    for (uint8_t tier = 0; tier < 3; tier++) {
+        if (inputs[MOUSE_INPUT_ACCEL0 + tier]) return profile->tiers[tier];
+    }
+    if (curve == MOUSE_CURVE_CONSTANT) {
+        return profile->tiers[MOUSE_MOTION_DEFAULT_TIER];
+    }
+    if (frames >= profile->frames_to_max) {
+        return profile->max;
+    }
+    uint32_t f = ((uint32_t)frames * profile->ramp) >> 16;
+    if (curve == MOUSE_CURVE_QUADRATIC) {
+        f = (f * f) >> 12;
+    }
+    return profile->start + (((profile->max - profile->start) * f) >> 12);
+}
+
+static void step_axes(axes_t *axes, const int8_t dir[2], const speed_profile_t *profile) {
+    if (!dir[0] && !dir[1]) {
+        // Stopped: drop the fraction so nothing creeps out later
+        axes->active = false;
+        axes->pos[0] = axes->pos[1] = 0;
+        return;
+    }
+    if (!axes->active) {
+        axes->active = true;
+        axes->frames = 0;
+        axes->pos[0] = dir[0] * SUBPIXEL;
+        axes->pos[1] = dir[1] * SUBPIXEL;
+    }
+
+    int32_t v = (int32_t)speed(profile, axes->frames);
+    if (dir[0] && dir[1]) {
+        // Same speed along the diagonal, 181/256 ~ 1/sqrt(2)
+        v = (v * 181) >> 8;
+    }
+    axes->pos[0] += dir[0] * v;
+    axes->pos[1] += dir[1] * v;
+    if (axes->frames < UINT16_MAX) axes->frames++;
+}
+
+// Whole pixels out of a position, at most what a report can carry
+static int8_t take(int32_t *pos) {
+    int32_t whole = *pos / SUBPIXEL;
+    if (whole > 127) whole = 127;
+    if (whole < -127) whole = -127;
+    *pos -= whole * SUBPIXEL;
+    return (int8_t)whole;
+}
+
+// Wheel: whole detents of the keys plus the encoder's; what doesn't fit
+// waits with the encoder's for the next frame
+static int8_t take_wheel(uint8_t axis) {
+    int32_t n = take(&wheel.pos[axis]) + detents[axis];
+    int32_t sent = n > 127 ? 127 : n < -127 ? -127 : n;
+    detents[axis] = (int16_t)(n - sent);
+    return (int8_t)sent;
+}
+
+void mouse_motion_input(mouse_input_t input, bool pressed, uint32_t now_us) {
+    if (input >= MOUSE_INPUT_COUNT) return;
+    inputs[input] = pressed;
+    if (pressed && !running) {
+        // Start the frame grid at the press, the first pixel goes out at once
+        running       = true;
+        next_frame_us = now_us;
+    }
+}
+
+void mouse_motion_button(uint8_t button_mask, bool pressed) {
+    uint8_t old = buttons;
+    buttons     = pressed ? buttons | button_mask : buttons & ~button_mask;
+    buttons_changed |= buttons != old;
+}
+
+void mouse_motion_wheel(int8_t v, int8_t h) {
+    detents[0] += h;
+    detents[1] += v;
+}
+
+void mouse_motion_set_scroll(bool on) {
+    scrolling = on;
+}
+
+bool mouse_motion_scrolling(void) {
+    return scrolling;
+}
+
+void mouse_motion_set_curve(mouse_curve_t c) {
+    if (c < MOUSE_CURVE_COUNT) curve = c;
+}
+
+mouse_curve_t mouse_motion_curve(void) {
+    return curve;
+}
+
+bool mouse_motion_task(uint32_t now_us, mouse_motion_report_t *report) {
+    int8_t cursor_dir[2], wheel_dir[2];
+    bool   keys = directions(cursor_dir, wheel_dir);
+    bool   knob = detents[0] || detents[1];
+    if (!running && (keys || knob)) {
+        running       = true;
+        next_frame_us = now_us;
+    }
+
+    bool moved = false;
+    if (running && (int32_t)(now_us - next_frame_us) >= 0) {
+        uint32_t due = (now_us - next_frame_us) / MOUSE_MOTION_FRAME_US + 1;
+        next_frame_us += due * MOUSE_MOTION_FRAME_US;
+        if (due > MOUSE_MOTION_MAX_CATCH_UP) {
+            stats.dropped += due - MOUSE_MOTION_MAX_CATCH_UP;
+            due = MOUSE_MOTION_MAX_CATCH_UP;
+        }
+        for (uint32_t i = 0; i < due; i++) {
+            step_axes(&cursor, cursor_dir, &cursor_profile);
+            step_axes(&wheel, wheel_dir, &wheel_profile);
+        }
+        stats.frames += due;
+
+        report->x = take(&cursor.pos[0]);
+        report->y = take(&cursor.pos[1]);
+        report->h = take_wheel(0);
+        report->v = take_wheel(1);
+        moved     = report->x || report->y || report->h || report->v;
+        running   = keys || detents[0] || detents[1];
+    }
+
+    if (!moved && !buttons_changed) {
+        return false;
+    }
+    if (!moved) {
+        report->x = report->y = report->h = report->v = 0;
+    }
+    report->buttons = buttons;
+    buttons_changed = false;
+    stats.reports++;
+    return true;
+}
+
+const mouse_motion_stats_t *mouse_motion_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Mouse key motion, stepped once per USB frame from the scan loop (see
+// mouse_motion.c). Speeds are in pixels (wheel: detents) per second.
+
+// Length of a USB full-speed frame
+#ifndef MOUSE_MOTION_FRAME_US
+#    define MOUSE_MOTION_FRAME_US 1000
+#endif
+
+// Cursor: speed when a key goes down, top speed and the time to reach it
+#ifndef MOUSE_MOTION_START_SPEED
+#    define MOUSE_MOTION_START_SPEED 300
+#endif
+#ifndef MOUSE_MOTION_MAX_SPEED
+#    define MOUSE_MOTION_MAX_SPEED 2400
+#endif
+#ifndef MOUSE_MOTION_TIME_TO_MAX
+#    define MOUSE_MOTION_TIME_TO_MAX 800
+#endif
+
+// Constant-speed tiers, picked with the MS_ACL0-2 keys or the constant curve
+#ifndef MOUSE_MOTION_TIER_SPEEDS
+#    define MOUSE_MOTION_TIER_SPEEDS {150, 600, 2000}
+#endif
+#ifndef MOUSE_MOTION_DEFAULT_TIER
+#    define MOUSE_MOTION_DEFAULT_TIER 1
+#endif
+
+// Wheel, from the wheel keys or the cursor keys in scroll mode
+#ifndef MOUSE_MOTION_WHEEL_START_SPEED
+#    define MOUSE_MOTION_WHEEL_START_SPEED 8
+#endif
+#ifndef MOUSE_MOTION_WHEEL_MAX_SPEED
+#    define MOUSE_MOTION_WHEEL_MAX_SPEED 40
+#endif
+#ifndef MOUSE_MOTION_WHEEL_TIME_TO_MAX
+#    define MOUSE_MOTION_WHEEL_TIME_TO_MAX 1000
+#endif
+#ifndef MOUSE_MOTION_WHEEL_TIER_SPEEDS
+#    define MOUSE_MOTION_WHEEL_TIER_SPEEDS {4, 12, 30}
+#endif
+
+#ifndef MOUSE_MOTION_DEFAULT_CURVE
+#    define MOUSE_MOTION_DEFAULT_CURVE MOUSE_CURVE_QUADRATIC
+#endif
+
+// Frames caught up at once after the loop was held up, longer stalls are dropped
+#ifndef MOUSE_MOTION_MAX_CATCH_UP
+#    define MOUSE_MOTION_MAX_CATCH_UP 32
+#endif
+
+typedef enum {
+    MOUSE_CURVE_LINEAR,    // start to top speed in a straight line
+    MOUSE_CURVE_QUADRATIC, // slow for fine positioning, then fast
+    MOUSE_CURVE_CONSTANT,  // one of the tier speeds, no acceleration
+    MOUSE_CURVE_COUNT
+} mouse_curve_t;
+
+typedef enum {
+    MOUSE_INPUT_UP,
+    MOUSE_INPUT_DOWN,
+    MOUSE_INPUT_LEFT,
+    MOUSE_INPUT_RIGHT,
+    MOUSE_INPUT_WHEEL_UP,
+    MOUSE_INPUT_WHEEL_DOWN,
+    MOUSE_INPUT_WHEEL_LEFT,
+    MOUSE_INPUT_WHEEL_RIGHT,
+    MOUSE_INPUT_ACCEL0,
+    MOUSE_INPUT_ACCEL1,
+    MOUSE_INPUT_ACCEL2,
+    MOUSE_INPUT_COUNT
+} mouse_input_t;
+
+// Same fields as QMK's report_mouse_t; y grows down, v grows up
+typedef struct {
+    uint8_t buttons;
+    int8_t  x;
+    int8_t  y;
+    int8_t  v;
+    int8_t  h;
+} mouse_motion_report_t;
+
+typedef struct {
+    uint32_t frames;  // frames stepped while something moved
+    uint32_t reports; // reports handed out by mouse_motion_task()
+    uint32_t dropped; // frames lost to stalls longer than MOUSE_MOTION_MAX_CATCH_UP
+} mouse_motion_stats_t;
+
+void mouse_motion_init(void);
+
+void mouse_motion_input(mouse_input_t input, bool pressed, uint32_t now_us);
+void mouse_motion_button(uint8_t button_mask, bool pressed);
+// Whole detents from the encoder, sent with the next frame's wheel motion
+void mouse_motion_wheel(int8_t v, int8_t h);
+
+// Scroll mode: the cursor keys move the wheel
+void mouse_motion_set_scroll(bool on);
+bool mouse_motion_scrolling(void);
+
+void mouse_motion_set_curve(mouse_curve_t curve);
+mouse_curve_t mouse_motion_curve(void);
+
+// Call from every pass of the scan loop. True when report should be sent
+// now: once per frame while moving, at once when a button changes.
+bool mouse_motion_task(uint32_t now_us, mouse_motion_report_t *report);
+
+const mouse_motion_stats_t *mouse_motion_stats(void);
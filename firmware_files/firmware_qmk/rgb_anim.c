@@ -0,0 +1,249 @@
+// Small keyframed animation engine for the status LED.
+//
+// HSV->RGB conversion is done through a hue lookup table filled once at
+// init, and every effect is rendered into runs when it starts: effects step
+// every RGB_ANIM_STEP_FRAMES frames, a step whose HSV equals the one before
+// extends that run without being converted, and equal neighbouring colors
+// merge. rgb_anim_task() plays one run per call and asks to be called again
+// when it ends, so held colors cost no wakeups, and it skips the LED write
+// when a run's color is what is already shown.
+
+#include "rgb_anim.h"
+
+// Fully saturated, full brightness color for every hue
+static rgb_anim_color_t hue_table[256];
+
+// Precomputed runs for the running effect
+static rgb_anim_run_t runs[RGB_ANIM_MAX_FRAMES];
+static uint8_t run_count = 0;
+static uint8_t run_pos   = 0;
+static bool    run_loop  = false;
+
+// User selected color, the current layer hue and what the LED shows now
+static uint8_t base_hue;
+static uint8_t base_sat;
+static uint8_t base_val;
+static uint8_t layer_hue;
+static bool    caps_word_active = false;
+
+static rgb_anim_color_t shown;
+static bool             shown_valid = false;
+
+static rgb_anim_stats_t stats;
+
+// Same integer conversion QMK uses in color.c, only run to fill the table
+static rgb_anim_color_t hsv_to_rgb_slow(uint8_t hue, uint8_t sat, uint8_t val) {
+    rgb_anim_color_t rgb;
+    if (sat == 0) {
+        rgb.r = rgb.g = rgb.b = val;
+        return rgb;
+    }
+
+    uint16_t h = hue, s = sat, v = val;
+    uint8_t  region    = h * 6 / 255;
+    uint8_t  remainder = (h * 2 - region * 85) * 3;
+    uint8_t  p         = (v * (255 - s)) >> 8;
+    uint8_t  q         = (v * (255 - ((s * remainder) >> 8))) >> 8;
+    uint8_t  t         = (v * (255 - ((s * (255 - remainder)) >> 8))) >> 8;
+
+    switch (region) {
+        case 6:
+        case 0:
+            rgb.r = v, rgb.g = t, rgb.b = p;
+            break;
+        case 1:
+            rgb.r = q, rgb.g = v, rgb.b = p;
+            break;
+        case 2:
+            rgb.r = p, rgb.g = v, rgb.b = t;
+            break;
+        case 3:
+            rgb.r = p, rgb.g = q, rgb.b = v;
+            break;
+        case 4:
+            rgb.r = t, rgb.g = p, rgb.b = v;
+            break;
+        default:
+            rgb.r = v, rgb.g = p, rgb.b = q;
+            break;
+    }
+    return rgb;
+}
+
+// Apply saturation and brightness to one channel of a full-color table entry
+static inline uint8_t scale_channel(uint8_t full, uint8_t sat, uint8_t val) {
+    if (full == 255) return val;
+    uint8_t level = 255 - (((uint16_t)sat * (255 - full)) >> 8);
+    return ((uint16_t)val * level) >> 8;
+}
+
+rgb_anim_color_t rgb_anim_hsv(uint8_t hue, uint8_t sat, uint8_t val) {
+    rgb_anim_color_t full = hue_table[hue];
+    rgb_anim_color_t rgb  = {
+        scale_channel(full.r, sat, val),
+        scale_channel(full.g, sat, val),
+        scale_channel(full.b, sat, val),
+    };
+    return rgb;
+}
+
+static inline uint8_t lerp8(uint8_t from, uint8_t to, uint8_t step, uint8_t steps) {
+    return from + (((int16_t)to - from) * step) / steps;
+}
+
+static rgb_anim_color_t resting_color(void) {
+    return rgb_anim_hsv(layer_hue, base_sat, base_val);
+}
+
+static inline bool same_color(rgb_anim_color_t a, rgb_anim_color_t b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+static void start_runs(bool loop) {
+    run_count = 0;
+    run_pos   = 0;
+    run_loop  = loop;
+}
+
+// Hold color for frames more, merged into the last run when it is the same
+static void push_run(rgb_anim_color_t color, uint8_t frames) {
+    if (run_count > 0 && same_color(runs[run_count - 1].color, color) && runs[run_count - 1].frames <= 255 - frames) {
+        runs[run_count - 1].frames += frames;
+    } else if (run_count < RGB_ANIM_MAX_FRAMES) {
+        runs[run_count].color  = color;
+        runs[run_count].frames = frames;
+        run_count++;
+    }
+}
+
+static inline uint8_t step_frames(uint8_t step, uint8_t frames) {
+    return frames - step < RGB_ANIM_STEP_FRAMES ? frames - step : RGB_ANIM_STEP_FRAMES;
+}
+
+// Render a keyframe list into runs. The last keyframe is held.
+static void play_keyframes(const rgb_anim_keyframe_t *kf, uint8_t count, bool loop) {
+    start_runs(loop);
+    uint8_t          h = 0, s = 0, v = 0;
+    rgb_anim_color_t color;
+    bool             have = false;
+    for (uint8_t i = 0; i + 1 < count; i++) {
+        for (uint8_t step = 0; step < kf[i].frames; step += RGB_ANIM_STEP_FRAMES) {
+            uint8_t nh = lerp8(kf[i].h, kf[i + 1].h, step, kf[i].frames);
+            uint8_t ns = lerp8(kf[i].s, kf[i + 1].s, step, kf[i].frames);
+            uint8_t nv = lerp8(kf[i].v, kf[i + 1].v, step, kf[i].frames);
+            // A held HSV needs no conversion
+            if (!have || nh != h || ns != s || nv != v) {
+                h = nh, s = ns, v = nv;
+                color = rgb_anim_hsv(h, s, v);
+                have  = true;
+            }
+            push_run(color, step_frames(step, kf[i].frames));
+        }
+    }
+    if (!loop) {
+        push_run(rgb_anim_hsv(kf[count - 1].h, kf[count - 1].s, kf[count - 1].v), 1);
+    }
+}
+
+// Cross-fade in RGB from whatever is shown to the given color
+static void play_fade(rgb_anim_color_t to) {
+    rgb_anim_color_t from = shown_valid ? shown : to;
+    start_runs(false);
+    for (uint8_t step = 0; step < RGB_ANIM_FADE_FRAMES; step += RGB_ANIM_STEP_FRAMES) {
+        uint8_t frames = step_frames(step, RGB_ANIM_FADE_FRAMES);
+        uint8_t end    = step + frames;
+        rgb_anim_color_t color = {
+            lerp8(from.r, to.r, end, RGB_ANIM_FADE_FRAMES),
+            lerp8(from.g, to.g, end, RGB_ANIM_FADE_FRAMES),
+            lerp8(from.b, to.b, end, RGB_ANIM_FADE_FRAMES),
+        };
+        push_run(color, frames);
+    }
+}
+
+static void play_caps_word(void) {
+    const rgb_anim_keyframe_t pulse[] = {
+        {layer_hue, base_sat, base_val, 8},
+        {layer_hue, base_sat, base_val / 4, 8},
+        {layer_hue, base_sat, base_val, 0},
+    };
+    play_keyframes(pulse, 3, true);
+}
+
+void rgb_anim_init(uint8_t hue, uint8_t sat, uint8_t val) {
+    for (uint16_t h = 0; h < 256; h++) {
+        hue_table[h] = hsv_to_rgb_slow(h, 255, 255);
+    }
+    base_hue  = hue;
+    base_sat  = sat;
+    base_val  = val;
+    layer_hue = hue;
+}
+
+void rgb_anim_set_base(uint8_t hue, uint8_t sat, uint8_t val) {
+    if (layer_hue == base_hue) {
+        layer_hue = hue;
+    }
+    base_hue = hue;
+    base_sat = sat;
+    base_val = val;
+}
+
+// Sweep through the hues for 2.5 seconds, then settle on the layer color
+void rgb_anim_startup(void) {
+    const rgb_anim_keyframe_t sweep[] = {
+        {250, 230, 70, 49},
+        {5, 230, 70, 0},
+    };
+    play_keyframes(sweep, 2, false);
+    push_run(resting_color(), 1);
+}
+
+void rgb_anim_layer(uint8_t hue) {
+    if (hue == layer_hue && shown_valid) return;
+    layer_hue = hue;
+    if (caps_word_active) {
+        play_caps_word();
+    } else {
+        play_fade(resting_color());
+    }
+}
+
+void rgb_anim_caps_word(bool active) {
+    if (active == caps_word_active) return;
+    caps_word_active = active;
+    if (active) {
+        play_caps_word();
+    } else {
+        play_fade(resting_color());
+    }
+}
+
+bool rgb_anim_running(void) {
+    return run_pos < run_count;
+}
+
+// Shows the next run; returns how long until the run after it, 0 when the
+// effect is over
+uint32_t rgb_anim_task(void) {
+    if (!rgb_anim_running()) return 0;
+
+    const rgb_anim_run_t *run = &runs[run_pos++];
+    stats.frames += run->frames;
+    stats.steps++;
+    if (!shown_valid || !same_color(run->color, shown)) {
+        rgb_anim_output(run->color.r, run->color.g, run->color.b);
+        shown       = run->color;
+        shown_valid = true;
+        stats.writes++;
+    }
+
+    if (run_pos == run_count && run_loop) {
+        run_pos = 0;
+    }
+    return rgb_anim_running() ? (uint32_t)run->frames * RGB_ANIM_FRAME_MS : 0;
+}
+
+const rgb_anim_stats_t *rgb_anim_stats(void) {
+    return &stats;
+}
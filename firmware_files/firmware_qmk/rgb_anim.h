@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Time between animation frames
+#ifndef RGB_ANIM_FRAME_MS
+#    define RGB_ANIM_FRAME_MS 50
+#endif
+
+// Longest precomputed effect, in runs of one color
+#ifndef RGB_ANIM_MAX_FRAMES
+#    define RGB_ANIM_MAX_FRAMES 64
+#endif
+
+// Frames used to fade from one layer color to the next
+#ifndef RGB_ANIM_FADE_FRAMES
+#    define RGB_ANIM_FADE_FRAMES 6
+#endif
+
+// Effects change color at most every this many frames; each color is held
+// as one run, so the LED is written and the task woken once per step
+#ifndef RGB_ANIM_STEP_FRAMES
+#    define RGB_ANIM_STEP_FRAMES 3
+#endif
+
+typedef struct {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} rgb_anim_color_t;
+
+typedef struct {
+    uint8_t h;
+    uint8_t s;
+    uint8_t v;
+    // Frames spent moving from this keyframe to the next one
+    uint8_t frames;
+} rgb_anim_keyframe_t;
+
+// A color held for a number of frames
+typedef struct {
+    rgb_anim_color_t color;
+    uint8_t          frames;
+} rgb_anim_run_t;
+
+typedef struct {
+    uint32_t frames; // animation frames played
+    uint32_t steps;  // rgb_anim_task() calls that played a run
+    uint32_t writes; // runs that actually reached the LED
+} rgb_anim_stats_t;
+
+void rgb_anim_init(uint8_t hue, uint8_t sat, uint8_t val);
+void rgb_anim_set_base(uint8_t hue, uint8_t sat, uint8_t val);
+rgb_anim_color_t rgb_anim_hsv(uint8_t hue, uint8_t sat, uint8_t val);
+
+void rgb_anim_startup(void);
+void rgb_anim_layer(uint8_t hue);
+void rgb_anim_caps_word(bool active);
+
+uint32_t rgb_anim_task(void);
+bool rgb_anim_running(void);
+const rgb_anim_stats_t *rgb_anim_stats(void);
+
+// Provided by the keyboard: push one color to the LED(s)
+void rgb_anim_output(uint8_t r, uint8_t g, uint8_t b);
@@ -3,6 +3,43 @@ CUSTOM_MATRIX = lite
 WS2812_DRIVER = vendor
 RGBLIGHT_ENABLE = yes
 DEFERRED_EXEC_ENABLE = yes
+RAW_ENABLE = yes
 SRC += encoder.c
 SRC += ghosting.c
+SRC += heatmap.c
 SRC += matrix.c
+SRC += mouse_motion.c
+SRC += rgb_anim.c
+SRC += telemetry.c
+
+# keymap_tables.h (heatmap.c's matrix to layout index) is generated from
+# keyboard.json and the keymap.json being built; regenerate it on every
+# build so it can't drift from the keymap QMK compiles. A keymap under
+# keymaps/ with its own keymap.json (keymaps/hrm) gets its tables next to
+# it. The compiler is built from firmware_host/tools when missing or older
+# than its source, unless KEYMAP_COMPILER names one; it only rewrites the
+# header when the tables change.
+KEYMAP_TABLES_DIR := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))
+ifndef KEYMAP_COMPILER
+    KEYMAP_COMPILER := $(BUILD_DIR)/keymap_compiler
+    KEYMAP_COMPILER_SRC := $(KEYMAP_TABLES_DIR)/../firmware_host/tools/keymap_compiler.cpp
+    KEYMAP_COMPILER_BUILT := $(shell mkdir -p $(BUILD_DIR) && { [ $(KEYMAP_COMPILER) -nt $(KEYMAP_COMPILER_SRC) ] || \
+        c++ -O2 -std=c++17 $(KEYMAP_COMPILER_SRC) -o $(KEYMAP_COMPILER) 1>&2; } && echo ok)
+    ifneq ($(KEYMAP_COMPILER_BUILT),ok)
+        $(error cannot build keymap_compiler from firmware_host/tools, set KEYMAP_COMPILER)
+    endif
+endif
+# Run from the parent directory so the paths in the header's comment stay
+# relative, as in the committed copies
+KEYMAP_TABLES_NAME := $(notdir $(abspath $(KEYMAP_TABLES_DIR)))
+KEYMAP_TABLES_KEYMAP :=
+ifneq ($(wildcard $(KEYMAP_TABLES_DIR)/keymaps/$(KEYMAP)/keymap.json),)
+    KEYMAP_TABLES_KEYMAP := keymaps/$(KEYMAP)/
+    OPT_DEFS += -DKEYMAP_TABLES_H=\"$(KEYMAP_TABLES_KEYMAP)keymap_tables.h\"
+endif
+KEYMAP_TABLES_GENERATED := $(shell cd $(KEYMAP_TABLES_DIR)/.. && $(abspath $(KEYMAP_COMPILER)) --target qmk \
+    $(KEYMAP_TABLES_NAME)/keyboard.json $(KEYMAP_TABLES_NAME)/$(KEYMAP_TABLES_KEYMAP)keymap.json \
+    -o $(KEYMAP_TABLES_NAME)/$(KEYMAP_TABLES_KEYMAP)keymap_tables.h 1>&2 && echo ok)
+ifneq ($(KEYMAP_TABLES_GENERATED),ok)
+    $(error keymap_compiler rejected keyboard.json/$(KEYMAP_TABLES_KEYMAP)keymap.json)
+endif
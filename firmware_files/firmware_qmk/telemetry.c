@@ -0,0 +1,138 @@
+// Streams timestamped matrix edges and keyboard report times to the host
+// over raw HID, see firmware_common/telemetry.h for the wire format.
+// Records are queued from the scan path and sent one report per
+// housekeeping pass.
+
+#include <ch.h>
+#include "quantum.h"
+#include "raw_hid.h"
+#include "telemetry.h"
+
+static telemetry_record_t queue[TELEMETRY_BUFFER_SIZE];
+static uint8_t queue_head = 0;
+static uint8_t queue_len  = 0;
+static uint8_t dropped    = 0;
+static uint8_t sequence   = 0;
+static bool    streaming  = false;
+
+// Last debounced state seen, to find debounced edges
+static matrix_row_t debounced[MATRIX_ROWS];
+
+// Last unfiltered scan, only valid once the first scan after enabling was seen
+static matrix_row_t unfiltered[MATRIX_ROWS];
+static bool         unfiltered_valid = false;
+static bool         record_unfiltered = false;
+
+static uint32_t now_us(void) {
+    return TIME_I2US(chVTGetSystemTimeX());
+}
+
+static void push(uint32_t time_us, uint8_t row, uint8_t col, uint8_t flags) {
+    if (queue_len == TELEMETRY_BUFFER_SIZE) {
+        if (dropped < 255) dropped++;
+        return;
+    }
+    // Rows in the upper half of the duplex matrix are the left hand
+    if (row >= MATRIX_ROWS / 2) flags |= TELEMETRY_LEFT_HALF;
+
+    telemetry_record_t *rec = &queue[(queue_head + queue_len) % TELEMETRY_BUFFER_SIZE];
+    rec->time_us = time_us;
+    rec->row     = row;
+    rec->col     = col;
+    rec->flags   = flags;
+    queue_len++;
+}
+
+static void push_changes(uint32_t time_us, uint8_t row, matrix_row_t before, matrix_row_t after, uint8_t flags) {
+    matrix_row_t changed = before ^ after;
+    for (uint8_t col = 0; changed; col++, changed >>= 1) {
+        if (changed & 1) {
+            push(time_us, row, col, flags | ((after >> col) & 1 ? TELEMETRY_PRESSED : 0));
+        }
+    }
+}
+
+void telemetry_set_enabled(bool enabled) {
+    streaming  = enabled;
+    queue_head = 0;
+    queue_len  = 0;
+    dropped    = 0;
+    unfiltered_valid = false;
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        debounced[row] = matrix_get_row(row);
+    }
+}
+
+bool telemetry_enabled(void) {
+    return streaming;
+}
+
+void telemetry_set_unfiltered(bool enabled) {
+    record_unfiltered = enabled;
+    unfiltered_valid  = false;
+}
+
+// Called right after the pins are read, before fix_encoder_action() and
+// fix_ghosting() touch the matrix: the edges a trace recorder needs
+// (firmware_host/tools/trace_tool from-telemetry)
+void telemetry_unfiltered_scan(const matrix_row_t current[]) {
+    if (!streaming || !record_unfiltered) return;
+    uint32_t time_us = now_us();
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        if (unfiltered_valid && unfiltered[row] != current[row]) {
+            push_changes(time_us, row, unfiltered[row], current[row], TELEMETRY_UNFILTERED);
+        }
+        unfiltered[row] = current[row];
+    }
+    unfiltered_valid = true;
+}
+
+// Called at the end of matrix_scan_custom() with the raw matrix
+void telemetry_raw_scan(const matrix_row_t previous[], const matrix_row_t current[]) {
+    if (!streaming) return;
+    uint32_t time_us = now_us();
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        if (previous[row] != current[row]) {
+            push_changes(time_us, row, previous[row], current[row], 0);
+        }
+    }
+}
+
+// Called after a key event changed the keyboard report and it went out
+// (post_process_record_user())
+void telemetry_hid_report(uint8_t row, uint8_t col, bool pressed) {
+    if (!streaming) return;
+    push(now_us(), row, col, TELEMETRY_HID_REPORT | (pressed ? TELEMETRY_PRESSED : 0));
+}
+
+// Called after debounce (matrix_scan_user())
+void telemetry_debounced_scan(void) {
+    if (!streaming) return;
+    uint32_t time_us = now_us();
+    for (uint8_t row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t current = matrix_get_row(row);
+        if (debounced[row] != current) {
+            push_changes(time_us, row, debounced[row], current, TELEMETRY_DEBOUNCED);
+            debounced[row] = current;
+        }
+    }
+}
+
+void telemetry_task(void) {
+    if (!streaming || queue_len == 0) return;
+
+    uint8_t report[TELEMETRY_REPORT_SIZE] = {0};
+    uint8_t count = queue_len < TELEMETRY_RECORDS_PER_REPORT ? queue_len : TELEMETRY_RECORDS_PER_REPORT;
+    report[0] = TELEMETRY_REPORT_ID;
+    report[1] = sequence++;
+    report[2] = count;
+    report[3] = dropped;
+    for (uint8_t i = 0; i < count; i++) {
+        telemetry_pack(&report[TELEMETRY_HEADER_SIZE + i * TELEMETRY_RECORD_SIZE], &queue[queue_head]);
+        queue_head = (queue_head + 1) % TELEMETRY_BUFFER_SIZE;
+    }
+    queue_len -= count;
+    dropped = 0;
+
+    raw_hid_send(report, sizeof(report));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include "matrix.h"
+#include "../firmware_common/telemetry.h"
+
+// Records buffered between raw HID reports
+#ifndef TELEMETRY_BUFFER_SIZE
+#    define TELEMETRY_BUFFER_SIZE 64
+#endif
+
+void telemetry_set_enabled(bool enabled);
+bool telemetry_enabled(void);
+void telemetry_set_unfiltered(bool enabled);
+void telemetry_unfiltered_scan(const matrix_row_t current[]);
+void telemetry_raw_scan(const matrix_row_t previous[], const matrix_row_t current[]);
+void telemetry_debounced_scan(void);
+void telemetry_hid_report(uint8_t row, uint8_t col, bool pressed);
+void telemetry_task(void);